@@ -0,0 +1,326 @@
+/*
+ * ESP32IMDB - Contention Benchmark
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Measures throughput and latency with several tasks sharing one database.
+ * Each workload mixes point reads, point writes and full-table scans in a
+ * given ratio, picks keys uniformly or from a zipfian distribution (a few hot
+ * keys get most of the traffic), and runs for a fixed time with 1, 2, 4 and
+ * 8 tasks. On the ESP32 the tasks are pinned to both cores in turn; on the
+ * host build they are threads.
+ *
+ * For every run it reports total ops/sec and the p50/p99/p999/max latency,
+ * overall and per operation type, as one JSON document (same conventions as
+ * the Microbenchmark example). Compare runs to see how a locking change
+ * affects throughput and tail latency as contention grows.
+ *
+ * Operations:
+ * - read:  select("Value", "ID", key)
+ * - write: updateWithMath("ID", key, "Value", +1)
+ * - scan:  countWhere("Group", group), a full pass over the table
+ *
+ * Latencies are kept in histograms with 8 buckets per power of two, so the
+ * percentiles are accurate to about 12%.
+ */
+
+#include <ESP32IMDB.h>
+#include <math.h>
+
+// Workload settings
+#ifndef BENCH_ROWS
+#define BENCH_ROWS 2000
+#endif
+
+#ifndef BENCH_DURATION_MS
+#define BENCH_DURATION_MS 2000
+#endif
+
+#define BENCH_MAX_TASKS 8
+
+struct Workload {
+  const char* name;
+  uint8_t readPercent;
+  uint8_t writePercent;    // The rest are scans
+  float zipfTheta;         // 0 = uniform keys
+};
+
+const Workload WORKLOADS[] = {
+  {"read-heavy", 95, 5, 0.0f},
+  {"read-heavy", 95, 5, 0.99f},
+  {"write-heavy", 50, 50, 0.99f},
+  {"with-scans", 80, 15, 0.0f}
+};
+const int WORKLOAD_COUNT = sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+
+const int TASK_COUNTS[] = {1, 2, 4, 8};
+const int TASK_COUNT_STEPS = sizeof(TASK_COUNTS) / sizeof(TASK_COUNTS[0]);
+
+enum OpType { OP_READ, OP_WRITE, OP_SCAN, OP_TYPES };
+const char* OP_NAMES[OP_TYPES] = {"read", "write", "scan"};
+
+// Latency histogram: exact below 16us, then 8 buckets per power of two
+#define HIST_SUB_BUCKETS 8
+#define HIST_BUCKETS (16 + 28 * HIST_SUB_BUCKETS)
+
+struct Histogram {
+  uint32_t counts[HIST_BUCKETS];
+  uint32_t total;
+  uint32_t maxMicros;
+};
+
+int bucketFor(uint32_t micros) {
+  if (micros < 16) {
+    return micros;
+  }
+  int msb = 31 - __builtin_clz(micros);
+  return 16 + (msb - 4) * HIST_SUB_BUCKETS + ((micros >> (msb - 3)) & (HIST_SUB_BUCKETS - 1));
+}
+
+// Largest latency that falls in bucket
+uint32_t bucketLimit(int bucket) {
+  if (bucket < 16) {
+    return bucket;
+  }
+  int msb = (bucket - 16) / HIST_SUB_BUCKETS + 4;
+  uint32_t sub = (bucket - 16) % HIST_SUB_BUCKETS;
+  uint64_t low = (uint64_t)(HIST_SUB_BUCKETS + sub) << (msb - 3);
+  return (uint32_t)(low + (1ULL << (msb - 3)) - 1);
+}
+
+void recordLatency(Histogram* histogram, uint32_t micros) {
+  histogram->counts[bucketFor(micros)]++;
+  histogram->total++;
+  if (micros > histogram->maxMicros) {
+    histogram->maxMicros = micros;
+  }
+}
+
+void mergeHistogram(Histogram* into, const Histogram* from) {
+  for (int i = 0; i < HIST_BUCKETS; i++) {
+    into->counts[i] += from->counts[i];
+  }
+  into->total += from->total;
+  if (from->maxMicros > into->maxMicros) {
+    into->maxMicros = from->maxMicros;
+  }
+}
+
+uint32_t percentile(const Histogram* histogram, double fraction) {
+  if (histogram->total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)ceil(fraction * histogram->total);
+  uint64_t seen = 0;
+  for (int i = 0; i < HIST_BUCKETS; i++) {
+    seen += histogram->counts[i];
+    if (seen >= rank) {
+      uint32_t limit = bucketLimit(i);
+      return limit < histogram->maxMicros ? limit : histogram->maxMicros;
+    }
+  }
+  return histogram->maxMicros;
+}
+
+// Zipfian key generator (Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases"). Ranks are hashed to keys so the hot keys are spread
+// over the table instead of sitting at its start.
+struct ZipfGenerator {
+  uint32_t items;
+  double theta;
+  double alpha;
+  double zetaN;
+  double eta;
+};
+
+void zipfInit(ZipfGenerator* zipf, uint32_t items, double theta) {
+  zipf->items = items;
+  zipf->theta = theta;
+  if (theta <= 0.0) {
+    return;
+  }
+  double zeta2 = 1.0 + pow(0.5, theta);
+  zipf->zetaN = 0.0;
+  for (uint32_t i = 1; i <= items; i++) {
+    zipf->zetaN += 1.0 / pow((double)i, theta);
+  }
+  zipf->alpha = 1.0 / (1.0 - theta);
+  zipf->eta = (1.0 - pow(2.0 / items, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetaN);
+}
+
+uint32_t nextRandom(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+int32_t nextKey(const ZipfGenerator* zipf, uint32_t* state) {
+  if (zipf->theta <= 0.0) {
+    return (int32_t)(nextRandom(state) % zipf->items);
+  }
+  double u = (double)nextRandom(state) / 4294967296.0;
+  double uz = u * zipf->zetaN;
+  uint32_t rank;
+  if (uz < 1.0) {
+    rank = 0;
+  } else if (uz < 1.0 + pow(0.5, zipf->theta)) {
+    rank = 1;
+  } else {
+    rank = (uint32_t)(zipf->items * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+  }
+  // FNV-1a of the rank
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < 4; i++) {
+    hash = (hash ^ ((rank >> (i * 8)) & 0xFF)) * 16777619u;
+  }
+  return (int32_t)(hash % zipf->items);
+}
+
+ESP32IMDB db;
+ZipfGenerator zipf;
+const Workload* workload;
+Histogram* histograms;            // [task][op type]
+SemaphoreHandle_t doneSemaphore;
+volatile bool running = false;
+bool firstResult = true;
+
+void workerTask(void* parameter) {
+  int taskId = (int)(intptr_t)parameter;
+  Histogram* own = &histograms[taskId * OP_TYPES];
+  uint32_t state = 0x9E3779B9u * (taskId + 1);
+
+  while (running) {
+    uint32_t dice = nextRandom(&state) % 100;
+    OpType op = dice < workload->readPercent ? OP_READ
+              : dice < (uint32_t)(workload->readPercent + workload->writePercent) ? OP_WRITE : OP_SCAN;
+    int32_t key = nextKey(&zipf, &state);
+
+    uint32_t start = micros();
+    if (op == OP_READ) {
+      IMDBSelectResult result;
+      db.select("Value", "ID", &key, &result);
+    } else if (op == OP_WRITE) {
+      db.updateWithMath("ID", &key, "Value", IMDB_MATH_ADD, 1);
+    } else {
+      int32_t group = key % 100;
+      db.countWhere("Group", &group);
+    }
+    recordLatency(&own[op], micros() - start);
+  }
+
+  xSemaphoreGive(doneSemaphore);
+  vTaskDelete(NULL);
+}
+
+void printLatencies(const Histogram* histogram) {
+  Serial.printf("\"ops\":%u,\"p50Us\":%u,\"p99Us\":%u,\"p999Us\":%u,\"maxUs\":%u",
+                (unsigned)histogram->total,
+                (unsigned)percentile(histogram, 0.50),
+                (unsigned)percentile(histogram, 0.99),
+                (unsigned)percentile(histogram, 0.999),
+                (unsigned)histogram->maxMicros);
+}
+
+void runStep(const Workload* step, int tasks) {
+  workload = step;
+  histograms = (Histogram*)calloc(tasks * OP_TYPES, sizeof(Histogram));
+  if (histograms == nullptr) {
+    return;
+  }
+
+  running = true;
+  uint32_t start = millis();
+  for (int i = 0; i < tasks; i++) {
+    xTaskCreatePinnedToCore(workerTask, "Worker", 4096, (void*)(intptr_t)i, 1, NULL,
+                            i % portNUM_PROCESSORS);
+  }
+  delay(BENCH_DURATION_MS);
+  running = false;
+  for (int i = 0; i < tasks; i++) {
+    xSemaphoreTake(doneSemaphore, portMAX_DELAY);
+  }
+  uint32_t elapsed = millis() - start;
+
+  Histogram all = {};
+  Histogram byType[OP_TYPES] = {};
+  for (int i = 0; i < tasks; i++) {
+    for (int op = 0; op < OP_TYPES; op++) {
+      mergeHistogram(&byType[op], &histograms[i * OP_TYPES + op]);
+      mergeHistogram(&all, &histograms[i * OP_TYPES + op]);
+    }
+  }
+  free(histograms);
+
+  Serial.printf("%s\n    {\"workload\":\"%s\",\"readPercent\":%d,\"writePercent\":%d,\"scanPercent\":%d,",
+                firstResult ? "" : ",", step->name, step->readPercent, step->writePercent,
+                100 - step->readPercent - step->writePercent);
+  firstResult = false;
+  Serial.printf("\"distribution\":\"%s\",\"zipfTheta\":%.2f,\"tasks\":%d,\"durationMs\":%u,",
+                step->zipfTheta > 0.0f ? "zipfian" : "uniform", step->zipfTheta, tasks, (unsigned)elapsed);
+  Serial.printf("\"opsPerSec\":%.1f,", elapsed > 0 ? all.total * 1000.0 / elapsed : 0.0);
+  printLatencies(&all);
+  for (int op = 0; op < OP_TYPES; op++) {
+    Serial.printf(",\"%s\":{", OP_NAMES[op]);
+    printLatencies(&byType[op]);
+    Serial.print("}");
+  }
+  Serial.print("}");
+}
+
+bool populate() {
+  IMDBColumn columns[] = {
+    {"ID", IMDB_TYPE_INT32},
+    {"Group", IMDB_TYPE_INT32},
+    {"Name", IMDB_TYPE_STRING},
+    {"Value", IMDB_TYPE_FLOAT}
+  };
+  if (db.createTable(columns, 4) != IMDB_OK) {
+    return false;
+  }
+
+  for (int32_t i = 0; i < BENCH_ROWS; i++) {
+    int32_t group = i % 100;
+    char name[24];
+    snprintf(name, sizeof(name), "device-%05ld", (long)i);
+    const char* namePtr = name;
+    float value = 0.0f;
+    const void* values[] = {&i, &group, &namePtr, &value};
+    if (db.insert(values) != IMDB_OK) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  doneSemaphore = xSemaphoreCreateCounting(BENCH_MAX_TASKS, 0);
+  bool ready = doneSemaphore != nullptr && populate();
+
+  Serial.println("{");
+  Serial.println("  \"benchmark\": \"ESP32IMDB contention\",");
+  Serial.printf("  \"chip\": \"%s\",\n", ESP.getChipModel());
+  Serial.printf("  \"cores\": %d,\n", portNUM_PROCESSORS);
+  Serial.printf("  \"rows\": %d,\n", ready ? db.getRecordCount() : 0);
+  Serial.print("  \"results\": [");
+
+  for (int w = 0; ready && w < WORKLOAD_COUNT; w++) {
+    zipfInit(&zipf, BENCH_ROWS, WORKLOADS[w].zipfTheta);
+    for (int t = 0; t < TASK_COUNT_STEPS; t++) {
+      runStep(&WORKLOADS[w], TASK_COUNTS[t]);
+    }
+  }
+
+  Serial.println("\n  ],");
+  Serial.printf("  \"complete\": %s\n", ready ? "true" : "false");
+  Serial.println("}");
+}
+
+void loop() {
+  delay(10000);
+}
@@ -0,0 +1,92 @@
+/*
+ * ESP32IMDB - Read-only Table Image Example
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * This example queries a large reference table (a MAC vendor list) straight
+ * from flash. The table is built on a PC and flashed into its own partition;
+ * IMDBImageTable memory-maps it, so nothing is loaded into heap and the
+ * table is ready the moment openPartition() returns.
+ *
+ * Setup:
+ * 1. Build the image from CSV on your PC (see tools/imdb_image):
+ *      c++ -std=c++17 -O2 -o imdb_image tools/imdb_image/imdb_image.cpp
+ *      ./imdb_image --index OUI --index Vendor vendors.csv vendors.img
+ * 2. Upload this sketch. The partitions.csv next to it adds a 512KB "imdb"
+ *    data partition (Arduino IDE and PlatformIO pick it up automatically)
+ * 3. Flash the image into the partition:
+ *      python parttool.py --port /dev/ttyUSB0 write_partition \
+ *        --partition-name imdb --input vendors.img
+ */
+
+#include <ESP32IMDB.h>
+#include <IMDBImage.h>
+
+IMDBImageTable vendors;
+
+void printVendor(const char* macString) {
+  uint8_t mac[6];
+  if (!ESP32IMDB::parseMacAddress(macString, mac)) {
+    Serial.printf("   ✗ Bad MAC: %s\n", macString);
+    return;
+  }
+
+  // The table is keyed by OUI: keep the first three bytes
+  mac[3] = mac[4] = mac[5] = 0;
+
+  unsigned long start = micros();
+  IMDBSelectResult result;
+  IMDBResult status = vendors.select("Vendor", "OUI", mac, &result);
+  unsigned long elapsed = micros() - start;
+
+  if (status == IMDB_OK) {
+    Serial.printf("   %s -> %s (%lu us)\n", macString, result.stringValue, elapsed);
+  } else {
+    Serial.printf("   %s -> %s\n", macString, ESP32IMDB::resultToString(status));
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n=== ESP32IMDB Read-only Table Image Example ===\n");
+
+  Serial.println("1. Mapping image from the \"imdb\" partition...");
+  unsigned long start = micros();
+  IMDBResult result = vendors.openPartition("imdb");
+  if (result != IMDB_OK) {
+    Serial.printf("   ✗ Failed: %s\n", ESP32IMDB::resultToString(result));
+    Serial.println("   Check the partition table and flash an image first (see the notes at the top).");
+    return;
+  }
+  Serial.printf("   ✓ Mapped %d rows in %lu us\n", vendors.getRecordCount(), micros() - start);
+
+  Serial.println("\n2. Columns:");
+  for (uint8_t i = 0; i < vendors.getColumnCount(); i++) {
+    const char* name = vendors.getColumnName(i);
+    Serial.printf("   %s%s\n", name, vendors.isIndexed(name) ? " (indexed)" : "");
+  }
+
+  Serial.println("\n3. Verifying image CRC...");
+  start = micros();
+  result = vendors.verify();
+  Serial.printf("   %s (%lu us)\n", ESP32IMDB::resultToString(result), micros() - start);
+
+  Serial.println("\n4. Vendor lookups:");
+  printVendor("24:6f:28:12:34:56");
+  printVendor("b8:27:eb:aa:bb:cc");
+  printVendor("02:00:00:00:00:01");
+
+  Serial.println("\n5. Counting rows by vendor...");
+  const char* vendor = "Espressif Inc.";
+  Serial.printf("   %s: %d OUIs\n", vendor, (int)vendors.countWhere("Vendor", &vendor));
+
+  Serial.printf("\nFree heap: %u bytes (the table uses none of it)\n", ESP.getFreeHeap());
+}
+
+void loop() {
+  delay(10000);
+}
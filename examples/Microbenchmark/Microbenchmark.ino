@@ -0,0 +1,435 @@
+/*
+ * ESP32IMDB - Microbenchmark
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Times every public operation at table sizes from 100 to 100,000 rows and
+ * for several table shapes (column count and string length). The results are
+ * printed as a single JSON document so runs can be stored and compared from
+ * one release to the next.
+ *
+ * Runs on the ESP32 and on the host build (see "Host Build" in the README):
+ *
+ *   IMDB_HOST_HEAP_BYTES=2000000000 ./build/Microbenchmark > bench.json
+ *
+ * On a device, table sizes that do not fit in the heap stop at the heap limit;
+ * their insert result carries an "error" and the remaining operations for that
+ * size are skipped. Anything printed before the first "{" line (boot messages)
+ * is not part of the document.
+ *
+ * On boards with PSRAM every step runs twice, with field arrays and strings
+ * in internal RAM and in PSRAM (see setPlacement()), to show what PSRAM costs
+ * in scan speed. The host build simulates PSRAM capacity only, with
+ * IMDB_HOST_PSRAM_BYTES, so its two runs time the same memory.
+ *
+ * Each result has the table shape and placement, the operation, how many
+ * times it ran and the total and per-operation time:
+ *
+ *   {"rows":1000,"columns":4,"stringBytes":16,"placement":"internal","op":"select",
+ *    "iterations":1000,"totalUs":1234,"usPerOp":6.170,"opsPerSec":162074.6}
+ *
+ * Table layout: ID (INT32, unique key), Group (INT32, ID % 100), Name
+ * (STRING), Value (FLOAT), then extra columns of every type for wider shapes.
+ */
+
+#include <ESP32IMDB.h>
+#if IMDB_ENABLE_PERSISTENCE
+#include <SPIFFS.h>
+#endif
+
+// Largest table size to run; lower it for a quick run
+#ifndef BENCH_MAX_ROWS
+#define BENCH_MAX_ROWS 100000
+#endif
+
+// Scan-type operations repeat until about this many rows have been visited
+#define BENCH_ROW_BUDGET 2000000
+#define BENCH_MAX_ITERATIONS 1000
+
+struct BenchShape {
+  uint8_t columns;
+  uint8_t stringBytes;
+};
+
+const int ROW_COUNTS[] = {100, 1000, 10000, 100000};
+const int ROW_COUNT_STEPS = sizeof(ROW_COUNTS) / sizeof(ROW_COUNTS[0]);
+const BenchShape SHAPES[] = {{4, 16}, {12, 16}, {4, 128}};
+const int SHAPE_COUNT = sizeof(SHAPES) / sizeof(SHAPES[0]);
+
+// Types of the columns after the first four, in order
+const IMDBDataType EXTRA_TYPES[] = {
+  IMDB_TYPE_BOOL, IMDB_TYPE_EPOCH, IMDB_TYPE_MAC, IMDB_TYPE_FLOAT, IMDB_TYPE_INT32, IMDB_TYPE_STRING
+};
+
+const char* BENCH_FILENAME = "/bench.imdb";
+
+ESP32IMDB db;
+bool firstResult = true;
+int failures = 0;
+bool storageReady = false;
+
+// Current table shape and placement
+int benchRows;
+BenchShape benchShape;
+IMDBPlacement benchPlacement;
+IMDBColumn columns[16];
+
+// xorshift32: cheaper than random() so it does not show in the timings
+uint32_t rngState = 2463534242UL;
+int32_t randomKey(int32_t limit) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return (int32_t)(rngState % (uint32_t)limit);
+}
+
+int scanIterations(int rows) {
+  int iterations = BENCH_ROW_BUDGET / rows;
+  if (iterations < 1) {
+    iterations = 1;
+  }
+  return iterations > BENCH_MAX_ITERATIONS ? BENCH_MAX_ITERATIONS : iterations;
+}
+
+// Print one result object. Heap exhaustion is expected on a device for large
+// tables and is not counted as a failure.
+void report(const char* op, int iterations, uint32_t totalMicros, IMDBResult result) {
+  Serial.printf("%s\n    {\"rows\":%d,\"columns\":%d,\"stringBytes\":%d,\"placement\":\"%s\",",
+                firstResult ? "" : ",", benchRows, benchShape.columns, benchShape.stringBytes,
+                benchPlacement == IMDB_PLACE_PSRAM ? "psram" : "internal");
+  Serial.printf("\"op\":\"%s\",\"iterations\":%d,", op, iterations);
+  firstResult = false;
+
+  double perOp = iterations > 0 ? (double)totalMicros / iterations : 0.0;
+  Serial.printf("\"totalUs\":%u,\"usPerOp\":%.3f,\"opsPerSec\":%.1f",
+                (unsigned)totalMicros, perOp, perOp > 0.0 ? 1000000.0 / perOp : 0.0);
+
+  if (result != IMDB_OK) {
+    Serial.printf(",\"error\":\"%s\"", ESP32IMDB::resultToString(result));
+    if (result != IMDB_ERROR_HEAP_LIMIT && result != IMDB_ERROR_OUT_OF_MEMORY) {
+      failures++;
+    }
+  }
+  Serial.print("}");
+}
+
+void buildColumns() {
+  const char* baseNames[] = {"ID", "Group", "Name", "Value"};
+  const IMDBDataType baseTypes[] = {IMDB_TYPE_INT32, IMDB_TYPE_INT32, IMDB_TYPE_STRING, IMDB_TYPE_FLOAT};
+
+  for (int i = 0; i < benchShape.columns; i++) {
+    if (i < 4) {
+      snprintf(columns[i].name, sizeof(columns[i].name), "%s", baseNames[i]);
+      columns[i].type = baseTypes[i];
+    } else {
+      snprintf(columns[i].name, sizeof(columns[i].name), "C%d", i);
+      columns[i].type = EXTRA_TYPES[(i - 4) % 6];
+    }
+  }
+}
+
+// Name stored in row key: unique, stringBytes long
+void rowName(int32_t key, char* name) {
+  int length = snprintf(name, IMDB_MAX_STRING_LENGTH + 1, "row-%07ld-", (long)key);
+  while (length < benchShape.stringBytes) {
+    name[length] = 'a' + (key + length) % 26;
+    length++;
+  }
+  name[length] = '\0';
+}
+
+// Insert row key with every column filled in
+IMDBResult insertRow(int32_t key, uint32_t ttlMillis) {
+  char name[IMDB_MAX_STRING_LENGTH + 1];
+  rowName(key, name);
+  const char* namePtr = name;
+
+  int32_t group = key % 100;
+  float value = (float)(key % 1000) * 0.5f;
+  bool flag = (key & 1) != 0;
+  uint32_t epoch = 1700000000UL + key;
+  uint8_t mac[6] = {0x24, 0x6F, 0x28, (uint8_t)(key >> 16), (uint8_t)(key >> 8), (uint8_t)key};
+
+  const void* values[16];
+  for (int i = 0; i < benchShape.columns; i++) {
+    switch (columns[i].type) {
+      case IMDB_TYPE_INT32: values[i] = (i == 1) ? &group : &key; break;
+      case IMDB_TYPE_STRING: values[i] = &namePtr; break;
+      case IMDB_TYPE_FLOAT: values[i] = &value; break;
+      case IMDB_TYPE_BOOL: values[i] = &flag; break;
+      case IMDB_TYPE_EPOCH: values[i] = &epoch; break;
+      case IMDB_TYPE_MAC: values[i] = mac; break;
+    }
+  }
+  return db.insert(values, ttlMillis);
+}
+
+void benchInserts(int* inserted) {
+  IMDBResult result = IMDB_OK;
+  uint32_t start = micros();
+  int i;
+  for (i = 0; i < benchRows; i++) {
+    result = insertRow(i, 0);
+    if (result != IMDB_OK) {
+      break;
+    }
+  }
+  report("insert", i, micros() - start, result);
+  *inserted = i;
+}
+
+void benchQueries() {
+  int iterations = scanIterations(benchRows);
+  IMDBResult result = IMDB_OK;
+  IMDBSelectResult value;
+  uint32_t start;
+
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    int32_t key = randomKey(benchRows);
+    result = db.select("Value", "ID", &key, &value);
+  }
+  report("select", iterations, micros() - start, result);
+
+  // Where clause on a string column
+  char name[IMDB_MAX_STRING_LENGTH + 1];
+  const char* namePtr = name;
+  result = IMDB_OK;
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    rowName(randomKey(benchRows), name);
+    result = db.select("ID", "Name", &namePtr, &value);
+  }
+  report("selectByString", iterations, micros() - start, result);
+
+  // About 1% of the rows match
+  result = IMDB_OK;
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    int32_t group = randomKey(100);
+    IMDBSelectResult* rows = nullptr;
+    int rowCount = 0;
+    result = db.selectAll("Group", &group, &rows, &rowCount);
+    ESP32IMDB::freeSelectResults(rows);
+  }
+  report("selectAll", iterations, micros() - start, result);
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) {
+    db.count();
+  }
+  report("count", iterations, micros() - start, IMDB_OK);
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) {
+    int32_t group = randomKey(100);
+    db.countWhere("Group", &group);
+  }
+  report("countWhere", iterations, micros() - start, IMDB_OK);
+
+  // Absent keys, scanned and then answered by the membership filter
+  start = micros();
+  for (int i = 0; i < iterations; i++) {
+    int32_t key = benchRows + randomKey(benchRows);
+    db.exists("ID", &key);
+  }
+  report("existsMiss", iterations, micros() - start, IMDB_OK);
+
+  result = db.setMembershipFilter("ID");
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    int32_t key = benchRows + randomKey(benchRows);
+    db.exists("ID", &key);
+  }
+  report("existsMissFiltered", iterations, micros() - start, result);
+  db.setMembershipFilter(nullptr);  // Later timings are without it
+
+  result = IMDB_OK;
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    result = db.min("Value", &value);
+  }
+  report("min", iterations, micros() - start, result);
+
+  result = IMDB_OK;
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    result = db.max("Value", &value);
+  }
+  report("max", iterations, micros() - start, result);
+
+  result = IMDB_OK;
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    IMDBSelectResult* rows = nullptr;
+    int rowCount = 0;
+    result = db.top(10, &rows, &rowCount);
+    ESP32IMDB::freeSelectResults(rows);
+  }
+  report("top10", iterations, micros() - start, result);
+}
+
+void benchUpdates() {
+  int iterations = scanIterations(benchRows);
+  IMDBResult result = IMDB_OK;
+  uint32_t start;
+
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    int32_t key = randomKey(benchRows);
+    float value = (float)i;
+    result = db.update("ID", &key, "Value", &value);
+  }
+  report("update", iterations, micros() - start, result);
+
+  // Same length as the stored strings, so no reallocation
+  result = IMDB_OK;
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    int32_t key = randomKey(benchRows);
+    char name[IMDB_MAX_STRING_LENGTH + 1];
+    memset(name, 'u', benchShape.stringBytes);
+    name[benchShape.stringBytes] = '\0';
+    const char* namePtr = name;
+    result = db.update("ID", &key, "Name", &namePtr);
+  }
+  report("updateString", iterations, micros() - start, result);
+
+  result = IMDB_OK;
+  start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    int32_t key = randomKey(benchRows);
+    result = db.updateWithMath("ID", &key, "Value", IMDB_MATH_ADD, 1);
+  }
+  report("updateWithMath", iterations, micros() - start, result);
+}
+
+#if IMDB_ENABLE_PERSISTENCE
+void benchPersistence() {
+  if (!storageReady) {
+    return;
+  }
+
+  uint32_t start = micros();
+  IMDBResult result = db.saveToFile(BENCH_FILENAME);
+  report("saveToFile", 1, micros() - start, result);
+  if (result != IMDB_OK) {
+    SPIFFS.remove(BENCH_FILENAME);
+    return;
+  }
+
+#if IMDB_ENABLE_COMPRESSION
+  start = micros();
+  result = db.saveToFileCompressed("/bench.imdbz");
+  report("saveToFileCompressed", 1, micros() - start, result);
+  SPIFFS.remove("/bench.imdbz");
+#endif
+
+  // Load the saved copy back in place of the table
+  db.dropTable();
+  start = micros();
+  result = db.loadFromFile(BENCH_FILENAME);
+  report("loadFromFile", 1, micros() - start, result);
+  SPIFFS.remove(BENCH_FILENAME);
+}
+#endif
+
+void benchRemovals() {
+  // Expired rows: a tenth of the table again, with a 1ms TTL
+  int expiring = benchRows / 10 > 0 ? benchRows / 10 : 1;
+  IMDBResult result = IMDB_OK;
+  for (int i = 0; i < expiring && result == IMDB_OK; i++) {
+    result = insertRow(benchRows + i, 1);
+  }
+  if (result == IMDB_OK) {
+    delay(5);
+    uint32_t start = micros();
+    db.purgeExpiredRecords();
+    report("purgeExpiredRecords", 1, micros() - start, IMDB_OK);
+  } else {
+    report("purgeExpiredRecords", 0, 0, result);
+  }
+
+  // Distinct keys, each deleted once
+  int iterations = scanIterations(benchRows);
+  if (iterations > benchRows) {
+    iterations = benchRows;
+  }
+  int step = benchRows / iterations;
+  result = IMDB_OK;
+  uint32_t start = micros();
+  for (int i = 0; i < iterations && result == IMDB_OK; i++) {
+    int32_t key = i * step;
+    result = db.deleteRecords("ID", &key);
+  }
+  report("deleteRecords", iterations, micros() - start, result);
+}
+
+void runStep(int rows, const BenchShape& shape, IMDBPlacement placement) {
+  benchRows = rows;
+  benchShape = shape;
+  benchPlacement = placement;
+  buildColumns();
+  db.setPlacement(placement);
+
+  IMDBResult result = db.createTable(columns, shape.columns);
+  if (result != IMDB_OK) {
+    report("createTable", 1, 0, result);
+    return;
+  }
+
+  int inserted;
+  benchInserts(&inserted);
+  if (inserted == rows) {
+    benchQueries();
+    benchUpdates();
+#if IMDB_ENABLE_PERSISTENCE
+    benchPersistence();
+#endif
+    benchRemovals();
+  }
+
+  db.dropTable();
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+#if IMDB_ENABLE_PERSISTENCE
+  storageReady = SPIFFS.begin(true);
+#endif
+
+  uint32_t startMillis = millis();
+  Serial.println("{");
+  Serial.println("  \"benchmark\": \"ESP32IMDB microbenchmark\",");
+  Serial.printf("  \"chip\": \"%s\",\n", ESP.getChipModel());
+  Serial.printf("  \"cpuMHz\": %u,\n", (unsigned)ESP.getCpuFreqMHz());
+  Serial.printf("  \"freeHeap\": %u,\n", (unsigned)ESP.getFreeHeap());
+  Serial.printf("  \"psramBytes\": %u,\n", (unsigned)ESP.getPsramSize());
+  Serial.printf("  \"persistence\": %s,\n", storageReady ? "true" : "false");
+  Serial.print("  \"results\": [");
+
+  for (int i = 0; i < ROW_COUNT_STEPS; i++) {
+    if (ROW_COUNTS[i] > BENCH_MAX_ROWS) {
+      break;
+    }
+    for (int s = 0; s < SHAPE_COUNT; s++) {
+      runStep(ROW_COUNTS[i], SHAPES[s], IMDB_PLACE_INTERNAL);
+      if (psramFound()) {
+        runStep(ROW_COUNTS[i], SHAPES[s], IMDB_PLACE_PSRAM);
+      }
+    }
+  }
+
+  Serial.println("\n  ],");
+  Serial.printf("  \"failures\": %d,\n", failures);
+  Serial.printf("  \"durationMs\": %u\n", (unsigned)(millis() - startMillis));
+  Serial.println("}");
+}
+
+void loop() {
+  delay(10000);
+}
@@ -0,0 +1,155 @@
+/*
+ * ESP32IMDB - Operation Stats Example
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * This example shows the built-in operation stats. With IMDB_ENABLE_STATS
+ * set, the database counts every operation by type and keeps a latency
+ * histogram for each, plus how many rows were scanned to find the matching
+ * ones. A high scanned/matched ratio points at lookups that walk the whole
+ * table; a p99 far above p50 points at lock waits or allocations.
+ *
+ * Lock use is tallied too: how often each operation type found the table
+ * lock taken, how long it waited, and how long it held the lock. A second
+ * task updates the table while the main task runs lookups, so some lock
+ * acquisitions are contended.
+ *
+ * IMDB_ENABLE_STATS changes the ESP32IMDB class, so the library must be
+ * built with the same setting - with PlatformIO, add -DIMDB_ENABLE_STATS=1
+ * to build_flags.
+ */
+
+#define IMDB_ENABLE_STATS 1
+#include <ESP32IMDB.h>
+
+ESP32IMDB db;
+
+void printStats() {
+  IMDBStats stats;
+  if (db.getStats(&stats) != IMDB_OK) {
+    return;
+  }
+
+  Serial.printf("Stats for the last %lu ms:\n", (unsigned long)stats.elapsedMillis);
+  Serial.println("  Operation    Calls   Avg (us)   p50 (us)   p99 (us)   Max (us)   Scanned/matched");
+  for (int i = 0; i < IMDB_STAT_OP_COUNT; i++) {
+    const IMDBOpStats* op = &stats.ops[i];
+    if (op->calls == 0) {
+      continue;
+    }
+    Serial.printf("  %-9s %8lu %10lu %10lu %10lu %10lu   %lu/%lu\n",
+                  ESP32IMDB::statOpName((IMDBStatOp)i),
+                  (unsigned long)op->calls,
+                  (unsigned long)(op->totalMicros / op->calls),
+                  (unsigned long)ESP32IMDB::latencyPercentile(op, 0.50f),
+                  (unsigned long)ESP32IMDB::latencyPercentile(op, 0.99f),
+                  (unsigned long)op->maxMicros,
+                  (unsigned long)op->rowsScanned,
+                  (unsigned long)op->rowsMatched);
+  }
+  Serial.println();
+
+  Serial.println("  Operation    Locks  Contended  Wait (us)  Max wait   Hold (us)  Max hold");
+  for (int i = 0; i < IMDB_STAT_OP_COUNT; i++) {
+    const IMDBOpStats* op = &stats.ops[i];
+    if (op->lockAcquisitions == 0) {
+      continue;
+    }
+    Serial.printf("  %-9s %8lu %10lu %10llu %9lu %11llu %9lu\n",
+                  ESP32IMDB::statOpName((IMDBStatOp)i),
+                  (unsigned long)op->lockAcquisitions,
+                  (unsigned long)op->lockContended,
+                  (unsigned long long)op->lockWaitMicros,
+                  (unsigned long)op->lockWaitMaxMicros,
+                  (unsigned long long)op->lockHoldMicros,
+                  (unsigned long)op->lockHoldMaxMicros);
+  }
+  if (stats.maxHoldMicros > 0) {
+    Serial.printf("  Longest hold: %lu us (%s)\n", (unsigned long)stats.maxHoldMicros,
+                  ESP32IMDB::statOpName(stats.maxHoldOp));
+  }
+  Serial.println();
+}
+
+// Updates random devices until told to stop
+volatile bool writerRunning = false;
+SemaphoreHandle_t writerDone;
+
+void writerTask(void* parameter) {
+  uint32_t state = 12345;
+  while (writerRunning) {
+    state = state * 1103515245 + 12345;
+    int32_t id = (state >> 8) % 500;
+    db.updateWithMath("ID", &id, "RSSI", IMDB_MATH_SUBTRACT, 1);
+  }
+  xSemaphoreGive(writerDone);
+  vTaskDelete(NULL);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n=== ESP32IMDB Operation Stats Example ===\n");
+
+  IMDBColumn columns[] = {
+    {"ID", IMDB_TYPE_INT32},
+    {"Name", IMDB_TYPE_STRING},
+    {"Online", IMDB_TYPE_BOOL},
+    {"RSSI", IMDB_TYPE_FLOAT}
+  };
+  db.createTable(columns, 4);
+
+  Serial.println("1. Inserting 500 devices, 50 of them with a 100ms TTL...");
+  for (int32_t i = 0; i < 500; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "device-%03ld", (long)i);
+    const char* namePtr = name;
+    bool online = (i % 3) != 0;
+    float rssi = -40.0f - (i % 50);
+    const void* values[] = {&i, &namePtr, &online, &rssi};
+    db.insert(values, (i % 10 == 0) ? 100 : 0);
+  }
+
+  Serial.println("2. Running lookups, updates and scans, with a second task writing...");
+  writerDone = xSemaphoreCreateBinary();
+  writerRunning = writerDone != nullptr;
+  if (writerRunning) {
+    xTaskCreate(writerTask, "Writer", 4096, NULL, 1, NULL);
+  }
+  for (int32_t i = 0; i < 200; i++) {
+    int32_t id = (i * 37) % 500;
+    IMDBSelectResult result;
+    db.select("RSSI", "ID", &id, &result);
+    db.updateWithMath("ID", &id, "RSSI", IMDB_MATH_ADD, 1);
+  }
+  bool online = true;
+  for (int i = 0; i < 20; i++) {
+    db.countWhere("Online", &online);
+  }
+  int32_t gone = 1000;
+  db.deleteRecords("ID", &gone);  // Matches nothing, still scans the table
+  if (writerRunning) {
+    writerRunning = false;
+    xSemaphoreTake(writerDone, portMAX_DELAY);
+  }
+
+  delay(150);
+  db.purgeExpiredRecords();
+
+  printStats();
+
+  Serial.println("3. Resetting stats...");
+  db.resetStats();
+  IMDBSelectResult result;
+  db.max("RSSI", &result);
+  printStats();
+
+  Serial.println("=== Example Complete ===");
+}
+
+void loop() {
+  delay(10000);
+}
@@ -0,0 +1,240 @@
+/*
+ * ESP32IMDB - Persistence Benchmark
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Measures saveToFile() and loadFromFile() at several table sizes.
+ *
+ * For each size it reports:
+ * - Save time (wall clock for the whole saveToFile() call)
+ * - Lock hold time, as seen by a probe task that keeps calling
+ *   getRecordCount() during the save. The longest wait the probe sees is how
+ *   long every other reader and writer is stalled by the save.
+ * - The same lock hold time for saveToFileAsync(), which only holds the lock
+ *   while the table is encoded into RAM
+ * - Load time
+ * - File size
+ *
+ * A second table compares the compressed format (saveToFileCompressed())
+ * with the plain one: file sizes, compression ratio, save and load time.
+ *
+ * The table mirrors a typical device-tracking workload:
+ * ID (INT32), Name (STRING), MAC, LastSeen (EPOCH), Online (BOOL), RSSI (FLOAT)
+ */
+
+#include <ESP32IMDB.h>
+#include <SPIFFS.h>
+
+ESP32IMDB db;
+
+const char* BENCH_FILENAME = "/bench.imdb";
+const char* BENCH_COMPRESSED_FILENAME = "/bench.imdbz";
+const int ROW_COUNTS[] = {500, 1000, 2000, 5000, 10000};
+const int ROW_COUNT_STEPS = sizeof(ROW_COUNTS) / sizeof(ROW_COUNTS[0]);
+
+// Probe task state
+volatile bool probeRunning = false;
+volatile bool probeActive = false;
+volatile uint32_t probeMaxWaitMicros = 0;
+volatile uint32_t probeCalls = 0;
+
+// Repeatedly takes the database lock and records the longest wait
+void probeTask(void* parameter) {
+  while (probeRunning) {
+    if (probeActive) {
+      uint32_t start = micros();
+      db.getRecordCount();
+      uint32_t waited = micros() - start;
+      if (waited > probeMaxWaitMicros) {
+        probeMaxWaitMicros = waited;
+      }
+      probeCalls++;
+    }
+    vTaskDelay(1);
+  }
+  vTaskDelete(NULL);
+}
+
+// Fill the table with rows rows; returns the number actually inserted
+int populate(int rows) {
+  IMDBColumn columns[] = {
+    {"ID", IMDB_TYPE_INT32},
+    {"Name", IMDB_TYPE_STRING},
+    {"MAC", IMDB_TYPE_MAC},
+    {"LastSeen", IMDB_TYPE_EPOCH},
+    {"Online", IMDB_TYPE_BOOL},
+    {"RSSI", IMDB_TYPE_FLOAT}
+  };
+  db.createTable(columns, 6);
+
+  for (int i = 0; i < rows; i++) {
+    int32_t id = i;
+    char name[24];
+    snprintf(name, sizeof(name), "sensor-%05d", i);
+    const char* namePtr = name;
+    uint8_t mac[6] = {0x24, 0x6F, 0x28, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+    uint32_t lastSeen = 1700000000UL + i;
+    bool online = (i % 3) != 0;
+    float rssi = -40.0f - (float)(i % 50);
+    const void* values[] = {&id, &namePtr, mac, &lastSeen, &online, &rssi};
+    if (db.insert(values) != IMDB_OK) {
+      return i;
+    }
+  }
+  return rows;
+}
+
+void runStep(int rows) {
+  int inserted = populate(rows);
+  if (inserted < rows) {
+    Serial.printf("%8d  (stopped at %d rows: heap limit)\n", rows, inserted);
+    db.dropTable();
+    return;
+  }
+
+  // Save with the probe task contending for the lock
+  probeMaxWaitMicros = 0;
+  probeCalls = 0;
+  probeActive = true;
+  vTaskDelay(5);
+  uint32_t saveStart = micros();
+  IMDBResult saveResult = db.saveToFile(BENCH_FILENAME);
+  uint32_t saveMicros = micros() - saveStart;
+  vTaskDelay(5);
+  probeActive = false;
+  uint32_t syncHoldMicros = probeMaxWaitMicros;
+
+  if (saveResult != IMDB_OK) {
+    Serial.printf("%8d  save failed: %s\n", rows, ESP32IMDB::resultToString(saveResult));
+    db.dropTable();
+    return;
+  }
+
+  // Background save: the probe only waits for the in-memory encode
+  probeMaxWaitMicros = 0;
+  probeActive = true;
+  vTaskDelay(5);
+  IMDBResult asyncResult = db.saveToFileAsync(BENCH_FILENAME);
+  while (db.isSaveInProgress()) {
+    vTaskDelay(1);
+  }
+  vTaskDelay(5);
+  probeActive = false;
+  uint32_t asyncHoldMicros = probeMaxWaitMicros;
+  if (asyncResult == IMDB_OK) {
+    asyncResult = db.getLastSaveResult();
+  }
+
+  File file = SPIFFS.open(BENCH_FILENAME, "r");
+  size_t fileSize = file.size();
+  file.close();
+
+  db.dropTable();
+  uint32_t loadStart = micros();
+  IMDBResult loadResult = db.loadFromFile(BENCH_FILENAME);
+  uint32_t loadMicros = micros() - loadStart;
+
+  if (asyncResult != IMDB_OK && loadResult == IMDB_OK) {
+    loadResult = asyncResult;
+  }
+
+  Serial.printf("%8d  %10.1f  %14.1f  %15.1f  %10.1f  %10u  %s\n",
+                rows,
+                saveMicros / 1000.0,
+                syncHoldMicros / 1000.0,
+                asyncHoldMicros / 1000.0,
+                loadMicros / 1000.0,
+                (unsigned)fileSize,
+                loadResult == IMDB_OK ? "ok" : ESP32IMDB::resultToString(loadResult));
+
+  db.dropTable();
+  SPIFFS.remove(BENCH_FILENAME);
+}
+
+#if IMDB_ENABLE_COMPRESSION
+size_t fileBytes(const char* filename) {
+  File file = SPIFFS.open(filename, "r");
+  size_t size = file ? file.size() : 0;
+  file.close();
+  return size;
+}
+
+void runCompressionStep(int rows) {
+  int inserted = populate(rows);
+  if (inserted < rows) {
+    Serial.printf("%8d  (stopped at %d rows: heap limit)\n", rows, inserted);
+    db.dropTable();
+    return;
+  }
+
+  IMDBResult result = db.saveToFile(BENCH_FILENAME);
+
+  uint32_t saveStart = micros();
+  if (result == IMDB_OK) {
+    result = db.saveToFileCompressed(BENCH_COMPRESSED_FILENAME);
+  }
+  uint32_t saveMicros = micros() - saveStart;
+
+  size_t plainSize = fileBytes(BENCH_FILENAME);
+  size_t compressedSize = fileBytes(BENCH_COMPRESSED_FILENAME);
+
+  db.dropTable();
+  uint32_t loadStart = micros();
+  if (result == IMDB_OK) {
+    result = db.loadFromFile(BENCH_COMPRESSED_FILENAME);
+  }
+  uint32_t loadMicros = micros() - loadStart;
+
+  Serial.printf("%8d  %10u  %10u  %6.2fx  %12.1f  %12.1f  %s\n",
+                rows,
+                (unsigned)plainSize,
+                (unsigned)compressedSize,
+                compressedSize > 0 ? (double)plainSize / compressedSize : 0.0,
+                saveMicros / 1000.0,
+                loadMicros / 1000.0,
+                result == IMDB_OK ? "ok" : ESP32IMDB::resultToString(result));
+
+  db.dropTable();
+  SPIFFS.remove(BENCH_FILENAME);
+  SPIFFS.remove(BENCH_COMPRESSED_FILENAME);
+}
+#endif
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n=== ESP32IMDB Persistence Benchmark ===\n");
+
+  if (!SPIFFS.begin(true)) {
+    Serial.println("SPIFFS mount failed!");
+    return;
+  }
+
+  Serial.printf("Block size: %d bytes, free heap: %u bytes\n\n",
+                IMDB_PERSIST_BLOCK_SIZE, ESP.getFreeHeap());
+
+  probeRunning = true;
+  xTaskCreate(probeTask, "Probe", 4096, NULL, 2, NULL);
+
+  Serial.println("    Rows   Save (ms)  Lock hold (ms)  Async hold (ms)   Load (ms)  File bytes  Result");
+  for (int i = 0; i < ROW_COUNT_STEPS; i++) {
+    runStep(ROW_COUNTS[i]);
+  }
+
+#if IMDB_ENABLE_COMPRESSION
+  Serial.println("\n    Rows    v2 bytes    v3 bytes    Ratio  v3 save (ms)  v3 load (ms)  Result");
+  for (int i = 0; i < ROW_COUNT_STEPS; i++) {
+    runCompressionStep(ROW_COUNTS[i]);
+  }
+#endif
+
+  probeRunning = false;
+  Serial.println("\nBenchmark complete.");
+}
+
+void loop() {
+  delay(1000);
+}
@@ -31,6 +31,9 @@ ESP32IMDB db;
 // Filename for database storage
 const char* DB_FILENAME = "/sensor_data.imdb";
 
+void createAndPopulateTable();
+void displayAllRecords();
+
 void setup() {
   Serial.begin(115200);
   delay(1000);
@@ -129,7 +132,9 @@ void loop() {
   // Purge expired records every 5 seconds
   if (millis() - lastPurge > 5000) {
     lastPurge = millis();
-    int expiredCount = db.purgeExpiredRecords();
+    int countBefore = db.count();
+    db.purgeExpiredRecords();
+    int expiredCount = countBefore - db.count();
     
     if (expiredCount > 0) {
       Serial.printf("[%lu] Purged %d expired record(s). Remaining: %d\n", 
@@ -62,7 +62,7 @@ void printSeparator() {
 
 // Task 1: Continuous writer - inserts data
 void writerTask(void* parameter) {
-  int taskId = (int)parameter;
+  int taskId = (int)(intptr_t)parameter;
   uint32_t localInserts = 0;
   
   Serial.printf("[Writer %d] Started\n", taskId);
@@ -91,7 +91,7 @@ void writerTask(void* parameter) {
 
 // Task 2: Continuous reader - performs queries
 void readerTask(void* parameter) {
-  int taskId = (int)parameter;
+  int taskId = (int)(intptr_t)parameter;
   uint32_t localReads = 0;
   
   Serial.printf("[Reader %d] Started\n", taskId);
@@ -122,7 +122,7 @@ void readerTask(void* parameter) {
 
 // Task 3: Mixed operations - reads and writes
 void mixedTask(void* parameter) {
-  int taskId = (int)parameter;
+  int taskId = (int)(intptr_t)parameter;
   uint32_t localOps = 0;
   
   Serial.printf("[Mixed %d] Started\n", taskId);
@@ -431,17 +431,17 @@ void testHighContentionStress() {
   
   // Launch writer tasks
   for (int i = 0; i < NUM_WRITER_TASKS; i++) {
-    xTaskCreate(writerTask, "Writer", 4096, (void*)i, 1, NULL);
+    xTaskCreate(writerTask, "Writer", 4096, (void*)(intptr_t)i, 1, NULL);
   }
   
   // Launch reader tasks
   for (int i = 0; i < NUM_READER_TASKS; i++) {
-    xTaskCreate(readerTask, "Reader", 4096, (void*)i, 1, NULL);
+    xTaskCreate(readerTask, "Reader", 4096, (void*)(intptr_t)i, 1, NULL);
   }
   
   // Launch mixed tasks
   for (int i = 0; i < NUM_MIXED_TASKS; i++) {
-    xTaskCreate(mixedTask, "Mixed", 4096, (void*)i, 1, NULL);
+    xTaskCreate(mixedTask, "Mixed", 4096, (void*)(intptr_t)i, 1, NULL);
   }
   
   // Monitor progress
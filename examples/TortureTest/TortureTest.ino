@@ -14,6 +14,7 @@
  * - Memory management
  * - TTL functionality
  * - Math operations
+ * - CSV and JSON export and import
  * - Optionally, persistence (save/load to SPIFFS)
  * 
  */
@@ -70,6 +71,18 @@ void printDbState() {
     testsFailed++; \
   }
 
+// The breakdown adds up to getMemoryUsage() with no category gone negative
+bool memoryBreakdownConsistent() {
+  IMDBMemoryUsage usage;
+  if (db.getMemoryBreakdown(&usage) != IMDB_OK) {
+    return false;
+  }
+  size_t sum = usage.directory + usage.fieldArrays + usage.strings + usage.indexes +
+               usage.allocatorSlack + usage.fragmentation;
+  return sum == usage.total && usage.total == db.getMemoryUsage() &&
+         usage.strings <= usage.total && usage.fragmentation <= usage.total;
+}
+
 void printSeparator() {
   Serial.println("\n" + String('-', 60));
 }
@@ -307,6 +320,38 @@ void testMacType() {
   TEST_ASSERT(!ESP32IMDB::parseMacAddress("invalid", parsedMac), "Reject invalid MAC");
   TEST_ASSERT(!ESP32IMDB::parseMacAddress("GG:HH:II:JJ:KK:LL", parsedMac), "Reject non-hex MAC");
   
+  // Membership filter: grows past its first size and follows deletes and updates
+  TEST_ASSERT(db.setMembershipFilter("MAC") == IMDB_OK, "Set MAC membership filter");
+  TEST_ASSERT(db.setMembershipFilter("ID") == IMDB_OK && db.setMembershipFilter("MAC") == IMDB_OK,
+              "Move membership filter");
+  uint8_t unknownMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  TEST_ASSERT(db.exists("MAC", mac1), "Filter finds inserted MAC");
+  TEST_ASSERT(!db.exists("MAC", unknownMac), "Filter rejects unknown MAC");
+  for (int32_t id = 100; id < 600; id++) {
+    uint8_t mac[6] = {0x10, 0x20, 0x30, 0x40, (uint8_t)(id >> 8), (uint8_t)id};
+    const void* vals[] = {&id, mac};
+    db.insert(vals);
+  }
+  bool allFound = true;
+  for (int32_t id = 100; id < 600; id++) {
+    uint8_t mac[6] = {0x10, 0x20, 0x30, 0x40, (uint8_t)(id >> 8), (uint8_t)id};
+    allFound = allFound && db.exists("MAC", mac);
+  }
+  TEST_ASSERT(allFound, "Filter finds all MACs after growing");
+  TEST_ASSERT(!db.exists("MAC", unknownMac), "Filter still rejects unknown MAC");
+  
+  db.deleteRecords("MAC", mac1);
+  TEST_ASSERT(!db.exists("MAC", mac1), "Deleted MAC leaves filter");
+  db.update("ID", &id2, "MAC", unknownMac);
+  TEST_ASSERT(!db.exists("MAC", mac2) && db.exists("MAC", unknownMac), "Updated MAC replaced in filter");
+  
+  // More copies of one value than two buckets hold: lookups fall back to scanning
+  for (int i = 0; i < 20; i++) {
+    const void* vals[] = {&id3, mac3};
+    db.insert(vals);
+  }
+  TEST_ASSERT(db.exists("MAC", mac3) && !db.exists("MAC", mac1), "Filter with repeated values");
+  
   db.dropTable();
 }
 
@@ -351,6 +396,35 @@ void testEpochType() {
   db.max("Timestamp", &result);
   TEST_ASSERT(result.epochValue == 2147483647, "Max epoch value");
   
+  // Rows in timestamp order span several zone map blocks; range scans skip most of them
+  uint32_t base = 1700000000;
+  for (int32_t i = 0; i < 200; i++) {
+    int32_t id = 100 + i;
+    uint32_t seen = base + i * 60;
+    const void* vals[] = {&id, &seen};
+    db.insert(vals);
+  }
+  uint32_t from = base + 150 * 60;
+  TEST_ASSERT(db.countWhere("Timestamp", IMDB_OP_GREATER_EQUAL, &from) == 51, "Range count skips blocks");
+  
+  IMDBSelectResult* rows = nullptr;
+  int rowCount = 0;
+  TEST_ASSERT(db.selectAll("Timestamp", IMDB_OP_LESS, &base, &rows, &rowCount) == IMDB_OK && rowCount == 2,
+              "Range selectAll");
+  ESP32IMDB::freeSelectResults(rows);
+  
+  // An update widens its block's bounds, a delete rebuilds them
+  int32_t moved = 250;
+  uint32_t early = 5;
+  db.update("ID", &moved, "Timestamp", &early);
+  TEST_ASSERT(db.countWhere("Timestamp", IMDB_OP_LESS, &base) == 3, "Range count after update");
+  db.deleteRecords("ID", &id1);
+  db.min("Timestamp", &result);
+  TEST_ASSERT(result.epochValue == 5, "Min epoch after delete");
+  db.deleteRecords("ID", &id3);
+  db.max("Timestamp", &result);
+  TEST_ASSERT(result.epochValue == base + 199 * 60, "Max epoch after delete");
+  
   db.dropTable();
 }
 
@@ -387,6 +461,32 @@ void testBoolType() {
   db.select("Active", "ID", &id1, &result);
   TEST_ASSERT(result.boolValue == false, "Verify updated bool");
   
+  // Bitmap index: counts span several words and follow updates, deletes and TTLs
+  bool yes = true;
+  bool no = false;
+  for (int32_t id = 3; id < 103; id++) {
+    bool active = (id % 3 == 0);
+    const void* vals[] = {&id, &active};
+    db.insert(vals, (id % 10 == 0) ? 1 : 0);
+  }
+  delay(5);  // Rows with a TTL expire
+  TEST_ASSERT_EQUAL(31, db.countWhere("Active", &yes), "Bitmap count true (TTL rows skipped)");
+  TEST_ASSERT_EQUAL(61, db.countWhere("Active", &no), "Bitmap count false (TTL rows skipped)");
+  
+  int32_t id99 = 99;
+  db.update("ID", &id99, "Active", &no);
+  TEST_ASSERT_EQUAL(30, db.countWhere("Active", &yes), "Bitmap count follows update");
+  
+  TEST_ASSERT(db.deleteRecords("Active", &no) == IMDB_OK, "Delete by bool");
+  TEST_ASSERT_EQUAL(0, db.countWhere("Active", &no), "Bitmap count after delete");
+  TEST_ASSERT_EQUAL(30, db.countWhere("Active", &yes), "Bitmap count after compaction");
+  
+  IMDBSelectResult* rows;
+  int rowCount;
+  TEST_ASSERT(db.selectAll("Active", &yes, &rows, &rowCount) == IMDB_OK && rowCount == 30,
+              "Select all by bool");
+  ESP32IMDB::freeSelectResults(rows);
+  
   db.dropTable();
 }
 
@@ -716,6 +816,39 @@ void testQueryOperations() {
   TEST_ASSERT(db.selectAll("ID", &badId, &topResults, &topCount) == IMDB_ERROR_NO_RECORDS, 
               "SelectAll non-existent");
   
+  // Compound WHERE clauses: the planner drives the scan from the range on Value,
+  // which the zone map narrows to the last blocks, and estimates from column statistics
+  for (int i = 11; i <= 400; i++) {
+    int32_t id = i;
+    int32_t val = i * 10;
+    const void* vals[] = {&id, &val};
+    db.insert(vals);
+  }
+  int32_t fromValue = 3000;
+  int32_t skipId = 350;
+  IMDBPredicate where[] = {{"ID", IMDB_OP_NOT_EQUAL, &skipId}, {"Value", IMDB_OP_GREATER_EQUAL, &fromValue}};
+  TEST_ASSERT(db.countWhere(where, 2) == 100, "Compound countWhere");
+  
+  IMDBPlan plan;
+  TEST_ASSERT(db.explain(where, 2, &plan) == IMDB_OK && plan.actualRows == 100, "Explain compound query");
+  TEST_ASSERT(plan.path == IMDB_PATH_ZONE_SCAN && plan.order[0] == 1, "Explain drives from the range");
+  TEST_ASSERT(plan.actualScanned < 400 && plan.estimatedRows >= 80 && plan.estimatedRows <= 120,
+              "Explain estimated vs actual rows");
+  
+  IMDBColumnStats stats;
+  TEST_ASSERT(db.getColumnStats("ID", &stats) == IMDB_OK && stats.rows == 400 && stats.min == 1 &&
+              stats.max == 400 && stats.distinct >= 360 && stats.distinct <= 440, "Column statistics");
+  
+  int32_t belowId = 5;
+  int32_t aboveValue = 20;
+  IMDBPredicate narrow[] = {{"ID", IMDB_OP_LESS, &belowId}, {"Value", IMDB_OP_GREATER, &aboveValue}};
+  TEST_ASSERT(db.selectAll(narrow, 2, &topResults, &topCount) == IMDB_OK && topCount == 2 &&
+              topResults[0].int32Value == 3, "Compound selectAll");
+  free(topResults);
+  
+  IMDBPredicate missing[] = {{"Missing", IMDB_OP_EQUAL, &belowId}};
+  TEST_ASSERT(db.explain(missing, 1, &plan) == IMDB_ERROR_COLUMN_NOT_FOUND, "Explain unknown column");
+  
   db.dropTable();
 }
 
@@ -844,6 +977,9 @@ void testMemoryManagement() {
   Serial.printf("   Database using %d bytes for 100 records\n", dbMemory);
   TEST_ASSERT(dbMemory > 0, "Memory usage reported");
   TEST_ASSERT(db.count() == 100, "All records inserted");
+  IMDBMemoryUsage usage;
+  db.getMemoryBreakdown(&usage);
+  TEST_ASSERT(usage.strings == 100 * 9 && memoryBreakdownConsistent(), "Breakdown after inserts");
   
   // Delete half the records
   for (int i = 0; i < 50; i++) {
@@ -852,6 +988,8 @@ void testMemoryManagement() {
   }
   
   TEST_ASSERT(db.count() == 50, "Half records deleted");
+  db.getMemoryBreakdown(&usage);
+  TEST_ASSERT(usage.strings == 50 * 9 && memoryBreakdownConsistent(), "Breakdown after deletes");
   
   // Drop table and check heap recovery
   db.dropTable();
@@ -862,6 +1000,99 @@ void testMemoryManagement() {
   
   // Heap should be close to original (within 1KB tolerance for measurement variations)
   TEST_ASSERT(abs(heapDiff) < 1024, "Heap recovered after dropTable");
+  
+  // A memory budget stops inserts once the table reaches it
+  db.createTable(cols, 2);
+  size_t previousBudget = db.getMemoryBudget();
+  size_t budget = db.getMemoryUsage() + 2048;
+  db.setMemoryBudget(budget);
+  int budgetInserted = 0;
+  IMDBResult budgetResult = IMDB_OK;
+  for (int i = 0; i < 1000 && budgetResult == IMDB_OK; i++) {
+    int32_t id = i;
+    const char* name = "BudgetUser";
+    const void* vals[] = {&id, &name};
+    budgetResult = db.insert(vals);
+    if (budgetResult == IMDB_OK) {
+      budgetInserted++;
+    }
+  }
+  Serial.printf("   %d records fit a budget of %u bytes\n", budgetInserted, (unsigned)budget);
+  TEST_ASSERT(budgetResult == IMDB_ERROR_HEAP_LIMIT && budgetInserted > 0, "Budget rejects inserts");
+  TEST_ASSERT(db.count() == budgetInserted, "Rejected insert leaves the table unchanged");
+  db.setMemoryBudget(previousBudget);
+  int32_t budgetId = 1000;
+  const char* budgetName = "AfterBudget";
+  const void* budgetVals[] = {&budgetId, &budgetName};
+  TEST_ASSERT(db.insert(budgetVals) == IMDB_OK, "Insert after lifting the budget");
+  db.dropTable();
+  
+  // Ring buffer table: storage is fixed and the oldest rows are overwritten
+  TEST_ASSERT(db.createTable(cols, 2, 8) == IMDB_OK, "Create ring buffer table");
+  TEST_ASSERT(db.getRingCapacity() == 8, "Ring capacity reported");
+  size_t ringMemory = db.getMemoryUsage();
+  for (int i = 0; i < 20; i++) {
+    int32_t id = i;
+    char nameBuffer[16];
+    snprintf(nameBuffer, sizeof(nameBuffer), "Sample%d", i);
+    const char* name = nameBuffer;
+    const void* vals[] = {&id, &name};
+    db.insert(vals);
+  }
+  TEST_ASSERT(db.count() == 8, "Ring keeps capacity rows");
+  TEST_ASSERT(db.getMemoryUsage() == ringMemory, "Ring inserts allocate nothing");
+  
+  int32_t ringId = 11;
+  TEST_ASSERT(db.countWhere("ID", &ringId) == 0, "Oldest rows overwritten");
+  IMDBSelectResult* ringRows;
+  int ringCount;
+  TEST_ASSERT(db.top(8, &ringRows, &ringCount) == IMDB_OK && ringCount == 8, "Top returns the ring window");
+  TEST_ASSERT(ringRows[0].int32Value == 12 && ringRows[7 * 2].int32Value == 19, "Ring scans in insertion order");
+  TEST_ASSERT_STR_EQUAL("Sample19", ringRows[7 * 2 + 1].stringValue, "Ring string slot");
+  ESP32IMDB::freeSelectResults(ringRows);
+  
+  // A delete frees a slot; the next insert fills it without evicting
+  ringId = 15;
+  TEST_ASSERT(db.deleteRecords("ID", &ringId) == IMDB_OK && db.count() == 7, "Delete from ring");
+  for (int i = 20; i < 22; i++) {
+    int32_t id = i;
+    const char* name = "Refill";
+    const void* vals[] = {&id, &name};
+    db.insert(vals);
+  }
+  ringId = 12;
+  TEST_ASSERT(db.count() == 8 && db.countWhere("ID", &ringId) == 0, "Ring refilled after delete");
+  ringId = 13;
+  TEST_ASSERT(db.countWhere("ID", &ringId) == 1, "Ring kept newer rows");
+  db.dropTable();
+  
+  // Evictions keep the BOOL index and zone map current across wraps
+  IMDBColumn flagCols[] = {{"ID", IMDB_TYPE_INT32}, {"Flag", IMDB_TYPE_BOOL}};
+  TEST_ASSERT(db.createTable(flagCols, 2, 100) == IMDB_OK, "Create indexed ring");
+  bool flagTrue = true;
+  int32_t ringFloor = 0;
+  for (int i = 0; i < 250; i++) {
+    int32_t id = i;
+    bool flag = (i % 2 == 0);
+    const void* vals[] = {&id, &flag};
+    db.insert(vals);
+    if (i == 60) {
+      db.countWhere("Flag", &flagTrue);  // Build both indexes before wrapping
+      db.countWhere("ID", IMDB_OP_GREATER_EQUAL, &ringFloor);
+    }
+  }
+  TEST_ASSERT(db.countWhere("Flag", &flagTrue) == 50, "Ring BOOL index after wrap");
+  ringFloor = 200;
+  TEST_ASSERT(db.countWhere("ID", IMDB_OP_GREATER_EQUAL, &ringFloor) == 50, "Ring range scan after wrap");
+  ringFloor = 160;
+  TEST_ASSERT(db.countWhere("ID", IMDB_OP_LESS, &ringFloor) == 10, "Ring range scan across the wrap");
+  IMDBSelectResult ringMin;
+  IMDBSelectResult ringMax;
+  TEST_ASSERT(db.min("ID", &ringMin) == IMDB_OK && ringMin.int32Value == 150, "Ring min after wrap");
+  TEST_ASSERT(db.max("ID", &ringMax) == IMDB_OK && ringMax.int32Value == 249, "Ring max after wrap");
+  db.dropTable();
+  
+  TEST_ASSERT(db.createTable(cols, 2, 0x7FFFFFFF) == IMDB_ERROR_INVALID_VALUE, "Reject oversized ring");
 }
 
 // Test 15: Stress test
@@ -921,7 +1152,109 @@ void testStressTest() {
   db.dropTable();
 }
 
+// In-memory Stream for export and import round trips
+class MemoryStream : public Stream {
+public:
+  MemoryStream() : _length(0), _position(0) { _data[0] = '\0'; }
+  size_t write(uint8_t c) override {
+    if (_length >= sizeof(_data) - 1) {
+      return 0;
+    }
+    _data[_length++] = (char)c;
+    _data[_length] = '\0';
+    return 1;
+  }
+  using Print::write;
+  int available() override { return (int)(_length - _position); }
+  int read() override { return (_position < _length) ? (uint8_t)_data[_position++] : -1; }
+  int peek() override { return (_position < _length) ? (uint8_t)_data[_position] : -1; }
+  const char* text() const { return _data; }
+private:
+  char _data[2048];
+  size_t _length;
+  size_t _position;
+};
+
+// Export the table, recreate it, import the output and compare the rows
+void exportImportRoundTrip(bool json) {
+  const char* format = json ? "JSON" : "CSV";
+  char testName[64];
+  IMDBColumn cols[] = {
+    {"ID", IMDB_TYPE_INT32},
+    {"Name", IMDB_TYPE_STRING},
+    {"MAC", IMDB_TYPE_MAC},
+    {"Value", IMDB_TYPE_FLOAT},
+    {"Active", IMDB_TYPE_BOOL}
+  };
+  const char* names[] = {"He said \"hi\", then left", "line one\nline two", ""};
+  
+  db.createTable(cols, 5);
+  for (int i = 0; i < 3; i++) {
+    int32_t id = i + 1;
+    uint8_t mac[6] = {0xAA, 0xBB, 0xCC, 0x00, 0x00, (uint8_t)i};
+    float value = 1.5f * i - 0.25f;
+    bool active = (i % 2) == 0;
+    const void* vals[] = {&id, &names[i], mac, &value, &active};
+    db.insert(vals);
+  }
+  
+  MemoryStream stream;
+  IMDBResult result = json ? db.exportJSON(stream) : db.exportCSV(stream);
+  snprintf(testName, sizeof(testName), "Export %s", format);
+  TEST_ASSERT(result == IMDB_OK, testName);
+  db.dropTable();
+  
+  db.createTable(cols, 5);
+  int imported = 0;
+  result = json ? db.importJSON(stream, 0, &imported) : db.importCSV(stream, 0, &imported);
+  snprintf(testName, sizeof(testName), "Import %s", format);
+  TEST_ASSERT(result == IMDB_OK && imported == 3 && db.count() == 3, testName);
+  
+  bool same = true;
+  for (int i = 0; i < 3; i++) {
+    int32_t id = i + 1;
+    IMDBSelectResult name, mac, value, active;
+    db.select("Name", "ID", &id, &name);
+    db.select("MAC", "ID", &id, &mac);
+    db.select("Value", "ID", &id, &value);
+    db.select("Active", "ID", &id, &active);
+    same = same && name.hasValue && strcmp(name.stringValue, names[i]) == 0 &&
+           mac.macAddress[5] == i && value.floatValue == 1.5f * i - 0.25f &&
+           active.boolValue == ((i % 2) == 0);
+  }
+  snprintf(testName, sizeof(testName), "%s round trip keeps quotes, newlines and empty strings", format);
+  TEST_ASSERT(same, testName);
+  db.dropTable();
+}
+
+// Test 19: Export and import
+void testExportImport() {
+  Serial.println("\n=== TEST 19: Export and Import ===");
+  
+  exportImportRoundTrip(false);
+  exportImportRoundTrip(true);
+  
+  // Malformed input stops with a parse error
+  IMDBColumn cols[] = {{"ID", IMDB_TYPE_INT32}, {"Name", IMDB_TYPE_STRING}};
+  db.createTable(cols, 2);
+  MemoryStream bad;
+  bad.write("ID,Name\n1,\"unterminated\n");
+  int imported = 0;
+  TEST_ASSERT(db.importCSV(bad, 0, &imported) == IMDB_ERROR_PARSE && imported == 0, "Reject unterminated quote");
+  db.dropTable();
+}
+
 #ifdef ENABLE_PERSISTENCE_TEST
+// Results seen by the background save callback
+IMDBResult backgroundSaveResult = IMDB_ERROR_INVALID_OPERATION;
+IMDBResult backgroundOverlapResult = IMDB_OK;
+
+// Runs in the save task while the save still counts as in progress
+void onBackgroundSave(IMDBResult result, void* userArg) {
+  backgroundSaveResult = result;
+  backgroundOverlapResult = db.saveToFile((const char*)userArg);
+}
+
 // Test 17: Persistence (save/load to SPIFFS)
 void testPersistence() {
   Serial.println("\n=== TEST 17: Persistence (SPIFFS Save/Load) ===");
@@ -1165,12 +1498,286 @@ void testPersistence() {
   TEST_ASSERT(corruptResult != IMDB_OK, "Reject corrupted file");
   Serial.printf("   Corrupted file returned: %s\n", ESP32IMDB::resultToString(corruptResult));
   
+  // Block CRCs catch a flipped payload byte and a file cut off mid-block
+  db.createTable(cols, 6);
+  for (int i = 0; i < 200; i++) {
+    id1 = i;
+    db.insert(vals1);
+  }
+  TEST_ASSERT(db.saveToFile(testFile) == IMDB_OK, "Save file to damage");
+  db.dropTable();
+  file = SPIFFS.open(testFile, "r");
+  size_t savedSize = file.size();
+  uint8_t* saved = (uint8_t*)malloc(savedSize);
+  TEST_ASSERT(saved != nullptr && file.read(saved, savedSize) == savedSize, "Read saved file");
+  file.close();
+  
+  if (saved != nullptr) {
+    // A name in a record from the middle of the file
+    uint8_t* payloadByte = nullptr;
+    for (size_t i = savedSize / 2; i + 10 <= savedSize && payloadByte == nullptr; i++) {
+      if (memcmp(saved + i, "TestDevice", 10) == 0) {
+        payloadByte = saved + i;
+      }
+    }
+    TEST_ASSERT(payloadByte != nullptr, "Found record payload");
+    if (payloadByte != nullptr) {
+      *payloadByte ^= 0x01;
+      file = SPIFFS.open(testFile, "w");
+      file.write(saved, savedSize);
+      file.close();
+      TEST_ASSERT(db.loadFromFile(testFile) == IMDB_ERROR_CORRUPT_FILE, "Reject flipped payload byte");
+      *payloadByte ^= 0x01;
+    }
+    
+    file = SPIFFS.open(testFile, "w");
+    file.write(saved, savedSize / 2);
+    file.close();
+    TEST_ASSERT(db.loadFromFile(testFile) == IMDB_ERROR_CORRUPT_FILE, "Reject file truncated mid-block");
+    file = SPIFFS.open(testFile, "w");
+    file.write(saved, savedSize - 2);
+    file.close();
+    TEST_ASSERT(db.loadFromFile(testFile) == IMDB_ERROR_CORRUPT_FILE, "Reject file cut in its last CRC");
+    TEST_ASSERT(db.saveToFile(testFile) == IMDB_ERROR_NO_TABLE, "Damaged file leaves no table");
+    free(saved);
+  }
+  
+  // Test 13: Background save
+  db.dropTable();
+  db.createTable(cols, 6);
+  for (int i = 0; i < 50; i++) {
+    id1 = i;
+    db.insert(vals1);
+  }
+  TEST_ASSERT(db.saveToFileAsync(testFile, onBackgroundSave, (void*)testFile) == IMDB_OK, "Start background save");
+  while (db.isSaveInProgress()) {
+    delay(1);
+  }
+  TEST_ASSERT(db.getLastSaveResult() == IMDB_OK && backgroundSaveResult == IMDB_OK, "Background save result");
+  TEST_ASSERT(backgroundOverlapResult == IMDB_ERROR_INVALID_OPERATION, "Save to a file being written rejected");
+  id1 = 50;
+  db.insert(vals1);
+  db.dropTable();
+  TEST_ASSERT(db.loadFromFile(testFile) == IMDB_OK && db.count() == 50, "Reload background save");
+  
+  // Test 14: Incremental save - base, deltas and reload
+  const char* incFile = "/test_torture_inc.imdb";
+  SPIFFS.remove(incFile);
+  SPIFFS.remove("/test_torture_inc.imdb.d1");
+  SPIFFS.remove("/test_torture_inc.imdb.d2");
+  db.dropTable();
+  db.createTable(cols, 6);
+  for (int i = 0; i < 10; i++) {
+    id1 = i;
+    db.insert(vals1);
+  }
+  TEST_ASSERT(db.saveIncremental(incFile) == IMDB_OK, "Save incremental base");
+  
+  id1 = 3;
+  float updatedValue = 9.5f;
+  db.update("ID", &id1, "Value", &updatedValue);
+  id1 = 4;
+  db.deleteRecords("ID", &id1);
+  id1 = 20;
+  db.insert(vals1);
+  db.deleteRecords("ID", &id1);  // Inserted and deleted between saves
+  id1 = 21;
+  db.insert(vals1);
+  TEST_ASSERT(db.saveIncremental(incFile) == IMDB_OK, "Save first delta");
+  TEST_ASSERT(SPIFFS.exists("/test_torture_inc.imdb.d1"), "First delta written");
+  
+  db.dropTable();
+  TEST_ASSERT(db.loadIncremental(incFile) == IMDB_OK, "Load base and delta");
+  TEST_ASSERT(db.count() == 10, "Delta merged");
+  id1 = 4;
+  TEST_ASSERT(db.countWhere("ID", &id1) == 0, "Delta delete merged");
+  id1 = 20;
+  TEST_ASSERT(db.countWhere("ID", &id1) == 0, "Insert-then-delete not restored");
+  id1 = 21;
+  TEST_ASSERT(db.countWhere("ID", &id1) == 1, "Delta insert merged");
+  id1 = 3;
+  IMDBSelectResult incValue;
+  TEST_ASSERT(db.select("Value", "ID", &id1, &incValue) == IMDB_OK && incValue.floatValue == 9.5f, "Delta update merged");
+  
+  // The reloaded table continues the series
+  id1 = 5;
+  db.deleteRecords("ID", &id1);
+  TEST_ASSERT(db.saveIncremental(incFile) == IMDB_OK, "Save delta after reload");
+  TEST_ASSERT(SPIFFS.exists("/test_torture_inc.imdb.d2"), "Second delta written");
+  db.dropTable();
+  TEST_ASSERT(db.loadIncremental(incFile) == IMDB_OK && db.count() == 9, "Load base and both deltas");
+  SPIFFS.remove(incFile);
+  SPIFFS.remove("/test_torture_inc.imdb.d1");
+  SPIFFS.remove("/test_torture_inc.imdb.d2");
+  
+  // Test 15: Lazy load - key lookups answered from the file
+  db.dropTable();
+  IMDBColumn lazyCols[] = {{"ID", IMDB_TYPE_INT32}, {"Name", IMDB_TYPE_STRING}};
+  db.createTable(lazyCols, 2);
+  TEST_ASSERT(db.setLazyLoadKey("ID") == IMDB_OK, "Set lazy load key");
+  int32_t lazyId;
+  char lazyNameBuffer[16];
+  const char* lazyNamePtr = lazyNameBuffer;
+  const void* lazyVals[] = {&lazyId, &lazyNamePtr};
+  for (int i = 0; i < 2000; i++) {
+    lazyId = i;
+    snprintf(lazyNameBuffer, sizeof(lazyNameBuffer), "Lazy%d", i);
+    db.insert(lazyVals);
+  }
+  TEST_ASSERT(db.saveToFile(testFile) == IMDB_OK, "Save file with key index");
+  db.dropTable();
+  
+  TEST_ASSERT(db.loadFromFileLazy(testFile) == IMDB_OK, "Start lazy load");
+  Serial.printf("   %u%% loaded when the call returned\n", db.getLoadProgress());
+  lazyId = 1999;
+  IMDBSelectResult lazyName;
+  TEST_ASSERT(db.select("Name", "ID", &lazyId, &lazyName) == IMDB_OK, "Key select during lazy load");
+  TEST_ASSERT_STR_EQUAL("Lazy1999", lazyName.stringValue, "Key select reads the row");
+  TEST_ASSERT(db.countWhere("ID", &lazyId) == 1, "Key count during lazy load");
+  lazyId = 5000;
+  TEST_ASSERT(db.countWhere("ID", &lazyId) == 0, "Missing key during lazy load");
+  
+  // A write finishes the load before it runs
+  lazyId = 2000;
+  TEST_ASSERT(db.insert(lazyVals) == IMDB_OK, "Insert during lazy load");
+  TEST_ASSERT(!db.isLoadInProgress() && db.getLoadProgress() == 100, "Insert finished the load");
+  TEST_ASSERT(db.count() == 2001, "Lazy load loaded every row");
+  TEST_ASSERT(db.getLastLoadResult() == IMDB_OK, "Lazy load result");
+  
+#if IMDB_ENABLE_COMPRESSION
+  // Test 16: Strings shared through a compressed file's dictionary are counted once
+  db.dropTable();
+  IMDBColumn sharedCols[] = {{"ID", IMDB_TYPE_INT32}, {"Name", IMDB_TYPE_STRING}};
+  db.createTable(sharedCols, 2);
+  int32_t sharedId;
+  const char* sharedName = "Repeated";
+  const void* sharedVals[] = {&sharedId, &sharedName};
+  for (int i = 0; i < 100; i++) {
+    sharedId = i;
+    db.insert(sharedVals);
+  }
+  TEST_ASSERT(db.saveToFileCompressed(testFile) == IMDB_OK, "Save shared strings compressed");
+  db.dropTable();
+  TEST_ASSERT(db.loadFromFile(testFile) == IMDB_OK, "Load shared strings");
+  IMDBMemoryUsage loadedUsage;
+  db.getMemoryBreakdown(&loadedUsage);
+  TEST_ASSERT(loadedUsage.strings == 9, "Shared string counted once");
+  TEST_ASSERT(memoryBreakdownConsistent(), "Breakdown after compressed load");
+  for (int i = 0; i < 50; i++) {
+    sharedId = i;
+    db.deleteRecords("ID", &sharedId);
+  }
+  TEST_ASSERT(memoryBreakdownConsistent(), "Breakdown after deleting loaded rows");
+  for (int i = 50; i < 100; i++) {
+    sharedId = i;
+    db.deleteRecords("ID", &sharedId);
+  }
+  db.getMemoryBreakdown(&loadedUsage);
+  TEST_ASSERT(loadedUsage.strings == 0 && loadedUsage.fragmentation == 0, "Load arenas freed with their last row");
+#endif
+  
+  // Test 17: Ring buffer tables keep their capacity and only the live rows
+  db.dropTable();
+  db.createTable(cols, 6, 4);
+  for (int i = 0; i < 6; i++) {
+    id1 = i;
+    db.insert(vals1);
+  }
+  TEST_ASSERT(db.saveToFile(testFile) == IMDB_OK, "Save ring buffer table");
+  db.dropTable();
+  TEST_ASSERT(db.loadFromFile(testFile) == IMDB_OK, "Load ring buffer table");
+  TEST_ASSERT(db.getRingCapacity() == 4 && db.count() == 4, "Ring capacity and rows restored");
+  id1 = 6;
+  db.insert(vals1);
+  int32_t ringId = 2;
+  TEST_ASSERT(db.count() == 4 && db.countWhere("ID", &ringId) == 0, "Loaded ring overwrites oldest");
+#if IMDB_ENABLE_COMPRESSION
+  TEST_ASSERT(db.saveToFileCompressed(testFile) == IMDB_OK, "Save compressed ring buffer table");
+  db.dropTable();
+  TEST_ASSERT(db.loadFromFile(testFile) == IMDB_OK, "Load compressed ring buffer table");
+  ringId = 3;
+  TEST_ASSERT(db.getRingCapacity() == 4 && db.countWhere("ID", &ringId) == 1, "Compressed ring restored");
+#endif
+  
   // Cleanup
   SPIFFS.remove(testFile);
   db.dropTable();
   
   Serial.println("   ✓ Persistence tests complete");
 }
+
+// Test 18: Write-ahead log
+void testWriteAheadLog() {
+  Serial.println("\n=== TEST 18: Write-Ahead Log ===");
+  
+  const char* snapshotFile = "/test_wal.imdb";
+  const char* logFile = "/test_wal.wal";
+  SPIFFS.remove(snapshotFile);
+  SPIFFS.remove(logFile);
+  
+  IMDBColumn cols[] = {{"ID", IMDB_TYPE_INT32}, {"Name", IMDB_TYPE_STRING}};
+  db.createTable(cols, 2);
+  TEST_ASSERT(db.enableWAL(snapshotFile, logFile, 0) == IMDB_OK, "Enable WAL");
+  
+  int32_t id = 1;
+  const char* name = "Logged";
+  const void* vals[] = {&id, &name};
+  db.insert(vals);
+  id = 2;
+  db.insert(vals, 200);  // Expires before the last logged change
+  id = 3;
+  db.insert(vals, 60000);
+  id = 4;
+  db.insert(vals);
+  db.deleteRecords("ID", &id);
+  id = 1;
+  const char* renamed = "Updated";
+  db.update("ID", &id, "Name", &renamed);
+  delay(300);
+  id = 5;
+  db.insert(vals);
+  db.dropTable();  // Commits and stops logging; both files stay
+  
+  TEST_ASSERT(db.recoverFromWAL(snapshotFile, logFile, 0) == IMDB_OK, "Recover from WAL");
+  TEST_ASSERT(db.count() == 3, "Replayed inserts and delete");
+  id = 2;
+  TEST_ASSERT(db.countWhere("ID", &id) == 0, "Replayed TTL keeps counting from the log");
+  id = 3;
+  TEST_ASSERT(db.countWhere("ID", &id) == 1, "Replayed TTL not yet expired");
+  id = 1;
+  IMDBSelectResult walName;
+  TEST_ASSERT(db.select("Name", "ID", &id, &walName) == IMDB_OK, "Select replayed row");
+  TEST_ASSERT_STR_EQUAL("Updated", walName.stringValue, "Replayed update");
+  
+  // A torn last entry is ignored
+  id = 6;
+  db.insert(vals);
+  db.dropTable();
+  File walFile = SPIFFS.open(logFile, "a");
+  uint32_t tornLength = 40;
+  walFile.write((const uint8_t*)&tornLength, 4);
+  walFile.write((const uint8_t*)"torn", 4);
+  walFile.close();
+  TEST_ASSERT(db.recoverFromWAL(snapshotFile, logFile, 0) == IMDB_OK, "Recover past torn tail");
+  TEST_ASSERT(db.count() == 4, "Entries before the torn tail replayed");
+  
+  // The commit task flushes a batch without further writes
+  TEST_ASSERT(db.disableWAL() == IMDB_OK, "Disable WAL");
+  TEST_ASSERT(db.enableWAL(snapshotFile, logFile, 50) == IMDB_OK, "Enable WAL with commit interval");
+  walFile = SPIFFS.open(logFile, "r");
+  size_t logSize = walFile.size();
+  walFile.close();
+  id = 7;
+  db.insert(vals);
+  delay(300);
+  walFile = SPIFFS.open(logFile, "r");
+  TEST_ASSERT(walFile.size() > logSize, "Idle batch committed");
+  walFile.close();
+  
+  db.dropTable();
+  SPIFFS.remove(snapshotFile);
+  SPIFFS.remove(logFile);
+}
 #endif
 
 void setup() {
@@ -1207,9 +1814,11 @@ void setup() {
   testMultiColumn();
   testStressTest();
   testMemoryManagement();
+  testExportImport();
   
 #ifdef ENABLE_PERSISTENCE_TEST
   testPersistence();
+  testWriteAheadLog();
 #endif
   
   uint32_t elapsed = millis() - startTime;
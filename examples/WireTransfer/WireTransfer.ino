@@ -0,0 +1,106 @@
+/*
+ * ESP32IMDB - Binary Wire Transfer Example
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * This example sends query results in the compact binary wire encoding
+ * (see IMDBWire.h). encodeRows() fills a packet-sized buffer with whole rows
+ * straight from the table; a gateway decodes each chunk with IMDBWireDecoder,
+ * which also builds on a PC. Here both ends run on the same board, with
+ * Serial standing in for the radio link.
+ *
+ * 250 bytes is the ESP-NOW payload limit; esp_now_send(peer, packet, length)
+ * would take the place of receivePacket().
+ */
+
+#include <ESP32IMDB.h>
+
+ESP32IMDB db;
+IMDBWireDecoder decoder;
+
+const size_t PACKET_SIZE = 250;
+uint8_t packet[PACKET_SIZE];
+
+// Gateway side: decode one chunk and print its rows
+void receivePacket(const uint8_t* data, size_t length) {
+  if (!decoder.begin(data, length)) {
+    Serial.println("   ✗ Malformed packet or unknown schema");
+    return;
+  }
+
+  int idColumn = decoder.findColumn("ID");
+  int nameColumn = decoder.findColumn("Name");
+  int rssiColumn = decoder.findColumn("RSSI");
+
+  while (decoder.next()) {
+    const IMDBWireValue* name = decoder.getValue(nameColumn);
+    Serial.printf("   ID %d  %.*s  RSSI %.1f\n",
+                  (int)decoder.getValue(idColumn)->int32Value,
+                  (int)name->stringLength, name->stringValue,
+                  decoder.getValue(rssiColumn)->floatValue);
+  }
+  if (decoder.hasError()) {
+    Serial.println("   ✗ Truncated row");
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n=== ESP32IMDB Binary Wire Transfer Example ===\n");
+
+  IMDBColumn columns[] = {
+    {"ID", IMDB_TYPE_INT32},
+    {"Name", IMDB_TYPE_STRING},
+    {"MAC", IMDB_TYPE_MAC},
+    {"Online", IMDB_TYPE_BOOL},
+    {"RSSI", IMDB_TYPE_FLOAT}
+  };
+  db.createTable(columns, 5);
+
+  for (int i = 1; i <= 40; i++) {
+    char name[24];
+    snprintf(name, sizeof(name), "sensor-%02d", i);
+    const char* namePtr = name;
+    uint8_t mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x00, (uint8_t)i};
+    bool online = (i % 4) != 0;
+    float rssi = -40.0f - i * 0.75f;
+    const void* values[] = {&i, &namePtr, mac, &online, &rssi};
+    db.insert(values);
+  }
+
+  Serial.println("1. Sending online sensors (ID, Name, RSSI) in 250-byte packets...");
+  bool online = true;
+  const char* fields[] = {"ID", "Name", "RSSI"};
+
+  IMDBWireCursor cursor = {};
+  cursor.whereColumn = "Online";
+  cursor.whereValue = &online;
+  cursor.columns = fields;
+  cursor.columnCount = 3;
+  cursor.schemaMode = IMDB_WIRE_SCHEMA_EVERY;  // Each packet decodes on its own
+
+  size_t totalBytes = 0;
+  while (!cursor.finished) {
+    size_t length;
+    IMDBResult result = db.encodeRows(&cursor, packet, PACKET_SIZE, &length);
+    if (result != IMDB_OK) {
+      Serial.printf("   ✗ Encode failed: %s\n", ESP32IMDB::resultToString(result));
+      return;
+    }
+    Serial.printf("  Packet %u: %u bytes\n", (unsigned)cursor.chunks, (unsigned)length);
+    receivePacket(packet, length);
+    totalBytes += length;
+  }
+
+  Serial.printf("\n2. Sent %u rows in %u packets, %u bytes (%.1f bytes/row)\n",
+                (unsigned)cursor.rowsEncoded, (unsigned)cursor.chunks, (unsigned)totalBytes,
+                cursor.rowsEncoded ? (float)totalBytes / cursor.rowsEncoded : 0.0f);
+}
+
+void loop() {
+  delay(10000);
+}
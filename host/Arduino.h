@@ -0,0 +1,133 @@
+/*
+ * ESP32IMDB - Host (Linux) Arduino shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Just enough of the ESP32 Arduino core for the library, its examples and
+ * its benchmarks to build and run on a Linux host:
+ * - millis()/micros()/delay() backed by a controllable clock
+ * - Print/Stream and a Serial object writing to stdout
+ * - A minimal String class
+ * - ESP.getFreeHeap() backed by a simulated heap of configurable size, and
+ *   optional simulated PSRAM (see esp_heap_caps.h)
+ *
+ * This is not a general-purpose Arduino emulator. Only what the library and
+ * the bundled sketches use is provided.
+ */
+
+#ifndef IMDB_HOST_ARDUINO_H
+#define IMDB_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Timing
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// PSRAM
+bool psramFound();
+
+// Random numbers (Arduino semantics: [0, max) and [min, max))
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+// Host controls for the simulated environment
+void imdbHostSetHeapSize(uint32_t bytes);     // Simulated heap; ESP.getFreeHeap() = size - bytes in use
+void imdbHostSetPsramSize(uint32_t bytes);    // Simulated PSRAM; 0 = none
+void imdbHostAdvanceMillis(uint32_t ms);      // Jump the clock forward without sleeping
+void imdbHostFreezeClock(bool frozen);        // Frozen clock only moves via delay()/advance
+
+class String {
+public:
+  String(const char* str = "");
+  String(const String& other);
+  String(char c, int count);
+  String(int value);
+  ~String();
+  String& operator=(const String& other);
+  String& operator+=(const String& other);
+  String& operator+=(const char* str);
+  const char* c_str() const { return _buffer; }
+  unsigned int length() const { return (unsigned int)strlen(_buffer); }
+private:
+  char* _buffer;
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const char* lhs, const String& rhs);
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+  size_t print(const char* str) { return write(str); }
+  size_t print(const String& str) { return write(str.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value);
+  size_t print(unsigned int value);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(double value, int digits = 2);
+  size_t println() { return write("\n"); }
+  template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(uint8_t* buffer, size_t length);
+  size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+};
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  operator bool() const { return true; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override { fflush(stdout); }
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getHeapSize() { return 320 * 1024; }
+  uint32_t getMinFreeHeap() { return getFreeHeap(); }
+  uint32_t getPsramSize();
+  uint32_t getFreePsram();
+  const char* getChipModel() { return "Linux host"; }
+  uint32_t getCpuFreqMHz() { return 240; }
+  void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+
+#endif // IMDB_HOST_ARDUINO_H
@@ -0,0 +1,688 @@
+/*
+ * ESP32IMDB - Host (Linux) Arduino/FreeRTOS shim implementation
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ */
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+#include <esp_memory_utils.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include <errno.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// Clock
+// ---------------------------------------------------------------------------
+
+static std::atomic<uint64_t> hostOffsetMicros(0);
+static std::atomic<bool> hostClockFrozen(false);
+static std::atomic<uint64_t> hostFrozenMicros(0);
+
+// Microseconds since the first clock read. A function-local start time, so
+// global objects constructed before main() (like a sketch's database) see a
+// valid clock too.
+static uint64_t hostRealMicros() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t hostNowMicros() {
+  if (hostClockFrozen.load()) {
+    return hostFrozenMicros.load() + hostOffsetMicros.load();
+  }
+  return hostRealMicros() + hostOffsetMicros.load();
+}
+
+uint32_t millis() {
+  return (uint32_t)(hostNowMicros() / 1000);
+}
+
+uint32_t micros() {
+  return (uint32_t)hostNowMicros();
+}
+
+void delay(uint32_t ms) {
+  if (hostClockFrozen.load()) {
+    hostOffsetMicros += (uint64_t)ms * 1000;
+    std::this_thread::yield();
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+  if (hostClockFrozen.load()) {
+    hostOffsetMicros += us;
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+void imdbHostAdvanceMillis(uint32_t ms) {
+  hostOffsetMicros += (uint64_t)ms * 1000;
+}
+
+void imdbHostFreezeClock(bool frozen) {
+  if (frozen == hostClockFrozen.load()) {
+    return;
+  }
+  uint64_t real = hostRealMicros();
+  if (frozen) {
+    hostFrozenMicros = real;
+  } else {
+    // Keep time continuous when thawing
+    hostOffsetMicros += hostFrozenMicros.load();
+    hostOffsetMicros -= real;
+  }
+  hostClockFrozen = frozen;
+}
+
+// ---------------------------------------------------------------------------
+// Random numbers
+// ---------------------------------------------------------------------------
+
+static std::mutex hostRandomMutex;
+static std::mt19937 hostRandom(12345);
+
+long random(long max) {
+  if (max <= 0) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> guard(hostRandomMutex);
+  return (long)(hostRandom() % (unsigned long)max);
+}
+
+long random(long min, long max) {
+  if (min >= max) {
+    return min;
+  }
+  return min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+  std::lock_guard<std::mutex> guard(hostRandomMutex);
+  hostRandom.seed((uint32_t)seed);
+}
+
+// ---------------------------------------------------------------------------
+// Simulated heap
+// ---------------------------------------------------------------------------
+
+static uint32_t hostHeapSize() {
+  static uint32_t size = 0;
+  if (size == 0) {
+    const char* env = getenv("IMDB_HOST_HEAP_BYTES");
+    size = (env != nullptr && atol(env) > 0) ? (uint32_t)atol(env) : 320 * 1024;
+  }
+  return size;
+}
+
+static std::atomic<uint32_t> hostHeapOverride(0);
+static size_t hostHeapBaseline = 0;
+
+// Simulated PSRAM blocks are allocated from the host heap too, but counted
+// against the PSRAM pool instead of the simulated heap
+static std::mutex hostPsramMutex;
+static std::atomic<size_t> hostPsramUsed(0);
+static std::atomic<int64_t> hostPsramOverride(-1);
+
+static std::unordered_map<const void*, size_t>& hostPsramBlocks() {
+  static std::unordered_map<const void*, size_t> blocks;  // Block -> heap bytes
+  return blocks;
+}
+
+static uint32_t hostPsramSize() {
+  if (hostPsramOverride.load() >= 0) {
+    return (uint32_t)hostPsramOverride.load();
+  }
+  static int64_t size = -1;
+  if (size < 0) {
+    const char* env = getenv("IMDB_HOST_PSRAM_BYTES");
+    size = (env != nullptr && atol(env) > 0) ? atol(env) : 0;
+  }
+  return (uint32_t)size;
+}
+
+// Heap bytes of a block, as counted by mallinfo2(): usable size plus the chunk header
+static size_t hostBlockBytes(void* ptr) {
+  return malloc_usable_size(ptr) + sizeof(size_t);
+}
+
+// Route every thread through the main arena, and keep large blocks out of
+// mmap, so mallinfo2() sees all allocations
+__attribute__((constructor)) static void hostHeapInit() {
+  mallopt(M_ARENA_MAX, 1);
+  mallopt(M_MMAP_THRESHOLD, 32 * 1024 * 1024);
+  hostHeapBaseline = mallinfo2().uordblks;
+}
+
+void imdbHostSetHeapSize(uint32_t bytes) {
+  hostHeapOverride = bytes;
+}
+
+void imdbHostSetPsramSize(uint32_t bytes) {
+  hostPsramOverride = bytes;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  uint32_t size = hostHeapOverride.load() ? hostHeapOverride.load() : hostHeapSize();
+  // Under AddressSanitizer mallinfo2() reports nothing in use, so the PSRAM
+  // share can exceed it
+  size_t allocated = mallinfo2().uordblks;
+  size_t psram = hostPsramUsed.load();
+  size_t used = (allocated > psram) ? allocated - psram : 0;
+  used = (used > hostHeapBaseline) ? used - hostHeapBaseline : 0;
+  return (used >= size) ? 0 : (uint32_t)(size - used);
+}
+
+uint32_t EspClass::getPsramSize() {
+  return hostPsramSize();
+}
+
+uint32_t EspClass::getFreePsram() {
+  size_t used = hostPsramUsed.load();
+  return (used >= hostPsramSize()) ? 0 : (uint32_t)(hostPsramSize() - used);
+}
+
+bool psramFound() {
+  return hostPsramSize() > 0;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+  if (!(caps & MALLOC_CAP_SPIRAM)) {
+    return malloc(size);
+  }
+  
+  std::lock_guard<std::mutex> guard(hostPsramMutex);
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    return nullptr;
+  }
+  size_t bytes = hostBlockBytes(ptr);
+  if (hostPsramUsed.load() + bytes > hostPsramSize()) {
+    free(ptr);
+    return nullptr;
+  }
+  hostPsramBlocks()[ptr] = bytes;
+  hostPsramUsed += bytes;
+  return ptr;
+}
+
+void heap_caps_free(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(hostPsramMutex);
+    auto block = hostPsramBlocks().find(ptr);
+    if (block != hostPsramBlocks().end()) {
+      hostPsramUsed -= block->second;
+      hostPsramBlocks().erase(block);
+    }
+  }
+  free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  return (caps & MALLOC_CAP_SPIRAM) ? ESP.getFreePsram() : ESP.getFreeHeap();
+}
+
+bool esp_ptr_external_ram(const void* ptr) {
+  if (ptr == nullptr || hostPsramUsed.load() == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(hostPsramMutex);
+  return hostPsramBlocks().count(ptr) != 0;
+}
+
+EspClass ESP;
+
+// ---------------------------------------------------------------------------
+// String
+// ---------------------------------------------------------------------------
+
+static char* hostStrdup(const char* str) {
+  size_t len = strlen(str);
+  char* copy = (char*)malloc(len + 1);
+  memcpy(copy, str, len + 1);
+  return copy;
+}
+
+String::String(const char* str) : _buffer(hostStrdup(str ? str : "")) {}
+
+String::String(const String& other) : _buffer(hostStrdup(other._buffer)) {}
+
+String::String(char c, int count) {
+  if (count < 0) {
+    count = 0;
+  }
+  _buffer = (char*)malloc(count + 1);
+  memset(_buffer, c, count);
+  _buffer[count] = '\0';
+}
+
+String::String(int value) {
+  char tmp[16];
+  snprintf(tmp, sizeof(tmp), "%d", value);
+  _buffer = hostStrdup(tmp);
+}
+
+String::~String() {
+  free(_buffer);
+}
+
+String& String::operator=(const String& other) {
+  if (this != &other) {
+    char* copy = hostStrdup(other._buffer);
+    free(_buffer);
+    _buffer = copy;
+  }
+  return *this;
+}
+
+String& String::operator+=(const char* str) {
+  if (str == nullptr) {
+    return *this;
+  }
+  size_t a = strlen(_buffer);
+  size_t b = strlen(str);
+  char* joined = (char*)malloc(a + b + 1);
+  memcpy(joined, _buffer, a);
+  memcpy(joined + a, str, b + 1);
+  free(_buffer);
+  _buffer = joined;
+  return *this;
+}
+
+String& String::operator+=(const String& other) {
+  return *this += other.c_str();
+}
+
+String operator+(const String& lhs, const String& rhs) {
+  String result(lhs);
+  result += rhs;
+  return result;
+}
+
+String operator+(const char* lhs, const String& rhs) {
+  String result(lhs);
+  result += rhs;
+  return result;
+}
+
+// ---------------------------------------------------------------------------
+// Print / Stream / Serial
+// ---------------------------------------------------------------------------
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && write(buffer[n]) == 1) {
+    n++;
+  }
+  return n;
+}
+
+size_t Print::print(int value) { return printf("%d", value); }
+size_t Print::print(unsigned int value) { return printf("%u", value); }
+size_t Print::print(long value) { return printf("%ld", value); }
+size_t Print::print(unsigned long value) { return printf("%lu", value); }
+size_t Print::print(double value, int digits) { return printf("%.*f", digits, value); }
+
+size_t Print::printf(const char* format, ...) {
+  char stackBuffer[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(stackBuffer, sizeof(stackBuffer), format, args);
+  va_end(args);
+  if (len < 0) {
+    return 0;
+  }
+  if ((size_t)len < sizeof(stackBuffer)) {
+    return write((const uint8_t*)stackBuffer, len);
+  }
+  char* heapBuffer = (char*)malloc(len + 1);
+  if (heapBuffer == nullptr) {
+    return 0;
+  }
+  va_start(args, format);
+  vsnprintf(heapBuffer, len + 1, format, args);
+  va_end(args);
+  size_t written = write((const uint8_t*)heapBuffer, len);
+  free(heapBuffer);
+  return written;
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+  size_t n = 0;
+  while (n < length) {
+    int c = read();
+    if (c < 0) {
+      break;
+    }
+    buffer[n++] = (uint8_t)c;
+  }
+  return n;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+HardwareSerial Serial;
+
+// ---------------------------------------------------------------------------
+// FreeRTOS semaphores
+// ---------------------------------------------------------------------------
+
+struct HostSemaphore {
+  std::mutex mutex;
+  std::condition_variable available;
+  UBaseType_t count;
+  UBaseType_t maxCount;
+};
+
+static SemaphoreHandle_t hostCreateSemaphore(UBaseType_t maxCount, UBaseType_t initialCount) {
+  HostSemaphore* semaphore = new HostSemaphore();
+  semaphore->count = initialCount;
+  semaphore->maxCount = maxCount;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return hostCreateSemaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return hostCreateSemaphore(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  return hostCreateSemaphore(maxCount, initialCount);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+  if (semaphore == nullptr) {
+    return pdFALSE;
+  }
+  std::unique_lock<std::mutex> guard(semaphore->mutex);
+  if (ticksToWait == portMAX_DELAY) {
+    semaphore->available.wait(guard, [semaphore] { return semaphore->count > 0; });
+  } else if (!semaphore->available.wait_for(guard, std::chrono::milliseconds(ticksToWait),
+                                            [semaphore] { return semaphore->count > 0; })) {
+    return pdFALSE;
+  }
+  semaphore->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  if (semaphore == nullptr) {
+    return pdFALSE;
+  }
+  {
+    std::lock_guard<std::mutex> guard(semaphore->mutex);
+    if (semaphore->count >= semaphore->maxCount) {
+      return pdFALSE;
+    }
+    semaphore->count++;
+  }
+  semaphore->available.notify_one();
+  return pdTRUE;
+}
+
+// ---------------------------------------------------------------------------
+// FreeRTOS tasks
+// ---------------------------------------------------------------------------
+
+struct HostTaskExit {};
+
+static thread_local bool hostInTask = false;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskCode, const char* name, uint32_t stackDepth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* createdTask,
+                                   BaseType_t coreId) {
+  (void)name;
+  (void)stackDepth;
+  (void)priority;
+  (void)coreId;
+  std::thread worker([taskCode, parameters] {
+    hostInTask = true;
+    try {
+      taskCode(parameters);
+    } catch (const HostTaskExit&) {
+      // vTaskDelete(NULL) unwinds back here
+    }
+  });
+  worker.detach();
+  if (createdTask != nullptr) {
+    *createdTask = nullptr;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t taskCode, const char* name, uint32_t stackDepth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* createdTask) {
+  return xTaskCreatePinnedToCore(taskCode, name, stackDepth, parameters, priority, createdTask,
+                                 tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr && hostInTask) {
+    throw HostTaskExit();
+  }
+}
+
+void vTaskDelay(TickType_t ticks) {
+  if (ticks == 0) {
+    std::this_thread::yield();
+    return;
+  }
+  delay(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+  return millis();
+}
+
+BaseType_t xPortGetCoreID() {
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Filesystem
+// ---------------------------------------------------------------------------
+
+namespace fs {
+
+File::File(FILE* handle) : _handle(handle, fclose) {}
+
+size_t File::write(uint8_t c) {
+  return _handle ? fwrite(&c, 1, 1, _handle.get()) : 0;
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  return _handle ? fwrite(buffer, 1, size, _handle.get()) : 0;
+}
+
+int File::available() {
+  if (!_handle) {
+    return 0;
+  }
+  size_t total = size();
+  size_t pos = position();
+  return (pos < total) ? (int)(total - pos) : 0;
+}
+
+int File::read() {
+  return _handle ? fgetc(_handle.get()) : -1;
+}
+
+int File::peek() {
+  if (!_handle) {
+    return -1;
+  }
+  int c = fgetc(_handle.get());
+  if (c != EOF) {
+    ungetc(c, _handle.get());
+  }
+  return c;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  return _handle ? fread(buffer, 1, size, _handle.get()) : 0;
+}
+
+void File::flush() {
+  if (_handle) {
+    fflush(_handle.get());
+  }
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!_handle) {
+    return false;
+  }
+  int whence = (mode == SeekCur) ? SEEK_CUR : (mode == SeekEnd) ? SEEK_END : SEEK_SET;
+  return fseek(_handle.get(), (long)pos, whence) == 0;
+}
+
+size_t File::position() const {
+  if (!_handle) {
+    return 0;
+  }
+  long pos = ftell(_handle.get());
+  return (pos < 0) ? 0 : (size_t)pos;
+}
+
+size_t File::size() const {
+  if (!_handle) {
+    return 0;
+  }
+  fflush(_handle.get());
+  struct stat info;
+  if (fstat(fileno(_handle.get()), &info) != 0) {
+    return 0;
+  }
+  return (size_t)info.st_size;
+}
+
+void File::close() {
+  _handle.reset();
+}
+
+FS::FS(const char* mountName) : _mountName(mountName) {}
+
+static const char* hostFsRoot() {
+  const char* env = getenv("IMDB_HOST_FS_ROOT");
+  return (env != nullptr && env[0] != '\0') ? env : "./imdb_host_fs";
+}
+
+// Create a directory and any missing parents
+static bool makeDirectories(char* dir) {
+  for (char* p = dir + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      bool ok = ::mkdir(dir, 0755) == 0 || errno == EEXIST;
+      *p = '/';
+      if (!ok) {
+        return false;
+      }
+    }
+  }
+  return ::mkdir(dir, 0755) == 0 || errno == EEXIST;
+}
+
+bool FS::ensureMounted() const {
+  char dir[512];
+  int len = snprintf(dir, sizeof(dir), "%s/%s", hostFsRoot(), _mountName);
+  return len > 0 && (size_t)len < sizeof(dir) && makeDirectories(dir);
+}
+
+bool FS::hostPath(const char* path, char* out, size_t outSize) const {
+  if (path == nullptr || path[0] != '/' || path[1] == '\0') {
+    return false;
+  }
+  int len = snprintf(out, outSize, "%s/%s%s", hostFsRoot(), _mountName, path);
+  return len > 0 && (size_t)len < outSize;
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+  (void)create;
+  char full[512];
+  if (!ensureMounted() || !hostPath(path, full, sizeof(full))) {
+    return File();
+  }
+  // Arduino modes are text-style ("r", "w", "a"); always open in binary
+  char hostMode[4] = {mode[0], 'b', mode[1] == '+' ? '+' : '\0', '\0'};
+  FILE* handle = fopen(full, hostMode);
+  return handle ? File(handle) : File();
+}
+
+bool FS::exists(const char* path) {
+  char full[512];
+  struct stat info;
+  return hostPath(path, full, sizeof(full)) && stat(full, &info) == 0;
+}
+
+bool FS::remove(const char* path) {
+  char full[512];
+  return hostPath(path, full, sizeof(full)) && ::remove(full) == 0;
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo) {
+  char from[512];
+  char to[512];
+  return hostPath(pathFrom, from, sizeof(from)) && hostPath(pathTo, to, sizeof(to)) &&
+         ::rename(from, to) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  char full[512];
+  return ensureMounted() && hostPath(path, full, sizeof(full)) &&
+         (::mkdir(full, 0755) == 0 || errno == EEXIST);
+}
+
+bool SPIFFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles,
+                     const char* partitionLabel) {
+  (void)formatOnFail;
+  (void)basePath;
+  (void)maxOpenFiles;
+  (void)partitionLabel;
+  return ensureMounted();
+}
+
+bool SPIFFSFS::format() {
+  return ensureMounted();
+}
+
+} // namespace fs
+
+fs::SPIFFSFS SPIFFS;
@@ -0,0 +1,77 @@
+/*
+ * ESP32IMDB - Host (Linux) filesystem shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * fs::FS and fs::File on top of stdio. Every filesystem object maps its
+ * absolute paths below a host directory, so "/data.imdb" on SPIFFS becomes
+ * "<root>/spiffs/data.imdb". The root defaults to ./imdb_host_fs and can be
+ * changed with the IMDB_HOST_FS_ROOT environment variable.
+ */
+
+#ifndef IMDB_HOST_FS_H
+#define IMDB_HOST_FS_H
+
+#include <Arduino.h>
+#include <memory>
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+class File : public Stream {
+public:
+  File() {}
+  explicit File(FILE* handle);
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+  void flush() override;
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  operator bool() const { return _handle != nullptr; }
+
+private:
+  std::shared_ptr<FILE> _handle;
+};
+
+class FS {
+public:
+  explicit FS(const char* mountName);
+  virtual ~FS() {}
+
+  File open(const char* path, const char* mode = "r", bool create = false);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* pathFrom, const char* pathTo);
+  bool mkdir(const char* path);
+
+protected:
+  bool hostPath(const char* path, char* out, size_t outSize) const;
+  bool ensureMounted() const;
+  const char* _mountName;
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif // IMDB_HOST_FS_H
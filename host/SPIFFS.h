@@ -0,0 +1,31 @@
+/*
+ * ESP32IMDB - Host (Linux) SPIFFS shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ */
+
+#ifndef IMDB_HOST_SPIFFS_H
+#define IMDB_HOST_SPIFFS_H
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS {
+public:
+  SPIFFSFS() : FS("spiffs") {}
+  bool begin(bool formatOnFail = false, const char* basePath = "/spiffs",
+             uint8_t maxOpenFiles = 10, const char* partitionLabel = nullptr);
+  bool format();
+  size_t totalBytes() { return 1024 * 1024; }
+  size_t usedBytes() { return 0; }
+  void end() {}
+};
+
+} // namespace fs
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif // IMDB_HOST_SPIFFS_H
@@ -0,0 +1,26 @@
+/*
+ * ESP32IMDB - Host (Linux) sketch runner
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Runs an Arduino sketch on the host: setup() once, then loop() the number
+ * of times given by IMDB_HOST_LOOPS (default 0).
+ */
+
+#include <Arduino.h>
+
+void setup();
+void loop();
+
+int main() {
+  setup();
+  const char* env = getenv("IMDB_HOST_LOOPS");
+  long loops = (env != nullptr) ? atol(env) : 0;
+  for (long i = 0; i < loops; i++) {
+    loop();
+  }
+  fflush(stdout);
+  return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * ESP32IMDB - Host (Linux) heap capabilities shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * heap_caps_malloc() with two pools: internal RAM is the simulated heap
+ * behind ESP.getFreeHeap(), and MALLOC_CAP_SPIRAM allocations come from a
+ * simulated PSRAM of IMDB_HOST_PSRAM_BYTES (default 0, no PSRAM). Both pools
+ * are host memory, so only capacity is simulated, not PSRAM's access speed.
+ */
+
+#ifndef IMDB_HOST_ESP_HEAP_CAPS_H
+#define IMDB_HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+void* heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void* ptr);
+size_t heap_caps_get_free_size(uint32_t caps);
+
+#endif // IMDB_HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,15 @@
+/*
+ * ESP32IMDB - Host (Linux) memory region shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ */
+
+#ifndef IMDB_HOST_ESP_MEMORY_UTILS_H
+#define IMDB_HOST_ESP_MEMORY_UTILS_H
+
+// True for blocks from the simulated PSRAM (see esp_heap_caps.h)
+bool esp_ptr_external_ram(const void* ptr);
+
+#endif // IMDB_HOST_ESP_MEMORY_UTILS_H
@@ -0,0 +1,32 @@
+/*
+ * ESP32IMDB - Host (Linux) FreeRTOS shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Maps the FreeRTOS primitives used by the library and its sketches onto
+ * pthreads. One tick is one millisecond.
+ */
+
+#ifndef IMDB_HOST_FREERTOS_H
+#define IMDB_HOST_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define portNUM_PROCESSORS 2  // As on the ESP32; core ids are accepted and ignored
+
+#endif // IMDB_HOST_FREERTOS_H
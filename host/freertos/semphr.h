@@ -0,0 +1,24 @@
+/*
+ * ESP32IMDB - Host (Linux) FreeRTOS semaphore shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ */
+
+#ifndef IMDB_HOST_SEMPHR_H
+#define IMDB_HOST_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+struct HostSemaphore;
+typedef HostSemaphore* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif // IMDB_HOST_SEMPHR_H
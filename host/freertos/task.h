@@ -0,0 +1,32 @@
+/*
+ * ESP32IMDB - Host (Linux) FreeRTOS task shim
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Tasks run as detached threads. Priorities and core affinity are accepted
+ * but ignored; vTaskDelete() only supports deleting the calling task.
+ */
+
+#ifndef IMDB_HOST_TASK_H
+#define IMDB_HOST_TASK_H
+
+#include "FreeRTOS.h"
+
+struct HostTask;
+typedef HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+BaseType_t xTaskCreate(TaskFunction_t taskCode, const char* name, uint32_t stackDepth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* createdTask);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskCode, const char* name, uint32_t stackDepth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* createdTask,
+                                   BaseType_t coreId);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
+#define taskYIELD() vTaskDelay(0)
+
+#endif // IMDB_HOST_TASK_H
@@ -24,8 +24,72 @@
 #include "ESP32IMDB.h"
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include <esp_heap_caps.h>
+#if __has_include(<esp_memory_utils.h>)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>  // esp_ptr_external_ram() before ESP-IDF 5
+#endif
 #if IMDB_ENABLE_PERSISTENCE
 #include <SPIFFS.h>
+#include <freertos/task.h>
+#include "IMDBCrc32.h"
+
+// Write-ahead log entry types (first byte of each entry body)
+#define IMDB_WAL_ENTRY_INSERT 1
+#define IMDB_WAL_ENTRY_UPDATE 2
+#define IMDB_WAL_ENTRY_MATH 3
+#define IMDB_WAL_ENTRY_DELETE 4
+
+// Storage used until setStorage() selects another filesystem
+static IMDBFSStorage imdbSpiffsStorage(SPIFFS);
+#endif
+
+#if IMDB_ENABLE_STATS
+// Lock acquisitions made by one operation
+struct IMDBLockSample {
+  uint32_t acquisitions;
+  uint32_t contended;
+  uint32_t waitMicros;
+  uint32_t waitMaxMicros;
+  uint32_t holdMicros;
+  uint32_t holdMaxMicros;
+};
+
+// Times a public operation from construction to the end of its scope and adds
+// it to the stats. Rows and lock use are tallied here, unshared, while the
+// operation runs; unlock() finds the scope through imdbActiveStat, which is
+// per task, so the lock use is charged to the operation that held the lock.
+struct IMDBStatScope;
+static thread_local IMDBStatScope* imdbActiveStat = nullptr;
+
+struct IMDBStatScope {
+  ESP32IMDB* db;
+  IMDBStatOp op;
+  uint32_t startMicros;
+  uint32_t rowsScanned;
+  uint32_t rowsMatched;
+  IMDBLockSample lockSample;
+  IMDBStatScope* outer;
+
+  IMDBStatScope(ESP32IMDB* database, IMDBStatOp operation)
+      : db(database), op(operation), startMicros(micros()), rowsScanned(0), rowsMatched(0),
+        lockSample(), outer(imdbActiveStat) {
+    imdbActiveStat = this;
+  }
+
+  ~IMDBStatScope() {
+    imdbActiveStat = outer;
+    db->recordStat(op, micros() - startMicros, rowsScanned, rowsMatched, &lockSample);
+  }
+};
+
+#define IMDB_STAT_SCOPE(op) IMDBStatScope imdbStat(this, op)
+#define IMDB_STAT_ROWS(scanned, matched) (imdbStat.rowsScanned += (scanned), imdbStat.rowsMatched += (matched))
+#else
+#define IMDB_STAT_SCOPE(op)
+#define IMDB_STAT_ROWS(scanned, matched)
 #endif
 
 // Constructor
@@ -36,6 +100,76 @@ ESP32IMDB::ESP32IMDB() {
   _recordCount = 0;
   _recordCapacity = 0;
   _tableExists = false;
+  _fieldArena = nullptr;
+  _fieldArenaSlots = 0;
+  _fieldArenaLive = 0;
+  _stringArena = nullptr;
+  _stringArenaSize = 0;
+  _stringArenaLive = 0;
+  _stringArenaUsed = 0;
+  _nextRowId = 1;
+  _tableGeneration = 0;
+  memset(&_memory, 0, sizeof(_memory));
+  _memoryBudget = IMDB_MEMORY_BUDGET;
+  _heapSample = 0;
+  _heapSampleUsage = 0;
+  _heapSampleMillis = 0;
+  _heapSampleValid = false;
+  _placement = IMDB_PSRAM_PLACEMENT ? IMDB_PLACE_PSRAM : IMDB_PLACE_INTERNAL;
+  _boolIndex = nullptr;
+  _boolIndexWords = 0;
+  _boolIndexMaps = 0;
+  _boolIndexStale = false;
+  _filter = nullptr;
+  _filterMutex = xSemaphoreCreateMutex();
+  _zones = nullptr;
+  _zoneBlocks = 0;
+  _zoneColumns = 0;
+  _zoneMapStale = false;
+  _columnStats = nullptr;
+  _columnStatsChanges = 0;
+  _columnStatsStale = false;
+  _ringBase = nullptr;
+  _ringFields = nullptr;
+  _ringStrings = nullptr;
+  _ringCapacity = 0;
+  _ringStringColumns = 0;
+#if IMDB_ENABLE_PERSISTENCE
+  _storage = &imdbSpiffsStorage;
+  _walEnabled = false;
+  _walSnapshotFilename = nullptr;
+  _walLogFilename = nullptr;
+  _walBuffer = nullptr;
+  _walUsed = 0;
+  _walOversize = nullptr;
+  _walLogBytes = 0;
+  _walCommitInterval = 0;
+  _walLastCommit = 0;
+  _walCheckpointId = 0;
+  _walTaskRunning = false;
+  _saveInProgress = false;
+  _lastSaveResult = IMDB_OK;
+  _saveFilename = nullptr;
+  _lazyKey = -1;
+  _lazy = nullptr;
+  _loadTaskRunning = false;
+  _lastLoadResult = IMDB_OK;
+  _incFilename = nullptr;
+  _incBaseId = 0;
+  _incDeltaCount = 0;
+  _incNeedsBase = false;
+  _incDeleted = nullptr;
+  _incDeletedCount = 0;
+  _incDeletedCapacity = 0;
+#endif
+#if IMDB_ENABLE_STATS
+  memset(&_stats, 0, sizeof(_stats));
+  _statsResetMillis = millis();
+  _statsMutex = xSemaphoreCreateMutex();
+  _lockAcquiredMicros = 0;
+  _lockWaitMicros = 0;
+  _lockContended = false;
+#endif
   _mutex = xSemaphoreCreateMutex();
   // Note: If mutex creation fails, operations will still work but won't be thread-safe.
   // Call isThreadSafe() to check if mutex initialization succeeded.
@@ -43,33 +177,153 @@ ESP32IMDB::ESP32IMDB() {
 
 // Destructor
 ESP32IMDB::~ESP32IMDB() {
+#if IMDB_ENABLE_PERSISTENCE
+  // The background save task reports back into this object
+  while (_saveInProgress) {
+    vTaskDelay(1);
+  }
+  free(_saveFilename);
+  _saveFilename = nullptr;
+#endif
   dropTable();
+#if IMDB_ENABLE_PERSISTENCE
+  // Background tasks exit once they see the log or the table is gone; wait
+  // until they have also released the mutex
+  while (_walTaskRunning || _loadTaskRunning) {
+    vTaskDelay(1);
+  }
+  lock();
+  unlock();
+#endif
   if (_mutex != nullptr) {
     vSemaphoreDelete(_mutex);
   }
+  if (_filterMutex != nullptr) {
+    vSemaphoreDelete(_filterMutex);
+  }
+#if IMDB_ENABLE_STATS
+  if (_statsMutex != nullptr) {
+    vSemaphoreDelete(_statsMutex);
+  }
+#endif
+}
+
+// Take and give the membership filter mutex; nullptr if creation failed
+static inline void takeMutex(SemaphoreHandle_t mutex) {
+  if (mutex != nullptr) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+  }
+}
+
+static inline void giveMutex(SemaphoreHandle_t mutex) {
+  if (mutex != nullptr) {
+    xSemaphoreGive(mutex);
+  }
 }
 
 // Thread-safe lock
 void ESP32IMDB::lock() const {
   if (_mutex != nullptr) {
+#if IMDB_ENABLE_STATS
+    // An acquisition is contended when the lock is not free right away
+    uint32_t start = micros();
+    bool contended = xSemaphoreTake(_mutex, 0) != pdTRUE;
+    if (contended) {
+      xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+    _lockAcquiredMicros = micros();
+    _lockWaitMicros = _lockAcquiredMicros - start;
+    _lockContended = contended;
+#else
     xSemaphoreTake(_mutex, portMAX_DELAY);
+#endif
   }
 }
 
 // Thread-safe unlock
 void ESP32IMDB::unlock() const {
   if (_mutex != nullptr) {
+#if IMDB_ENABLE_STATS
+    // Read the hold before releasing; the next holder overwrites it
+    uint32_t waitMicros = _lockWaitMicros;
+    bool contended = _lockContended;
+    uint32_t holdMicros = micros() - _lockAcquiredMicros;
     xSemaphoreGive(_mutex);
+    recordLockUse(waitMicros, contended, holdMicros);
+#else
+    xSemaphoreGive(_mutex);
+#endif
+  }
+}
+
+// Check the memory budget and that free heap stays above the minimum limit,
+// also after reserveBytes more of internal RAM and bulkBytes more through
+// allocBulk() are allocated. ESP.getFreeHeap() walks heap metadata, so it is
+// not called on every check: a new sample is taken when
+// IMDB_HEAP_SAMPLE_INTERVAL_MS has passed, after an allocation failure, or
+// once the table has grown by half the headroom the last sample left above
+// IMDB_MIN_HEAP_BYTES. Far from the floor that is rare; close to it every
+// check samples, so the floor is never crossed on an estimate that
+// undercounts heap overhead or other tasks' allocations.
+bool ESP32IMDB::checkHeapLimit(size_t reserveBytes, size_t bulkBytes) const {
+  IMDBMemoryUsage memory;
+  getMemoryBreakdown(&memory);
+  if (_memoryBudget > 0 && (uint64_t)memory.total + reserveBytes + bulkBytes >= _memoryBudget) {
+    return false;
   }
+  
+  // ESP.getFreeHeap() is internal RAM; table memory in PSRAM doesn't use it,
+  // and neither does bulk storage that PSRAM has room for
+  size_t usage = memory.total - memory.psram;
+  size_t internalBytes = reserveBytes;
+  if (_placement != IMDB_PLACE_PSRAM || heap_caps_get_free_size(MALLOC_CAP_SPIRAM) < bulkBytes) {
+    internalBytes += bulkBytes;
+  }
+  
+  uint32_t now = millis();
+  int64_t headroom = (int64_t)_heapSample - IMDB_MIN_HEAP_BYTES;
+  int64_t grown = (int64_t)usage - (int64_t)_heapSampleUsage + (int64_t)internalBytes;
+  if (!_heapSampleValid || now - _heapSampleMillis >= IMDB_HEAP_SAMPLE_INTERVAL_MS ||
+      grown * 2 >= headroom) {
+    _heapSample = ESP.getFreeHeap();
+    _heapSampleUsage = usage;
+    _heapSampleMillis = now;
+    _heapSampleValid = true;
+    grown = (int64_t)internalBytes;
+  }
+  return (int64_t)_heapSample - grown >= IMDB_MIN_HEAP_BYTES;
+}
+
+// An allocation failed: the next check samples the heap again
+void ESP32IMDB::heapAllocationFailed() const {
+  _heapSampleValid = false;
+}
+
+// Limit the memory the table may use (bytes, 0 = no limit besides IMDB_MIN_HEAP_BYTES)
+void ESP32IMDB::setMemoryBudget(size_t bytes) {
+  lock();
+  _memoryBudget = bytes;
+  unlock();
+}
+
+size_t ESP32IMDB::getMemoryBudget() const {
+  return _memoryBudget;
+}
+
+// Choose where field arrays and strings allocated from now on are placed
+void ESP32IMDB::setPlacement(IMDBPlacement placement) {
+  lock();
+  _placement = placement;
+  unlock();
 }
 
-// Check if heap is above minimum limit
-bool ESP32IMDB::checkHeapLimit() const {
-  return ESP.getFreeHeap() >= IMDB_MIN_HEAP_BYTES;
+IMDBPlacement ESP32IMDB::getPlacement() const {
+  return _placement;
 }
 
-// Create a new table
-IMDBResult ESP32IMDB::createTable(const IMDBColumn* columns, uint8_t columnCount) {
+// Create a new table, as a ring buffer when ringCapacity is above 0
+IMDBResult ESP32IMDB::createTable(const IMDBColumn* columns, uint8_t columnCount,
+                                  uint32_t ringCapacity) {
   lock();
   
   if (_tableExists) {
@@ -89,6 +343,7 @@ IMDBResult ESP32IMDB::createTable(const IMDBColumn* columns, uint8_t columnCount
   
   _columns = (IMDBColumn*)malloc(sizeof(IMDBColumn) * columnCount);
   if (_columns == nullptr) {
+    heapAllocationFailed();
     unlock();
     return IMDB_ERROR_OUT_OF_MEMORY;
   }
@@ -101,6 +356,7 @@ IMDBResult ESP32IMDB::createTable(const IMDBColumn* columns, uint8_t columnCount
   _recordCapacity = 10;
   _records = (IMDBRecord*)malloc(sizeof(IMDBRecord) * _recordCapacity);
   if (_records == nullptr) {
+    heapAllocationFailed();
     free(_columns);
     _columns = nullptr;
     _tableExists = false;
@@ -109,6 +365,18 @@ IMDBResult ESP32IMDB::createTable(const IMDBColumn* columns, uint8_t columnCount
   }
   
   _recordCount = 0;
+  _nextRowId = 1;
+  memoryAllocated(&_memory.directory, sizeof(IMDBColumn) * columnCount, _columns);
+  memoryAllocated(&_memory.directory, sizeof(IMDBRecord) * _recordCapacity, _records);
+  
+  if (ringCapacity > 0) {
+    IMDBResult result = enterRingMode(ringCapacity);
+    if (result != IMDB_OK) {
+      discardTable();
+      unlock();
+      return result;
+    }
+  }
   
   unlock();
   return IMDB_OK;
@@ -123,450 +391,5942 @@ IMDBResult ESP32IMDB::dropTable() {
     return IMDB_ERROR_NO_TABLE;
   }
   
+#if IMDB_ENABLE_PERSISTENCE
+  // Commit what is buffered so the log matches the last state; the files stay on disk
+  if (_walEnabled) {
+    walFlush();
+    releaseWAL();
+  }
+#endif
+  
+  discardTable();
+  
+  unlock();
+  return IMDB_OK;
+}
+
+// Free all records, arenas and the schema (caller holds the lock)
+void ESP32IMDB::discardTable() {
   // Free all records
-  for (int i = 0; i < _recordCount; i++) {
-    freeRecord(&_records[i]);
+  if (_records != nullptr) {
+    for (int i = 0; i < _recordCount; i++) {
+      freeRecord(&_records[i]);
+    }
   }
   
-  // Free arrays
-  free(_records);
+  // Free arrays; a ring buffer's directory starts at _ringBase
+  free((_ringBase != nullptr) ? _ringBase : _records);
   free(_columns);
+  heap_caps_free(_ringFields);
+  heap_caps_free(_ringStrings);
+  
+  // Arenas are normally released with their last record; this covers
+  // records whose fields were never attached (failed load)
+  heap_caps_free(_fieldArena);
+  heap_caps_free(_stringArena);
+  releaseBoolIndex();
+  releaseZoneMap();
+  releaseFilter();
+  if (_columnStats != nullptr) {
+    memoryFreed(&_memory.indexes, sizeof(IMDBColumnStats) * _columnCount, _columnStats);
+    free(_columnStats);
+    _columnStats = nullptr;
+  }
+  _columnStatsChanges = 0;
+  _columnStatsStale = false;
   
   _records = nullptr;
   _columns = nullptr;
+  _ringBase = nullptr;
+  _ringFields = nullptr;
+  _ringStrings = nullptr;
+  _ringCapacity = 0;
+  _ringStringColumns = 0;
+  _fieldArena = nullptr;
+  _fieldArenaSlots = 0;
+  _fieldArenaLive = 0;
+  _stringArena = nullptr;
+  _stringArenaSize = 0;
+  _stringArenaLive = 0;
+  _stringArenaUsed = 0;
   _recordCount = 0;
   _recordCapacity = 0;
   _columnCount = 0;
   _tableExists = false;
+  _nextRowId = 1;
+  _tableGeneration++;  // Tells a streaming export or import the table is gone
   
-  unlock();
-  return IMDB_OK;
+#if IMDB_ENABLE_PERSISTENCE
+  // An unfinished lazy load is abandoned; the new table picks its own key
+  releaseLazyLoad();
+  _lazyKey = -1;
+  
+  // Incremental saves start over with a new table
+  resetIncrementalTracking();
+  free(_incFilename);
+  _incFilename = nullptr;
+  _incBaseId = 0;
+  _incDeltaCount = 0;
+  _incNeedsBase = false;
+#endif
+  
+  // Everything counted belonged to the table
+  memset(&_memory, 0, sizeof(_memory));
 }
 
 // Free a single record's allocated memory
 void ESP32IMDB::freeRecord(IMDBRecord* record) {
+  if (ringOwns(record->fields)) {
+    return;  // Ring storage stays with its entry
+  }
   if (record->fields != nullptr) {
     // Free string fields
     if (_columns != nullptr) {
       for (int i = 0; i < _columnCount; i++) {
         if (_columns[i].type == IMDB_TYPE_STRING && record->fields[i].stringValue != nullptr) {
-          free(record->fields[i].stringValue);
+          releaseString(record->fields[i].stringValue);
         }
       }
     }
-    free(record->fields);
+    releaseFields(record->fields);
     record->fields = nullptr;
   }
 }
 
-// Find column index by name
-int ESP32IMDB::findColumnIndex(const char* columnName) const {
-  for (int i = 0; i < _columnCount; i++) {
-    if (strcmp(_columns[i].name, columnName) == 0) {
-      return i;
+// Free a record's field array, which is either its own heap block or a slot in the load arena
+void ESP32IMDB::releaseFields(IMDBFieldValue* fields) {
+  if (ringOwns(fields)) {
+    return;
+  }
+  if (_fieldArena != nullptr && fields >= _fieldArena && fields < _fieldArena + _fieldArenaSlots) {
+    if (--_fieldArenaLive == 0) {
+      memoryFreed(&_memory.fragmentation, sizeof(IMDBFieldValue) * _fieldArenaSlots, _fieldArena);
+      heap_caps_free(_fieldArena);
+      _fieldArena = nullptr;
+      _fieldArenaSlots = 0;
     }
+    return;
   }
-  return -1;
+  heap_caps_free(fields);
 }
 
-// Copy field value with proper memory allocation for strings
-IMDBResult ESP32IMDB::copyFieldValue(IMDBFieldValue* dest, const void* src, IMDBDataType type) {
-  switch (type) {
-    case IMDB_TYPE_INT32:
-      dest->int32Value = *(const int32_t*)src;
-      break;
-      
-    case IMDB_TYPE_MAC:
-      memcpy(dest->macAddress, src, 6);
-      break;
-      
-    case IMDB_TYPE_STRING: {
-      const char* srcStr = *(const char**)src;
-      if (srcStr == nullptr) {
-        return IMDB_ERROR_INVALID_VALUE;
-      }
-      size_t len = strlen(srcStr);
-      if (len > IMDB_MAX_STRING_LENGTH) {
-        len = IMDB_MAX_STRING_LENGTH;
-      }
-      // Allocate only needed space (compacted storage)
-      dest->stringValue = (char*)malloc(len + 1);
-      if (dest->stringValue == nullptr) {
-        return IMDB_ERROR_OUT_OF_MEMORY;
-      }
-      strncpy(dest->stringValue, srcStr, len);
-      dest->stringValue[len] = '\0';
-      break;
+// Free a string value, which is either its own heap block or part of the load arena
+void ESP32IMDB::releaseString(char* str) {
+  if (ringOwns(str)) {
+    return;
+  }
+  if (_stringArena != nullptr && str >= _stringArena && str < _stringArena + _stringArenaSize) {
+    if (--_stringArenaLive == 0) {
+      _memory.strings -= _stringArenaUsed;
+      _memory.fragmentation += _stringArenaUsed;
+      memoryFreed(&_memory.fragmentation, _stringArenaSize, _stringArena);
+      heap_caps_free(_stringArena);
+      _stringArena = nullptr;
+      _stringArenaSize = 0;
+      _stringArenaUsed = 0;
     }
-    
-    case IMDB_TYPE_EPOCH:
-      dest->epochValue = *(const uint32_t*)src;
-      break;
-      
-    case IMDB_TYPE_BOOL:
-      dest->boolValue = *(const bool*)src;
-      break;
-      
-    case IMDB_TYPE_FLOAT:
-      dest->floatValue = *(const float*)src;
-      break;
+    return;
   }
-  
-  return IMDB_OK;
+  heap_caps_free(str);
 }
 
-// Check if a record is expired
-bool ESP32IMDB::isRecordExpired(uint32_t expiryMillis) const {
-  if (expiryMillis == 0) {
-    return false;  // No expiry set
+// Memory accounting
+//
+// Every allocation the table holds is counted in one IMDBMemoryUsage category
+// when it is made and removed when it is freed, so reading the totals costs
+// nothing. A load arena is counted as fragmentation when it is allocated. Each
+// record placed in the field arena moves its bytes to fieldArrays, and moves
+// them back when it is removed. A string copied into the string arena moves
+// its bytes to strings once, however many records share it, and they stay
+// there until the arena is freed as a whole.
+
+// Field arrays and strings go to PSRAM first when psram is set; without
+// PSRAM, or with it full, they fall back to internal RAM
+static void* imdbAllocBulk(size_t bytes, bool psram) {
+  if (psram) {
+    void* ptr = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (ptr != nullptr) {
+      return ptr;
+    }
   }
-  
-  uint32_t currentMillis = millis();
-  
-  // Cast to int32_t to handle wraparound
-  return (int32_t)(currentMillis - expiryMillis) >= 0;
+  return malloc(bytes);
 }
 
-// Purge expired records
-void ESP32IMDB::purgeExpiredRecords() {
-  lock();
-  
-  if (!_tableExists) {
-    unlock();
+// Heap overhead of one allocation: block header plus padding to 4 bytes
+static size_t imdbAllocSlack(size_t bytes) {
+  return IMDB_HEAP_BLOCK_OVERHEAD + (((bytes + 3) & ~(size_t)3) - bytes);
+}
+
+// Allocation of bytes at ptr added to category
+void ESP32IMDB::memoryAllocated(size_t* category, size_t bytes, const void* ptr) {
+  size_t slack = imdbAllocSlack(bytes);
+  *category += bytes;
+  _memory.allocatorSlack += slack;
+  if (esp_ptr_external_ram(ptr)) {
+    _memory.psram += bytes + slack;
+  }
+}
+
+void ESP32IMDB::memoryFreed(size_t* category, size_t bytes, const void* ptr) {
+  size_t slack = imdbAllocSlack(bytes);
+  *category -= bytes;
+  _memory.allocatorSlack -= slack;
+  if (esp_ptr_external_ram(ptr)) {
+    _memory.psram -= bytes + slack;
+  }
+}
+
+// Allocate field arrays and strings according to the placement policy. Free
+// them with heap_caps_free().
+void* ESP32IMDB::allocBulk(size_t bytes) const {
+  return imdbAllocBulk(bytes, _placement == IMDB_PLACE_PSRAM);
+}
+
+// Count a string entering (added) or leaving the table; call before it is
+// freed. Ring storage is counted as a whole when it is allocated, and load
+// arena strings by arenaStringLoaded().
+void ESP32IMDB::trackString(const char* str, bool added) {
+  if (str == nullptr || ringOwns(str)) {
+    return;
+  }
+  if (_stringArena != nullptr && str >= _stringArena && str < _stringArena + _stringArenaSize) {
+    return;
+  }
+  size_t bytes = strlen(str) + 1;
+  if (added) {
+    memoryAllocated(&_memory.strings, bytes, str);
+  } else {
+    memoryFreed(&_memory.strings, bytes, str);
+  }
+}
+
+// Count a string of bytes (terminator included) just copied into the load arena
+void ESP32IMDB::arenaStringLoaded(size_t bytes) {
+  _stringArenaUsed += bytes;
+  _memory.strings += bytes;
+  _memory.fragmentation -= bytes;
+}
+
+// Count a record's fields and strings entering or leaving the table
+void ESP32IMDB::trackRecord(const IMDBRecord* record, bool added) {
+  if (record->fields == nullptr || ringOwns(record->fields)) {
     return;
   }
+  size_t bytes = sizeof(IMDBFieldValue) * _columnCount;
+  if (_fieldArena != nullptr && record->fields >= _fieldArena &&
+      record->fields < _fieldArena + _fieldArenaSlots) {
+    _memory.fieldArrays += added ? bytes : -bytes;
+    _memory.fragmentation += added ? -bytes : bytes;
+  } else if (added) {
+    memoryAllocated(&_memory.fieldArrays, bytes, record->fields);
+  } else {
+    memoryFreed(&_memory.fieldArrays, bytes, record->fields);
+  }
   
-  for (int i = 0; i < _recordCount; i++) {
-    if (_records[i].isValid && isRecordExpired(_records[i].expiryMillis)) {
-      freeRecord(&_records[i]);
-      _records[i].isValid = false;
+  for (int i = 0; i < _columnCount; i++) {
+    if (_columns[i].type == IMDB_TYPE_STRING) {
+      trackString(record->fields[i].stringValue, added);
     }
   }
-  
-  compactRecords();
-  
-  unlock();
 }
 
-// Compact records array by removing invalid entries
-void ESP32IMDB::compactRecords() {
-  int writeIndex = 0;
-  for (int readIndex = 0; readIndex < _recordCount; readIndex++) {
-    if (_records[readIndex].isValid) {
-      if (writeIndex != readIndex) {
-        _records[writeIndex] = _records[readIndex];
-        // Clear the old slot to prevent stale pointers
-        _records[readIndex].fields = nullptr;
-        _records[readIndex].isValid = false;
-      }
-      writeIndex++;
-    }
+// BOOL column bitmap index
+//
+// Each bitmap holds one bit per record slot. countWhere() on a BOOL column ANDs
+// the valid bitmap with the column's bitmap (or its complement) and counts 32
+// records per word; only records with a TTL still get an expiry check. Other
+// lookups on a BOOL column jump from one set bit to the next instead of
+// comparing every record.
+
+#define IMDB_BOOL_MAP_VALID 0
+#define IMDB_BOOL_MAP_TTL 1
+#define IMDB_BOOL_MAP_FIRST 2  // Bitmap of the first BOOL column
+
+// Position of a record slot in the BOOL index and zone map. Ordinary tables
+// index by slot. A ring buffer indexes by place in its storage, which stays
+// put while the window slides, so evicting a row only touches its own bits
+// and zone block.
+int ESP32IMDB::indexPosition(int slot) const {
+  if (_ringCapacity == 0) {
+    return slot;
   }
-  _recordCount = writeIndex;
-  
-  // Shrink array if significantly underutilized (less than 50% used)
-  if (_recordCapacity > 10 && _recordCount < _recordCapacity / 2) {
-    shrinkRecordArray();
+  return (int)(((size_t)(_records - _ringBase) + slot) % _ringCapacity);
+}
+
+// Record slot at an index position; slots from _recordCount on are unused
+int ESP32IMDB::indexSlot(int position) const {
+  if (_ringCapacity == 0) {
+    return position;
   }
+  int start = indexPosition(0);
+  return (position >= start) ? position - start : position + (int)_ringCapacity - start;
 }
 
-// Grow the records array capacity
-IMDBResult ESP32IMDB::growRecordArray() {
+// Positions the indexes cover
+int ESP32IMDB::indexPositions() const {
+  return (_ringCapacity > 0) ? (int)_ringCapacity : _recordCount;
+}
+
+static inline void setIndexBit(uint32_t* word, uint32_t bit, bool set) {
+  if (set) {
+    *word |= bit;
+  } else {
+    *word &= ~bit;
+  }
+}
+
+// Make room for slots records in every bitmap, keeping the bits already set
+bool ESP32IMDB::reserveBoolIndex(int slots) {
+  size_t words = ((size_t)slots + 31) / 32;
+  if (_boolIndex != nullptr && words <= _boolIndexWords) {
+    return true;
+  }
   if (!checkHeapLimit()) {
-    return IMDB_ERROR_HEAP_LIMIT;
+    return false;
   }
   
-  // Check for potential overflow
-  if (_recordCapacity > INT_MAX / 2) {
-    return IMDB_ERROR_OUT_OF_MEMORY;
+  size_t newWords = _boolIndexWords * 2;
+  if (newWords < words) {
+    newWords = words;
   }
-  
-  int newCapacity = _recordCapacity * 2;
-  IMDBRecord* newRecords = (IMDBRecord*)realloc(_records, sizeof(IMDBRecord) * newCapacity);
-  if (newRecords == nullptr) {
-    return IMDB_ERROR_OUT_OF_MEMORY;
+  uint32_t* grown = (uint32_t*)calloc(newWords * _boolIndexMaps, sizeof(uint32_t));
+  if (grown == nullptr) {
+    heapAllocationFailed();
+    return false;
   }
   
-  // Initialize new slots to prevent undefined behavior
-  for (int i = _recordCapacity; i < newCapacity; i++) {
-    newRecords[i].fields = nullptr;
-    newRecords[i].isValid = false;
-    newRecords[i].expiryMillis = 0;
+  if (_boolIndex != nullptr) {
+    for (uint8_t map = 0; map < _boolIndexMaps; map++) {
+      memcpy(grown + map * newWords, _boolIndex + map * _boolIndexWords,
+             sizeof(uint32_t) * _boolIndexWords);
+    }
+    memoryFreed(&_memory.indexes, sizeof(uint32_t) * _boolIndexWords * _boolIndexMaps, _boolIndex);
+    free(_boolIndex);
   }
-  
-  _records = newRecords;
-  _recordCapacity = newCapacity;
-  return IMDB_OK;
+  memoryAllocated(&_memory.indexes, sizeof(uint32_t) * newWords * _boolIndexMaps, grown);
+  _boolIndex = grown;
+  _boolIndexWords = newWords;
+  return true;
 }
 
-// Shrink the records array capacity to reclaim memory
-IMDBResult ESP32IMDB::shrinkRecordArray() {
-  // Calculate new capacity (half of current, but at least 10 and enough for records)
-  int newCapacity = _recordCapacity / 2;
-  if (newCapacity < 10) {
-    newCapacity = 10;
+// Build the index from the records (caller holds the lock). Returns false when
+// the table has no BOOL column or there is no memory for it; lookups then scan.
+bool ESP32IMDB::rebuildBoolIndex() {
+  uint8_t boolColumns = 0;
+  for (int i = 0; i < _columnCount; i++) {
+    if (_columns[i].type == IMDB_TYPE_BOOL) {
+      boolColumns++;
+    }
   }
-  if (newCapacity < _recordCount) {
-    newCapacity = _recordCount;
+  if (boolColumns == 0) {
+    return false;
   }
   
-  // Don't bother if the reduction is minimal
-  if (newCapacity >= _recordCapacity) {
-    return IMDB_OK;
+  _boolIndexMaps = IMDB_BOOL_MAP_FIRST + boolColumns;
+  if (!reserveBoolIndex(indexPositions() > 32 ? indexPositions() : 32)) {
+    return false;
   }
   
-  IMDBRecord* newRecords = (IMDBRecord*)realloc(_records, sizeof(IMDBRecord) * newCapacity);
-  if (newRecords == nullptr) {
-    // Shrinking failed, but this is not critical - keep the larger array
-    return IMDB_OK;
+  memset(_boolIndex, 0, sizeof(uint32_t) * _boolIndexWords * _boolIndexMaps);
+  _boolIndexStale = false;
+  for (int i = 0; i < _recordCount; i++) {
+    indexBoolSlot(i);
   }
-  
-  _records = newRecords;
-  _recordCapacity = newCapacity;
-  return IMDB_OK;
+  return true;
+}
+
+void ESP32IMDB::releaseBoolIndex() {
+  if (_boolIndex != nullptr) {
+    memoryFreed(&_memory.indexes, sizeof(uint32_t) * _boolIndexWords * _boolIndexMaps, _boolIndex);
+    free(_boolIndex);
+  }
+  _boolIndex = nullptr;
+  _boolIndexWords = 0;
+  _boolIndexStale = false;
+}
+
+// Bring a record slot's bits up to date after it was added, changed or
+// invalidated. Does nothing until a lookup has built the index.
+void ESP32IMDB::indexBoolSlot(int slot) {
+  if (_boolIndex == nullptr || _boolIndexStale) {
+    return;
+  }
+  int position = indexPosition(slot);
+  if (!reserveBoolIndex(position + 1)) {
+    releaseBoolIndex();  // The next lookup tries to build it again
+    return;
+  }
+  
+  const IMDBRecord* record = &_records[slot];
+  bool valid = record->isValid && record->fields != nullptr;
+  uint32_t* word = _boolIndex + position / 32;
+  uint32_t bit = 1UL << (position % 32);
+  
+  setIndexBit(word + IMDB_BOOL_MAP_VALID * _boolIndexWords, bit, valid);
+  setIndexBit(word + IMDB_BOOL_MAP_TTL * _boolIndexWords, bit, valid && record->expiryMillis != 0);
+  size_t map = IMDB_BOOL_MAP_FIRST;
+  for (int i = 0; i < _columnCount; i++) {
+    if (_columns[i].type == IMDB_TYPE_BOOL) {
+      setIndexBit(word + map * _boolIndexWords, bit, valid && record->fields[i].boolValue);
+      map++;
+    }
+  }
+}
+
+// Bitmap of a BOOL column, building the index if needed; nullptr for other
+// column types or when the index can't be built
+const uint32_t* ESP32IMDB::boolIndexFor(int colIdx) {
+  if (_columns[colIdx].type != IMDB_TYPE_BOOL) {
+    return nullptr;
+  }
+  if ((_boolIndex == nullptr || _boolIndexStale) && !rebuildBoolIndex()) {
+    return nullptr;
+  }
+  size_t map = IMDB_BOOL_MAP_FIRST;
+  for (int i = 0; i < colIdx; i++) {
+    if (_columns[i].type == IMDB_TYPE_BOOL) {
+      map++;
+    }
+  }
+  return _boolIndex + map * _boolIndexWords;
+}
+
+// First position in [from, to) whose valid bit is set and whose bit in bits
+// equals the flipped value, or to if there is none
+static int nextIndexMatch(const uint32_t* valid, const uint32_t* bits, uint32_t flip, int from, int to) {
+  while (from < to) {
+    size_t word = from / 32;
+    uint32_t match = valid[word] & (bits[word] ^ flip) & (UINT32_MAX << (from % 32));
+    if (match != 0) {
+      int found = (int)(word * 32) + __builtin_ctz(match);
+      return found < to ? found : to;
+    }
+    from = (int)(word + 1) * 32;
+  }
+  return to;
+}
+
+// First valid record at or after slot whose bit in bits equals *whereValue.
+// Without a bitmap every slot is a candidate, so slot itself is returned.
+int ESP32IMDB::nextBoolMatch(const uint32_t* bits, const void* whereValue, int slot) const {
+  if (bits == nullptr) {
+    return slot;
+  }
+  if (slot >= _recordCount) {
+    return _recordCount;
+  }
+  const uint32_t* valid = _boolIndex + IMDB_BOOL_MAP_VALID * _boolIndexWords;
+  uint32_t flip = *(const bool*)whereValue ? 0 : UINT32_MAX;
+  
+  // A ring buffer's remaining slots may wrap around the end of its storage
+  int from = indexPosition(slot);
+  int end = from + (_recordCount - slot);
+  int limit = (_ringCapacity > 0 && end > (int)_ringCapacity) ? (int)_ringCapacity : end;
+  int found = nextIndexMatch(valid, bits, flip, from, limit);
+  if (found < limit) {
+    return slot + (found - from);
+  }
+  if (end > limit) {
+    found = nextIndexMatch(valid, bits, flip, 0, end - limit);
+    if (found < end - limit) {
+      return slot + (limit - from) + found;
+    }
+  }
+  return _recordCount;
+}
+
+// Unexpired valid records whose bit in bits equals *whereValue
+int32_t ESP32IMDB::countBoolMatches(const uint32_t* bits, const void* whereValue) const {
+  const uint32_t* valid = _boolIndex + IMDB_BOOL_MAP_VALID * _boolIndexWords;
+  const uint32_t* ttl = _boolIndex + IMDB_BOOL_MAP_TTL * _boolIndexWords;
+  uint32_t flip = *(const bool*)whereValue ? 0 : UINT32_MAX;
+  size_t words = ((size_t)indexPositions() + 31) / 32;
+  
+  int32_t cnt = 0;
+  for (size_t word = 0; word < words; word++) {
+    uint32_t match = valid[word] & (bits[word] ^ flip);
+    uint32_t expiring = match & ttl[word];
+    cnt += __builtin_popcount(match & ~expiring);
+    while (expiring != 0) {
+      int slot = indexSlot((int)(word * 32) + __builtin_ctz(expiring));
+      if (!isRecordExpired(_records[slot].expiryMillis)) {
+        cnt++;
+      }
+      expiring &= expiring - 1;
+    }
+  }
+  return cnt;
+}
+
+// Zone map
+//
+// For every block of IMDB_ZONE_MAP_BLOCK_ROWS record slots the map keeps the
+// lowest and highest value of each INT32, EPOCH and FLOAT column. A scan skips
+// blocks whose bounds can't satisfy the WHERE clause, and min()/max() skip
+// blocks that can't beat the value found so far. Inserts and updates widen the
+// bounds; deletes leave them wider than needed until compaction rebuilds the
+// map, which only costs skipping fewer blocks. Tables whose rows arrive in
+// order of a column, like a lastSeen timestamp, skip almost every block.
+
+struct IMDBZone {
+  uint32_t min;   // Raw bits of the column type; an empty block has min > max
+  uint32_t max;
+};
+
+static inline bool isZoneType(IMDBDataType type) {
+  return type == IMDB_TYPE_INT32 || type == IMDB_TYPE_EPOCH || type == IMDB_TYPE_FLOAT;
+}
+
+static inline float zoneFloat(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// a < b for values of type stored as raw bits (false if either float is NaN)
+static inline bool zoneLess(uint32_t a, uint32_t b, IMDBDataType type) {
+  switch (type) {
+    case IMDB_TYPE_INT32: return (int32_t)a < (int32_t)b;
+    case IMDB_TYPE_FLOAT: return zoneFloat(a) < zoneFloat(b);
+    default: return a < b;
+  }
+}
+
+static void clearZone(IMDBZone* zone, IMDBDataType type) {
+  float high = INFINITY;
+  float low = -INFINITY;
+  switch (type) {
+    case IMDB_TYPE_INT32:
+      zone->min = (uint32_t)INT32_MAX;
+      zone->max = (uint32_t)INT32_MIN;
+      break;
+    case IMDB_TYPE_FLOAT:
+      memcpy(&zone->min, &high, sizeof(high));
+      memcpy(&zone->max, &low, sizeof(low));
+      break;
+    default:
+      zone->min = UINT32_MAX;
+      zone->max = 0;
+      break;
+  }
+}
+
+static inline void widenZone(IMDBZone* zone, const IMDBFieldValue* field, IMDBDataType type) {
+  uint32_t value;
+  memcpy(&value, field, sizeof(value));  // INT32, EPOCH and FLOAT share the union's first 4 bytes
+  if (zoneLess(value, zone->min, type)) {
+    zone->min = value;
+  }
+  if (zoneLess(zone->max, value, type)) {
+    zone->max = value;
+  }
+}
+
+// Whether any value within the zone's bounds can satisfy "value op compareValue",
+// with the same semantics as compareValues()
+static bool zoneMayMatch(const IMDBZone* zone, IMDBDataType type, IMDBOperator op, const void* compareValue) {
+  if (op == IMDB_OP_NOT_EQUAL) {
+    return true;
+  }
+  uint32_t b;
+  memcpy(&b, compareValue, sizeof(b));
+  
+  if (type == IMDB_TYPE_FLOAT) {
+    float low = zoneFloat(zone->min);
+    float high = zoneFloat(zone->max);
+    float value = zoneFloat(b);
+    switch (op) {
+      case IMDB_OP_EQUAL: return high - value > -IMDB_FLOAT_EPSILON && low - value < IMDB_FLOAT_EPSILON;
+      case IMDB_OP_GREATER: return high > value;
+      case IMDB_OP_LESS: return low < value;
+      case IMDB_OP_GREATER_EQUAL: return high >= value;
+      case IMDB_OP_LESS_EQUAL: return low <= value;
+      default: return true;
+    }
+  }
+  
+  switch (op) {
+    case IMDB_OP_EQUAL: return !zoneLess(b, zone->min, type) && !zoneLess(zone->max, b, type);
+    case IMDB_OP_GREATER: return zoneLess(b, zone->max, type);
+    case IMDB_OP_LESS: return zoneLess(zone->min, b, type);
+    case IMDB_OP_GREATER_EQUAL: return !zoneLess(zone->max, b, type) && !zoneLess(zone->max, zone->min, type);
+    case IMDB_OP_LESS_EQUAL: return !zoneLess(b, zone->min, type) && !zoneLess(zone->max, zone->min, type);
+    default: return true;
+  }
+}
+
+// Make room for slots records, keeping the bounds already collected
+bool ESP32IMDB::reserveZoneMap(int slots) {
+  size_t blocks = ((size_t)slots + IMDB_ZONE_MAP_BLOCK_ROWS - 1) / IMDB_ZONE_MAP_BLOCK_ROWS;
+  if (_zones != nullptr && blocks <= _zoneBlocks) {
+    return true;
+  }
+  if (!checkHeapLimit()) {
+    return false;
+  }
+  
+  size_t newBlocks = _zoneBlocks * 2;
+  if (newBlocks < blocks) {
+    newBlocks = blocks;
+  }
+  IMDBZone* grown = (IMDBZone*)realloc(_zones, sizeof(IMDBZone) * newBlocks * _zoneColumns);
+  if (grown == nullptr) {
+    heapAllocationFailed();
+    return false;
+  }
+  if (_zones != nullptr) {
+    memoryFreed(&_memory.indexes, sizeof(IMDBZone) * _zoneBlocks * _zoneColumns, _zones);
+  }
+  memoryAllocated(&_memory.indexes, sizeof(IMDBZone) * newBlocks * _zoneColumns, grown);
+  _zones = grown;
+  _zoneBlocks = newBlocks;
+  return true;
+}
+
+// Build the map from the records (caller holds the lock). Returns false when
+// the table has no numeric column or there is no memory for it.
+bool ESP32IMDB::rebuildZoneMap() {
+  uint8_t zoneColumns = 0;
+  for (int i = 0; i < _columnCount; i++) {
+    if (isZoneType(_columns[i].type)) {
+      zoneColumns++;
+    }
+  }
+  if (zoneColumns == 0) {
+    return false;
+  }
+  
+  _zoneColumns = zoneColumns;
+  int positions = indexPositions();
+  if (!reserveZoneMap(positions > IMDB_ZONE_MAP_BLOCK_ROWS ? positions : IMDB_ZONE_MAP_BLOCK_ROWS)) {
+    return false;
+  }
+  
+  size_t blocks = ((size_t)positions + IMDB_ZONE_MAP_BLOCK_ROWS - 1) / IMDB_ZONE_MAP_BLOCK_ROWS;
+  for (size_t b = 0; b < blocks; b++) {
+    IMDBZone* zone = _zones + b * _zoneColumns;
+    for (int i = 0; i < _columnCount; i++) {
+      if (isZoneType(_columns[i].type)) {
+        clearZone(zone++, _columns[i].type);
+      }
+    }
+  }
+  
+  _zoneMapStale = false;
+  for (int i = 0; i < _recordCount; i++) {
+    zoneMapSlot(i);
+  }
+  return true;
+}
+
+void ESP32IMDB::releaseZoneMap() {
+  if (_zones != nullptr) {
+    memoryFreed(&_memory.indexes, sizeof(IMDBZone) * _zoneBlocks * _zoneColumns, _zones);
+    free(_zones);
+  }
+  _zones = nullptr;
+  _zoneBlocks = 0;
+  _zoneMapStale = false;
+}
+
+// Widen the bounds of a slot's block with its values after it was added or
+// changed. A record appended at the start of a block starts that block over;
+// a ring buffer's blocks start over through refreshZoneBlock() instead.
+// Does nothing until a lookup has built the map.
+void ESP32IMDB::zoneMapSlot(int slot) {
+  if (_zones == nullptr || _zoneMapStale) {
+    return;
+  }
+  int position = indexPosition(slot);
+  if (!reserveZoneMap(position + 1)) {
+    releaseZoneMap();  // The next lookup tries to build it again
+    return;
+  }
+  
+  IMDBZone* zone = _zones + (size_t)(position / IMDB_ZONE_MAP_BLOCK_ROWS) * _zoneColumns;
+  const IMDBRecord* record = &_records[slot];
+  bool blockStart = (_ringCapacity == 0 && slot % IMDB_ZONE_MAP_BLOCK_ROWS == 0 &&
+                     slot == _recordCount - 1);
+  for (int i = 0; i < _columnCount; i++) {
+    if (!isZoneType(_columns[i].type)) {
+      continue;
+    }
+    if (blockStart) {
+      clearZone(zone, _columns[i].type);
+    }
+    if (record->isValid && record->fields != nullptr) {
+      widenZone(zone, &record->fields[i], _columns[i].type);
+    }
+    zone++;
+  }
+}
+
+// Recompute the bounds of a slot's block from the valid records in it, after a
+// ring buffer evicted the record at slot
+void ESP32IMDB::refreshZoneBlock(int slot) {
+  if (_zones == nullptr || _zoneMapStale) {
+    return;
+  }
+  int first = indexPosition(slot) / IMDB_ZONE_MAP_BLOCK_ROWS * IMDB_ZONE_MAP_BLOCK_ROWS;
+  int last = first + IMDB_ZONE_MAP_BLOCK_ROWS;
+  if (last > indexPositions()) {
+    last = indexPositions();
+  }
+  
+  IMDBZone* zones = _zones + (size_t)(first / IMDB_ZONE_MAP_BLOCK_ROWS) * _zoneColumns;
+  IMDBZone* zone = zones;
+  for (int i = 0; i < _columnCount; i++) {
+    if (isZoneType(_columns[i].type)) {
+      clearZone(zone++, _columns[i].type);
+    }
+  }
+  for (int position = first; position < last; position++) {
+    int recordSlot = indexSlot(position);
+    if (recordSlot >= _recordCount || !_records[recordSlot].isValid) {
+      continue;
+    }
+    zone = zones;
+    for (int i = 0; i < _columnCount; i++) {
+      if (isZoneType(_columns[i].type)) {
+        widenZone(zone++, &_records[recordSlot].fields[i], _columns[i].type);
+      }
+    }
+  }
+}
+
+// Bounds of slot's block within a column's zones from zoneMapFor()
+const IMDBZone* ESP32IMDB::zoneOfSlot(const IMDBZone* zones, int slot) const {
+  return zones + (size_t)(indexPosition(slot) / IMDB_ZONE_MAP_BLOCK_ROWS) * _zoneColumns;
+}
+
+// First slot after slot's block
+int ESP32IMDB::nextZoneBlock(int slot) const {
+  int position = indexPosition(slot);
+  int blockEnd = (position / IMDB_ZONE_MAP_BLOCK_ROWS + 1) * IMDB_ZONE_MAP_BLOCK_ROWS;
+  if (_ringCapacity > 0 && blockEnd > (int)_ringCapacity) {
+    blockEnd = (int)_ringCapacity;  // A ring's last block may be short
+  }
+  return slot + (blockEnd - position);
+}
+
+// Records in zone block b
+int ESP32IMDB::zoneBlockRows(int block) const {
+  int first = block * IMDB_ZONE_MAP_BLOCK_ROWS;
+  int last = first + IMDB_ZONE_MAP_BLOCK_ROWS;
+  if (_ringCapacity == 0) {
+    int rows = _recordCount - first;
+    return (rows < 0) ? 0 : (rows < IMDB_ZONE_MAP_BLOCK_ROWS) ? rows : IMDB_ZONE_MAP_BLOCK_ROWS;
+  }
+  
+  // A ring's records fill positions from start on and may wrap around to 0
+  int start = indexPosition(0);
+  int end = start + _recordCount;
+  int capacity = (int)_ringCapacity;
+  int rows = 0;
+  int from = (first > start) ? first : start;
+  int to = (last < end) ? last : end;
+  if (to > from) {
+    rows += to - from;
+  }
+  if (end > capacity) {
+    to = (last < end - capacity) ? last : end - capacity;
+    if (to > first) {
+      rows += to - first;
+    }
+  }
+  return rows;
+}
+
+// Bounds of a numeric column in block 0, building the map if needed; block b
+// is _zoneColumns entries further on per block. nullptr for other column types.
+const IMDBZone* ESP32IMDB::zoneMapFor(int colIdx) {
+  if (!isZoneType(_columns[colIdx].type)) {
+    return nullptr;
+  }
+  if ((_zones == nullptr || _zoneMapStale) && !rebuildZoneMap()) {
+    return nullptr;
+  }
+  const IMDBZone* zone = _zones;
+  for (int i = 0; i < colIdx; i++) {
+    if (isZoneType(_columns[i].type)) {
+      zone++;
+    }
+  }
+  return zone;
+}
+
+// Access path of a WHERE clause
+//
+// Loops over records matching a WHERE clause start at nextCandidate(scan, 0)
+// and continue from nextCandidate(scan, i + 1). A BOOL column jumps between
+// the bits of its index, a numeric column skips blocks its zone map rules out,
+// and any other column visits every slot. The loop still compares each
+// candidate, so the index only has to be a superset of the matches.
+
+struct IMDBScan {
+  int column;
+  IMDBOperator op;
+  const void* value;
+  const uint32_t* boolBits;  // BOOL index bitmap of the column, or nullptr
+  const IMDBZone* zones;     // Zone map of the column, or nullptr
+};
+
+void ESP32IMDB::prepareScan(IMDBScan* scan, int colIdx, IMDBOperator op, const void* value) {
+  scan->column = colIdx;
+  scan->op = op;
+  scan->value = value;
+  scan->boolBits = boolIndexFor(colIdx);
+  scan->zones = zoneMapFor(colIdx);
+}
+
+int ESP32IMDB::nextCandidate(const IMDBScan* scan, int slot) const {
+  if (scan->boolBits != nullptr) {
+    return nextBoolMatch(scan->boolBits, scan->value, slot);
+  }
+  if (scan->zones != nullptr) {
+    IMDBDataType type = _columns[scan->column].type;
+    while (slot < _recordCount) {
+      if (zoneMayMatch(zoneOfSlot(scan->zones, slot), type, scan->op, scan->value)) {
+        break;
+      }
+      slot = nextZoneBlock(slot);
+    }
+    if (slot > _recordCount) {
+      slot = _recordCount;
+    }
+  }
+  return slot;
+}
+
+// Membership filter
+//
+// A cuckoo filter over one column. Each value is reduced to a 16-bit
+// fingerprint kept in one of two buckets of 4 slots, so a lookup reads at most
+// 8 slots and a miss costs two hashes instead of a table scan. Unlike a Bloom
+// filter it supports removal, so deletes and purges keep it exact apart from
+// fingerprint collisions (about 1 lookup in 8000 for an absent value).
+
+#define IMDB_FILTER_SLOTS 4          // Fingerprints per bucket
+#define IMDB_FILTER_MAX_KICKS 500    // Relocations before an insert gives up
+#define IMDB_FILTER_MIN_BUCKETS 16
+
+struct IMDBFilter {
+  uint16_t* slots;       // IMDB_FILTER_SLOTS per bucket, 0 = empty
+  uint32_t bucketMask;   // Bucket count - 1, a power of two
+  uint32_t kickSeed;     // Picks the fingerprint an insert relocates
+  int column;
+  IMDBDataType type;
+  char name[32];         // Column name, read by exists() without the table lock
+  bool stale;            // Records changed in bulk; the next locked lookup rebuilds it
+  bool saturated;        // A value repeats more often than two buckets hold; lookups scan
+};
+
+// FNV-1a, for the membership filter, the compressed string dictionary and the key index
+static inline uint32_t hashString(const char* str, size_t length) {
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)str[i]) * 16777619U;
+  }
+  return hash;
+}
+
+// MurmurHash3 finalizer, spreads numeric values over all 32 bits
+static inline uint32_t mixHash(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6BU;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35U;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// Hash of a value in the form insert() takes it. A stored IMDBFieldValue has
+// the same layout, so fields are hashed through the same function.
+static uint32_t filterHash(const void* value, IMDBDataType type) {
+  switch (type) {
+    case IMDB_TYPE_MAC:
+      return mixHash(hashString((const char*)value, 6));
+    case IMDB_TYPE_STRING: {
+      const char* str = *(const char* const*)value;
+      return mixHash(str != nullptr ? hashString(str, strlen(str)) : hashString("", 0));
+    }
+    default:
+      return mixHash(*(const uint32_t*)value);  // INT32 and EPOCH
+  }
+}
+
+static inline uint16_t filterFingerprint(uint32_t hash) {
+  uint16_t fingerprint = (uint16_t)(hash >> 16);
+  return fingerprint != 0 ? fingerprint : 1;
+}
+
+static inline uint32_t filterAltBucket(const IMDBFilter* filter, uint32_t bucket, uint16_t fingerprint) {
+  return (bucket ^ mixHash(fingerprint)) & filter->bucketMask;
+}
+
+static bool filterPlace(IMDBFilter* filter, uint32_t bucket, uint16_t fingerprint) {
+  uint16_t* slots = filter->slots + bucket * IMDB_FILTER_SLOTS;
+  for (int i = 0; i < IMDB_FILTER_SLOTS; i++) {
+    if (slots[i] == 0) {
+      slots[i] = fingerprint;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool filterHas(const IMDBFilter* filter, uint32_t bucket, uint16_t fingerprint) {
+  const uint16_t* slots = filter->slots + bucket * IMDB_FILTER_SLOTS;
+  for (int i = 0; i < IMDB_FILTER_SLOTS; i++) {
+    if (slots[i] == fingerprint) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool filterContains(const IMDBFilter* filter, uint32_t hash) {
+  uint16_t fingerprint = filterFingerprint(hash);
+  uint32_t bucket = hash & filter->bucketMask;
+  return filterHas(filter, bucket, fingerprint) ||
+         filterHas(filter, filterAltBucket(filter, bucket, fingerprint), fingerprint);
+}
+
+// Add a value, relocating fingerprints to their other bucket to make room.
+// On failure one fingerprint is left without a slot and the filter must be rebuilt.
+static bool filterInsert(IMDBFilter* filter, uint32_t hash) {
+  uint16_t fingerprint = filterFingerprint(hash);
+  uint32_t bucket = hash & filter->bucketMask;
+  if (filterPlace(filter, bucket, fingerprint)) {
+    return true;
+  }
+  bucket = filterAltBucket(filter, bucket, fingerprint);
+  if (filterPlace(filter, bucket, fingerprint)) {
+    return true;
+  }
+  
+  for (int kick = 0; kick < IMDB_FILTER_MAX_KICKS; kick++) {
+    filter->kickSeed = filter->kickSeed * 1103515245U + 12345U;
+    uint16_t* slot = filter->slots + bucket * IMDB_FILTER_SLOTS + (filter->kickSeed >> 16) % IMDB_FILTER_SLOTS;
+    uint16_t evicted = *slot;
+    *slot = fingerprint;
+    fingerprint = evicted;
+    bucket = filterAltBucket(filter, bucket, fingerprint);
+    if (filterPlace(filter, bucket, fingerprint)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void filterRemove(IMDBFilter* filter, uint32_t hash) {
+  uint16_t fingerprint = filterFingerprint(hash);
+  uint32_t buckets[2];
+  buckets[0] = hash & filter->bucketMask;
+  buckets[1] = filterAltBucket(filter, buckets[0], fingerprint);
+  for (int b = 0; b < 2; b++) {
+    uint16_t* slots = filter->slots + buckets[b] * IMDB_FILTER_SLOTS;
+    for (int i = 0; i < IMDB_FILTER_SLOTS; i++) {
+      if (slots[i] == fingerprint) {
+        slots[i] = 0;
+        return;
+      }
+    }
+  }
+}
+
+// Fill the filter from the records (caller holds the table lock). buckets is
+// the size to start from, 0 to size it for the table. The new slots are built
+// aside and swapped in, so exists() never sees a half-built filter.
+IMDBResult ESP32IMDB::rebuildFilter(uint32_t buckets) {
+  IMDBFilter* filter = _filter;
+  
+  // Two buckets per 4 records leave the filter about half full
+  uint32_t needed = IMDB_FILTER_MIN_BUCKETS;
+  while (needed < UINT32_MAX / 2 && needed * 2 < (uint32_t)_recordCount) {
+    needed *= 2;
+  }
+  if (buckets < needed) {
+    buckets = needed;
+  }
+  
+  // Repeated values can't be spread by a larger filter; stop after two doublings
+  IMDBResult result = IMDB_OK;
+  IMDBFilter built = *filter;
+  built.slots = nullptr;
+  built.saturated = true;
+  for (int attempt = 0; attempt < 3 && built.saturated; attempt++, buckets *= 2) {
+    if (!checkHeapLimit()) {
+      result = IMDB_ERROR_HEAP_LIMIT;
+      break;
+    }
+    built.slots = (uint16_t*)calloc((size_t)buckets * IMDB_FILTER_SLOTS, sizeof(uint16_t));
+    if (built.slots == nullptr) {
+      heapAllocationFailed();
+      result = IMDB_ERROR_OUT_OF_MEMORY;
+      break;
+    }
+    built.bucketMask = buckets - 1;
+    built.saturated = false;
+    for (int i = 0; i < _recordCount && !built.saturated; i++) {
+      if (_records[i].isValid && _records[i].fields != nullptr) {
+        built.saturated = !filterInsert(&built, filterHash(&_records[i].fields[built.column], built.type));
+      }
+    }
+    if (built.saturated) {
+      free(built.slots);
+      built.slots = nullptr;
+    }
+  }
+  
+  // Without memory the filter stays stale and the next lookup tries again
+  if (result != IMDB_OK) {
+    return result;
+  }
+  
+  uint16_t* oldSlots = filter->slots;
+  size_t oldBytes = (oldSlots != nullptr) ? sizeof(uint16_t) * IMDB_FILTER_SLOTS * (filter->bucketMask + 1) : 0;
+  takeMutex(_filterMutex);
+  filter->slots = built.slots;
+  filter->bucketMask = built.bucketMask;
+  filter->saturated = built.saturated;
+  filter->stale = false;
+  giveMutex(_filterMutex);
+  
+  if (oldSlots != nullptr) {
+    memoryFreed(&_memory.indexes, oldBytes, oldSlots);
+    free(oldSlots);
+  }
+  if (filter->slots != nullptr) {
+    memoryAllocated(&_memory.indexes, sizeof(uint16_t) * IMDB_FILTER_SLOTS * (filter->bucketMask + 1),
+                    filter->slots);
+  }
+  return IMDB_OK;
+}
+
+// Remove the filter (caller holds the table lock)
+void ESP32IMDB::releaseFilter() {
+  IMDBFilter* filter = _filter;
+  if (filter == nullptr) {
+    return;
+  }
+  takeMutex(_filterMutex);
+  _filter = nullptr;
+  giveMutex(_filterMutex);
+  
+  if (filter->slots != nullptr) {
+    memoryFreed(&_memory.indexes, sizeof(uint16_t) * IMDB_FILTER_SLOTS * (filter->bucketMask + 1),
+                filter->slots);
+    free(filter->slots);
+  }
+  memoryFreed(&_memory.indexes, sizeof(IMDBFilter), filter);
+  free(filter);
+}
+
+// Add or remove a value hash (caller holds the table lock). An insert that
+// finds no slot marks the filter stale before the lock is dropped, so lookups
+// scan until it has been rebuilt larger.
+void ESP32IMDB::filterValue(uint32_t hash, bool added) {
+  if (_filter == nullptr || _filter->stale || _filter->saturated) {
+    return;
+  }
+  takeMutex(_filterMutex);
+  bool placed = true;
+  if (added) {
+    placed = filterInsert(_filter, hash);
+  } else {
+    filterRemove(_filter, hash);
+  }
+  if (!placed) {
+    _filter->stale = true;
+  }
+  giveMutex(_filterMutex);
+  
+  if (!placed) {
+    rebuildFilter((_filter->bucketMask + 1) * 2);
+  }
+}
+
+// Add or remove a record's value in the filtered column
+void ESP32IMDB::filterRecord(const IMDBRecord* record, bool added) {
+  if (_filter == nullptr || !record->isValid || record->fields == nullptr) {
+    return;
+  }
+  filterValue(filterHash(&record->fields[_filter->column], _filter->type), added);
+}
+
+// Records changed without the per-record hooks (loads, delta merges); the BOOL
+// index, the zone map, the membership filter and the column statistics are
+// rebuilt by their next locked lookup
+void ESP32IMDB::markIndexesStale() {
+  _boolIndexStale = true;
+  _zoneMapStale = true;
+  _columnStatsStale = true;
+  if (_filter != nullptr && !_filter->stale) {
+    takeMutex(_filterMutex);
+    _filter->stale = true;
+    giveMutex(_filterMutex);
+  }
+}
+
+// Find column index by name
+int ESP32IMDB::findColumnIndex(const char* columnName) const {
+  for (int i = 0; i < _columnCount; i++) {
+    if (strcmp(_columns[i].name, columnName) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Copy field value with proper memory allocation for strings
+IMDBResult ESP32IMDB::copyFieldValue(IMDBFieldValue* dest, const void* src, IMDBDataType type) {
+  switch (type) {
+    case IMDB_TYPE_INT32:
+      dest->int32Value = *(const int32_t*)src;
+      break;
+      
+    case IMDB_TYPE_MAC:
+      memcpy(dest->macAddress, src, 6);
+      break;
+      
+    case IMDB_TYPE_STRING: {
+      const char* srcStr = *(const char**)src;
+      if (srcStr == nullptr) {
+        return IMDB_ERROR_INVALID_VALUE;
+      }
+      size_t len = strlen(srcStr);
+      if (len > IMDB_MAX_STRING_LENGTH) {
+        len = IMDB_MAX_STRING_LENGTH;
+      }
+      // Ring buffer rows copy into their fixed slot (src may be that slot)
+      if (ringOwns(dest)) {
+        dest->stringValue = ringStringSlot(dest);
+        memmove(dest->stringValue, srcStr, len);
+        dest->stringValue[len] = '\0';
+        break;
+      }
+      // Allocate only needed space (compacted storage)
+      dest->stringValue = (char*)allocBulk(len + 1);
+      if (dest->stringValue == nullptr) {
+        heapAllocationFailed();
+        return IMDB_ERROR_OUT_OF_MEMORY;
+      }
+      strncpy(dest->stringValue, srcStr, len);
+      dest->stringValue[len] = '\0';
+      break;
+    }
+    
+    case IMDB_TYPE_EPOCH:
+      dest->epochValue = *(const uint32_t*)src;
+      break;
+      
+    case IMDB_TYPE_BOOL:
+      dest->boolValue = *(const bool*)src;
+      break;
+      
+    case IMDB_TYPE_FLOAT:
+      dest->floatValue = *(const float*)src;
+      break;
+  }
+  
+  return IMDB_OK;
+}
+
+// Check if a record is expired
+bool ESP32IMDB::isRecordExpired(uint32_t expiryMillis) const {
+  if (expiryMillis == 0) {
+    return false;  // No expiry set
+  }
+  
+  uint32_t currentMillis = millis();
+  
+  // Cast to int32_t to handle wraparound
+  return (int32_t)(currentMillis - expiryMillis) >= 0;
+}
+
+// Purge expired records
+void ESP32IMDB::purgeExpiredRecords() {
+  IMDB_STAT_SCOPE(IMDB_STAT_PURGE);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return;
+  }
+  
+  for (int i = 0; i < _recordCount; i++) {
+    if (_records[i].isValid && isRecordExpired(_records[i].expiryMillis)) {
+      trackRecord(&_records[i], false);
+      filterRecord(&_records[i], false);
+      freeRecord(&_records[i]);
+      _records[i].isValid = false;
+      indexBoolSlot(i);
+      _columnStatsChanges++;
+      IMDB_STAT_ROWS(0, 1);
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, 0);
+  
+  compactRecords();
+  
+  unlock();
+}
+
+// Compact records array by removing invalid entries
+void ESP32IMDB::compactRecords() {
+  int writeIndex = 0;
+  for (int readIndex = 0; readIndex < _recordCount; readIndex++) {
+    if (_records[readIndex].isValid) {
+      if (writeIndex != readIndex) {
+        // Swap so the old slot gets the removed entry: fields already freed,
+        // or a ring buffer's storage, which must stay in the ring
+        IMDBRecord removed = _records[writeIndex];
+        _records[writeIndex] = _records[readIndex];
+        _records[readIndex] = removed;
+      }
+      writeIndex++;
+    } else {
+#if IMDB_ENABLE_PERSISTENCE
+      // Removed rows go into the next incremental delta
+      if (_incFilename != nullptr) {
+        noteDeletedRow(_records[readIndex].rowId);
+      }
+#endif
+    }
+  }
+  bool removed = writeIndex < _recordCount;
+  _recordCount = writeIndex;
+  
+  // Records moved to new slots; current indexes are rebuilt in place
+  if (removed && _boolIndex != nullptr && !_boolIndexStale) {
+    rebuildBoolIndex();
+  }
+  if (removed && _zones != nullptr && !_zoneMapStale) {
+    rebuildZoneMap();
+  }
+  
+  // Shrink array if significantly underutilized (less than 50% used); a ring
+  // buffer keeps its capacity
+  if (_ringCapacity == 0 && _recordCapacity > 10 && _recordCount < _recordCapacity / 2) {
+    shrinkRecordArray();
+  }
+}
+
+// Grow the records array capacity
+IMDBResult ESP32IMDB::growRecordArray() {
+  if (!checkHeapLimit()) {
+    return IMDB_ERROR_HEAP_LIMIT;
+  }
+  
+  // Check for potential overflow
+  if (_recordCapacity > INT_MAX / 2) {
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  int newCapacity = _recordCapacity * 2;
+  IMDBRecord* newRecords = (IMDBRecord*)realloc(_records, sizeof(IMDBRecord) * newCapacity);
+  if (newRecords == nullptr) {
+    heapAllocationFailed();
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  // Initialize new slots to prevent undefined behavior
+  for (int i = _recordCapacity; i < newCapacity; i++) {
+    newRecords[i].fields = nullptr;
+    newRecords[i].isValid = false;
+    newRecords[i].expiryMillis = 0;
+  }
+  
+  memoryFreed(&_memory.directory, sizeof(IMDBRecord) * _recordCapacity, newRecords);
+  memoryAllocated(&_memory.directory, sizeof(IMDBRecord) * newCapacity, newRecords);
+  _records = newRecords;
+  _recordCapacity = newCapacity;
+  return IMDB_OK;
+}
+
+// Shrink the records array capacity to reclaim memory
+IMDBResult ESP32IMDB::shrinkRecordArray() {
+  // Calculate new capacity (half of current, but at least 10 and enough for records)
+  int newCapacity = _recordCapacity / 2;
+  if (newCapacity < 10) {
+    newCapacity = 10;
+  }
+  if (newCapacity < _recordCount) {
+    newCapacity = _recordCount;
+  }
+  
+  // Don't bother if the reduction is minimal
+  if (newCapacity >= _recordCapacity) {
+    return IMDB_OK;
+  }
+  
+  IMDBRecord* newRecords = (IMDBRecord*)realloc(_records, sizeof(IMDBRecord) * newCapacity);
+  if (newRecords == nullptr) {
+    // Shrinking failed, but this is not critical - keep the larger array
+    return IMDB_OK;
+  }
+  
+  memoryFreed(&_memory.directory, sizeof(IMDBRecord) * _recordCapacity, newRecords);
+  memoryAllocated(&_memory.directory, sizeof(IMDBRecord) * newCapacity, newRecords);
+  _records = newRecords;
+  _recordCapacity = newCapacity;
+  return IMDB_OK;
+}
+
+// Ring buffer tables
+//
+// createTable() with a ring capacity allocates the directory, field arrays and
+// string slots for every row at once and binds each directory entry to its
+// own storage. Records never allocate or free anything: freeRecord() leaves
+// ring storage in place and compaction swaps entries instead of moving them.
+// Once the ring is full, an insert evicts the oldest row by sliding _records
+// one entry forward and reusing the evicted entry's storage for the new row.
+// When the window reaches the end of the directory it is moved back to the
+// start, one memmove of the directory per capacity inserts.
+
+// Switch the table to ring mode with storage for capacity rows, keeping the
+// newest rows that fit (caller holds the lock)
+IMDBResult ESP32IMDB::enterRingMode(uint32_t capacity) {
+  uint8_t stringColumns = 0;
+  for (int i = 0; i < _columnCount; i++) {
+    if (_columns[i].type == IMDB_TYPE_STRING) {
+      stringColumns++;
+    }
+  }
+  
+  const size_t slotBytes = IMDB_MAX_STRING_LENGTH + 1;
+  if (capacity == 0 || capacity > (uint32_t)INT_MAX / 2 ||
+      capacity > SIZE_MAX / (2 * sizeof(IMDBRecord)) ||
+      capacity > SIZE_MAX / (sizeof(IMDBFieldValue) * _columnCount) ||
+      (stringColumns > 0 && capacity > SIZE_MAX / (slotBytes * stringColumns))) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  size_t directoryBytes = sizeof(IMDBRecord) * 2 * capacity;
+  size_t fieldBytes = sizeof(IMDBFieldValue) * _columnCount * capacity;
+  size_t stringBytes = slotBytes * stringColumns * capacity;
+  if (!checkHeapLimit() ||
+      (_memoryBudget > 0 && getMemoryUsage() + directoryBytes + fieldBytes + stringBytes > _memoryBudget)) {
+    return IMDB_ERROR_HEAP_LIMIT;
+  }
+  
+  IMDBRecord* base = (IMDBRecord*)malloc(directoryBytes);
+  IMDBFieldValue* fields = (IMDBFieldValue*)allocBulk(fieldBytes);
+  char* strings = (stringBytes > 0) ? (char*)allocBulk(stringBytes) : nullptr;
+  if (base == nullptr || fields == nullptr || (stringBytes > 0 && strings == nullptr)) {
+    heapAllocationFailed();
+    free(base);
+    heap_caps_free(fields);
+    heap_caps_free(strings);
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  memset(base, 0, directoryBytes);
+  memset(fields, 0, fieldBytes);
+  if (strings != nullptr) {
+    memset(strings, 0, stringBytes);
+  }
+  memoryAllocated(&_memory.directory, directoryBytes, base);
+  memoryAllocated(&_memory.fieldArrays, fieldBytes, fields);
+  if (strings != nullptr) {
+    memoryAllocated(&_memory.strings, stringBytes, strings);
+  }
+  
+  _ringBase = base;
+  _ringFields = fields;
+  _ringStrings = strings;
+  _ringCapacity = capacity;
+  _ringStringColumns = stringColumns;
+  
+  // Bind every entry to its field array; string fields point at empty slots
+  for (uint32_t row = 0; row < capacity; row++) {
+    base[row].fields = fields + (size_t)row * _columnCount;
+    for (int i = 0; i < _columnCount; i++) {
+      if (_columns[i].type == IMDB_TYPE_STRING) {
+        base[row].fields[i].stringValue = ringStringSlot(&base[row].fields[i]);
+      }
+    }
+  }
+  
+  // Copy the newest rows that fit into the ring and free the old records
+  int validCount = 0;
+  for (int i = 0; i < _recordCount; i++) {
+    if (_records[i].isValid) {
+      validCount++;
+    }
+  }
+  int skip = (validCount > (int)capacity) ? validCount - (int)capacity : 0;
+  int kept = 0;
+  for (int i = 0; i < _recordCount; i++) {
+    IMDBRecord* record = &_records[i];
+    if (record->isValid) {
+      if (skip > 0) {
+        skip--;
+      } else {
+        copyIntoRing(&base[kept++], record);
+      }
+    }
+    trackRecord(record, false);
+    freeRecord(record);
+  }
+  
+  memoryFreed(&_memory.directory, sizeof(IMDBRecord) * _recordCapacity, _records);
+  free(_records);
+  _records = base;
+  _recordCount = kept;
+  _recordCapacity = (int)capacity;
+  markIndexesStale();
+  return IMDB_OK;
+}
+
+// Entry for the next row of a ring buffer table, evicting the oldest row when
+// the ring is full. The caller fills it in and increments _recordCount.
+IMDBRecord* ESP32IMDB::ringAppendSlot() {
+  if ((uint32_t)_recordCount == _ringCapacity) {
+    IMDBRecord* oldest = &_records[0];
+    if (oldest->isValid) {
+      filterRecord(oldest, false);
+      _columnStatsChanges++;
+#if IMDB_ENABLE_PERSISTENCE
+      // Evicted rows go into the next incremental delta
+      if (_incFilename != nullptr) {
+        noteDeletedRow(oldest->rowId);
+      }
+#endif
+    }
+    oldest->isValid = false;
+    indexBoolSlot(0);
+    refreshZoneBlock(0);
+    
+    // Move the window back to the start of the directory when it reaches the end
+    if (_records == _ringBase + _ringCapacity) {
+      memmove(_ringBase, _records, sizeof(IMDBRecord) * _ringCapacity);
+      _records = _ringBase;
+    }
+    
+    // The evicted entry and its storage become the window's last entry, at
+    // the same index position, which the caller's indexBoolSlot() and
+    // zoneMapSlot() fill in
+    _records[_ringCapacity] = _records[0];
+    _records++;
+    _recordCount--;
+  }
+  return &_records[_recordCount];
+}
+
+// True if ptr is a field array or string slot of the ring storage
+bool ESP32IMDB::ringOwns(const void* ptr) const {
+  if (_ringCapacity == 0) {
+    return false;
+  }
+  const char* p = (const char*)ptr;
+  const char* fields = (const char*)_ringFields;
+  if (p >= fields && p < fields + sizeof(IMDBFieldValue) * _columnCount * _ringCapacity) {
+    return true;
+  }
+  return _ringStrings != nullptr && p >= _ringStrings &&
+         p < _ringStrings + (IMDB_MAX_STRING_LENGTH + 1) * _ringStringColumns * (size_t)_ringCapacity;
+}
+
+// String slot belonging to a STRING field of the ring storage
+char* ESP32IMDB::ringStringSlot(const IMDBFieldValue* field) const {
+  size_t offset = field - _ringFields;
+  size_t row = offset / _columnCount;
+  int column = (int)(offset % _columnCount);
+  size_t ordinal = 0;
+  for (int i = 0; i < column; i++) {
+    if (_columns[i].type == IMDB_TYPE_STRING) {
+      ordinal++;
+    }
+  }
+  return _ringStrings + (row * _ringStringColumns + ordinal) * (IMDB_MAX_STRING_LENGTH + 1);
+}
+
+// Copy a record's values and row state into a ring entry, which keeps its storage
+void ESP32IMDB::copyIntoRing(IMDBRecord* dest, const IMDBRecord* src) {
+  for (int i = 0; i < _columnCount; i++) {
+    if (_columns[i].type == IMDB_TYPE_STRING) {
+      const char* str = (src->fields[i].stringValue != nullptr) ? src->fields[i].stringValue : "";
+      copyFieldValue(&dest->fields[i], &str, IMDB_TYPE_STRING);
+    } else {
+      dest->fields[i] = src->fields[i];
+    }
+  }
+  dest->expiryMillis = src->expiryMillis;
+  dest->rowId = src->rowId;
+  dest->isValid = src->isValid;
+#if IMDB_ENABLE_PERSISTENCE
+  dest->isDirty = src->isDirty;
+#endif
+}
+
+// Capacity of a ring buffer table (0 = ordinary table)
+uint32_t ESP32IMDB::getRingCapacity() const {
+  return _ringCapacity;
+}
+
+// Expiry time for a record inserted now with the given TTL (0 = no expiry)
+static uint32_t expiryForTTL(uint32_t ttlMillis) {
+  if (ttlMillis == 0) {
+    return 0;
+  }
+  uint32_t currentMillis = millis();
+  // Check for potential overflow: if currentMillis + ttlMillis would overflow,
+  // set to maximum value to avoid wraparound
+  if (ttlMillis > (UINT32_MAX - currentMillis)) {
+    return UINT32_MAX;
+  }
+  return currentMillis + ttlMillis;
 }
 
 // Insert a new record
 IMDBResult ESP32IMDB::insert(const void** values, uint32_t ttlMillis) {
+  IMDB_STAT_SCOPE(IMDB_STAT_INSERT);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (values == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  // A ring buffer allocates nothing here
+  if (_ringCapacity == 0 && !checkHeapLimit()) {
+    unlock();
+    return IMDB_ERROR_HEAP_LIMIT;
+  }
+  
+  // Validate TTL
+  if (ttlMillis > IMDB_MAX_TTL_MS) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  IMDBRecord* record;
+  if (_ringCapacity > 0) {
+    // Check every value before the oldest row is evicted; copying into ring
+    // storage can't fail after that
+    for (int i = 0; i < _columnCount; i++) {
+      if (values[i] == nullptr ||
+          (_columns[i].type == IMDB_TYPE_STRING && *(const char* const*)values[i] == nullptr)) {
+        unlock();
+        return IMDB_ERROR_INVALID_VALUE;
+      }
+    }
+    record = ringAppendSlot();
+  } else {
+    // Grow array if needed
+    if (_recordCount >= _recordCapacity) {
+      IMDBResult result = growRecordArray();
+      if (result != IMDB_OK) {
+        unlock();
+        return result;
+      }
+    }
+    
+    // Allocate record fields
+    record = &_records[_recordCount];
+    record->fields = (IMDBFieldValue*)allocBulk(sizeof(IMDBFieldValue) * _columnCount);
+    if (record->fields == nullptr) {
+      heapAllocationFailed();
+      unlock();
+      return IMDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    // Initialize fields
+    memset(record->fields, 0, sizeof(IMDBFieldValue) * _columnCount);
+  }
+  
+  // Copy values
+  for (int i = 0; i < _columnCount; i++) {
+    if (values[i] == nullptr) {
+      // Cleanup on error
+      for (int j = 0; j < i; j++) {
+        if (_columns[j].type == IMDB_TYPE_STRING && record->fields[j].stringValue != nullptr) {
+          heap_caps_free(record->fields[j].stringValue);
+        }
+      }
+      heap_caps_free(record->fields);
+      unlock();
+      return IMDB_ERROR_INVALID_VALUE;
+    }
+    
+    IMDBResult result = copyFieldValue(&record->fields[i], values[i], _columns[i].type);
+    if (result != IMDB_OK) {
+      // Cleanup on error
+      for (int j = 0; j < i; j++) {
+        if (_columns[j].type == IMDB_TYPE_STRING && record->fields[j].stringValue != nullptr) {
+          heap_caps_free(record->fields[j].stringValue);
+        }
+      }
+      heap_caps_free(record->fields);
+      unlock();
+      return result;
+    }
+  }
+  
+  record->expiryMillis = expiryForTTL(ttlMillis);
+  record->rowId = _nextRowId++;
+  record->isValid = true;
+#if IMDB_ENABLE_PERSISTENCE
+  record->isDirty = true;
+#endif
+  _recordCount++;
+  trackRecord(record, true);
+  indexBoolSlot(_recordCount - 1);
+  zoneMapSlot(_recordCount - 1);
+  filterRecord(record, true);
+  _columnStatsChanges++;
+  
+  IMDBResult walResult = IMDB_OK;
+#if IMDB_ENABLE_PERSISTENCE
+  if (_walEnabled) {
+    walResult = walLogInsert(values, record->expiryMillis);
+  }
+#endif
+  
+  unlock();
+  return walResult;
+}
+
+// Compare field values
+bool ESP32IMDB::compareValues(const IMDBFieldValue* fieldValue, const void* compareValue, 
+                             IMDBDataType type, IMDBOperator op) const {
+  if (fieldValue == nullptr || compareValue == nullptr) {
+    return false;
+  }
+  
+  switch (type) {
+    case IMDB_TYPE_INT32: {
+      int32_t a = fieldValue->int32Value;
+      int32_t b = *(const int32_t*)compareValue;
+      switch (op) {
+        case IMDB_OP_EQUAL: return a == b;
+        case IMDB_OP_NOT_EQUAL: return a != b;
+        case IMDB_OP_GREATER: return a > b;
+        case IMDB_OP_LESS: return a < b;
+        case IMDB_OP_GREATER_EQUAL: return a >= b;
+        case IMDB_OP_LESS_EQUAL: return a <= b;
+      }
+      break;
+    }
+    
+    case IMDB_TYPE_MAC:
+      // Only equality supported for MAC
+      return memcmp(fieldValue->macAddress, compareValue, 6) == 0;
+      
+    case IMDB_TYPE_STRING: {
+      // Only equality supported for strings
+      if (fieldValue->stringValue == nullptr || compareValue == nullptr) {
+        return false;
+      }
+      const char* strToCompare = *(const char**)compareValue;
+      if (strToCompare == nullptr) {
+        return false;
+      }
+      return strcmp(fieldValue->stringValue, strToCompare) == 0;
+    }
+      
+    case IMDB_TYPE_EPOCH: {
+      uint32_t a = fieldValue->epochValue;
+      uint32_t b = *(const uint32_t*)compareValue;
+      switch (op) {
+        case IMDB_OP_EQUAL: return a == b;
+        case IMDB_OP_NOT_EQUAL: return a != b;
+        case IMDB_OP_GREATER: return a > b;
+        case IMDB_OP_LESS: return a < b;
+        case IMDB_OP_GREATER_EQUAL: return a >= b;
+        case IMDB_OP_LESS_EQUAL: return a <= b;
+      }
+      break;
+    }
+    
+    case IMDB_TYPE_BOOL:
+      return fieldValue->boolValue == *(const bool*)compareValue;
+      
+    case IMDB_TYPE_FLOAT: {
+      float a = fieldValue->floatValue;
+      float b = *(const float*)compareValue;
+      float diff = a - b;
+      switch (op) {
+        case IMDB_OP_EQUAL: return (diff > -IMDB_FLOAT_EPSILON && diff < IMDB_FLOAT_EPSILON);
+        case IMDB_OP_NOT_EQUAL: return (diff <= -IMDB_FLOAT_EPSILON || diff >= IMDB_FLOAT_EPSILON);
+        case IMDB_OP_GREATER: return a > b;
+        case IMDB_OP_LESS: return a < b;
+        case IMDB_OP_GREATER_EQUAL: return a >= b;
+        case IMDB_OP_LESS_EQUAL: return a <= b;
+      }
+      break;
+    }
+  }
+  
+  return false;
+}
+
+// Update records matching WHERE condition
+IMDBResult ESP32IMDB::update(const char* whereColumn, const void* whereValue,
+                            const char* setColumn, const void* setValue) {
+  IMDB_STAT_SCOPE(IMDB_STAT_UPDATE);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (whereColumn == nullptr || whereValue == nullptr || setColumn == nullptr || setValue == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int whereIdx = findColumnIndex(whereColumn);
+  int setIdx = findColumnIndex(setColumn);
+  
+  if (whereIdx < 0 || setIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  // Update matching records
+  IMDBResult result = IMDB_OK;
+  bool updated = false;
+  IMDBScan scan;
+  prepareScan(&scan, whereIdx, IMDB_OP_EQUAL, whereValue);
+  for (int i = nextCandidate(&scan, 0); i < _recordCount; i = nextCandidate(&scan, i + 1)) {
+    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
+      continue;
+    }
+    
+    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
+      // The filtered column's old value leaves the filter once the new one is stored
+      bool refilter = (_filter != nullptr && _filter->column == setIdx);
+      uint32_t oldHash = refilter ? filterHash(&_records[i].fields[setIdx], _columns[setIdx].type) : 0;
+      
+      // For strings, allocate new value before freeing old to prevent data loss on failure
+      if (_columns[setIdx].type == IMDB_TYPE_STRING) {
+        char* oldString = _records[i].fields[setIdx].stringValue;
+        _records[i].fields[setIdx].stringValue = nullptr;  // Temporarily clear to avoid double-free
+        
+        result = copyFieldValue(&_records[i].fields[setIdx], setValue, _columns[setIdx].type);
+        if (result != IMDB_OK) {
+          // Restore old value on failure
+          _records[i].fields[setIdx].stringValue = oldString;
+          break;
+        }
+        // Success - now free the old value
+        trackString(_records[i].fields[setIdx].stringValue, true);
+        if (oldString != nullptr) {
+          trackString(oldString, false);
+          releaseString(oldString);
+        }
+      } else {
+        // Non-string types can be overwritten directly
+        result = copyFieldValue(&_records[i].fields[setIdx], setValue, _columns[setIdx].type);
+        if (result != IMDB_OK) {
+          break;
+        }
+      }
+#if IMDB_ENABLE_PERSISTENCE
+      _records[i].isDirty = true;
+#endif
+      if (_columns[setIdx].type == IMDB_TYPE_BOOL) {
+        indexBoolSlot(i);
+      } else if (isZoneType(_columns[setIdx].type)) {
+        zoneMapSlot(i);
+      }
+      if (refilter) {
+        filterValue(oldHash, false);
+        filterRecord(&_records[i], true);
+      }
+      updated = true;
+      _columnStatsChanges++;
+      IMDB_STAT_ROWS(0, 1);
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, 0);
+  
+  // Rows changed before a failure stay changed, so they are logged either way
+  IMDBResult walResult = IMDB_OK;
+#if IMDB_ENABLE_PERSISTENCE
+  if (updated && _walEnabled) {
+    walResult = walLogChange(IMDB_WAL_ENTRY_UPDATE, whereIdx, whereValue, setIdx, setValue,
+                             IMDB_MATH_ADD, 0);
+  }
+#endif
+  
+  unlock();
+  if (result != IMDB_OK) {
+    return result;
+  }
+  return updated ? walResult : IMDB_ERROR_NO_RECORDS;
+}
+
+// Simple float modulo implementation
+static inline float floatModulo(float x, float y) {
+  if (y == 0.0f) return 0.0f;
+  return x - ((int)(x / y)) * y;
+}
+
+// Update with math operation
+IMDBResult ESP32IMDB::updateWithMath(const char* whereColumn, const void* whereValue,
+                                    const char* setColumn, IMDBMathOp operation, 
+                                    int32_t operand) {
+  IMDB_STAT_SCOPE(IMDB_STAT_UPDATE);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (whereColumn == nullptr || whereValue == nullptr || setColumn == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int whereIdx = findColumnIndex(whereColumn);
+  int setIdx = findColumnIndex(setColumn);
+  
+  if (whereIdx < 0 || setIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  // Math operations only supported on INT32, EPOCH, and FLOAT types
+  if (_columns[setIdx].type != IMDB_TYPE_INT32 && 
+      _columns[setIdx].type != IMDB_TYPE_EPOCH && 
+      _columns[setIdx].type != IMDB_TYPE_FLOAT) {
+    unlock();
+    return IMDB_ERROR_INVALID_TYPE;
+  }
+  
+  // A zero divisor is rejected before any row changes, so a partial update
+  // never goes unlogged
+  if (operand == 0 && (operation == IMDB_MATH_DIVIDE || operation == IMDB_MATH_MODULO)) {
+    unlock();
+    return IMDB_ERROR_INVALID_OPERATION;
+  }
+  
+  // Update matching records
+  bool updated = false;
+  IMDBScan scan;
+  prepareScan(&scan, whereIdx, IMDB_OP_EQUAL, whereValue);
+  for (int i = nextCandidate(&scan, 0); i < _recordCount; i = nextCandidate(&scan, i + 1)) {
+    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
+      continue;
+    }
+    
+    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
+      bool refilter = (_filter != nullptr && _filter->column == setIdx);
+      uint32_t oldHash = refilter ? filterHash(&_records[i].fields[setIdx], _columns[setIdx].type) : 0;
+      
+      if (_columns[setIdx].type == IMDB_TYPE_FLOAT) {
+        // Float math operations
+        float* valuePtr = &_records[i].fields[setIdx].floatValue;
+        float floatOperand = (float)operand;
+        
+        switch (operation) {
+          case IMDB_MATH_ADD:
+            *valuePtr += floatOperand;
+            break;
+          case IMDB_MATH_SUBTRACT:
+            *valuePtr -= floatOperand;
+            break;
+          case IMDB_MATH_MULTIPLY:
+            *valuePtr *= floatOperand;
+            break;
+          case IMDB_MATH_DIVIDE:
+            *valuePtr /= floatOperand;
+            break;
+          case IMDB_MATH_MODULO:
+            *valuePtr = floatModulo(*valuePtr, floatOperand);
+            break;
+        }
+      } else if (_columns[setIdx].type == IMDB_TYPE_INT32) {
+        // INT32 math operations
+        int32_t* valuePtr = &_records[i].fields[setIdx].int32Value;
+        
+        switch (operation) {
+          case IMDB_MATH_ADD:
+            *valuePtr += operand;
+            break;
+          case IMDB_MATH_SUBTRACT:
+            *valuePtr -= operand;
+            break;
+          case IMDB_MATH_MULTIPLY:
+            *valuePtr *= operand;
+            break;
+          case IMDB_MATH_DIVIDE:
+            *valuePtr /= operand;
+            break;
+          case IMDB_MATH_MODULO:
+            *valuePtr %= operand;
+            break;
+        }
+      } else {
+        // EPOCH math operations (treat as uint32_t to avoid aliasing)
+        uint32_t* valuePtr = &_records[i].fields[setIdx].epochValue;
+        
+        switch (operation) {
+          case IMDB_MATH_ADD:
+            *valuePtr += (uint32_t)operand;
+            break;
+          case IMDB_MATH_SUBTRACT:
+            *valuePtr -= (uint32_t)operand;
+            break;
+          case IMDB_MATH_MULTIPLY:
+            *valuePtr *= (uint32_t)operand;
+            break;
+          case IMDB_MATH_DIVIDE:
+            *valuePtr /= (uint32_t)operand;
+            break;
+          case IMDB_MATH_MODULO:
+            *valuePtr %= (uint32_t)operand;
+            break;
+        }
+      }
+#if IMDB_ENABLE_PERSISTENCE
+      _records[i].isDirty = true;
+#endif
+      zoneMapSlot(i);
+      if (refilter) {
+        filterValue(oldHash, false);
+        filterRecord(&_records[i], true);
+      }
+      updated = true;
+      _columnStatsChanges++;
+      IMDB_STAT_ROWS(0, 1);
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, 0);
+  
+  IMDBResult walResult = IMDB_OK;
+#if IMDB_ENABLE_PERSISTENCE
+  if (updated && _walEnabled) {
+    walResult = walLogChange(IMDB_WAL_ENTRY_MATH, whereIdx, whereValue, setIdx, nullptr,
+                             operation, operand);
+  }
+#endif
+  
+  unlock();
+  return updated ? walResult : IMDB_ERROR_NO_RECORDS;
+}
+
+// Delete records matching WHERE condition
+IMDBResult ESP32IMDB::deleteRecords(const char* whereColumn, const void* whereValue) {
+  IMDB_STAT_SCOPE(IMDB_STAT_DELETE);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (whereColumn == nullptr || whereValue == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int whereIdx = findColumnIndex(whereColumn);
+  if (whereIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  bool deleted = false;
+  IMDBScan scan;
+  prepareScan(&scan, whereIdx, IMDB_OP_EQUAL, whereValue);
+  for (int i = nextCandidate(&scan, 0); i < _recordCount; i = nextCandidate(&scan, i + 1)) {
+    if (!_records[i].isValid) {
+      continue;
+    }
+    
+    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
+      trackRecord(&_records[i], false);
+      filterRecord(&_records[i], false);
+      freeRecord(&_records[i]);
+      _records[i].isValid = false;
+      indexBoolSlot(i);
+      deleted = true;
+      _columnStatsChanges++;
+      IMDB_STAT_ROWS(0, 1);
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, 0);
+  
+  if (deleted) {
+    compactRecords();
+  }
+  
+  IMDBResult walResult = IMDB_OK;
+#if IMDB_ENABLE_PERSISTENCE
+  if (deleted && _walEnabled) {
+    walResult = walLogChange(IMDB_WAL_ENTRY_DELETE, whereIdx, whereValue, -1, nullptr,
+                             IMDB_MATH_ADD, 0);
+  }
+#endif
+  
+  unlock();
+  return deleted ? walResult : IMDB_ERROR_NO_RECORDS;
+}
+
+// Copy field value to result structure
+void ESP32IMDB::getFieldValue(const IMDBFieldValue* field, IMDBDataType type, 
+                             IMDBSelectResult* result) const {
+  result->type = type;
+  result->hasValue = true;
+  
+  switch (type) {
+    case IMDB_TYPE_INT32:
+      result->int32Value = field->int32Value;
+      break;
+    case IMDB_TYPE_MAC:
+      memcpy(result->macAddress, field->macAddress, 6);
+      break;
+    case IMDB_TYPE_STRING:
+      if (field->stringValue != nullptr) {
+        strncpy(result->stringValue, field->stringValue, IMDB_MAX_STRING_LENGTH);
+        result->stringValue[IMDB_MAX_STRING_LENGTH] = '\0';
+      } else {
+        result->stringValue[0] = '\0';
+      }
+      break;
+    case IMDB_TYPE_EPOCH:
+      result->epochValue = field->epochValue;
+      break;
+    case IMDB_TYPE_BOOL:
+      result->boolValue = field->boolValue;
+      break;
+    case IMDB_TYPE_FLOAT:
+      result->floatValue = field->floatValue;
+      break;
+  }
+}
+
+// Select a single column value from first matching record
+IMDBResult ESP32IMDB::select(const char* column, const char* whereColumn,
+                            const void* whereValue, IMDBSelectResult* result) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SELECT);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad(whereColumn);  // Key lookups are answered from the file
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (column == nullptr || whereColumn == nullptr || whereValue == nullptr || result == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int colIdx = findColumnIndex(column);
+  int whereIdx = findColumnIndex(whereColumn);
+  
+  if (colIdx < 0 || whereIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  result->hasValue = false;
+  
+  IMDBScan scan;
+  prepareScan(&scan, whereIdx, IMDB_OP_EQUAL, whereValue);
+  for (int i = nextCandidate(&scan, 0); i < _recordCount; i = nextCandidate(&scan, i + 1)) {
+    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
+      continue;
+    }
+    
+    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
+      getFieldValue(&_records[i].fields[colIdx], _columns[colIdx].type, result);
+      IMDB_STAT_ROWS(i + 1, 1);
+      unlock();
+      return IMDB_OK;
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, 0);
+  
+#if IMDB_ENABLE_PERSISTENCE
+  // Rows a lazy load hasn't reached yet come after the loaded ones
+  if (_lazy != nullptr) {
+    IMDBRecord* diskRows;
+    int diskMatches;
+    IMDBResult lookup = readLazyMatches(whereValue, 1, &diskRows, &diskMatches);
+    if (lookup == IMDB_OK) {
+      getFieldValue(&diskRows[0].fields[colIdx], _columns[colIdx].type, result);
+      freeLazyMatches(diskRows, diskMatches);
+    }
+    unlock();
+    return lookup;
+  }
+#endif
+  
+  unlock();
+  return IMDB_ERROR_NO_RECORDS;
+}
+
+// Select all matching records (caller must free results)
+IMDBResult ESP32IMDB::selectAll(const char* whereColumn, const void* whereValue,
+                               IMDBSelectResult** results, int* resultCount) {
+  return selectAll(whereColumn, IMDB_OP_EQUAL, whereValue, results, resultCount);
+}
+
+// Select all records whose whereColumn compares to whereValue with op (caller must free results)
+IMDBResult ESP32IMDB::selectAll(const char* whereColumn, IMDBOperator op, const void* whereValue,
+                               IMDBSelectResult** results, int* resultCount) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SELECT);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad(op == IMDB_OP_EQUAL ? whereColumn : nullptr);  // Only key lookups are answered from the file
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (whereColumn == nullptr || whereValue == nullptr || results == nullptr || resultCount == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int whereIdx = findColumnIndex(whereColumn);
+  if (whereIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  // Count matches first
+  IMDBScan scan;
+  prepareScan(&scan, whereIdx, op, whereValue);
+  int matches = 0;
+  for (int i = nextCandidate(&scan, 0); i < _recordCount; i = nextCandidate(&scan, i + 1)) {
+    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis) &&
+        compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type, op)) {
+      matches++;
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, matches);
+  
+  // Rows a lazy load hasn't reached yet are read from the file
+  IMDBRecord* diskRows = nullptr;
+  int diskMatches = 0;
+#if IMDB_ENABLE_PERSISTENCE
+  if (_lazy != nullptr) {
+    IMDBResult lookup = readLazyMatches(whereValue, INT_MAX, &diskRows, &diskMatches);
+    if (lookup != IMDB_OK && lookup != IMDB_ERROR_NO_RECORDS) {
+      unlock();
+      return lookup;
+    }
+  }
+#endif
+  
+  if (matches + diskMatches == 0) {
+    *results = nullptr;
+    *resultCount = 0;
+    unlock();
+    return IMDB_ERROR_NO_RECORDS;
+  }
+  
+  // Allocate result array with overflow check
+  // Check for potential integer overflow: matches * _columnCount
+  int totalMatches = matches + diskMatches;
+  if (_columnCount > 0 && totalMatches > (INT_MAX / _columnCount / (int)sizeof(IMDBSelectResult))) {
+#if IMDB_ENABLE_PERSISTENCE
+    freeLazyMatches(diskRows, diskMatches);
+#endif
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;  // Would overflow
+  }
+  
+  *results = (IMDBSelectResult*)malloc(sizeof(IMDBSelectResult) * totalMatches * _columnCount);
+  if (*results == nullptr) {
+#if IMDB_ENABLE_PERSISTENCE
+    freeLazyMatches(diskRows, diskMatches);
+#endif
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  // Fill results
+  int resultIdx = 0;
+  for (int i = nextCandidate(&scan, 0); i < _recordCount; i = nextCandidate(&scan, i + 1)) {
+    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis) &&
+        compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type, op)) {
+      for (int col = 0; col < _columnCount; col++) {
+        getFieldValue(&_records[i].fields[col], _columns[col].type, 
+                     &(*results)[resultIdx * _columnCount + col]);
+      }
+      resultIdx++;
+    }
+  }
+  
+  for (int i = 0; i < diskMatches; i++) {
+    for (int col = 0; col < _columnCount; col++) {
+      getFieldValue(&diskRows[i].fields[col], _columns[col].type,
+                   &(*results)[resultIdx * _columnCount + col]);
+    }
+    resultIdx++;
+  }
+#if IMDB_ENABLE_PERSISTENCE
+  freeLazyMatches(diskRows, diskMatches);
+#endif
+  
+  *resultCount = totalMatches;
+  unlock();
+  return IMDB_OK;
+}
+
+// Count all valid records
+int32_t ESP32IMDB::count() {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return 0;
+  }
+  
+  int32_t cnt = 0;
+  for (int i = 0; i < _recordCount; i++) {
+    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis)) {
+      cnt++;
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, cnt);
+  
+  unlock();
+  return cnt;
+}
+
+// Count records matching WHERE condition
+int32_t ESP32IMDB::countWhere(const char* whereColumn, const void* whereValue) {
+  return countWhere(whereColumn, IMDB_OP_EQUAL, whereValue);
+}
+
+// Count records whose whereColumn compares to whereValue with op
+int32_t ESP32IMDB::countWhere(const char* whereColumn, IMDBOperator op, const void* whereValue) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad(op == IMDB_OP_EQUAL ? whereColumn : nullptr);
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return 0;
+  }
+  
+  if (whereColumn == nullptr || whereValue == nullptr) {
+    unlock();
+    return 0;
+  }
+  
+  int whereIdx = findColumnIndex(whereColumn);
+  if (whereIdx < 0) {
+    unlock();
+    return 0;
+  }
+  
+  int32_t cnt = 0;
+  IMDBScan scan;
+  prepareScan(&scan, whereIdx, op, whereValue);
+  if (scan.boolBits != nullptr) {
+    cnt = countBoolMatches(scan.boolBits, whereValue);
+  } else {
+    for (int i = nextCandidate(&scan, 0); i < _recordCount; i = nextCandidate(&scan, i + 1)) {
+      if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis) &&
+          compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type, op)) {
+        cnt++;
+      }
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, cnt);
+  
+#if IMDB_ENABLE_PERSISTENCE
+  if (_lazy != nullptr) {
+    IMDBRecord* diskRows;
+    int diskMatches;
+    if (readLazyMatches(whereValue, INT_MAX, &diskRows, &diskMatches) == IMDB_OK) {
+      cnt += diskMatches;
+      freeLazyMatches(diskRows, diskMatches);
+    }
+  }
+#endif
+  
+  unlock();
+  return cnt;
+}
+
+// Find minimum value in a column
+IMDBResult ESP32IMDB::min(const char* column, IMDBSelectResult* result) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (column == nullptr || result == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int colIdx = findColumnIndex(column);
+  if (colIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  // Only numeric types supported
+  IMDBDataType type = _columns[colIdx].type;
+  if (type != IMDB_TYPE_INT32 && type != IMDB_TYPE_EPOCH && type != IMDB_TYPE_FLOAT) {
+    unlock();
+    return IMDB_ERROR_INVALID_TYPE;
+  }
+  
+  result->hasValue = false;
+  int32_t minVal = INT32_MAX;  // Max int32
+  uint32_t minEpoch = UINT32_MAX;  // Max uint32 for EPOCH
+  float minFloat = 3.4028235e38f;  // Max float
+  const void* current = (type == IMDB_TYPE_FLOAT) ? (const void*)&minFloat :
+                        (type == IMDB_TYPE_INT32) ? (const void*)&minVal : (const void*)&minEpoch;
+  const IMDBZone* zones = zoneMapFor(colIdx);
+  
+  for (int i = 0; i < _recordCount; i++) {
+    // Blocks whose smallest value doesn't beat the current one are skipped
+    if (zones != nullptr && result->hasValue && indexPosition(i) % IMDB_ZONE_MAP_BLOCK_ROWS == 0 &&
+        !zoneMayMatch(zoneOfSlot(zones, i), type, IMDB_OP_LESS, current)) {
+      i = nextZoneBlock(i) - 1;
+      continue;
+    }
+    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
+      continue;
+    }
+    
+    if (type == IMDB_TYPE_FLOAT) {
+      float val = _records[i].fields[colIdx].floatValue;
+      if (!result->hasValue || val < minFloat) {
+        minFloat = val;
+        result->hasValue = true;
+      }
+    } else if (type == IMDB_TYPE_INT32) {
+      int32_t val = _records[i].fields[colIdx].int32Value;
+      if (!result->hasValue || val < minVal) {
+        minVal = val;
+        result->hasValue = true;
+      }
+    } else {  // IMDB_TYPE_EPOCH
+      uint32_t val = _records[i].fields[colIdx].epochValue;
+      if (!result->hasValue || val < minEpoch) {
+        minEpoch = val;
+        result->hasValue = true;
+      }
+    }
+  }
+  
+  IMDB_STAT_ROWS(_recordCount, 0);
+  
+  if (!result->hasValue) {
+    unlock();
+    return IMDB_ERROR_NO_RECORDS;
+  }
+  
+  result->type = type;
+  if (type == IMDB_TYPE_INT32) {
+    result->int32Value = minVal;
+  } else if (type == IMDB_TYPE_EPOCH) {
+    result->epochValue = minEpoch;
+  } else {
+    result->floatValue = minFloat;
+  }
+  
+  unlock();
+  return IMDB_OK;
+}
+
+// Find maximum value in a column
+IMDBResult ESP32IMDB::max(const char* column, IMDBSelectResult* result) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (column == nullptr || result == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int colIdx = findColumnIndex(column);
+  if (colIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  // Only numeric types supported
+  IMDBDataType type = _columns[colIdx].type;
+  if (type != IMDB_TYPE_INT32 && type != IMDB_TYPE_EPOCH && type != IMDB_TYPE_FLOAT) {
+    unlock();
+    return IMDB_ERROR_INVALID_TYPE;
+  }
+  
+  result->hasValue = false;
+  int32_t maxVal = INT32_MIN;  // Minimum int32 value
+  uint32_t maxEpoch = 0;  // Min uint32 for EPOCH
+  float maxFloat = -3.4028235e38f;  // Min float (close to -FLT_MAX)
+  const void* current = (type == IMDB_TYPE_FLOAT) ? (const void*)&maxFloat :
+                        (type == IMDB_TYPE_INT32) ? (const void*)&maxVal : (const void*)&maxEpoch;
+  const IMDBZone* zones = zoneMapFor(colIdx);
+  
+  for (int i = 0; i < _recordCount; i++) {
+    // Blocks whose largest value doesn't beat the current one are skipped
+    if (zones != nullptr && result->hasValue && indexPosition(i) % IMDB_ZONE_MAP_BLOCK_ROWS == 0 &&
+        !zoneMayMatch(zoneOfSlot(zones, i), type, IMDB_OP_GREATER, current)) {
+      i = nextZoneBlock(i) - 1;
+      continue;
+    }
+    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
+      continue;
+    }
+    
+    if (type == IMDB_TYPE_FLOAT) {
+      float val = _records[i].fields[colIdx].floatValue;
+      if (!result->hasValue || val > maxFloat) {
+        maxFloat = val;
+        result->hasValue = true;
+      }
+    } else if (type == IMDB_TYPE_INT32) {
+      int32_t val = _records[i].fields[colIdx].int32Value;
+      if (!result->hasValue || val > maxVal) {
+        maxVal = val;
+        result->hasValue = true;
+      }
+    } else {  // IMDB_TYPE_EPOCH
+      uint32_t val = _records[i].fields[colIdx].epochValue;
+      if (!result->hasValue || val > maxEpoch) {
+        maxEpoch = val;
+        result->hasValue = true;
+      }
+    }
+  }
+  
+  IMDB_STAT_ROWS(_recordCount, 0);
+  
+  if (!result->hasValue) {
+    unlock();
+    return IMDB_ERROR_NO_RECORDS;
+  }
+  
+  result->type = type;
+  if (type == IMDB_TYPE_INT32) {
+    result->int32Value = maxVal;
+  } else if (type == IMDB_TYPE_EPOCH) {
+    result->epochValue = maxEpoch;
+  } else {
+    result->floatValue = maxFloat;
+  }
+  
+  unlock();
+  return IMDB_OK;
+}
+
+// Get top N records (caller must free results)
+IMDBResult ESP32IMDB::top(int n, IMDBSelectResult** results, int* resultCount) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (results == nullptr || resultCount == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  // Count valid records
+  int validCount = 0;
+  for (int i = 0; i < _recordCount; i++) {
+    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis)) {
+      validCount++;
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, validCount);
+  
+  if (validCount == 0) {
+    *results = nullptr;
+    *resultCount = 0;
+    unlock();
+    return IMDB_ERROR_NO_RECORDS;
+  }
+  
+  int returnCount = (n < validCount) ? n : validCount;
+  
+  // Allocate result array with overflow check
+  // Check for potential integer overflow: returnCount * _columnCount
+  if (returnCount > 0 && _columnCount > 0 && returnCount > (INT_MAX / _columnCount / (int)sizeof(IMDBSelectResult))) {
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;  // Would overflow
+  }
+  
+  *results = (IMDBSelectResult*)malloc(sizeof(IMDBSelectResult) * returnCount * _columnCount);
+  if (*results == nullptr) {
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  // Fill results
+  int resultIdx = 0;
+  for (int i = 0; i < _recordCount && resultIdx < returnCount; i++) {
+    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis)) {
+      for (int col = 0; col < _columnCount; col++) {
+        getFieldValue(&_records[i].fields[col], _columns[col].type,
+                     &(*results)[resultIdx * _columnCount + col]);
+      }
+      resultIdx++;
+    }
+  }
+  
+  *resultCount = returnCount;
+  unlock();
+  return IMDB_OK;
+}
+
+// Keep a membership filter over column for exists(); nullptr removes it.
+// The filter is discarded with the table, so set it again after a load.
+IMDBResult ESP32IMDB::setMembershipFilter(const char* column) {
+  lock();
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  releaseFilter();
+  if (column == nullptr) {
+    unlock();
+    return IMDB_OK;
+  }
+  
+  int colIdx = findColumnIndex(column);
+  if (colIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  // Floats compare within an epsilon and booleans have two values; neither hashes usefully
+  if (_columns[colIdx].type == IMDB_TYPE_FLOAT || _columns[colIdx].type == IMDB_TYPE_BOOL) {
+    unlock();
+    return IMDB_ERROR_INVALID_TYPE;
+  }
+  
+  if (!checkHeapLimit()) {
+    unlock();
+    return IMDB_ERROR_HEAP_LIMIT;
+  }
+  
+  IMDBFilter* filter = (IMDBFilter*)malloc(sizeof(IMDBFilter));
+  if (filter == nullptr) {
+    heapAllocationFailed();
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  memset(filter, 0, sizeof(IMDBFilter));
+  filter->kickSeed = 1;
+  filter->column = colIdx;
+  filter->type = _columns[colIdx].type;
+  memcpy(filter->name, _columns[colIdx].name, sizeof(filter->name));
+  filter->stale = true;  // Lookups scan until it is filled
+  memoryAllocated(&_memory.indexes, sizeof(IMDBFilter), filter);
+  
+  takeMutex(_filterMutex);
+  _filter = filter;
+  giveMutex(_filterMutex);
+  
+  IMDBResult result = rebuildFilter(0);
+  if (result != IMDB_OK) {
+    releaseFilter();
+  }
+  unlock();
+  return result;
+}
+
+// Check whether any unexpired record has value in column. With a membership
+// filter on the column, absent values are answered without the table lock.
+bool ESP32IMDB::exists(const char* column, const void* value) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SELECT);
+  if (column == nullptr || value == nullptr) {
+    return false;
+  }
+  
+  bool filtered = false;
+  bool maybe = true;
+  takeMutex(_filterMutex);
+  if (_filter != nullptr && !_filter->stale && !_filter->saturated &&
+      strcmp(_filter->name, column) == 0) {
+    filtered = true;
+    maybe = filterContains(_filter, filterHash(value, _filter->type));
+  }
+  giveMutex(_filterMutex);
+  if (filtered && !maybe) {
+    return false;
+  }
+  
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad(column);
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return false;
+  }
+  
+  int colIdx = findColumnIndex(column);
+  if (colIdx < 0) {
+    unlock();
+    return false;
+  }
+  
+  // A stale filter is rebuilt here, so lookups after this one skip the scan again
+  if (_filter != nullptr && _filter->stale && _filter->column == colIdx) {
+    rebuildFilter(0);
+  }
+  
+  bool found = false;
+  IMDBScan scan;
+  prepareScan(&scan, colIdx, IMDB_OP_EQUAL, value);
+  for (int i = nextCandidate(&scan, 0); i < _recordCount && !found; i = nextCandidate(&scan, i + 1)) {
+    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis) &&
+        compareValues(&_records[i].fields[colIdx], value, _columns[colIdx].type)) {
+      found = true;
+      IMDB_STAT_ROWS(i + 1, 1);
+    }
+  }
+  if (!found) {
+    IMDB_STAT_ROWS(_recordCount, 0);
+  }
+  
+#if IMDB_ENABLE_PERSISTENCE
+  // Rows a lazy load hasn't reached yet come after the loaded ones
+  if (!found && _lazy != nullptr) {
+    IMDBRecord* diskRows;
+    int diskMatches;
+    if (readLazyMatches(value, 1, &diskRows, &diskMatches) == IMDB_OK) {
+      found = true;
+      freeLazyMatches(diskRows, diskMatches);
+    }
+  }
+#endif
+  
+  unlock();
+  return found;
+}
+
+// Query planner
+//
+// Column statistics hold the live row count, a distinct-value estimate (linear
+// counting over a 1024-bit sketch of value hashes), and for numeric columns the
+// range and an equal-width histogram. They give each condition of a WHERE
+// clause a selectivity. The planner then costs the access path of every
+// condition by the records it would visit: the expected matches plus one word
+// per 32 slots for a BOOL bitmap, the blocks the zone map can't rule out for a
+// numeric column (counted exactly from the map), or every slot. The cheapest
+// condition drives the scan and the others are checked most selective first.
+// Conditions are assumed independent when their selectivities are combined.
+
+#define IMDB_STATS_SKETCH_BITS 1024
+
+// Planned compound WHERE clause
+struct IMDBQuery {
+  IMDBScan scan;                          // Access path of the driving condition
+  const IMDBPredicate* where;
+  uint8_t columns[IMDB_MAX_PREDICATES];   // Column index of each condition
+  uint8_t order[IMDB_MAX_PREDICATES];     // Conditions in checking order, driver first
+  uint8_t count;
+};
+
+// INT32, EPOCH or FLOAT value (a field or a WHERE value) as a double
+static inline double numericValue(const void* value, IMDBDataType type) {
+  switch (type) {
+    case IMDB_TYPE_INT32: return *(const int32_t*)value;
+    case IMDB_TYPE_FLOAT: return *(const float*)value;
+    default: return *(const uint32_t*)value;
+  }
+}
+
+// Share of the column's values below value, interpolated within its histogram bucket
+static float fractionBelow(const IMDBColumnStats* stats, double value) {
+  if (stats->rows == 0 || !(value > stats->min)) {
+    return 0.0f;
+  }
+  if (value > stats->max) {
+    return 1.0f;
+  }
+  
+  double position = (value - stats->min) * IMDB_COLUMN_HISTOGRAM_BUCKETS / (stats->max - stats->min);
+  int bucket = (int)position;
+  if (bucket >= IMDB_COLUMN_HISTOGRAM_BUCKETS) {
+    bucket = IMDB_COLUMN_HISTOGRAM_BUCKETS - 1;
+  }
+  double below = stats->histogram[bucket] * (position - bucket);
+  for (int i = 0; i < bucket; i++) {
+    below += stats->histogram[i];
+  }
+  return (float)(below / stats->rows);
+}
+
+// Collect the statistics of every column (caller holds the lock)
+IMDBResult ESP32IMDB::collectColumnStats() {
+  if (_columnStats == nullptr) {
+    if (!checkHeapLimit()) {
+      return IMDB_ERROR_HEAP_LIMIT;
+    }
+    _columnStats = (IMDBColumnStats*)malloc(sizeof(IMDBColumnStats) * _columnCount);
+    if (_columnStats == nullptr) {
+      heapAllocationFailed();
+      return IMDB_ERROR_OUT_OF_MEMORY;
+    }
+    memoryAllocated(&_memory.indexes, sizeof(IMDBColumnStats) * _columnCount, _columnStats);
+  }
+  
+  for (int c = 0; c < _columnCount; c++) {
+    IMDBColumnStats* stats = &_columnStats[c];
+    IMDBDataType type = _columns[c].type;
+    bool numeric = isZoneType(type);
+    bool ranged = false;
+    uint32_t sketch[IMDB_STATS_SKETCH_BITS / 32] = {0};
+    memset(stats, 0, sizeof(*stats));
+  
+    for (int i = 0; i < _recordCount; i++) {
+      if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
+        continue;
+      }
+      const IMDBFieldValue* field = &_records[i].fields[c];
+      stats->rows++;
+      if (type == IMDB_TYPE_BOOL) {
+        stats->histogram[field->boolValue ? 1 : 0]++;
+        continue;
+      }
+      uint32_t bit = filterHash(field, type) % IMDB_STATS_SKETCH_BITS;
+      sketch[bit / 32] |= 1UL << (bit % 32);
+  
+      if (numeric) {
+        double value = numericValue(field, type);
+        if (isfinite(value)) {
+          if (!ranged || value < stats->min) {
+            stats->min = value;
+          }
+          if (!ranged || value > stats->max) {
+            stats->max = value;
+          }
+          ranged = true;
+        }
+      }
+    }
+  
+    if (type == IMDB_TYPE_BOOL) {
+      stats->distinct = (stats->histogram[0] > 0) + (stats->histogram[1] > 0);
+      continue;
+    }
+  
+    int empty = 0;
+    for (int w = 0; w < IMDB_STATS_SKETCH_BITS / 32; w++) {
+      empty += 32 - __builtin_popcount(sketch[w]);
+    }
+    if (empty == 0) {
+      stats->distinct = stats->rows;  // Sketch saturated; assume the values are unique
+    } else {
+      double estimate = IMDB_STATS_SKETCH_BITS * log((double)IMDB_STATS_SKETCH_BITS / empty);
+      stats->distinct = (uint32_t)(estimate + 0.5);
+      if (stats->distinct > stats->rows) {
+        stats->distinct = stats->rows;
+      }
+      if (stats->distinct == 0 && stats->rows > 0) {
+        stats->distinct = 1;
+      }
+    }
+  
+    if (!ranged) {
+      continue;
+    }
+    double width = (stats->max - stats->min) / IMDB_COLUMN_HISTOGRAM_BUCKETS;
+    for (int i = 0; i < _recordCount; i++) {
+      if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
+        continue;
+      }
+      double value = numericValue(&_records[i].fields[c], type);
+      if (!isfinite(value)) {
+        continue;
+      }
+      int bucket = (width > 0) ? (int)((value - stats->min) / width) : 0;
+      stats->histogram[bucket < IMDB_COLUMN_HISTOGRAM_BUCKETS ? bucket : IMDB_COLUMN_HISTOGRAM_BUCKETS - 1]++;
+    }
+  }
+  
+  _columnStatsChanges = 0;
+  _columnStatsStale = false;
+  return IMDB_OK;
+}
+
+bool ESP32IMDB::columnStatsOutdated() const {
+  return _columnStats == nullptr || _columnStatsStale || _columnStatsChanges > _columnStats[0].rows / 4;
+}
+
+// Estimated share of the live records for which "column op value" holds, with
+// the same semantics as compareValues(). 1 when there are no statistics.
+float ESP32IMDB::estimateSelectivity(int colIdx, IMDBOperator op, const void* value) const {
+  if (_columnStats == nullptr) {
+    return 1.0f;
+  }
+  const IMDBColumnStats* stats = &_columnStats[colIdx];
+  if (stats->rows == 0) {
+    return 0.0f;
+  }
+  
+  IMDBDataType type = _columns[colIdx].type;
+  if (type == IMDB_TYPE_BOOL) {
+    return (float)stats->histogram[*(const bool*)value ? 1 : 0] / stats->rows;
+  }
+  float equal = 1.0f / stats->distinct;
+  if (!isZoneType(type)) {
+    return equal;  // MAC and STRING only compare for equality
+  }
+  
+  double number = numericValue(value, type);
+  if (number < stats->min || number > stats->max) {
+    equal = 0.0f;
+  }
+  float below = fractionBelow(stats, number);
+  float selectivity;
+  switch (op) {
+    case IMDB_OP_NOT_EQUAL: selectivity = 1.0f - equal; break;
+    case IMDB_OP_LESS: selectivity = below; break;
+    case IMDB_OP_LESS_EQUAL: selectivity = below + equal; break;
+    case IMDB_OP_GREATER: selectivity = 1.0f - below - equal; break;
+    case IMDB_OP_GREATER_EQUAL: selectivity = 1.0f - below; break;
+    default: selectivity = equal; break;
+  }
+  return selectivity < 0.0f ? 0.0f : (selectivity > 1.0f ? 1.0f : selectivity);
+}
+
+// Resolve the conditions and choose how to run them (caller holds the lock)
+IMDBResult ESP32IMDB::planQuery(IMDBQuery* query, const IMDBPredicate* where, uint8_t whereCount,
+                                IMDBPlan* plan) {
+  if (where == nullptr || whereCount == 0 || whereCount > IMDB_MAX_PREDICATES) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  for (int k = 0; k < whereCount; k++) {
+    if (where[k].column == nullptr || where[k].value == nullptr) {
+      return IMDB_ERROR_INVALID_VALUE;
+    }
+    int colIdx = findColumnIndex(where[k].column);
+    if (colIdx < 0) {
+      return IMDB_ERROR_COLUMN_NOT_FOUND;
+    }
+    query->columns[k] = (uint8_t)colIdx;
+  }
+  query->where = where;
+  query->count = whereCount;
+  
+  // Without statistics every condition is estimated to match all records
+  if (columnStatsOutdated()) {
+    collectColumnStats();
+  }
+  
+  float selectivity[IMDB_MAX_PREDICATES];
+  float bestCost = 0.0f;
+  int driver = 0;
+  IMDBAccessPath driverPath = IMDB_PATH_FULL_SCAN;
+  uint32_t driverScanned = _recordCount;
+  int blocks = (indexPositions() + IMDB_ZONE_MAP_BLOCK_ROWS - 1) / IMDB_ZONE_MAP_BLOCK_ROWS;
+  
+  for (int k = 0; k < whereCount; k++) {
+    int colIdx = query->columns[k];
+    IMDBDataType type = _columns[colIdx].type;
+    selectivity[k] = estimateSelectivity(colIdx, where[k].op, where[k].value);
+  
+    IMDBAccessPath path = IMDB_PATH_FULL_SCAN;
+    uint32_t scanned = _recordCount;
+    float cost = (float)_recordCount;
+    const IMDBZone* zones;
+    if (type == IMDB_TYPE_BOOL && boolIndexFor(colIdx) != nullptr) {
+      path = IMDB_PATH_BOOL_INDEX;
+      scanned = (uint32_t)(selectivity[k] * _recordCount + 0.5f);
+      cost = scanned + _recordCount / 32.0f;
+    } else if ((zones = zoneMapFor(colIdx)) != nullptr) {
+      uint32_t candidates = 0;
+      for (int b = 0; b < blocks; b++) {
+        if (zoneMayMatch(zones + (size_t)b * _zoneColumns, type, where[k].op, where[k].value)) {
+          candidates += zoneBlockRows(b);
+        }
+      }
+      if (candidates < (uint32_t)_recordCount) {
+        path = IMDB_PATH_ZONE_SCAN;
+        scanned = candidates;
+        cost = (float)(candidates + blocks);
+      }
+    }
+  
+    if (k == 0 || cost < bestCost || (cost == bestCost && selectivity[k] < selectivity[driver])) {
+      bestCost = cost;
+      driver = k;
+      driverPath = path;
+      driverScanned = scanned;
+    }
+  }
+  
+  // Driver first, then the remaining conditions by ascending selectivity
+  query->order[0] = (uint8_t)driver;
+  int ordered = 1;
+  for (int k = 0; k < whereCount; k++) {
+    if (k == driver) {
+      continue;
+    }
+    int pos = ordered++;
+    while (pos > 1 && selectivity[query->order[pos - 1]] > selectivity[k]) {
+      query->order[pos] = query->order[pos - 1];
+      pos--;
+    }
+    query->order[pos] = (uint8_t)k;
+  }
+  
+  int driverCol = query->columns[driver];
+  query->scan.column = driverCol;
+  query->scan.op = where[driver].op;
+  query->scan.value = where[driver].value;
+  query->scan.boolBits = (driverPath == IMDB_PATH_BOOL_INDEX) ? boolIndexFor(driverCol) : nullptr;
+  query->scan.zones = (driverPath == IMDB_PATH_ZONE_SCAN) ? zoneMapFor(driverCol) : nullptr;
+  
+  double estimate = (_columnStats != nullptr) ? _columnStats[0].rows : _recordCount;
+  for (int k = 0; k < whereCount; k++) {
+    estimate *= selectivity[k];
+  }
+  plan->path = driverPath;
+  memcpy(plan->order, query->order, whereCount);
+  plan->predicateCount = whereCount;
+  plan->estimatedRows = (uint32_t)(estimate + 0.5);
+  plan->estimatedScanned = driverScanned;
+  plan->actualRows = 0;
+  plan->actualScanned = 0;
+  return IMDB_OK;
+}
+
+bool ESP32IMDB::queryMatches(const IMDBQuery* query, const IMDBRecord* record) const {
+  if (!record->isValid || isRecordExpired(record->expiryMillis)) {
+    return false;
+  }
+  for (int k = 0; k < query->count; k++) {
+    const IMDBPredicate* condition = &query->where[query->order[k]];
+    int colIdx = query->columns[query->order[k]];
+    if (!compareValues(&record->fields[colIdx], condition->value, _columns[colIdx].type, condition->op)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Count records matching every condition
+int32_t ESP32IMDB::countWhere(const IMDBPredicate* where, uint8_t whereCount) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  IMDBQuery query;
+  IMDBPlan plan;
+  if (!_tableExists || planQuery(&query, where, whereCount, &plan) != IMDB_OK) {
+    unlock();
+    return 0;
+  }
+  
+  int32_t cnt = 0;
+  for (int i = nextCandidate(&query.scan, 0); i < _recordCount; i = nextCandidate(&query.scan, i + 1)) {
+    if (queryMatches(&query, &_records[i])) {
+      cnt++;
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, cnt);
+  
+  unlock();
+  return cnt;
+}
+
+// Select all records matching every condition (caller must free results)
+IMDBResult ESP32IMDB::selectAll(const IMDBPredicate* where, uint8_t whereCount,
+                               IMDBSelectResult** results, int* resultCount) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SELECT);
+  lock();
+
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (results == nullptr || resultCount == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  IMDBQuery query;
+  IMDBPlan plan;
+  IMDBResult planned = planQuery(&query, where, whereCount, &plan);
+  if (planned != IMDB_OK) {
+    unlock();
+    return planned;
+  }
+  
+  // Count matches first
+  int matches = 0;
+  for (int i = nextCandidate(&query.scan, 0); i < _recordCount; i = nextCandidate(&query.scan, i + 1)) {
+    if (queryMatches(&query, &_records[i])) {
+      matches++;
+    }
+  }
+  IMDB_STAT_ROWS(_recordCount, matches);
+  
+  if (matches == 0) {
+    *results = nullptr;
+    *resultCount = 0;
+    unlock();
+    return IMDB_ERROR_NO_RECORDS;
+  }
+  
+  if (matches > (INT_MAX / _columnCount / (int)sizeof(IMDBSelectResult))) {
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;  // Would overflow
+  }
+  
+  *results = (IMDBSelectResult*)malloc(sizeof(IMDBSelectResult) * matches * _columnCount);
+  if (*results == nullptr) {
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  int resultIdx = 0;
+  for (int i = nextCandidate(&query.scan, 0); i < _recordCount; i = nextCandidate(&query.scan, i + 1)) {
+    if (queryMatches(&query, &_records[i])) {
+      for (int col = 0; col < _columnCount; col++) {
+        getFieldValue(&_records[i].fields[col], _columns[col].type,
+                     &(*results)[resultIdx * _columnCount + col]);
+      }
+      resultIdx++;
+    }
+  }
+  
+  *resultCount = matches;
+  unlock();
+  return IMDB_OK;
+}
+
+// Plan and run a count, reporting the plan with estimated and actual rows
+IMDBResult ESP32IMDB::explain(const IMDBPredicate* where, uint8_t whereCount, IMDBPlan* plan) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (plan == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  IMDBQuery query;
+  IMDBResult planned = planQuery(&query, where, whereCount, plan);
+  if (planned != IMDB_OK) {
+    unlock();
+    return planned;
+  }
+  
+  for (int i = nextCandidate(&query.scan, 0); i < _recordCount; i = nextCandidate(&query.scan, i + 1)) {
+    plan->actualScanned++;
+    if (queryMatches(&query, &_records[i])) {
+      plan->actualRows++;
+    }
+  }
+  IMDB_STAT_ROWS(plan->actualScanned, plan->actualRows);
+  
+  unlock();
+  return IMDB_OK;
+}
+
+// Collect the column statistics now instead of at the next compound query
+IMDBResult ESP32IMDB::analyze() {
+  lock();
+
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  IMDBResult result = collectColumnStats();
+  unlock();
+  return result;
+}
+
+// Statistics of one column, collected first if they are missing or outdated
+IMDBResult ESP32IMDB::getColumnStats(const char* column, IMDBColumnStats* stats) {
+  lock();
+
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (column == nullptr || stats == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int colIdx = findColumnIndex(column);
+  if (colIdx < 0) {
+    unlock();
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+  
+  IMDBResult result = columnStatsOutdated() ? collectColumnStats() : IMDB_OK;
+  if (result == IMDB_OK) {
+    *stats = _columnStats[colIdx];
+  }
+  unlock();
+  return result;
+}
+
+const char* ESP32IMDB::accessPathName(IMDBAccessPath path) {
+  switch (path) {
+    case IMDB_PATH_FULL_SCAN: return "full scan";
+    case IMDB_PATH_ZONE_SCAN: return "zone scan";
+    case IMDB_PATH_BOOL_INDEX: return "bool index";
+    default: return "unknown";
+  }
+}
+
+// Get total number of records (including invalid)
+int ESP32IMDB::getRecordCount() const {
+  lock();
+  int count = _recordCount;
+  unlock();
+  return count;
+}
+
+// Estimated memory used by the table (bytes), without locking
+size_t ESP32IMDB::getMemoryUsage() const {
+  IMDBMemoryUsage usage;
+  getMemoryBreakdown(&usage);
+  return usage.total;
+}
+
+// Memory used by the table by category. The counters are kept current by every
+// change, so this neither locks nor scans; a change running at the same time
+// may show in some categories and not yet in others.
+IMDBResult ESP32IMDB::getMemoryBreakdown(IMDBMemoryUsage* usage) const {
+  if (usage == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  usage->directory = _memory.directory;
+  usage->fieldArrays = _memory.fieldArrays;
+  usage->strings = _memory.strings;
+  usage->indexes = _memory.indexes;
+  usage->allocatorSlack = _memory.allocatorSlack;
+  usage->fragmentation = _memory.fragmentation;
+  usage->psram = _memory.psram;
+  
+  usage->total = usage->directory + usage->fieldArrays + usage->strings + usage->indexes +
+                 usage->allocatorSlack + usage->fragmentation;
+  return IMDB_OK;
+}
+
+// Helper function to validate hexadecimal character
+static bool isHexChar(char c) {
+  return (c >= '0' && c <= '9') || 
+         (c >= 'a' && c <= 'f') || 
+         (c >= 'A' && c <= 'F');
+}
+
+// Parse MAC address from string (supports multiple formats)
+bool ESP32IMDB::parseMacAddress(const char* macStr, uint8_t* macBytes) {
+  if (macStr == nullptr || macBytes == nullptr) {
+    return false;
+  }
+  
+  // Validate string length before operations to prevent buffer overruns
+  size_t len = strlen(macStr);
+  if (len != 12 && len != 17) {
+    return false;  // Invalid length for MAC address
+  }
+  
+  // Check for 12-character format (no delimiters): aabbccddeeff
+  if (len == 12) {
+    // Validate all characters are hex
+    for (int i = 0; i < 12; i++) {
+      if (!isHexChar(macStr[i])) {
+        return false;
+      }
+    }
+    
+    // Parse hex pairs
+    for (int i = 0; i < 6; i++) {
+      char hex[3] = {macStr[i*2], macStr[i*2+1], '\0'};
+      macBytes[i] = (uint8_t)strtol(hex, nullptr, 16);
+    }
+    return true;
+  }
+  
+  // Check for 17-character format with delimiters: aa:bb:cc:dd:ee:ff or aa-bb-cc-dd-ee-ff
+  if (len == 17) {
+    char delimiter = macStr[2];
+    if (delimiter != ':' && delimiter != '-') {
+      return false;
+    }
+    
+    for (int i = 0; i < 6; i++) {
+      int pos = i * 3;
+      
+      // Validate hex characters for this octet
+      if (!isHexChar(macStr[pos]) || !isHexChar(macStr[pos + 1])) {
+        return false;
+      }
+      
+      char hex[3] = {macStr[pos], macStr[pos + 1], '\0'};
+      macBytes[i] = (uint8_t)strtol(hex, nullptr, 16);
+      
+      // Check delimiters
+      if (i < 5 && macStr[pos + 2] != delimiter) {
+        return false;
+      }
+    }
+    return true;
+  }
+  
+  return false;
+}
+
+// Format MAC address as colon-separated string (output is 18 bytes)
+void ESP32IMDB::formatMacAddress(const uint8_t* macBytes, char* output) {
+  if (macBytes == nullptr || output == nullptr) {
+    if (output != nullptr) {
+      output[0] = '\0';
+    }
+    return;
+  }
+  
+  sprintf(output, "%02x:%02x:%02x:%02x:%02x:%02x",
+          macBytes[0], macBytes[1], macBytes[2],
+          macBytes[3], macBytes[4], macBytes[5]);
+}
+
+// Check if the database is thread-safe (mutex was created successfully)
+bool ESP32IMDB::isThreadSafe() const {
+  return _mutex != nullptr;
+}
+
+// Free memory allocated by selectAll() or top() functions
+void ESP32IMDB::freeSelectResults(IMDBSelectResult* results) {
+  if (results != nullptr) {
+    free(results);
+  }
+}
+
+#if IMDB_ENABLE_STATS
+// Add lock use to an operation type's counters (stats mutex held)
+static void imdbAddLockSample(IMDBStats* all, IMDBStatOp op, const IMDBLockSample* sample) {
+  IMDBOpStats* stats = &all->ops[op];
+  stats->lockAcquisitions += sample->acquisitions;
+  stats->lockContended += sample->contended;
+  stats->lockWaitMicros += sample->waitMicros;
+  if (sample->waitMaxMicros > stats->lockWaitMaxMicros) {
+    stats->lockWaitMaxMicros = sample->waitMaxMicros;
+  }
+  stats->lockHoldMicros += sample->holdMicros;
+  if (sample->holdMaxMicros > stats->lockHoldMaxMicros) {
+    stats->lockHoldMaxMicros = sample->holdMaxMicros;
+  }
+  if (sample->holdMaxMicros > all->maxHoldMicros) {
+    all->maxHoldMicros = sample->holdMaxMicros;
+    all->maxHoldOp = op;
+  }
+}
+
+// Charge one lock hold to the operation running on this task, or to
+// IMDB_STAT_OTHER when the lock was taken outside a timed operation
+void ESP32IMDB::recordLockUse(uint32_t waitMicros, bool contended, uint32_t holdMicros) const {
+  IMDBLockSample sample = {1, contended ? 1u : 0u, waitMicros, waitMicros, holdMicros, holdMicros};
+  
+  IMDBStatScope* scope = imdbActiveStat;
+  if (scope != nullptr && scope->db == this) {
+    IMDBLockSample* own = &scope->lockSample;
+    own->acquisitions++;
+    own->contended += sample.contended;
+    own->waitMicros += waitMicros;
+    if (waitMicros > own->waitMaxMicros) {
+      own->waitMaxMicros = waitMicros;
+    }
+    own->holdMicros += holdMicros;
+    if (holdMicros > own->holdMaxMicros) {
+      own->holdMaxMicros = holdMicros;
+    }
+    return;
+  }
+  
+  if (_statsMutex != nullptr) {
+    xSemaphoreTake(_statsMutex, portMAX_DELAY);
+  }
+  imdbAddLockSample(&_stats, IMDB_STAT_OTHER, &sample);
+  if (_statsMutex != nullptr) {
+    xSemaphoreGive(_statsMutex);
+  }
+}
+
+// Add one finished operation to the stats
+void ESP32IMDB::recordStat(IMDBStatOp op, uint32_t micros, uint32_t rowsScanned, uint32_t rowsMatched,
+                           const IMDBLockSample* lockSample) {
+  int bucket = 0;
+  while (bucket < IMDB_STATS_BUCKETS - 1 && (micros >> (bucket + 1)) != 0) {
+    bucket++;
+  }
+  
+  if (_statsMutex != nullptr) {
+    xSemaphoreTake(_statsMutex, portMAX_DELAY);
+  }
+  IMDBOpStats* stats = &_stats.ops[op];
+  stats->calls++;
+  stats->totalMicros += micros;
+  if (micros > stats->maxMicros) {
+    stats->maxMicros = micros;
+  }
+  stats->rowsScanned += rowsScanned;
+  stats->rowsMatched += rowsMatched;
+  stats->latency[bucket]++;
+  imdbAddLockSample(&_stats, op, lockSample);
+  if (_statsMutex != nullptr) {
+    xSemaphoreGive(_statsMutex);
+  }
+}
+
+// Copy the stats collected since the last reset
+IMDBResult ESP32IMDB::getStats(IMDBStats* stats) const {
+  if (stats == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  if (_statsMutex != nullptr) {
+    xSemaphoreTake(_statsMutex, portMAX_DELAY);
+  }
+  memcpy(stats, &_stats, sizeof(IMDBStats));
+  stats->elapsedMillis = millis() - _statsResetMillis;
+  if (_statsMutex != nullptr) {
+    xSemaphoreGive(_statsMutex);
+  }
+  return IMDB_OK;
+}
+
+// Clear all counters and histograms
+void ESP32IMDB::resetStats() {
+  if (_statsMutex != nullptr) {
+    xSemaphoreTake(_statsMutex, portMAX_DELAY);
+  }
+  memset(&_stats, 0, sizeof(IMDBStats));
+  _statsResetMillis = millis();
+  if (_statsMutex != nullptr) {
+    xSemaphoreGive(_statsMutex);
+  }
+}
+
+const char* ESP32IMDB::statOpName(IMDBStatOp op) {
+  switch (op) {
+    case IMDB_STAT_INSERT: return "insert";
+    case IMDB_STAT_SELECT: return "select";
+    case IMDB_STAT_UPDATE: return "update";
+    case IMDB_STAT_DELETE: return "delete";
+    case IMDB_STAT_SCAN: return "scan";
+    case IMDB_STAT_PURGE: return "purge";
+    case IMDB_STAT_SAVE: return "save";
+    case IMDB_STAT_LOAD: return "load";
+    case IMDB_STAT_OTHER: return "other";
+    default: return "unknown";
+  }
+}
+
+// Upper bound of the histogram bucket holding the given fraction of calls
+uint32_t ESP32IMDB::latencyPercentile(const IMDBOpStats* op, float fraction) {
+  if (op == nullptr || op->calls == 0) {
+    return 0;
+  }
+  
+  uint32_t rank = (uint32_t)ceilf(fraction * op->calls);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint32_t seen = 0;
+  for (int i = 0; i < IMDB_STATS_BUCKETS - 1; i++) {
+    seen += op->latency[i];
+    if (seen >= rank) {
+      uint32_t bound = (2UL << i) - 1;
+      return bound < op->maxMicros ? bound : op->maxMicros;
+    }
+  }
+  return op->maxMicros;
+}
+#endif
+
+// Streaming export and import
+//
+// Exports format rows into an IMDB_STREAM_BUFFER_SIZE buffer under the lock
+// and write it to the output after releasing the lock, then resume at the next
+// row id. Row ids ascend through the table, so rows inserted in between are
+// still exported and deleted rows are skipped, but nothing is written twice.
+// Imports parse rows without the lock against a copy of the schema and insert
+// them IMDB_STREAM_CHUNK_ROWS at a time.
+
+// Export output buffer
+struct IMDBStreamWriter {
+  Print* out;
+  char* buffer;
+  size_t length;
+  bool failed;
+};
+
+static void streamFlush(IMDBStreamWriter* writer) {
+  if (writer->length > 0 && !writer->failed &&
+      writer->out->write((const uint8_t*)writer->buffer, writer->length) != writer->length) {
+    writer->failed = true;
+  }
+  writer->length = 0;
+}
+
+static void streamPut(IMDBStreamWriter* writer, char c) {
+  if (writer->length == IMDB_STREAM_BUFFER_SIZE) {
+    streamFlush(writer);  // Row longer than the buffer; written while still locked
+  }
+  writer->buffer[writer->length++] = c;
+}
+
+static void streamPuts(IMDBStreamWriter* writer, const char* text) {
+  while (*text != '\0') {
+    streamPut(writer, *text++);
+  }
+}
+
+// CSV field, quoted if empty or if it contains a separator, quote, line break
+// or leading/trailing space
+static void streamCsvText(IMDBStreamWriter* writer, const char* text) {
+  size_t length = strlen(text);
+  bool quote = (length == 0 || text[0] == ' ' || text[length - 1] == ' ');
+  for (size_t i = 0; i < length && !quote; i++) {
+    quote = (text[i] == ',' || text[i] == '"' || text[i] == '\r' || text[i] == '\n');
+  }
+  
+  if (!quote) {
+    streamPuts(writer, text);
+    return;
+  }
+  
+  streamPut(writer, '"');
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '"') {
+      streamPut(writer, '"');
+    }
+    streamPut(writer, text[i]);
+  }
+  streamPut(writer, '"');
+}
+
+// JSON string; bytes above 0x7F (UTF-8) pass through unchanged
+static void streamJsonText(IMDBStreamWriter* writer, const char* text) {
+  streamPut(writer, '"');
+  for (const char* p = text; *p != '\0'; p++) {
+    uint8_t c = (uint8_t)*p;
+    if (c == '"' || c == '\\') {
+      streamPut(writer, '\\');
+      streamPut(writer, (char)c);
+    } else if (c == '\n') {
+      streamPuts(writer, "\\n");
+    } else if (c == '\r') {
+      streamPuts(writer, "\\r");
+    } else if (c == '\t') {
+      streamPuts(writer, "\\t");
+    } else if (c < 0x20) {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      streamPuts(writer, escape);
+    } else {
+      streamPut(writer, (char)c);
+    }
+  }
+  streamPut(writer, '"');
+}
+
+// Shortest text that reads back as the same float
+static void formatFloat(float value, char* output, size_t size) {
+  for (int precision = 6; precision < 9; precision++) {
+    snprintf(output, size, "%.*g", precision, value);
+    if (strtof(output, nullptr) == value) {
+      return;
+    }
+  }
+  snprintf(output, size, "%.9g", value);
+}
+
+static void streamField(IMDBStreamWriter* writer, const IMDBFieldValue* field, IMDBDataType type, bool json) {
+  char text[24];
+  
+  switch (type) {
+    case IMDB_TYPE_INT32:
+      snprintf(text, sizeof(text), "%ld", (long)field->int32Value);
+      streamPuts(writer, text);
+      break;
+      
+    case IMDB_TYPE_EPOCH:
+      snprintf(text, sizeof(text), "%lu", (unsigned long)field->epochValue);
+      streamPuts(writer, text);
+      break;
+      
+    case IMDB_TYPE_BOOL:
+      streamPuts(writer, field->boolValue ? "true" : "false");
+      break;
+      
+    case IMDB_TYPE_FLOAT:
+      // JSON has no NaN or infinity
+      if (json && !isfinite(field->floatValue)) {
+        streamPuts(writer, "null");
+        break;
+      }
+      formatFloat(field->floatValue, text, sizeof(text));
+      streamPuts(writer, text);
+      break;
+      
+    case IMDB_TYPE_MAC:
+      ESP32IMDB::formatMacAddress(field->macAddress, text);
+      if (json) {
+        streamJsonText(writer, text);
+      } else {
+        streamPuts(writer, text);
+      }
+      break;
+      
+    case IMDB_TYPE_STRING: {
+      const char* str = (field->stringValue != nullptr) ? field->stringValue : "";
+      if (json) {
+        streamJsonText(writer, str);
+      } else {
+        streamCsvText(writer, str);
+      }
+      break;
+    }
+  }
+}
+
+// Index of the first record whose row id is at least rowId (binary search;
+// row ids ascend through the table)
+int ESP32IMDB::firstRecordFrom(uint32_t rowId) const {
+  int low = 0;
+  int high = _recordCount;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (_records[mid].rowId < rowId) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Column indexes for a projection list (nullptr = all columns, in table
+// order). The caller frees *projection.
+IMDBResult ESP32IMDB::resolveColumns(const char* const* columns, uint8_t columnCount,
+                                     uint8_t** projection, uint8_t* outputCount) const {
+  *outputCount = (columns != nullptr) ? columnCount : _columnCount;
+  *projection = (uint8_t*)malloc(*outputCount);
+  if (*projection == nullptr) {
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  for (int i = 0; i < *outputCount; i++) {
+    int colIdx = i;
+    if (columns != nullptr) {
+      colIdx = (columns[i] != nullptr) ? findColumnIndex(columns[i]) : -1;
+    }
+    if (colIdx < 0) {
+      free(*projection);
+      *projection = nullptr;
+      return IMDB_ERROR_COLUMN_NOT_FOUND;
+    }
+    (*projection)[i] = (uint8_t)colIdx;
+  }
+  return IMDB_OK;
+}
+
+// Write matching rows as CSV: a header line with the column names, then one line per row
+IMDBResult ESP32IMDB::exportCSV(Print& out, const char* whereColumn, const void* whereValue,
+                                const char* const* columns, uint8_t columnCount) {
+  return exportRows(out, false, whereColumn, whereValue, columns, columnCount);
+}
+
+// Write matching rows as a JSON array with one object per row
+IMDBResult ESP32IMDB::exportJSON(Print& out, const char* whereColumn, const void* whereValue,
+                                 const char* const* columns, uint8_t columnCount) {
+  return exportRows(out, true, whereColumn, whereValue, columns, columnCount);
+}
+
+IMDBResult ESP32IMDB::exportRows(Print& out, bool json, const char* whereColumn, const void* whereValue,
+                                 const char* const* columns, uint8_t columnCount) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if ((whereColumn == nullptr) != (whereValue == nullptr) || (columns != nullptr && columnCount == 0)) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  int whereIdx = -1;
+  if (whereColumn != nullptr) {
+    whereIdx = findColumnIndex(whereColumn);
+    if (whereIdx < 0) {
+      unlock();
+      return IMDB_ERROR_COLUMN_NOT_FOUND;
+    }
+  }
+  
+  uint8_t* projection;
+  uint8_t outputCount;
+  IMDBResult result = resolveColumns(columns, columnCount, &projection, &outputCount);
+  if (result != IMDB_OK) {
+    unlock();
+    return result;
+  }
+  
+  IMDBStreamWriter writer = {&out, (char*)malloc(IMDB_STREAM_BUFFER_SIZE), 0, false};
+  if (writer.buffer == nullptr) {
+    free(projection);
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  if (json) {
+    streamPut(&writer, '[');
+  } else {
+    for (int i = 0; i < outputCount; i++) {
+      if (i > 0) {
+        streamPut(&writer, ',');
+      }
+      streamCsvText(&writer, _columns[projection[i]].name);
+    }
+    streamPut(&writer, '\n');
+  }
+  
+  uint32_t generation = _tableGeneration;
+  uint32_t resumeRowId = 0;
+  bool firstRow = true;
+  
+  while (true) {
+    int index = firstRecordFrom(resumeRowId);
+    int examined = 0;
+    while (index < _recordCount && examined < IMDB_STREAM_CHUNK_ROWS &&
+           writer.length < IMDB_STREAM_BUFFER_SIZE / 2) {
+      const IMDBRecord* record = &_records[index++];
+      examined++;
+      
+      if (!record->isValid || isRecordExpired(record->expiryMillis)) {
+        continue;
+      }
+      if (whereIdx >= 0 && !compareValues(&record->fields[whereIdx], whereValue, _columns[whereIdx].type)) {
+        continue;
+      }
+      
+      if (json) {
+        streamPuts(&writer, firstRow ? "\n{" : ",\n{");
+        for (int i = 0; i < outputCount; i++) {
+          if (i > 0) {
+            streamPut(&writer, ',');
+          }
+          streamJsonText(&writer, _columns[projection[i]].name);
+          streamPut(&writer, ':');
+          streamField(&writer, &record->fields[projection[i]], _columns[projection[i]].type, true);
+        }
+        streamPut(&writer, '}');
+      } else {
+        for (int i = 0; i < outputCount; i++) {
+          if (i > 0) {
+            streamPut(&writer, ',');
+          }
+          streamField(&writer, &record->fields[projection[i]], _columns[projection[i]].type, false);
+        }
+        streamPut(&writer, '\n');
+      }
+      firstRow = false;
+      IMDB_STAT_ROWS(0, 1);
+    }
+    IMDB_STAT_ROWS(examined, 0);
+    
+    bool done = (index >= _recordCount);
+    if (!done) {
+      resumeRowId = _records[index].rowId;
+    }
+    unlock();
+    
+    // Output may block (serial port, network); other tasks get the table meanwhile
+    streamFlush(&writer);
+    if (writer.failed) {
+      result = IMDB_ERROR_STREAM_WRITE;
+      break;
+    }
+    if (done) {
+      break;
+    }
+    
+    lock();
+    if (_tableGeneration != generation) {
+      unlock();
+      result = IMDB_ERROR_NO_TABLE;
+      break;
+    }
+  }
+  
+  if (result == IMDB_OK && json) {
+    streamPuts(&writer, firstRow ? "]\n" : "\n]\n");
+    streamFlush(&writer);
+    if (writer.failed) {
+      result = IMDB_ERROR_STREAM_WRITE;
+    }
+  }
+  
+  free(projection);
+  free(writer.buffer);
+  return result;
+}
+
+// Import input buffer
+struct IMDBStreamReader {
+  Stream* in;
+  char* buffer;
+  size_t length;
+  size_t position;
+};
+
+// Next input byte, or -1 at the end of the stream (or on a read timeout)
+static int streamGet(IMDBStreamReader* reader) {
+  if (reader->position == reader->length) {
+    reader->length = reader->in->readBytes(reader->buffer, IMDB_STREAM_BUFFER_SIZE);
+    reader->position = 0;
+    if (reader->length == 0) {
+      return -1;
+    }
+  }
+  return (uint8_t)reader->buffer[reader->position++];
+}
+
+// One parsed CSV field or JSON value
+struct IMDBStreamToken {
+  char text[IMDB_MAX_STRING_LENGTH + 1];
+  size_t length;
+  bool overflow;  // Input was longer than IMDB_MAX_STRING_LENGTH; strings are truncated
+  bool quoted;
+};
+
+static void resetToken(IMDBStreamToken* token, bool quoted) {
+  token->length = 0;
+  token->overflow = false;
+  token->quoted = quoted;
+}
+
+static void tokenAppend(IMDBStreamToken* token, char c) {
+  if (token->length < IMDB_MAX_STRING_LENGTH) {
+    token->text[token->length++] = c;
+  } else {
+    token->overflow = true;
+  }
+}
+
+static void tokenAppendUtf8(IMDBStreamToken* token, uint32_t code) {
+  if (code < 0x80) {
+    tokenAppend(token, (char)code);
+  } else if (code < 0x800) {
+    tokenAppend(token, (char)(0xC0 | (code >> 6)));
+    tokenAppend(token, (char)(0x80 | (code & 0x3F)));
+  } else if (code < 0x10000) {
+    tokenAppend(token, (char)(0xE0 | (code >> 12)));
+    tokenAppend(token, (char)(0x80 | ((code >> 6) & 0x3F)));
+    tokenAppend(token, (char)(0x80 | (code & 0x3F)));
+  } else {
+    tokenAppend(token, (char)(0xF0 | (code >> 18)));
+    tokenAppend(token, (char)(0x80 | ((code >> 12) & 0x3F)));
+    tokenAppend(token, (char)(0x80 | ((code >> 6) & 0x3F)));
+    tokenAppend(token, (char)(0x80 | (code & 0x3F)));
+  }
+}
+
+// Parsing state shared by the CSV and JSON importers
+struct IMDBImportState {
+  IMDBStreamReader reader;
+  IMDBStreamToken* token;
+  IMDBColumn* columns;     // Copy of the schema taken when the import started
+  uint8_t columnCount;
+  uint8_t* columnMap;      // CSV: table column of each field; JSON: columns seen in the current object
+  bool started;            // JSON: opening '[' consumed
+  bool psram;              // Allocate parsed rows in PSRAM (IMDB_PLACE_PSRAM)
+};
+
+static int findImportColumn(const IMDBImportState* state, const char* name) {
+  for (int i = 0; i < state->columnCount; i++) {
+    if (strcmp(state->columns[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Convert a token to a field value; strings are copied to the heap
+static IMDBResult parseFieldValue(const IMDBStreamToken* token, IMDBDataType type, IMDBFieldValue* field,
+                                  bool psram) {
+  const char* text = token->text;
+  char* end = nullptr;
+  
+  if (type != IMDB_TYPE_STRING && (token->overflow || token->length == 0)) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  switch (type) {
+    case IMDB_TYPE_INT32: {
+      long long value = strtoll(text, &end, 10);
+      if (*end != '\0' || value < INT32_MIN || value > INT32_MAX) {
+        return IMDB_ERROR_INVALID_VALUE;
+      }
+      field->int32Value = (int32_t)value;
+      break;
+    }
+    
+    case IMDB_TYPE_EPOCH: {
+      unsigned long long value = strtoull(text, &end, 10);
+      if (*end != '\0' || text[0] == '-' || value > UINT32_MAX) {
+        return IMDB_ERROR_INVALID_VALUE;
+      }
+      field->epochValue = (uint32_t)value;
+      break;
+    }
+    
+    case IMDB_TYPE_FLOAT:
+      field->floatValue = strtof(text, &end);
+      if (*end != '\0') {
+        return IMDB_ERROR_INVALID_VALUE;
+      }
+      break;
+      
+    case IMDB_TYPE_BOOL:
+      if (strcmp(text, "true") == 0 || strcmp(text, "1") == 0) {
+        field->boolValue = true;
+      } else if (strcmp(text, "false") == 0 || strcmp(text, "0") == 0) {
+        field->boolValue = false;
+      } else {
+        return IMDB_ERROR_INVALID_VALUE;
+      }
+      break;
+      
+    case IMDB_TYPE_MAC:
+      if (!ESP32IMDB::parseMacAddress(text, field->macAddress)) {
+        return IMDB_ERROR_INVALID_MAC_FORMAT;
+      }
+      break;
+      
+    case IMDB_TYPE_STRING:
+      field->stringValue = (char*)imdbAllocBulk(token->length + 1, psram);
+      if (field->stringValue == nullptr) {
+        return IMDB_ERROR_OUT_OF_MEMORY;
+      }
+      memcpy(field->stringValue, text, token->length);
+      field->stringValue[token->length] = '\0';
+      break;
+  }
+  
+  return IMDB_OK;
+}
+
+// Free a parsed row that never made it into the table
+static void freeImportedRow(IMDBFieldValue* fields, const IMDBColumn* columns, uint8_t columnCount) {
+  for (int i = 0; i < columnCount; i++) {
+    if (columns[i].type == IMDB_TYPE_STRING) {
+      heap_caps_free(fields[i].stringValue);
+    }
+  }
+  heap_caps_free(fields);
+}
+
+// Read one CSV field (RFC 4180 quoting). *end receives the character that
+// ended it: ',', '\n' or -1 at the end of the input.
+static bool readCsvField(IMDBStreamReader* reader, IMDBStreamToken* token, int* end) {
+  int c = streamGet(reader);
+  
+  if (c == '"') {
+    resetToken(token, true);
+    while (true) {
+      c = streamGet(reader);
+      if (c < 0) {
+        return false;  // Unterminated quote
+      }
+      if (c == '"') {
+        c = streamGet(reader);
+        if (c != '"') {
+          break;
+        }
+      }
+      tokenAppend(token, (char)c);
+    }
+    if (c == '\r') {
+      c = streamGet(reader);
+    }
+    if (c >= 0 && c != ',' && c != '\n') {
+      return false;  // Text after the closing quote
+    }
+  } else {
+    resetToken(token, false);
+    while (c >= 0 && c != ',' && c != '\n') {
+      if (c != '\r') {
+        tokenAppend(token, (char)c);
+      }
+      c = streamGet(reader);
+    }
+  }
+  
+  token->text[token->length] = '\0';
+  *end = c;
+  return true;
+}
+
+// Header line: every table column exactly once, in any order
+static IMDBResult readCsvHeader(IMDBImportState* state) {
+  IMDBStreamToken* token = state->token;
+  int field = 0;
+  int end;
+  
+  do {
+    if (!readCsvField(&state->reader, token, &end)) {
+      return IMDB_ERROR_PARSE;
+    }
+    if (field == 0 && end < 0 && token->length == 0 && !token->quoted) {
+      return IMDB_ERROR_PARSE;  // Empty input
+    }
+    if (field >= state->columnCount) {
+      return IMDB_ERROR_COLUMN_COUNT_MISMATCH;
+    }
+    
+    int colIdx = findImportColumn(state, token->text);
+    if (colIdx < 0) {
+      return IMDB_ERROR_COLUMN_NOT_FOUND;
+    }
+    for (int i = 0; i < field; i++) {
+      if (state->columnMap[i] == colIdx) {
+        return IMDB_ERROR_INVALID_VALUE;
+      }
+    }
+    state->columnMap[field++] = (uint8_t)colIdx;
+  } while (end == ',');
+  
+  return (field == state->columnCount) ? IMDB_OK : IMDB_ERROR_COLUMN_COUNT_MISMATCH;
+}
+
+static IMDBResult readCsvRow(IMDBImportState* state, IMDBFieldValue* fields, bool* done) {
+  IMDBStreamToken* token = state->token;
+  int field = 0;
+  int end;
+  
+  *done = false;
+  while (true) {
+    if (!readCsvField(&state->reader, token, &end)) {
+      return IMDB_ERROR_PARSE;
+    }
+    
+    // Blank line, or the end of the input
+    if (field == 0 && end != ',' && token->length == 0 && !token->quoted) {
+      if (end < 0) {
+        *done = true;
+        return IMDB_OK;
+      }
+      continue;
+    }
+    
+    if (field >= state->columnCount) {
+      return IMDB_ERROR_COLUMN_COUNT_MISMATCH;
+    }
+    uint8_t colIdx = state->columnMap[field++];
+    IMDBResult result = parseFieldValue(token, state->columns[colIdx].type, &fields[colIdx], state->psram);
+    if (result != IMDB_OK) {
+      return result;
+    }
+    
+    if (end != ',') {
+      break;
+    }
+  }
+  
+  return (field == state->columnCount) ? IMDB_OK : IMDB_ERROR_COLUMN_COUNT_MISMATCH;
+}
+
+static int skipJsonSpace(IMDBStreamReader* reader) {
+  int c;
+  do {
+    c = streamGet(reader);
+  } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+  return c;
+}
+
+static bool readJsonHex(IMDBStreamReader* reader, uint32_t* code) {
+  *code = 0;
+  for (int i = 0; i < 4; i++) {
+    int c = streamGet(reader);
+    int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    *code = (*code << 4) | (uint32_t)digit;
+  }
+  return true;
+}
+
+// Read a JSON string after its opening quote, decoding escapes to UTF-8
+static bool readJsonString(IMDBStreamReader* reader, IMDBStreamToken* token) {
+  resetToken(token, true);
+  
+  while (true) {
+    int c = streamGet(reader);
+    if (c < 0) {
+      return false;
+    }
+    if (c == '"') {
+      break;
+    }
+    if (c != '\\') {
+      tokenAppend(token, (char)c);
+      continue;
+    }
+    
+    c = streamGet(reader);
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        tokenAppend(token, (char)c);
+        break;
+      case 'b': tokenAppend(token, '\b'); break;
+      case 'f': tokenAppend(token, '\f'); break;
+      case 'n': tokenAppend(token, '\n'); break;
+      case 'r': tokenAppend(token, '\r'); break;
+      case 't': tokenAppend(token, '\t'); break;
+      case 'u': {
+        uint32_t code;
+        if (!readJsonHex(reader, &code)) {
+          return false;
+        }
+        // Characters outside the BMP arrive as a surrogate pair
+        if (code >= 0xD800 && code < 0xDC00) {
+          uint32_t low;
+          if (streamGet(reader) != '\\' || streamGet(reader) != 'u' || !readJsonHex(reader, &low) ||
+              low < 0xDC00 || low > 0xDFFF) {
+            return false;
+          }
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+        tokenAppendUtf8(token, code);
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  
+  token->text[token->length] = '\0';
+  return true;
+}
+
+// Next object of the top-level array: a member for every table column
+static IMDBResult readJsonRow(IMDBImportState* state, IMDBFieldValue* fields, bool* done) {
+  IMDBStreamReader* reader = &state->reader;
+  IMDBStreamToken* token = state->token;
+  
+  *done = false;
+  int c = skipJsonSpace(reader);
+  if (!state->started) {
+    if (c != '[') {
+      return IMDB_ERROR_PARSE;
+    }
+    state->started = true;
+    c = skipJsonSpace(reader);
+  } else if (c == ',') {
+    c = skipJsonSpace(reader);
+  } else if (c != ']') {
+    return IMDB_ERROR_PARSE;
+  }
+  
+  if (c == ']') {
+    *done = true;
+    return IMDB_OK;
+  }
+  if (c != '{') {
+    return IMDB_ERROR_PARSE;
+  }
+  
+  memset(state->columnMap, 0, state->columnCount);
+  int present = 0;
+  
+  c = skipJsonSpace(reader);
+  while (c != '}') {
+    if (c != '"' || !readJsonString(reader, token)) {
+      return IMDB_ERROR_PARSE;
+    }
+    int colIdx = findImportColumn(state, token->text);
+    if (colIdx < 0) {
+      return IMDB_ERROR_COLUMN_NOT_FOUND;
+    }
+    if (state->columnMap[colIdx]) {
+      return IMDB_ERROR_INVALID_VALUE;  // Duplicate member
+    }
+    state->columnMap[colIdx] = 1;
+    present++;
+    
+    if (skipJsonSpace(reader) != ':') {
+      return IMDB_ERROR_PARSE;
+    }
+    
+    IMDBDataType type = state->columns[colIdx].type;
+    bool textColumn = (type == IMDB_TYPE_STRING || type == IMDB_TYPE_MAC);
+    c = skipJsonSpace(reader);
+    if (c == '"') {
+      if (!readJsonString(reader, token)) {
+        return IMDB_ERROR_PARSE;
+      }
+      if (!textColumn) {
+        return IMDB_ERROR_INVALID_TYPE;
+      }
+      c = skipJsonSpace(reader);
+    } else {
+      // Number or literal, up to the next delimiter
+      resetToken(token, false);
+      while (c >= 0 && c != ',' && c != '}' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        tokenAppend(token, (char)c);
+        c = streamGet(reader);
+      }
+      token->text[token->length] = '\0';
+      if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        c = skipJsonSpace(reader);
+      }
+      if (textColumn) {
+        return IMDB_ERROR_INVALID_TYPE;
+      }
+    }
+    
+    IMDBResult result;
+    if (type == IMDB_TYPE_FLOAT && !token->quoted && strcmp(token->text, "null") == 0) {
+      fields[colIdx].floatValue = NAN;  // Written for NaN and infinity
+      result = IMDB_OK;
+    } else {
+      result = parseFieldValue(token, type, &fields[colIdx], state->psram);
+    }
+    if (result != IMDB_OK) {
+      return result;
+    }
+    
+    if (c == ',') {
+      c = skipJsonSpace(reader);
+    } else if (c != '}') {
+      return IMDB_ERROR_PARSE;
+    }
+  }
+  
+  return (present == state->columnCount) ? IMDB_OK : IMDB_ERROR_COLUMN_COUNT_MISMATCH;
+}
+
+// Insert rows from CSV with a header line naming every column, in any order
+IMDBResult ESP32IMDB::importCSV(Stream& in, uint32_t ttlMillis, int* importedCount) {
+  return importRows(in, false, ttlMillis, importedCount);
+}
+
+// Insert rows from a JSON array of objects with a member for every column
+IMDBResult ESP32IMDB::importJSON(Stream& in, uint32_t ttlMillis, int* importedCount) {
+  return importRows(in, true, ttlMillis, importedCount);
+}
+
+IMDBResult ESP32IMDB::importRows(Stream& in, bool json, uint32_t ttlMillis, int* importedCount) {
+  if (importedCount != nullptr) {
+    *importedCount = 0;
+  }
+  
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (ttlMillis > IMDB_MAX_TTL_MS) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  IMDBImportState state;
+  memset(&state, 0, sizeof(state));
+  state.reader.in = &in;
+  state.reader.buffer = (char*)malloc(IMDB_STREAM_BUFFER_SIZE);
+  state.token = (IMDBStreamToken*)malloc(sizeof(IMDBStreamToken));
+  state.columns = (IMDBColumn*)malloc(sizeof(IMDBColumn) * _columnCount);
+  state.columnCount = _columnCount;
+  state.columnMap = (uint8_t*)malloc(_columnCount);
+  state.psram = (_placement == IMDB_PLACE_PSRAM);
+  IMDBFieldValue** batch = (IMDBFieldValue**)malloc(sizeof(IMDBFieldValue*) * IMDB_STREAM_CHUNK_ROWS);
+  if (state.reader.buffer == nullptr || state.token == nullptr || state.columns == nullptr ||
+      state.columnMap == nullptr || batch == nullptr) {
+    free(state.reader.buffer);
+    free(state.token);
+    free(state.columns);
+    free(state.columnMap);
+    free(batch);
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  memcpy(state.columns, _columns, sizeof(IMDBColumn) * _columnCount);
+  uint32_t generation = _tableGeneration;
+  unlock();
+  
+  IMDBResult result = json ? IMDB_OK : readCsvHeader(&state);
+  int batched = 0;
+  int imported = 0;
+  bool done = false;
+  
+  while (result == IMDB_OK && !done) {
+    // The heap governor is only touched under the lock: insertBatchLocked()
+    // checks the limit for every row it takes
+    IMDBFieldValue* fields = (IMDBFieldValue*)imdbAllocBulk(sizeof(IMDBFieldValue) * state.columnCount,
+                                                            state.psram);
+    if (fields == nullptr) {
+      lock();
+      heapAllocationFailed();
+      unlock();
+      result = IMDB_ERROR_OUT_OF_MEMORY;
+    } else {
+      memset(fields, 0, sizeof(IMDBFieldValue) * state.columnCount);
+    }
+    
+    if (result == IMDB_OK) {
+      result = json ? readJsonRow(&state, fields, &done) : readCsvRow(&state, fields, &done);
+      if (result == IMDB_OK && !done) {
+        batch[batched++] = fields;
+        fields = nullptr;
+      }
+    }
+    if (fields != nullptr) {
+      freeImportedRow(fields, state.columns, state.columnCount);
+    }
+    
+    // Rows parsed before an error are still inserted
+    if (batched == IMDB_STREAM_CHUNK_ROWS || (batched > 0 && (done || result != IMDB_OK))) {
+      lock();
+      IMDBResult batchResult = IMDB_ERROR_NO_TABLE;
+      if (_tableGeneration == generation) {
+        batchResult = insertBatchLocked(batch, batched, ttlMillis);
+      }
+      unlock();
+      
+      for (int i = 0; i < batched; i++) {
+        if (batch[i] == nullptr) {
+          imported++;
+        } else {
+          freeImportedRow(batch[i], state.columns, state.columnCount);
+        }
+      }
+      batched = 0;
+      
+      if (result == IMDB_OK) {
+        result = batchResult;
+      }
+    }
+  }
+  
+  free(state.reader.buffer);
+  free(state.token);
+  free(state.columns);
+  free(state.columnMap);
+  free(batch);
+  
+  if (importedCount != nullptr) {
+    *importedCount = imported;
+  }
+  return result;
+}
+
+// Append parsed rows as new records (caller holds the lock). Rows taken into
+// the table are set to nullptr; any others still belong to the caller.
+IMDBResult ESP32IMDB::insertBatchLocked(IMDBFieldValue** rows, int rowCount, uint32_t ttlMillis) {
+  IMDBResult walResult = IMDB_OK;
+#if IMDB_ENABLE_PERSISTENCE
+  // Each row is logged as an insert; &fields[i] is the value pointer insert() takes
+  const void** values = nullptr;
+  if (_walEnabled) {
+    values = (const void**)malloc(sizeof(void*) * _columnCount);
+    if (values == nullptr) {
+      walResult = IMDB_ERROR_OUT_OF_MEMORY;
+    }
+  }
+#endif
+  
+  uint32_t expiryMillis = expiryForTTL(ttlMillis);
+  for (int i = 0; i < rowCount; i++) {
+    // Rows were parsed without the lock, so the limit is checked here; a ring
+    // buffer copies them into storage it already has
+    if (_ringCapacity == 0 && !checkHeapLimit()) {
+      walResult = IMDB_ERROR_HEAP_LIMIT;
+      break;
+    }
+    
+    IMDBRecord* record;
+    if (_ringCapacity > 0) {
+      // Ring storage takes a copy of the row
+      record = ringAppendSlot();
+      IMDBRecord parsed;
+      memset(&parsed, 0, sizeof(parsed));
+      parsed.fields = rows[i];
+      parsed.isValid = true;
+      copyIntoRing(record, &parsed);
+      freeImportedRow(rows[i], _columns, _columnCount);
+      _recordCount++;
+    } else {
+      // Checked per row: a checkpoint triggered by the log may have shrunk the array
+      if (_recordCount >= _recordCapacity) {
+        IMDBResult result = growRecordArray();
+        if (result != IMDB_OK) {
+          walResult = result;
+          break;
+        }
+      }
+      
+      record = &_records[_recordCount++];
+      record->fields = rows[i];
+    }
+    record->expiryMillis = expiryMillis;
+    record->rowId = _nextRowId++;
+    record->isValid = true;
+#if IMDB_ENABLE_PERSISTENCE
+    record->isDirty = true;
+#endif
+    rows[i] = nullptr;
+    trackRecord(record, true);
+    indexBoolSlot(_recordCount - 1);
+    zoneMapSlot(_recordCount - 1);
+    filterRecord(record, true);
+    _columnStatsChanges++;
+    
+#if IMDB_ENABLE_PERSISTENCE
+    if (_walEnabled) {
+      if (values != nullptr) {
+        for (int col = 0; col < _columnCount; col++) {
+          values[col] = &record->fields[col];
+        }
+        walResult = walLogInsert(values, record->expiryMillis);
+      }
+      // Like insert(), a row that couldn't be logged stays; the rest are not inserted
+      if (walResult != IMDB_OK) {
+        break;
+      }
+    }
+#endif
+  }
+  
+#if IMDB_ENABLE_PERSISTENCE
+  free(values);
+#endif
+  return walResult;
+}
+
+// Binary wire encoding
+//
+// encodeRows() writes chunks in the layout described in IMDBWire.h straight
+// from the records into the caller's buffer. Each call takes the lock once
+// and fills one chunk with whole rows; the cursor resumes at the next row id,
+// like the streaming exports.
+
+// Encoded size of a row's projected columns
+size_t ESP32IMDB::wireRowSize(const IMDBRecord* record, const uint8_t* projection, uint8_t outputCount,
+                              size_t boolBytes) const {
+  size_t size = boolBytes;
+  for (int i = 0; i < outputCount; i++) {
+    const IMDBFieldValue* field = &record->fields[projection[i]];
+    switch (_columns[projection[i]].type) {
+      case IMDB_TYPE_INT32:
+        size += imdbWireVarintSize(imdbWireZigzag(field->int32Value));
+        break;
+      case IMDB_TYPE_EPOCH:
+        size += imdbWireVarintSize(field->epochValue);
+        break;
+      case IMDB_TYPE_FLOAT:
+        size += 4;
+        break;
+      case IMDB_TYPE_MAC:
+        size += 6;
+        break;
+      case IMDB_TYPE_STRING: {
+        size_t length = (field->stringValue != nullptr) ? strlen(field->stringValue) : 0;
+        size += imdbWireVarintSize((uint32_t)length) + length;
+        break;
+      }
+      case IMDB_TYPE_BOOL:
+        break;
+    }
+  }
+  return size;
+}
+
+IMDBResult ESP32IMDB::encodeRows(IMDBWireCursor* cursor, uint8_t* buffer, size_t capacity, size_t* length) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SCAN);
+  lock();
+  
+#if IMDB_ENABLE_PERSISTENCE
+  finishLazyLoad();
+#endif
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (cursor == nullptr || buffer == nullptr || length == nullptr ||
+      (cursor->whereColumn == nullptr) != (cursor->whereValue == nullptr) ||
+      (cursor->columns != nullptr && cursor->columnCount == 0) ||
+      cursor->schemaMode > IMDB_WIRE_SCHEMA_EVERY) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  *length = 0;
+  if (cursor->finished) {
+    unlock();
+    return IMDB_OK;
+  }
+  
+  // A series stays on the table it started on
+  if (cursor->chunks == 0) {
+    cursor->tableGeneration = _tableGeneration;
+  } else if (cursor->tableGeneration != _tableGeneration) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  int whereIdx = -1;
+  if (cursor->whereColumn != nullptr) {
+    whereIdx = findColumnIndex(cursor->whereColumn);
+    if (whereIdx < 0) {
+      unlock();
+      return IMDB_ERROR_COLUMN_NOT_FOUND;
+    }
+  }
+  
+  uint8_t* projection;
+  uint8_t outputCount;
+  IMDBResult result = resolveColumns(cursor->columns, cursor->columnCount, &projection, &outputCount);
+  if (result != IMDB_OK) {
+    unlock();
+    return result;
+  }
+  
+  // Schema tag, schema section size and packed BOOL bytes
+  uint32_t hash = IMDB_WIRE_TAG_SEED;
+  size_t schemaSize = 1;
+  size_t boolCount = 0;
+  for (int i = 0; i < outputCount; i++) {
+    const IMDBColumn* column = &_columns[projection[i]];
+    size_t nameLength = strlen(column->name);
+    hash = imdbWireHashColumn(hash, (uint8_t)column->type, column->name, nameLength);
+    schemaSize += 2 + nameLength;
+    if (column->type == IMDB_TYPE_BOOL) {
+      boolCount++;
+    }
+  }
+  size_t boolBytes = (boolCount + 7) / 8;
+  uint16_t schemaTag = imdbWireSchemaTag(hash);
+  
+  bool withSchema = (cursor->schemaMode == IMDB_WIRE_SCHEMA_EVERY) ||
+                    (cursor->schemaMode == IMDB_WIRE_SCHEMA_FIRST && cursor->chunks == 0);
+  if (capacity < IMDB_WIRE_HEADER_SIZE + (withSchema ? schemaSize : 0)) {
+    free(projection);
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;  // Buffer can't hold the header
+  }
+  
+  uint8_t* out = buffer + IMDB_WIRE_HEADER_SIZE;
+  if (withSchema) {
+    *out++ = outputCount;
+    for (int i = 0; i < outputCount; i++) {
+      const IMDBColumn* column = &_columns[projection[i]];
+      size_t nameLength = strlen(column->name);
+      *out++ = (uint8_t)column->type;
+      *out++ = (uint8_t)nameLength;
+      memcpy(out, column->name, nameLength);
+      out += nameLength;
+    }
+  }
+  
+  int index = firstRecordFrom(cursor->nextRowId);
+  uint16_t rows = 0;
+  while (index < _recordCount && rows < UINT16_MAX) {
+    const IMDBRecord* record = &_records[index];
+    if (!record->isValid || isRecordExpired(record->expiryMillis) ||
+        (whereIdx >= 0 && !compareValues(&record->fields[whereIdx], cursor->whereValue, _columns[whereIdx].type))) {
+      index++;
+      continue;
+    }
+    
+    size_t rowSize = wireRowSize(record, projection, outputCount, boolBytes);
+    if (rowSize > (size_t)(buffer + capacity - out)) {
+      if (rows == 0) {
+        free(projection);
+        unlock();
+        return IMDB_ERROR_INVALID_VALUE;  // Row larger than an empty chunk
+      }
+      break;
+    }
+    
+    uint8_t* bools = out;
+    memset(bools, 0, boolBytes);
+    out += boolBytes;
+    int boolIndex = 0;
+    for (int i = 0; i < outputCount; i++) {
+      const IMDBFieldValue* field = &record->fields[projection[i]];
+      switch (_columns[projection[i]].type) {
+        case IMDB_TYPE_BOOL:
+          if (field->boolValue) {
+            bools[boolIndex / 8] |= (uint8_t)(1 << (boolIndex % 8));
+          }
+          boolIndex++;
+          break;
+        case IMDB_TYPE_INT32:
+          out = imdbWirePutVarint(out, imdbWireZigzag(field->int32Value));
+          break;
+        case IMDB_TYPE_EPOCH:
+          out = imdbWirePutVarint(out, field->epochValue);
+          break;
+        case IMDB_TYPE_FLOAT: {
+          uint32_t raw;
+          memcpy(&raw, &field->floatValue, 4);
+          out[0] = (uint8_t)raw;
+          out[1] = (uint8_t)(raw >> 8);
+          out[2] = (uint8_t)(raw >> 16);
+          out[3] = (uint8_t)(raw >> 24);
+          out += 4;
+          break;
+        }
+        case IMDB_TYPE_MAC:
+          memcpy(out, field->macAddress, 6);
+          out += 6;
+          break;
+        case IMDB_TYPE_STRING: {
+          size_t stringLength = (field->stringValue != nullptr) ? strlen(field->stringValue) : 0;
+          out = imdbWirePutVarint(out, (uint32_t)stringLength);
+          if (stringLength > 0) {
+            memcpy(out, field->stringValue, stringLength);
+            out += stringLength;
+          }
+          break;
+        }
+      }
+    }
+    
+    rows++;
+    index++;
+  }
+  
+  bool lastChunk = (index >= _recordCount);
+  cursor->nextRowId = lastChunk ? _nextRowId : _records[index].rowId;
+  cursor->rowsEncoded += rows;
+  cursor->chunks++;
+  cursor->finished = lastChunk;
+  
+  buffer[0] = IMDB_WIRE_MAGIC_0;
+  buffer[1] = IMDB_WIRE_MAGIC_1;
+  buffer[2] = IMDB_WIRE_VERSION;
+  buffer[3] = (withSchema ? IMDB_WIRE_FLAG_SCHEMA : 0) | (lastChunk ? IMDB_WIRE_FLAG_FINAL : 0);
+  buffer[4] = (uint8_t)rows;
+  buffer[5] = (uint8_t)(rows >> 8);
+  buffer[6] = (uint8_t)schemaTag;
+  buffer[7] = (uint8_t)(schemaTag >> 8);
+  *length = (size_t)(out - buffer);
+  
+  free(projection);
+  unlock();
+  return IMDB_OK;
+}
+
+#if IMDB_ENABLE_PERSISTENCE
+
+// File format versions. v1: uint16_t record count, unframed. v2: uint32_t
+// record count; everything after the 5-byte preamble ("IMDB" + version) is a
+// sequence of blocks framed as [uint32_t length][payload][uint32_t CRC32].
+#define IMDB_FILE_VERSION_V1 1
+#define IMDB_FILE_VERSION_V2 2
+#define IMDB_FILE_VERSION_V3 3  // Compressed columnar row groups
+
+// v2 header flags
+#define IMDB_FILE_FLAG_CHECKPOINT_ID 0x01  // uint32_t WAL checkpoint id follows the header
+#define IMDB_FILE_FLAG_ROW_IDS 0x02        // Incremental base: uint32_t baseId and nextRowId follow,
+                                           // and every record is prefixed with its uint32_t rowId
+#define IMDB_FILE_FLAG_KEY_INDEX 0x04      // Lazy load key: keyColumn u8, reserved u8[3], blockSize u32 and
+                                           // indexOffset u32 follow; the key index comes after the records
+#define IMDB_FILE_FLAG_RING 0x08           // Ring buffer table: uint32_t ring capacity follows (also v3)
+#define IMDB_FILE_KNOWN_FLAGS (IMDB_FILE_FLAG_CHECKPOINT_ID | IMDB_FILE_FLAG_ROW_IDS | \
+                               IMDB_FILE_FLAG_KEY_INDEX | IMDB_FILE_FLAG_RING)
+
+// Bytes of framing around each v2 block payload (length prefix + CRC trailer)
+#define IMDB_BLOCK_FRAMING 8
+
+// Key index for lazy loads, stored after the records of a v2 file: one entry
+// per record, sorted by key and then offset. The key is the value itself for
+// INT32 and EPOCH columns and an FNV-1a hash for STRING and MAC columns, so
+// equal keys only mark candidates. offset is the record's position in the
+// block payload (framing excluded), which lets a reader seek straight to it.
+struct IMDBKeyIndexEntry {
+  uint32_t key;
+  uint32_t offset;
+};
+
+// Key index value of a field; FLOAT and BOOL columns can't be keys
+static uint32_t keyIndexKey(const IMDBFieldValue* field, IMDBDataType type) {
+  switch (type) {
+    case IMDB_TYPE_MAC:
+      return hashString((const char*)field->macAddress, 6);
+    case IMDB_TYPE_STRING:
+      return (field->stringValue != nullptr) ? hashString(field->stringValue, strlen(field->stringValue)) :
+                                               hashString("", 0);
+    default:
+      return (uint32_t)field->int32Value;  // INT32 and EPOCH share the union's first 4 bytes
+  }
+}
+
+// Order key index entries by key, then offset
+static int compareKeyIndexEntries(const void* a, const void* b) {
+  const IMDBKeyIndexEntry* entryA = (const IMDBKeyIndexEntry*)a;
+  const IMDBKeyIndexEntry* entryB = (const IMDBKeyIndexEntry*)b;
+  if (entryA->key != entryB->key) {
+    return (entryA->key < entryB->key) ? -1 : 1;
+  }
+  return (entryA->offset < entryB->offset) ? -1 : (entryA->offset > entryB->offset);
+}
+
+// Buffered block writer for persistence. Fields are encoded into a fixed-size
+// RAM buffer and the filesystem only sees whole blocks, instead of one tiny
+// VFS call per flag, expiry and field. Each flush emits one framed v2 block;
+// the buffer reserves room for the framing so a block is a single write.
+// With file == nullptr the writer instead lays blocks out back to back in a
+// RAM image sized by snapshotImageSize(), advancing buffer past each block.
+struct IMDBBlockWriter {
+  IMDBFile* file;
+  uint8_t* buffer;       // IMDB_PERSIST_BLOCK_SIZE + IMDB_BLOCK_FRAMING bytes
+  size_t used;           // Payload bytes buffered (payload starts at buffer + 4)
+  bool failed;
+};
+
+// Write unframed bytes (the preamble) ahead of the first block
+static bool writeRawBytes(IMDBBlockWriter* writer, const void* data, size_t length) {
+  if (writer->file == nullptr) {
+    memcpy(writer->buffer, data, length);
+    writer->buffer += length;
+  } else if (writer->file->write((const uint8_t*)data, length) != length) {
+    writer->failed = true;
+  }
+  return !writer->failed;
+}
+
+// Frame the buffered payload and hand it to the filesystem
+static bool flushBlock(IMDBBlockWriter* writer) {
+  if (writer->failed) {
+    return false;
+  }
+  if (writer->used > 0) {
+    uint32_t length = (uint32_t)writer->used;
+    uint32_t crc = imdbCrc32(0, writer->buffer + 4, writer->used);
+    memcpy(writer->buffer, &length, 4);
+    memcpy(writer->buffer + 4 + writer->used, &crc, 4);
+    size_t total = writer->used + IMDB_BLOCK_FRAMING;
+    if (writer->file == nullptr) {
+      writer->buffer += total;
+    } else if (writer->file->write(writer->buffer, total) != total) {
+      writer->failed = true;
+      return false;
+    }
+    writer->used = 0;
+  }
+  return true;
+}
+
+// Append bytes to the block buffer, flushing whenever it fills
+static bool writeBlockBytes(IMDBBlockWriter* writer, const void* data, size_t length) {
+  const uint8_t* src = (const uint8_t*)data;
+  while (length > 0) {
+    if (writer->used == IMDB_PERSIST_BLOCK_SIZE && !flushBlock(writer)) {
+      return false;
+    }
+    size_t chunk = IMDB_PERSIST_BLOCK_SIZE - writer->used;
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(writer->buffer + 4 + writer->used, src, chunk);
+    writer->used += chunk;
+    src += chunk;
+    length -= chunk;
+  }
+  return !writer->failed;
+}
+
+// Encode one record (isValid flag, expiry, fields) into the block buffer
+bool ESP32IMDB::writeRecord(IMDBBlockWriter* writer, const IMDBRecord* record) const {
+  uint8_t isValid = record->isValid ? 1 : 0;
+  writeBlockBytes(writer, &isValid, 1);
+  writeBlockBytes(writer, &record->expiryMillis, 4);
+  
+  for (int j = 0; j < _columnCount; j++) {
+    const IMDBFieldValue* field = &record->fields[j];
+    
+    switch (_columns[j].type) {
+      case IMDB_TYPE_INT32:
+        writeBlockBytes(writer, &field->int32Value, 4);
+        break;
+        
+      case IMDB_TYPE_FLOAT:
+        writeBlockBytes(writer, &field->floatValue, 4);
+        break;
+        
+      case IMDB_TYPE_BOOL: {
+        uint8_t boolValue = field->boolValue ? 1 : 0;
+        writeBlockBytes(writer, &boolValue, 1);
+        break;
+      }
+      
+      case IMDB_TYPE_MAC:
+        writeBlockBytes(writer, field->macAddress, 6);
+        break;
+        
+      case IMDB_TYPE_EPOCH:
+        writeBlockBytes(writer, &field->epochValue, 4);
+        break;
+        
+      case IMDB_TYPE_STRING: {
+        uint8_t length = 0;
+        if (field->stringValue) {
+          size_t strLen = strlen(field->stringValue);
+          // Clamp to max string length for safety
+          length = (strLen > IMDB_MAX_STRING_LENGTH) ? IMDB_MAX_STRING_LENGTH : (uint8_t)strLen;
+        }
+        writeBlockBytes(writer, &length, 1);
+        if (length > 0) {
+          writeBlockBytes(writer, field->stringValue, length);
+        }
+        break;
+      }
+    }
+  }
+  
+  return !writer->failed;
+}
+
+// Select the filesystem used by all persistence functions
+IMDBResult ESP32IMDB::setStorage(IMDBStorage* storage) {
+  lock();
+  
+  finishLazyLoad();
+  
+  // The open log and a background save belong to the current storage
+  if (_walEnabled || _saveInProgress) {
+    unlock();
+    return IMDB_ERROR_INVALID_OPERATION;
+  }
+  
+  IMDBStorage* selected = (storage != nullptr) ? storage : &imdbSpiffsStorage;
+  if (selected != _storage && _incFilename != nullptr) {
+    _incNeedsBase = true;  // Deltas can't extend a base on another filesystem
+  }
+  _storage = selected;
+  
+  unlock();
+  return IMDB_OK;
+}
+
+// Save database to a file
+IMDBResult ESP32IMDB::saveToFile(const char* filename) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SAVE);
+  lock();
+  
+  finishLazyLoad();
+  
+  if (!_tableExists) {
+    unlock();
+    return IMDB_ERROR_NO_TABLE;
+  }
+  
+  if (filename == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  if (saveTargetBusy(filename)) {
+    unlock();
+    return IMDB_ERROR_INVALID_OPERATION;
+  }
+  
+  IMDBResult result;
+  if (_walEnabled && strcmp(filename, _walSnapshotFilename) == 0) {
+    // Saving over the WAL snapshot must also restart the log
+    result = checkpointLocked();
+  } else {
+    result = saveSnapshotLocked(filename, 0);
+  }
+  
+  unlock();
+  return result;
+}
+
+// Encoded size of one record, matching writeRecord()
+size_t ESP32IMDB::recordEncodedSize(const IMDBRecord* record) const {
+  size_t size = 1 + 4;
+  for (int j = 0; j < _columnCount; j++) {
+    switch (_columns[j].type) {
+      case IMDB_TYPE_BOOL:
+        size += 1;
+        break;
+      case IMDB_TYPE_MAC:
+        size += 6;
+        break;
+      case IMDB_TYPE_STRING: {
+        size_t strLen = record->fields[j].stringValue ? strlen(record->fields[j].stringValue) : 0;
+        size += 1 + ((strLen > IMDB_MAX_STRING_LENGTH) ? IMDB_MAX_STRING_LENGTH : strLen);
+        break;
+      }
+      default:
+        size += 4;
+        break;
+    }
+  }
+  return size;
+}
+
+// Drop expired records so they are not written (caller holds the lock)
+void ESP32IMDB::purgeForSnapshot() {
+  for (int i = 0; i < _recordCount; i++) {
+    if (_records[i].isValid && isRecordExpired(_records[i].expiryMillis)) {
+      trackRecord(&_records[i], false);
+      filterRecord(&_records[i], false);
+      freeRecord(&_records[i]);
+      _records[i].isValid = false;
+      indexBoolSlot(i);
+    }
+  }
+  compactRecords();
+}
+
+// Payload bytes of a v2 snapshot up to the end of the records, which is where
+// the key index starts (caller holds the lock)
+size_t ESP32IMDB::snapshotPayloadSize(uint32_t checkpointId, uint32_t baseId) const {
+  size_t payload = 12 + ((checkpointId != 0) ? 4 : 0) + ((baseId != 0) ? 8 : 0) +
+                   ((_lazyKey >= 0) ? 12 : 0) + ((_ringCapacity > 0) ? 4 : 0) +
+                   (size_t)_columnCount * 33;
+  for (int i = 0; i < _recordCount; i++) {
+    payload += recordEncodedSize(&_records[i]) + ((baseId != 0) ? 4 : 0);
+  }
+  return payload;
+}
+
+// Exact size of the v2 file encodeSnapshot() produces (caller holds the lock)
+size_t ESP32IMDB::snapshotImageSize(uint32_t checkpointId, uint32_t baseId) const {
+  size_t payload = snapshotPayloadSize(checkpointId, baseId);
+  if (_lazyKey >= 0) {
+    payload += (size_t)_recordCount * sizeof(IMDBKeyIndexEntry);
+  }
+  size_t blocks = (payload + IMDB_PERSIST_BLOCK_SIZE - 1) / IMDB_PERSIST_BLOCK_SIZE;
+  return 5 + payload + blocks * IMDB_BLOCK_FRAMING;
+}
+
+// Build the sorted key index for a snapshot (caller holds the lock). *index
+// is nullptr when no lazy load key is set or the table is empty.
+IMDBResult ESP32IMDB::buildKeyIndex(uint32_t checkpointId, uint32_t baseId,
+                                    IMDBKeyIndexEntry** index) const {
+  *index = nullptr;
+  if (_lazyKey < 0 || _recordCount == 0) {
+    return IMDB_OK;
+  }
+  
+  IMDBKeyIndexEntry* entries = (IMDBKeyIndexEntry*)malloc(sizeof(IMDBKeyIndexEntry) * _recordCount);
+  if (entries == nullptr) {
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  // Records start right after the header and schema
+  size_t offset = 12 + ((checkpointId != 0) ? 4 : 0) + ((baseId != 0) ? 8 : 0) + 12 +
+                  ((_ringCapacity > 0) ? 4 : 0) + (size_t)_columnCount * 33;
+  for (int i = 0; i < _recordCount; i++) {
+    entries[i].key = keyIndexKey(&_records[i].fields[_lazyKey], _columns[_lazyKey].type);
+    entries[i].offset = (uint32_t)offset;
+    offset += recordEncodedSize(&_records[i]) + ((baseId != 0) ? 4 : 0);
+  }
+  qsort(entries, _recordCount, sizeof(IMDBKeyIndexEntry), compareKeyIndexEntries);
+  
+  *index = entries;
+  return IMDB_OK;
+}
+
+// Encode preamble, header, schema and records as a v2 file (caller holds the
+// lock). A non-zero checkpointId is stored in the header so recovery can
+// match the snapshot with its WAL; a non-zero baseId makes the file an
+// incremental base that carries row ids. With a lazy load key set, keyIndex
+// (from buildKeyIndex()) is written after the records.
+bool ESP32IMDB::encodeSnapshot(IMDBBlockWriter* writer, uint32_t checkpointId,
+                               uint32_t baseId, const IMDBKeyIndexEntry* keyIndex) const {
+  // Preamble (unframed so readers can pick the format)
+  const uint8_t preamble[5] = {'I', 'M', 'D', 'B', IMDB_FILE_VERSION_V2};
+  writeRawBytes(writer, preamble, 5);
+  
+  // Header (first block, covered by its CRC)
+  const uint8_t flags = ((checkpointId != 0) ? IMDB_FILE_FLAG_CHECKPOINT_ID : 0) |
+                        ((baseId != 0) ? IMDB_FILE_FLAG_ROW_IDS : 0) |
+                        ((_lazyKey >= 0) ? IMDB_FILE_FLAG_KEY_INDEX : 0) |
+                        ((_ringCapacity > 0) ? IMDB_FILE_FLAG_RING : 0);
+  const uint16_t reserved = 0;
+  uint32_t recordCount = (uint32_t)_recordCount;
+  uint32_t saveMillis = millis();
+  
+  writeBlockBytes(writer, &flags, 1);
+  writeBlockBytes(writer, &_columnCount, 1);
+  writeBlockBytes(writer, &reserved, 2);
+  writeBlockBytes(writer, &recordCount, 4);
+  writeBlockBytes(writer, &saveMillis, 4);
+  if (checkpointId != 0) {
+    writeBlockBytes(writer, &checkpointId, 4);
+  }
+  if (baseId != 0) {
+    writeBlockBytes(writer, &baseId, 4);
+    writeBlockBytes(writer, &_nextRowId, 4);
+  }
+  if (_lazyKey >= 0) {
+    const uint8_t keyHeader[4] = {(uint8_t)_lazyKey, 0, 0, 0};
+    const uint32_t blockSize = IMDB_PERSIST_BLOCK_SIZE;
+    uint32_t indexOffset = (uint32_t)snapshotPayloadSize(checkpointId, baseId);
+    writeBlockBytes(writer, keyHeader, 4);
+    writeBlockBytes(writer, &blockSize, 4);
+    writeBlockBytes(writer, &indexOffset, 4);
+  }
+  if (_ringCapacity > 0) {
+    writeBlockBytes(writer, &_ringCapacity, 4);
+  }
+  
+  // Schema
+  for (int i = 0; i < _columnCount; i++) {
+    uint8_t typeValue = (uint8_t)_columns[i].type;
+    writeBlockBytes(writer, _columns[i].name, 32);
+    writeBlockBytes(writer, &typeValue, 1);
+  }
+  
+  // Records (stop at the first failed block write)
+  for (int i = 0; i < _recordCount && !writer->failed; i++) {
+    if (baseId != 0) {
+      writeBlockBytes(writer, &_records[i].rowId, 4);
+    }
+    writeRecord(writer, &_records[i]);
+  }
+  
+  if (keyIndex != nullptr) {
+    writeBlockBytes(writer, keyIndex, sizeof(IMDBKeyIndexEntry) * _recordCount);
+  }
+  
+  return flushBlock(writer);
+}
+
+// Atomic rename - replace filename with the fully written temporary file.
+// LittleFS and POSIX rename over an existing file in one step; SPIFFS and FAT
+// refuse, so the old file is removed first there.
+static bool replaceFile(IMDBStorage* storage, const char* tempFilename, const char* filename) {
+  if (storage->rename(tempFilename, filename)) {
+    return true;
+  }
+  if (storage->exists(filename)) {
+    storage->remove(filename);
+  }
+  if (!storage->rename(tempFilename, filename)) {
+    storage->remove(tempFilename);
+    return false;
+  }
+  return true;
+}
+
+// Write a v2 snapshot straight to the file (caller holds the lock)
+IMDBResult ESP32IMDB::saveSnapshotLocked(const char* filename, uint32_t checkpointId,
+                                         uint32_t baseId) {
+  purgeForSnapshot();
+  
+  IMDBKeyIndexEntry* keyIndex;
+  IMDBResult indexResult = buildKeyIndex(checkpointId, baseId, &keyIndex);
+  if (indexResult != IMDB_OK) {
+    return indexResult;
+  }
+  
+  // Block buffer is allocated per save so idle databases don't pin it
+  uint8_t* blockBuffer = (uint8_t*)malloc(IMDB_PERSIST_BLOCK_SIZE + IMDB_BLOCK_FRAMING);
+  if (blockBuffer == nullptr) {
+    free(keyIndex);
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  // Create temporary filename for atomic write
+  char tempFilename[256];
+  snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", filename);
+  
+  // Open file for writing
+  IMDBFile* file = _storage->open(tempFilename, "w");
+  if (file == nullptr) {
+    free(blockBuffer);
+    free(keyIndex);
+    return IMDB_ERROR_FILE_OPEN;
+  }
+  
+  IMDBBlockWriter writer = {file, blockBuffer, 0, false};
+  bool writeOk = encodeSnapshot(&writer, checkpointId, baseId, keyIndex);
+  writeOk = _storage->close(file) && writeOk;
+  free(blockBuffer);
+  free(keyIndex);
+  
+  if (!writeOk) {
+    _storage->remove(tempFilename);
+    return IMDB_ERROR_FILE_WRITE;
+  }
+  
+  if (!replaceFile(_storage, tempFilename, filename)) {
+    return IMDB_ERROR_FILE_WRITE;
+  }
+  
+  return IMDB_OK;
+}
+
+// Work handed to the background save task. The task owns everything here.
+struct IMDBSaveJob {
+  ESP32IMDB* db;
+  IMDBStorage* storage;
+  char* filename;
+  uint8_t* image;        // Complete v2 file, from allocBulk()
+  size_t size;
+  IMDBSaveCallback callback;
+  void* userArg;
+};
+
+// Start a background save. Purge, compaction and encoding happen under the
+// lock at memory speed; the file is written by a separate task, so other
+// callers only wait for the in-memory copy, not for flash I/O.
+IMDBResult ESP32IMDB::saveToFileAsync(const char* filename, IMDBSaveCallback callback,
+                                      void* userArg) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SAVE);
   lock();
   
+  finishLazyLoad();
+  
   if (!_tableExists) {
     unlock();
     return IMDB_ERROR_NO_TABLE;
   }
   
-  if (values == nullptr) {
+  if (filename == nullptr) {
     unlock();
     return IMDB_ERROR_INVALID_VALUE;
   }
   
-  if (!checkHeapLimit()) {
+  // One background save at a time; WAL checkpoints must stay synchronous
+  if (_saveInProgress || (_walEnabled && strcmp(filename, _walSnapshotFilename) == 0)) {
+    unlock();
+    return IMDB_ERROR_INVALID_OPERATION;
+  }
+  
+  purgeForSnapshot();
+  
+  // The image is a full copy of the table - it counts against the budget and
+  // the heap floor like the table's own growth, and is placed like its rows
+  size_t imageSize = snapshotImageSize(0, 0);
+  if (!checkHeapLimit(0, imageSize)) {
     unlock();
     return IMDB_ERROR_HEAP_LIMIT;
   }
   
-  // Validate TTL
-  if (ttlMillis > IMDB_MAX_TTL_MS) {
+  IMDBKeyIndexEntry* keyIndex;
+  IMDBResult indexResult = buildKeyIndex(0, 0, &keyIndex);
+  if (indexResult != IMDB_OK) {
     unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+    return indexResult;
   }
   
-  // Grow array if needed
-  if (_recordCount >= _recordCapacity) {
-    IMDBResult result = growRecordArray();
-    if (result != IMDB_OK) {
-      unlock();
-      return result;
-    }
+  IMDBSaveJob* job = (IMDBSaveJob*)malloc(sizeof(IMDBSaveJob));
+  uint8_t* image = (uint8_t*)allocBulk(imageSize);
+  char* filenameCopy = strdup(filename);
+  if (job == nullptr || image == nullptr || filenameCopy == nullptr) {
+    free(job);
+    heap_caps_free(image);
+    free(filenameCopy);
+    free(keyIndex);
+    heapAllocationFailed();
+    unlock();
+    return IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  // Allocate record fields
-  IMDBRecord* record = &_records[_recordCount];
-  record->fields = (IMDBFieldValue*)malloc(sizeof(IMDBFieldValue) * _columnCount);
-  if (record->fields == nullptr) {
+  IMDBBlockWriter writer = {nullptr, image, 0, false};
+  encodeSnapshot(&writer, 0, 0, keyIndex);
+  free(keyIndex);
+  
+  job->db = this;
+  job->storage = _storage;
+  job->filename = filenameCopy;
+  job->image = image;
+  job->size = imageSize;
+  job->callback = callback;
+  job->userArg = userArg;
+  
+  _saveInProgress = true;
+  if (xTaskCreate(saveTask, "IMDBSave", IMDB_SAVE_TASK_STACK, job,
+                  IMDB_SAVE_TASK_PRIORITY, NULL) != pdPASS) {
+    _saveInProgress = false;
+    free(job);
+    heap_caps_free(image);
+    free(filenameCopy);
     unlock();
     return IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  // Initialize fields
-  memset(record->fields, 0, sizeof(IMDBFieldValue) * _columnCount);
+  // Kept until the next background save so synchronous saves can tell
+  // whether the task is writing their file
+  free(_saveFilename);
+  _saveFilename = filenameCopy;
   
-  // Copy values
-  for (int i = 0; i < _columnCount; i++) {
-    if (values[i] == nullptr) {
-      // Cleanup on error
-      for (int j = 0; j < i; j++) {
-        if (_columns[j].type == IMDB_TYPE_STRING && record->fields[j].stringValue != nullptr) {
-          free(record->fields[j].stringValue);
-        }
+  unlock();
+  return IMDB_OK;
+}
+
+// Background save task: write the image, swap it in, report, exit
+void ESP32IMDB::saveTask(void* parameter) {
+  IMDBSaveJob* job = (IMDBSaveJob*)parameter;
+  IMDBResult result = IMDB_OK;
+  
+  char tempFilename[256];
+  snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", job->filename);
+  
+  IMDBStorage* storage = job->storage;
+  IMDBFile* file = storage->open(tempFilename, "w");
+  if (file == nullptr) {
+    result = IMDB_ERROR_FILE_OPEN;
+  } else {
+    bool writeOk = (file->write(job->image, job->size) == job->size);
+    writeOk = storage->close(file) && writeOk;
+    if (!writeOk) {
+      storage->remove(tempFilename);
+      result = IMDB_ERROR_FILE_WRITE;
+    } else if (!replaceFile(storage, tempFilename, job->filename)) {
+      result = IMDB_ERROR_FILE_WRITE;
+    }
+  }
+  
+  ESP32IMDB* db = job->db;
+  IMDBSaveCallback callback = job->callback;
+  void* userArg = job->userArg;
+  heap_caps_free(job->image);
+  free(job);
+  
+  db->_lastSaveResult = result;
+  if (callback != nullptr) {
+    callback(result, userArg);
+  }
+  // Cleared last: the destructor waits on this flag
+  db->_saveInProgress = false;
+  
+  vTaskDelete(NULL);
+}
+
+// True while a background save is writing its file
+bool ESP32IMDB::isSaveInProgress() const {
+  return _saveInProgress;
+}
+
+// True while a background save is writing filename (caller holds the lock).
+// Both would write "<filename>.tmp", so the other save has to wait.
+bool ESP32IMDB::saveTargetBusy(const char* filename) const {
+  return _saveInProgress && _saveFilename != nullptr && strcmp(filename, _saveFilename) == 0;
+}
+
+// Result of the most recent completed background save
+IMDBResult ESP32IMDB::getLastSaveResult() const {
+  return _lastSaveResult;
+}
+
+// Buffered block reader for persistence. The file is pulled in
+// IMDB_PERSIST_BLOCK_SIZE chunks and fields are decoded from RAM. For v2 files
+// the reader also strips block framing and checks each block's CRC as its
+// last payload byte is consumed, so corruption is caught in the same pass.
+struct IMDBBlockReader {
+  IMDBFile* file;
+  uint8_t* buffer;
+  size_t used;
+  size_t pos;
+  bool failed;           // Short read (truncated file or I/O error)
+  bool corrupt;          // Bad framing or CRC mismatch
+  bool framed;           // v2: payload is split into CRC-checked blocks
+  uint32_t blockRemaining;
+  uint32_t blockCrc;
+  uint32_t payloadRead;  // v2: payload bytes consumed so far
+};
+
+// Copy raw file bytes out of the buffer, refilling it from the file as needed
+static bool readRawBytes(IMDBBlockReader* reader, void* data, size_t length) {
+  uint8_t* dest = (uint8_t*)data;
+  while (length > 0 && !reader->failed) {
+    if (reader->pos == reader->used) {
+      reader->used = reader->file->read(reader->buffer, IMDB_PERSIST_BLOCK_SIZE);
+      reader->pos = 0;
+      if (reader->used == 0) {
+        reader->failed = true;
+        break;
       }
-      free(record->fields);
-      unlock();
-      return IMDB_ERROR_INVALID_VALUE;
+    }
+    size_t chunk = reader->used - reader->pos;
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(dest, reader->buffer + reader->pos, chunk);
+    reader->pos += chunk;
+    dest += chunk;
+    length -= chunk;
+  }
+  return !reader->failed;
+}
+
+// Read a block trailer and compare it with the CRC of the payload just consumed
+static bool checkBlockCrc(IMDBBlockReader* reader) {
+  uint32_t storedCrc;
+  if (!readRawBytes(reader, &storedCrc, 4)) {
+    return false;
+  }
+  if (storedCrc != reader->blockCrc) {
+    reader->corrupt = true;
+    return false;
+  }
+  return true;
+}
+
+// Copy payload bytes, crossing block boundaries (and verifying CRCs) as needed
+static bool readBlockBytes(IMDBBlockReader* reader, void* data, size_t length) {
+  if (!reader->framed) {
+    return readRawBytes(reader, data, length);
+  }
+  
+  uint8_t* dest = (uint8_t*)data;
+  while (length > 0 && !reader->failed && !reader->corrupt) {
+    if (reader->blockRemaining == 0) {
+      uint32_t blockLength;
+      if (!readRawBytes(reader, &blockLength, 4)) {
+        break;
+      }
+      if (blockLength == 0) {
+        reader->corrupt = true;
+        break;
+      }
+      reader->blockRemaining = blockLength;
+      reader->blockCrc = 0;
     }
     
-    IMDBResult result = copyFieldValue(&record->fields[i], values[i], _columns[i].type);
-    if (result != IMDB_OK) {
-      // Cleanup on error
-      for (int j = 0; j < i; j++) {
-        if (_columns[j].type == IMDB_TYPE_STRING && record->fields[j].stringValue != nullptr) {
-          free(record->fields[j].stringValue);
+    size_t chunk = reader->blockRemaining;
+    if (chunk > length) {
+      chunk = length;
+    }
+    if (!readRawBytes(reader, dest, chunk)) {
+      break;
+    }
+    reader->blockCrc = imdbCrc32(reader->blockCrc, dest, chunk);
+    reader->blockRemaining -= chunk;
+    reader->payloadRead += chunk;
+    dest += chunk;
+    length -= chunk;
+    
+    if (reader->blockRemaining == 0) {
+      checkBlockCrc(reader);
+    }
+  }
+  
+  // The framing promised more bytes, so running out of file means it was torn
+  if (reader->failed) {
+    reader->corrupt = true;
+  }
+  return !reader->failed && !reader->corrupt;
+}
+
+// Confirm the payload ended on a block boundary with nothing after it
+static bool finishBlocks(IMDBBlockReader* reader) {
+  if (reader->failed || reader->corrupt) {
+    return false;
+  }
+  uint8_t extra;
+  if (reader->blockRemaining != 0 || readRawBytes(reader, &extra, 1)) {
+    reader->corrupt = true;
+    return false;
+  }
+  reader->failed = false;  // Hitting end of file is the expected outcome
+  return true;
+}
+
+// Read and drop payload bytes (CRC-checked like any other)
+static bool skipBlockBytes(IMDBBlockReader* reader, size_t length) {
+  uint8_t scratch[64];
+  while (length > 0) {
+    size_t chunk = (length < sizeof(scratch)) ? length : sizeof(scratch);
+    if (!readBlockBytes(reader, scratch, chunk)) {
+      return false;
+    }
+    length -= chunk;
+  }
+  return true;
+}
+
+// Position a reader at a payload offset of a v2 file whose blocks carry
+// blockSize payload bytes each (all but the last are full). The block is read
+// from its start so its CRC can still be checked.
+static bool seekPayload(IMDBBlockReader* reader, uint32_t blockSize, uint32_t offset) {
+  uint32_t block = offset / blockSize;
+  reader->used = 0;
+  reader->pos = 0;
+  reader->failed = false;
+  reader->corrupt = false;
+  reader->framed = true;
+  reader->blockRemaining = 0;
+  reader->blockCrc = 0;
+  reader->payloadRead = block * blockSize;
+  if (!reader->file->seek(5 + (size_t)block * (blockSize + IMDB_BLOCK_FRAMING))) {
+    reader->failed = true;
+    return false;
+  }
+  return skipBlockBytes(reader, offset - reader->payloadRead);
+}
+
+// Check a key index read from a file: sorted, and every offset inside the records
+static bool validKeyIndex(const IMDBKeyIndexEntry* index, uint32_t count, uint32_t recordsOffset,
+                          uint32_t indexOffset) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (index[i].offset < recordsOffset || index[i].offset >= indexOffset) {
+      return false;
+    }
+    if (i > 0 && compareKeyIndexEntries(&index[i - 1], &index[i]) >= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Decode one record into caller-provided field storage. Strings are placed in
+// the string arena at *stringCursor. Returns false on a read error or if the
+// data doesn't fit the declared layout.
+bool ESP32IMDB::readRecord(IMDBBlockReader* reader, IMDBRecord* record,
+                           char** stringCursor, char* stringEnd) {
+  uint8_t isValid = 0;
+  readBlockBytes(reader, &isValid, 1);
+  readBlockBytes(reader, &record->expiryMillis, 4);
+  record->isValid = (isValid != 0);
+  
+  for (int j = 0; j < _columnCount && !reader->failed; j++) {
+    IMDBFieldValue* field = &record->fields[j];
+    
+    switch (_columns[j].type) {
+      case IMDB_TYPE_INT32:
+        readBlockBytes(reader, &field->int32Value, 4);
+        break;
+        
+      case IMDB_TYPE_FLOAT:
+        readBlockBytes(reader, &field->floatValue, 4);
+        break;
+        
+      case IMDB_TYPE_BOOL: {
+        uint8_t boolValue = 0;
+        readBlockBytes(reader, &boolValue, 1);
+        field->boolValue = (boolValue != 0);
+        break;
+      }
+      
+      case IMDB_TYPE_MAC:
+        readBlockBytes(reader, field->macAddress, 6);
+        break;
+        
+      case IMDB_TYPE_EPOCH:
+        readBlockBytes(reader, &field->epochValue, 4);
+        break;
+        
+      case IMDB_TYPE_STRING: {
+        uint8_t length = 0;
+        field->stringValue = nullptr;
+        if (!readBlockBytes(reader, &length, 1)) {
+          break;
         }
+        
+        // Validate string length against the limit (only below the 255 a
+        // length byte can hold) and the arena bounds
+#if IMDB_MAX_STRING_LENGTH < 255
+        if (length > IMDB_MAX_STRING_LENGTH) {
+          return false;
+        }
+#endif
+        if (*stringCursor + length + 1 > stringEnd) {
+          return false;
+        }
+        
+        if (length > 0) {
+          char* str = *stringCursor;
+          if (readBlockBytes(reader, str, length)) {
+            str[length] = '\0';
+            field->stringValue = str;
+            *stringCursor += length + 1;
+            _stringArenaLive++;
+            arenaStringLoaded(length + 1);
+          }
+        }
+        break;
       }
-      free(record->fields);
-      unlock();
-      return result;
     }
   }
   
-  // Set expiry TTL with overflow protection
-  if (ttlMillis > 0) {
-    uint32_t currentMillis = millis();
-    // Check for potential overflow: if currentMillis + ttlMillis would overflow
-    if (ttlMillis > (UINT32_MAX - currentMillis)) {
-      // Set to maximum value to avoid wraparound
-      record->expiryMillis = UINT32_MAX;
-    } else {
-      record->expiryMillis = currentMillis + ttlMillis;
+  return !reader->failed;
+}
+
+// Map an expiry saved at saveMillis onto the current clock. TTL "pauses"
+// while the device is off: the remaining time is carried over.
+static uint32_t restoreExpiry(uint32_t savedExpiryMillis, uint32_t saveMillis, uint32_t currentMillis) {
+  if (savedExpiryMillis == 0) {
+    return 0;  // No expiry
+  }
+  // Calculate remaining time, handling potential underflow
+  if (savedExpiryMillis > saveMillis) {
+    uint32_t remainingMillis = savedExpiryMillis - saveMillis;
+    // Check for overflow when adding to currentMillis
+    if (remainingMillis > (UINT32_MAX - currentMillis)) {
+      return UINT32_MAX;
     }
-  } else {
-    record->expiryMillis = 0;
+    return currentMillis + remainingMillis;
   }
+  // Record was already expired when saved, mark as expired now
+  return currentMillis - 1;
+}
 
-  record->isValid = true;
+// A lazy load in progress. The file stays open: reader continues with the
+// next record to hydrate, and lookups seek with their own buffer and then
+// put the file position back.
+struct IMDBLazyLoad {
+  IMDBFile* file;
+  IMDBBlockReader reader;
+  uint8_t* lookupBuffer;
+  IMDBKeyIndexEntry* index;
+  uint32_t recordCount;
+  uint32_t blockSize;       // Payload bytes per block in the file
+  uint32_t indexOffset;     // Payload offset of the key index (end of the records)
+  uint32_t saveMillis;
+  uint32_t loadMillis;      // TTLs resume from when the load started
+  uint32_t nextRowId;
+  uint32_t lastRowId;
+  bool hasRowIds;
+  int keyColumn;
+  char* stringCursor;
+  char* stringEnd;
+};
+
+// Decode the next record into the load arenas and append it (caller holds the lock)
+IMDBResult ESP32IMDB::loadNextRecord(IMDBBlockReader* reader, bool hasRowIds, uint32_t saveMillis,
+                                     uint32_t currentMillis, uint32_t* lastRowId,
+                                     char** stringCursor, char* stringEnd) {
+  IMDBRecord* record = &_records[_recordCount];
+  record->fields = &_fieldArena[(size_t)_recordCount * _columnCount];
+  record->isDirty = false;
+  
+  // Row ids must ascend so rows can be found by binary search
+  record->rowId = (uint32_t)_recordCount + 1;
+  if (hasRowIds && readBlockBytes(reader, &record->rowId, 4) && record->rowId <= *lastRowId) {
+    record->fields = nullptr;
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+  *lastRowId = record->rowId;
+  
+  if (!readRecord(reader, record, stringCursor, stringEnd)) {
+    // Keep the strings read so far so they are released with the arena
+    record->fields = nullptr;
+    return (reader->failed && !reader->corrupt) ? IMDB_ERROR_FILE_READ : IMDB_ERROR_CORRUPT_FILE;
+  }
+  _fieldArenaLive++;
+  
+  // Adjust TTL based on time difference
+  record->expiryMillis = restoreExpiry(record->expiryMillis, saveMillis, currentMillis);
+  
   _recordCount++;
+  trackRecord(record, true);
+  markIndexesStale();
+  return IMDB_OK;
+}
+
+// Load database from a file
+IMDBResult ESP32IMDB::loadFromFile(const char* filename) {
+  IMDB_STAT_SCOPE(IMDB_STAT_LOAD);
+  lock();
+  IMDBResult result = loadLocked(filename, false);
+  unlock();
+  return result;
+}
+
+// Read a file into the empty table (caller holds the lock). With lazy set
+// and a key index in the file, only the header, schema and index are read
+// here; the file stays open and hydrateLocked() reads the records.
+IMDBResult ESP32IMDB::loadLocked(const char* filename, bool lazy) {
+  if (filename == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  // Check if table already exists - don't overwrite
+  if (_tableExists) {
+    return IMDB_ERROR_TABLE_EXISTS;
+  }
+  
+  // Check if file exists first
+  if (!_storage->exists(filename)) {
+    return IMDB_ERROR_FILE_OPEN;
+  }
+  
+  // Open file for reading
+  IMDBFile* file = _storage->open(filename, "r");
+  if (file == nullptr) {
+    return IMDB_ERROR_FILE_OPEN;
+  }
+  size_t fileSize = file->size();
+  
+  uint8_t* blockBuffer = (uint8_t*)malloc(IMDB_PERSIST_BLOCK_SIZE);
+  if (blockBuffer == nullptr) {
+    _storage->close(file);
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+  
+  IMDBBlockReader reader = {file, blockBuffer, 0, 0, false, false, false, 0, 0, 0};
+  IMDBResult result = IMDB_OK;
+  
+  // Read and validate preamble
+  char magic[4];
+  uint8_t version = 0;
+  uint8_t columnCount = 0;
+  uint32_t recordCount = 0;
+  uint32_t saveMillis = 0;
+  uint32_t checkpointId = 0;
+  uint32_t baseId = 0;
+  uint32_t nextRowId = 0;
+  bool hasRowIds = false;
+  uint32_t maxRawBytes = 0;   // v3: largest uncompressed row group
+  uint32_t stringBytes = 0;   // v3: string arena size
+  bool hasKeyIndex = false;
+  uint8_t keyHeader[4] = {0, 0, 0, 0};  // Key column, reserved
+  uint32_t blockSize = 0;
+  uint32_t indexOffset = 0;
+  uint32_t ringCapacity = 0;  // 0 = ordinary table
+  
+  if (!readRawBytes(&reader, magic, 4) ||
+      magic[0] != 'I' || magic[1] != 'M' || magic[2] != 'D' || magic[3] != 'B' ||
+      !readRawBytes(&reader, &version, 1) ||
+      (version != IMDB_FILE_VERSION_V1 && version != IMDB_FILE_VERSION_V2
+#if IMDB_ENABLE_COMPRESSION
+       && version != IMDB_FILE_VERSION_V3
+#endif
+      )) {
+    result = IMDB_ERROR_CORRUPT_FILE;
+  }
+  
+  // Read header
+  if (result == IMDB_OK && version == IMDB_FILE_VERSION_V1) {
+    uint16_t recordCount16 = 0;
+    if (!readBlockBytes(&reader, &columnCount, 1) ||
+        !readBlockBytes(&reader, &recordCount16, 2) ||
+        !readBlockBytes(&reader, &saveMillis, 4)) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
+    recordCount = recordCount16;
+  } else if (result == IMDB_OK) {
+    uint8_t flags = 0;
+    uint16_t reserved = 0;
+    reader.framed = true;
+    if (!readBlockBytes(&reader, &flags, 1) ||
+        !readBlockBytes(&reader, &columnCount, 1) ||
+        !readBlockBytes(&reader, &reserved, 2) ||
+        !readBlockBytes(&reader, &recordCount, 4) ||
+        !readBlockBytes(&reader, &saveMillis, 4) ||
+        (flags & ~IMDB_FILE_KNOWN_FLAGS) != 0) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
+    if (result == IMDB_OK && (flags & IMDB_FILE_FLAG_CHECKPOINT_ID) &&
+        !readBlockBytes(&reader, &checkpointId, 4)) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
+    hasRowIds = (flags & IMDB_FILE_FLAG_ROW_IDS) != 0;
+    if (result == IMDB_OK && hasRowIds &&
+        (!readBlockBytes(&reader, &baseId, 4) || !readBlockBytes(&reader, &nextRowId, 4))) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
+    hasKeyIndex = (flags & IMDB_FILE_FLAG_KEY_INDEX) != 0;
+    if (result == IMDB_OK && hasKeyIndex &&
+        (!readBlockBytes(&reader, keyHeader, 4) || !readBlockBytes(&reader, &blockSize, 4) ||
+         !readBlockBytes(&reader, &indexOffset, 4) || blockSize == 0 || indexOffset >= fileSize)) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
+    if (result == IMDB_OK && (flags & IMDB_FILE_FLAG_RING) &&
+        (!readBlockBytes(&reader, &ringCapacity, 4) || ringCapacity == 0)) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
+    if (result == IMDB_OK && version == IMDB_FILE_VERSION_V3 &&
+        ((flags & ~IMDB_FILE_FLAG_RING) != 0 || !readBlockBytes(&reader, &maxRawBytes, 4) ||
+         !readBlockBytes(&reader, &stringBytes, 4))) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
+  }
+  
+  // Read schema
+  if (result == IMDB_OK && !checkHeapLimit()) {
+    result = IMDB_ERROR_HEAP_LIMIT;
+  }
+  
+  if (result == IMDB_OK) {
+    _columns = (IMDBColumn*)malloc(sizeof(IMDBColumn) * columnCount);
+    if (_columns == nullptr) {
+      result = IMDB_ERROR_OUT_OF_MEMORY;
+    }
+  }
+  
+  // Fixed bytes per record (row id, flag, expiry, fixed-width fields, string length bytes)
+  size_t fixedRecordBytes = hasRowIds ? 9 : 5;
+  int stringColumns = 0;
+  
+  for (int i = 0; i < columnCount && result == IMDB_OK; i++) {
+    uint8_t typeValue;
+    if (!readBlockBytes(&reader, _columns[i].name, 32) || !readBlockBytes(&reader, &typeValue, 1)) {
+      result = reader.corrupt ? IMDB_ERROR_CORRUPT_FILE : IMDB_ERROR_FILE_READ;
+      break;
+    }
+    // Ensure null-termination of column name for safety
+    _columns[i].name[31] = '\0';
+    
+    // Validate type value is within valid enum range
+    if (typeValue > IMDB_TYPE_FLOAT) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+      break;
+    }
+    _columns[i].type = (IMDBDataType)typeValue;
+    
+    switch (_columns[i].type) {
+      case IMDB_TYPE_MAC: fixedRecordBytes += 6; break;
+      case IMDB_TYPE_BOOL: fixedRecordBytes += 1; break;
+      case IMDB_TYPE_STRING: fixedRecordBytes += 1; stringColumns++; break;
+      default: fixedRecordBytes += 4; break;
+    }
+  }
+  
+  // The key must be a column that buildKeyIndex() would accept
+  uint8_t keyColumn = keyHeader[0];
+  if (result == IMDB_OK && hasKeyIndex &&
+      (keyColumn >= columnCount || _columns[keyColumn].type == IMDB_TYPE_FLOAT ||
+       _columns[keyColumn].type == IMDB_TYPE_BOOL)) {
+    result = IMDB_ERROR_CORRUPT_FILE;
+  }
+  
+  if (result != IMDB_OK) {
+    free(_columns);
+    _columns = nullptr;
+    free(blockBuffer);
+    _storage->close(file);
+    return result;
+  }
+  
+  _columnCount = columnCount;
+  _tableExists = true;
+  memoryAllocated(&_memory.directory, sizeof(IMDBColumn) * columnCount, _columns);
+  
+  // Everything after the schema is record data (plus any v2 block framing and
+  // the key index); it bounds the record count and the string bytes
+  size_t headerBytes = file->position() - (reader.used - reader.pos);
+  size_t dataBytes = (fileSize > headerBytes) ? fileSize - headerBytes : 0;
+  size_t indexBytes = hasKeyIndex ? (size_t)recordCount * sizeof(IMDBKeyIndexEntry) : 0;
+  uint32_t recordsOffset = reader.payloadRead;
+  if (version == IMDB_FILE_VERSION_V3) {
+    // Compressed data doesn't bound the record count; the heap does. Field
+    // values and strings follow the placement policy, the rest is internal RAM.
+    uint64_t internalBytes = (uint64_t)recordCount * sizeof(IMDBRecord) + maxRawBytes;
+    uint64_t bulkBytes = (uint64_t)recordCount * sizeof(IMDBFieldValue) * _columnCount + stringBytes;
+    if ((size_t)(internalBytes + bulkBytes) != internalBytes + bulkBytes ||
+        !checkHeapLimit((size_t)internalBytes, (size_t)bulkBytes)) {
+      result = IMDB_ERROR_HEAP_LIMIT;
+    }
+  } else if ((uint64_t)fixedRecordBytes * recordCount + indexBytes > dataBytes) {
+    // Truncated file; a v2 file's blocks make that a torn file
+    result = reader.framed ? IMDB_ERROR_CORRUPT_FILE : IMDB_ERROR_FILE_READ;
+  } else if (hasKeyIndex && (indexOffset < recordsOffset ||
+                             indexOffset - recordsOffset < (uint64_t)fixedRecordBytes * recordCount)) {
+    result = IMDB_ERROR_CORRUPT_FILE;
+  }
+  
+  // Allocate the records array and bulk storage for every record up front
+  if (result == IMDB_OK && !checkHeapLimit()) {
+    result = IMDB_ERROR_HEAP_LIMIT;
+  }
+  
+  if (result == IMDB_OK) {
+    _recordCapacity = recordCount > 10 ? recordCount : 10;
+    _records = (IMDBRecord*)malloc(sizeof(IMDBRecord) * _recordCapacity);
+    if (_records == nullptr) {
+      heapAllocationFailed();
+      result = IMDB_ERROR_OUT_OF_MEMORY;
+    } else {
+      memoryAllocated(&_memory.directory, sizeof(IMDBRecord) * _recordCapacity, _records);
+    }
+  }
+  
+  if (result == IMDB_OK && recordCount > 0) {
+    _fieldArenaSlots = (size_t)recordCount * _columnCount;
+    _fieldArena = (IMDBFieldValue*)allocBulk(sizeof(IMDBFieldValue) * _fieldArenaSlots);
+    if (_fieldArena == nullptr) {
+      heapAllocationFailed();
+      result = IMDB_ERROR_OUT_OF_MEMORY;
+    } else {
+      memoryAllocated(&_memory.fragmentation, sizeof(IMDBFieldValue) * _fieldArenaSlots, _fieldArena);
+    }
+  }
+  
+  if (result == IMDB_OK && recordCount > 0 && stringColumns > 0) {
+    // String payload plus a terminator per string slot (v3 stores the total)
+    if (version == IMDB_FILE_VERSION_V3) {
+      _stringArenaSize = (stringBytes > 0) ? stringBytes : 1;
+    } else {
+      _stringArenaSize = dataBytes - fixedRecordBytes * recordCount - indexBytes +
+                         (size_t)recordCount * stringColumns;
+    }
+    _stringArena = (char*)allocBulk(_stringArenaSize);
+    if (_stringArena == nullptr) {
+      heapAllocationFailed();
+      result = IMDB_ERROR_OUT_OF_MEMORY;
+    } else {
+      memoryAllocated(&_memory.fragmentation, _stringArenaSize, _stringArena);
+    }
+  }
   
-  unlock();
-  return IMDB_OK;
-}
-
-// Compare field values
-bool ESP32IMDB::compareValues(const IMDBFieldValue* fieldValue, const void* compareValue, 
-                             IMDBDataType type, IMDBOperator op) const {
-  if (fieldValue == nullptr || compareValue == nullptr) {
-    return false;
+  // Bulk allocation must still leave the configured heap reserve
+  if (result == IMDB_OK && !checkHeapLimit()) {
+    result = IMDB_ERROR_HEAP_LIMIT;
   }
   
-  switch (type) {
-    case IMDB_TYPE_INT32: {
-      int32_t a = fieldValue->int32Value;
-      int32_t b = *(const int32_t*)compareValue;
-      switch (op) {
-        case IMDB_OP_EQUAL: return a == b;
-        case IMDB_OP_NOT_EQUAL: return a != b;
-        case IMDB_OP_GREATER: return a > b;
-        case IMDB_OP_LESS: return a < b;
-        case IMDB_OP_GREATER_EQUAL: return a >= b;
-        case IMDB_OP_LESS_EQUAL: return a <= b;
-      }
-      break;
+  _recordCount = 0;
+  uint32_t currentMillis = millis();
+  char* stringCursor = _stringArena;
+  char* stringEnd = _stringArena + _stringArenaSize;
+  
+  // Lazy load: read the key index now and leave the records for later. A ring
+  // buffer table is always loaded eagerly.
+  if (result == IMDB_OK && lazy && hasKeyIndex && recordCount > 0 && ringCapacity == 0) {
+    IMDBLazyLoad* state = (IMDBLazyLoad*)malloc(sizeof(IMDBLazyLoad));
+    uint8_t* lookupBuffer = (uint8_t*)malloc(IMDB_PERSIST_BLOCK_SIZE);
+    IMDBKeyIndexEntry* index = (IMDBKeyIndexEntry*)malloc(indexBytes);
+    if (state == nullptr || lookupBuffer == nullptr || index == nullptr) {
+      result = IMDB_ERROR_OUT_OF_MEMORY;
+    } else if (!checkHeapLimit()) {
+      result = IMDB_ERROR_HEAP_LIMIT;
     }
     
-    case IMDB_TYPE_MAC:
-      // Only equality supported for MAC
-      return memcmp(fieldValue->macAddress, compareValue, 6) == 0;
-      
-    case IMDB_TYPE_STRING: {
-      // Only equality supported for strings
-      if (fieldValue->stringValue == nullptr || compareValue == nullptr) {
-        return false;
+    // The index runs to the end of the file, so reading it also checks the
+    // file's last block. Then the file goes back to the first record.
+    if (result == IMDB_OK) {
+      size_t resume = file->position();
+      IMDBBlockReader indexReader = {file, lookupBuffer, 0, 0, false, false, true, 0, 0, 0};
+      if (!seekPayload(&indexReader, blockSize, indexOffset) ||
+          !readBlockBytes(&indexReader, index, indexBytes) || !finishBlocks(&indexReader)) {
+        result = (indexReader.failed && !indexReader.corrupt) ? IMDB_ERROR_FILE_READ : IMDB_ERROR_CORRUPT_FILE;
+      } else if (!validKeyIndex(index, recordCount, recordsOffset, indexOffset)) {
+        result = IMDB_ERROR_CORRUPT_FILE;
+      } else if (!file->seek(resume)) {
+        result = IMDB_ERROR_FILE_READ;
       }
-      const char* strToCompare = *(const char**)compareValue;
-      if (strToCompare == nullptr) {
-        return false;
-      }
-      return strcmp(fieldValue->stringValue, strToCompare) == 0;
     }
-      
-    case IMDB_TYPE_EPOCH: {
-      uint32_t a = fieldValue->epochValue;
-      uint32_t b = *(const uint32_t*)compareValue;
-      switch (op) {
-        case IMDB_OP_EQUAL: return a == b;
-        case IMDB_OP_NOT_EQUAL: return a != b;
-        case IMDB_OP_GREATER: return a > b;
-        case IMDB_OP_LESS: return a < b;
-        case IMDB_OP_GREATER_EQUAL: return a >= b;
-        case IMDB_OP_LESS_EQUAL: return a <= b;
-      }
-      break;
+    
+    if (result == IMDB_OK) {
+      // The lazy load now owns the file and both buffers
+      state->file = file;
+      state->reader = reader;
+      state->lookupBuffer = lookupBuffer;
+      state->index = index;
+      state->recordCount = recordCount;
+      state->blockSize = blockSize;
+      state->indexOffset = indexOffset;
+      state->saveMillis = saveMillis;
+      state->loadMillis = currentMillis;
+      state->nextRowId = nextRowId;
+      state->lastRowId = 0;
+      state->hasRowIds = hasRowIds;
+      state->keyColumn = keyColumn;
+      state->stringCursor = stringCursor;
+      state->stringEnd = stringEnd;
+      _lazy = state;
+      _lazyKey = keyColumn;
+      memoryAllocated(&_memory.indexes, indexBytes, index);
+      _walCheckpointId = checkpointId;
+      _incBaseId = baseId;
+      return IMDB_OK;
     }
     
-    case IMDB_TYPE_BOOL:
-      return fieldValue->boolValue == *(const bool*)compareValue;
-      
-    case IMDB_TYPE_FLOAT: {
-      float a = fieldValue->floatValue;
-      float b = *(const float*)compareValue;
-      float diff = a - b;
-      switch (op) {
-        case IMDB_OP_EQUAL: return (diff > -IMDB_FLOAT_EPSILON && diff < IMDB_FLOAT_EPSILON);
-        case IMDB_OP_NOT_EQUAL: return (diff <= -IMDB_FLOAT_EPSILON || diff >= IMDB_FLOAT_EPSILON);
-        case IMDB_OP_GREATER: return a > b;
-        case IMDB_OP_LESS: return a < b;
-        case IMDB_OP_GREATER_EQUAL: return a >= b;
-        case IMDB_OP_LESS_EQUAL: return a <= b;
+    free(state);
+    free(lookupBuffer);
+    free(index);
+  }
+  
+  // Read records
+  uint32_t lastRowId = 0;
+  if (version == IMDB_FILE_VERSION_V3) {
+#if IMDB_ENABLE_COMPRESSION
+    if (result == IMDB_OK) {
+      result = readColumnarRecords(&reader, recordCount, saveMillis, maxRawBytes, stringCursor, stringEnd);
+      if (result == IMDB_OK && reader.corrupt) {
+        result = IMDB_ERROR_CORRUPT_FILE;
       }
-      break;
+    }
+    lastRowId = (uint32_t)_recordCount;
+#endif
+  } else {
+    for (uint32_t i = 0; i < recordCount && result == IMDB_OK; i++) {
+      result = loadNextRecord(&reader, hasRowIds, saveMillis, currentMillis, &lastRowId,
+                              &stringCursor, stringEnd);
     }
   }
   
-  return false;
-}
-
-// Update records matching WHERE condition
-IMDBResult ESP32IMDB::update(const char* whereColumn, const void* whereValue,
-                            const char* setColumn, const void* setValue) {
-  lock();
+  // The key index must start right after the last record; an eager load skips it
+  if (result == IMDB_OK && hasKeyIndex &&
+      (reader.payloadRead != indexOffset || !skipBlockBytes(&reader, indexBytes))) {
+    result = IMDB_ERROR_CORRUPT_FILE;
+  }
   
-  if (!_tableExists) {
-    unlock();
-    return IMDB_ERROR_NO_TABLE;
+  if (result == IMDB_OK) {
+    _nextRowId = (nextRowId > lastRowId) ? nextRowId : lastRowId + 1;
   }
   
-  if (whereColumn == nullptr || whereValue == nullptr || setColumn == nullptr || setValue == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+  // v2: the last block must end exactly after the last record (or the key index)
+  if (result == IMDB_OK && reader.framed && !finishBlocks(&reader)) {
+    result = IMDB_ERROR_CORRUPT_FILE;
   }
   
-  int whereIdx = findColumnIndex(whereColumn);
-  int setIdx = findColumnIndex(setColumn);
+  free(blockBuffer);
+  _storage->close(file);
   
-  if (whereIdx < 0 || setIdx < 0) {
-    unlock();
-    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  // A ring buffer table moves the loaded rows into its preallocated storage
+  if (result == IMDB_OK && ringCapacity > 0) {
+    result = enterRingMode(ringCapacity);
   }
   
-  // Update matching records
-  bool updated = false;
-  for (int i = 0; i < _recordCount; i++) {
-    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
-      continue;
-    }
-    
-    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
-      // For strings, allocate new value before freeing old to prevent data loss on failure
-      if (_columns[setIdx].type == IMDB_TYPE_STRING) {
-        char* oldString = _records[i].fields[setIdx].stringValue;
-        _records[i].fields[setIdx].stringValue = nullptr;  // Temporarily clear to avoid double-free
-        
-        IMDBResult result = copyFieldValue(&_records[i].fields[setIdx], setValue, _columns[setIdx].type);
-        if (result != IMDB_OK) {
-          // Restore old value on failure
-          _records[i].fields[setIdx].stringValue = oldString;
-          unlock();
-          return result;
-        }
-        // Success - now free the old value
-        if (oldString != nullptr) {
-          free(oldString);
-        }
-      } else {
-        // Non-string types can be overwritten directly
-        IMDBResult result = copyFieldValue(&_records[i].fields[setIdx], setValue, _columns[setIdx].type);
-        if (result != IMDB_OK) {
-          unlock();
-          return result;
-        }
-      }
-      updated = true;
-    }
+  if (result != IMDB_OK) {
+    discardTable();
+  } else {
+    _lazyKey = hasKeyIndex ? keyColumn : -1;
+    _walCheckpointId = checkpointId;
+    _incBaseId = baseId;
   }
   
-  unlock();
-  return updated ? IMDB_OK : IMDB_ERROR_NO_RECORDS;
+  return result;
 }
 
-// Simple float modulo implementation
-static inline float floatModulo(float x, float y) {
-  if (y == 0.0f) return 0.0f;
-  return x - ((int)(x / y)) * y;
-}
+// Lazy loads
+//
+// loadFromFileLazy() reads the header, schema and key index of a v2 file and
+// returns. A background task then hydrates the records IMDB_LAZY_LOAD_BATCH
+// at a time, taking the lock for each batch. Until the last one is in:
+// - select(), selectAll() and countWhere() on the key column check the rows
+//   loaded so far, then read the index's remaining candidates from the file
+// - every other operation, writes included, first finishes the load under
+//   the lock, so it always works on the whole table
 
-// Update with math operation
-IMDBResult ESP32IMDB::updateWithMath(const char* whereColumn, const void* whereValue,
-                                    const char* setColumn, IMDBMathOp operation, 
-                                    int32_t operand) {
+// Choose the column indexed in v2 snapshots for loadFromFileLazy()
+IMDBResult ESP32IMDB::setLazyLoadKey(const char* column) {
   lock();
   
   if (!_tableExists) {
@@ -574,1281 +6334,2138 @@ IMDBResult ESP32IMDB::updateWithMath(const char* whereColumn, const void* whereV
     return IMDB_ERROR_NO_TABLE;
   }
   
-  if (whereColumn == nullptr || whereValue == nullptr || setColumn == nullptr) {
+  if (column == nullptr) {
+    _lazyKey = -1;
     unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+    return IMDB_OK;
   }
   
-  int whereIdx = findColumnIndex(whereColumn);
-  int setIdx = findColumnIndex(setColumn);
-  
-  if (whereIdx < 0 || setIdx < 0) {
+  int keyIdx = findColumnIndex(column);
+  if (keyIdx < 0) {
     unlock();
     return IMDB_ERROR_COLUMN_NOT_FOUND;
   }
   
-  // Math operations only supported on INT32, EPOCH, and FLOAT types
-  if (_columns[setIdx].type != IMDB_TYPE_INT32 && 
-      _columns[setIdx].type != IMDB_TYPE_EPOCH && 
-      _columns[setIdx].type != IMDB_TYPE_FLOAT) {
+  // Floats compare within an epsilon and booleans have two values; neither is a key
+  if (_columns[keyIdx].type == IMDB_TYPE_FLOAT || _columns[keyIdx].type == IMDB_TYPE_BOOL) {
     unlock();
     return IMDB_ERROR_INVALID_TYPE;
   }
   
-  // Update matching records
-  bool updated = false;
-  for (int i = 0; i < _recordCount; i++) {
-    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
-      continue;
-    }
-    
-    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
-      if (_columns[setIdx].type == IMDB_TYPE_FLOAT) {
-        // Float math operations
-        float* valuePtr = &_records[i].fields[setIdx].floatValue;
-        float floatOperand = (float)operand;
-        
-        switch (operation) {
-          case IMDB_MATH_ADD:
-            *valuePtr += floatOperand;
-            break;
-          case IMDB_MATH_SUBTRACT:
-            *valuePtr -= floatOperand;
-            break;
-          case IMDB_MATH_MULTIPLY:
-            *valuePtr *= floatOperand;
-            break;
-          case IMDB_MATH_DIVIDE:
-            if (operand == 0) {
-              unlock();
-              return IMDB_ERROR_INVALID_OPERATION;
-            }
-            *valuePtr /= floatOperand;
-            break;
-          case IMDB_MATH_MODULO:
-            if (operand == 0) {
-              unlock();
-              return IMDB_ERROR_INVALID_OPERATION;
-            }
-            *valuePtr = floatModulo(*valuePtr, floatOperand);
-            break;
-        }
-      } else if (_columns[setIdx].type == IMDB_TYPE_INT32) {
-        // INT32 math operations
-        int32_t* valuePtr = &_records[i].fields[setIdx].int32Value;
-        
-        switch (operation) {
-          case IMDB_MATH_ADD:
-            *valuePtr += operand;
-            break;
-          case IMDB_MATH_SUBTRACT:
-            *valuePtr -= operand;
-            break;
-          case IMDB_MATH_MULTIPLY:
-            *valuePtr *= operand;
-            break;
-          case IMDB_MATH_DIVIDE:
-            if (operand == 0) {
-              unlock();
-              return IMDB_ERROR_INVALID_OPERATION;
-            }
-            *valuePtr /= operand;
-            break;
-          case IMDB_MATH_MODULO:
-            if (operand == 0) {
-              unlock();
-              return IMDB_ERROR_INVALID_OPERATION;
-            }
-            *valuePtr %= operand;
-            break;
-        }
-      } else {
-        // EPOCH math operations (treat as uint32_t to avoid aliasing)
-        uint32_t* valuePtr = &_records[i].fields[setIdx].epochValue;
-        
-        switch (operation) {
-          case IMDB_MATH_ADD:
-            *valuePtr += (uint32_t)operand;
-            break;
-          case IMDB_MATH_SUBTRACT:
-            *valuePtr -= (uint32_t)operand;
-            break;
-          case IMDB_MATH_MULTIPLY:
-            *valuePtr *= (uint32_t)operand;
-            break;
-          case IMDB_MATH_DIVIDE:
-            if (operand == 0) {
-              unlock();
-              return IMDB_ERROR_INVALID_OPERATION;
-            }
-            *valuePtr /= (uint32_t)operand;
-            break;
-          case IMDB_MATH_MODULO:
-            if (operand == 0) {
-              unlock();
-              return IMDB_ERROR_INVALID_OPERATION;
-            }
-            *valuePtr %= (uint32_t)operand;
-            break;
-        }
-      }
-      updated = true;
+  _lazyKey = keyIdx;
+  unlock();
+  return IMDB_OK;
+}
+
+// Load a file, returning as soon as lookups on its key column can be answered
+IMDBResult ESP32IMDB::loadFromFileLazy(const char* filename) {
+  IMDB_STAT_SCOPE(IMDB_STAT_LOAD);
+  lock();
+  
+  // Files without a key index are loaded completely by loadLocked()
+  IMDBResult result = loadLocked(filename, true);
+  _lastLoadResult = result;
+  
+  // A task that is still winding down from an earlier lazy load picks this one up
+  if (result == IMDB_OK && _lazy != nullptr && !_loadTaskRunning) {
+    _loadTaskRunning = true;
+    if (xTaskCreate(loadTask, "IMDBLoad", IMDB_SAVE_TASK_STACK, this,
+                    IMDB_SAVE_TASK_PRIORITY, NULL) != pdPASS) {
+      // No task: finish here, like loadFromFile()
+      _loadTaskRunning = false;
+      hydrateLocked(UINT32_MAX);
+      result = _lastLoadResult;
     }
   }
   
   unlock();
-  return updated ? IMDB_OK : IMDB_ERROR_NO_RECORDS;
+  return result;
 }
 
-// Delete records matching WHERE condition
-IMDBResult ESP32IMDB::deleteRecords(const char* whereColumn, const void* whereValue) {
-  lock();
+// Hydrate up to rows more records (caller holds the lock). After the last one
+// the file is checked through to its end and closed; a failed load discards
+// the table, as loadFromFile() would.
+void ESP32IMDB::hydrateLocked(uint32_t rows) {
+  IMDBLazyLoad* lazy = _lazy;
+  IMDBResult result = IMDB_OK;
+  
+  for (uint32_t i = 0; i < rows && (uint32_t)_recordCount < lazy->recordCount && result == IMDB_OK; i++) {
+    result = loadNextRecord(&lazy->reader, lazy->hasRowIds, lazy->saveMillis, lazy->loadMillis,
+                            &lazy->lastRowId, &lazy->stringCursor, lazy->stringEnd);
+  }
   
-  if (!_tableExists) {
-    unlock();
-    return IMDB_ERROR_NO_TABLE;
+  if (result == IMDB_OK && (uint32_t)_recordCount < lazy->recordCount) {
+    return;
   }
   
-  if (whereColumn == nullptr || whereValue == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+  // The index was verified when the load started; it only has to follow the last record
+  if (result == IMDB_OK &&
+      (lazy->reader.payloadRead != lazy->indexOffset ||
+       !skipBlockBytes(&lazy->reader, (size_t)lazy->recordCount * sizeof(IMDBKeyIndexEntry)) ||
+       !finishBlocks(&lazy->reader))) {
+    result = IMDB_ERROR_CORRUPT_FILE;
   }
   
-  int whereIdx = findColumnIndex(whereColumn);
-  if (whereIdx < 0) {
-    unlock();
-    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  uint32_t nextRowId = lazy->nextRowId;
+  uint32_t lastRowId = lazy->lastRowId;
+  releaseLazyLoad();
+  
+  _lastLoadResult = result;
+  if (result != IMDB_OK) {
+    discardTable();
+  } else {
+    _nextRowId = (nextRowId > lastRowId) ? nextRowId : lastRowId + 1;
+  }
+}
+
+// Complete a lazy load now (caller holds the lock), unless whereColumn is
+// its key column: those lookups can be answered while rows are still loading
+void ESP32IMDB::finishLazyLoad(const char* whereColumn) {
+  if (_lazy == nullptr) {
+    return;
+  }
+  if (whereColumn != nullptr && findColumnIndex(whereColumn) == _lazy->keyColumn) {
+    return;
+  }
+  hydrateLocked(UINT32_MAX);
+}
+
+// Close the file and free the lazy load state (caller holds the lock)
+void ESP32IMDB::releaseLazyLoad() {
+  if (_lazy == nullptr) {
+    return;
+  }
+  _storage->close(_lazy->file);
+  free(_lazy->reader.buffer);
+  free(_lazy->lookupBuffer);
+  memoryFreed(&_memory.indexes, sizeof(IMDBKeyIndexEntry) * _lazy->recordCount, _lazy->index);
+  free(_lazy->index);
+  free(_lazy);
+  _lazy = nullptr;
+}
+
+// Read the record at a payload offset straight from the file into
+// individually allocated fields (caller holds the lock and frees the record).
+// The hydration reader's file position is restored afterwards.
+IMDBResult ESP32IMDB::readLazyRecord(uint32_t offset, IMDBRecord* record) {
+  IMDBLazyLoad* lazy = _lazy;
+  size_t resume = lazy->file->position();
+  IMDBBlockReader reader = {lazy->file, lazy->lookupBuffer, 0, 0, false, false, true, 0, 0, 0};
+  char scratch[IMDB_MAX_STRING_LENGTH + 1];
+  uint32_t rowId;
+  
+  record->fields = nullptr;
+  bool ok = seekPayload(&reader, lazy->blockSize, offset) &&
+            (!lazy->hasRowIds || readBlockBytes(&reader, &rowId, 4)) &&
+            readRecordOwned(&reader, record, scratch);
+  
+  // Read on to the end of the block so its CRC is checked
+  if (ok && !skipBlockBytes(&reader, reader.blockRemaining)) {
+    freeRecord(record);
+    ok = false;
   }
   
-  bool deleted = false;
-  for (int i = 0; i < _recordCount; i++) {
-    if (!_records[i].isValid) {
-      continue;
-    }
-    
-    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
-      freeRecord(&_records[i]);
-      _records[i].isValid = false;
-      deleted = true;
-    }
+  if (!lazy->file->seek(resume)) {
+    lazy->reader.failed = true;  // The next hydration step reports it
   }
   
-  if (deleted) {
-    compactRecords();
+  if (!ok) {
+    if (reader.corrupt) {
+      return IMDB_ERROR_CORRUPT_FILE;
+    }
+    return reader.failed ? IMDB_ERROR_FILE_READ : IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  unlock();
-  return deleted ? IMDB_OK : IMDB_ERROR_NO_RECORDS;
+  record->expiryMillis = restoreExpiry(record->expiryMillis, lazy->saveMillis, lazy->loadMillis);
+  return IMDB_OK;
 }
 
-// Copy field value to result structure
-void ESP32IMDB::getFieldValue(const IMDBFieldValue* field, IMDBDataType type, 
-                             IMDBSelectResult* result) const {
-  result->type = type;
-  result->hasValue = true;
-  
-  switch (type) {
-    case IMDB_TYPE_INT32:
-      result->int32Value = field->int32Value;
-      break;
+// Rows not hydrated yet whose key column equals whereValue, in table order
+// (caller holds the lock; release with freeLazyMatches()). At most maxRows
+// are returned. IMDB_ERROR_NO_RECORDS if there are none.
+IMDBResult ESP32IMDB::readLazyMatches(const void* whereValue, int maxRows, IMDBRecord** rows,
+                                      int* rowCount) {
+  IMDBLazyLoad* lazy = _lazy;
+  int keyIdx = lazy->keyColumn;
+  IMDBDataType keyType = _columns[keyIdx].type;
+  *rows = nullptr;
+  *rowCount = 0;
+  
+  // Key of the where value, computed as for a stored field
+  IMDBFieldValue whereField;
+  memset(&whereField, 0, sizeof(whereField));
+  switch (keyType) {
     case IMDB_TYPE_MAC:
-      memcpy(result->macAddress, field->macAddress, 6);
+      memcpy(whereField.macAddress, whereValue, 6);
       break;
     case IMDB_TYPE_STRING:
-      if (field->stringValue != nullptr) {
-        strncpy(result->stringValue, field->stringValue, IMDB_MAX_STRING_LENGTH);
-        result->stringValue[IMDB_MAX_STRING_LENGTH] = '\0';
-      } else {
-        result->stringValue[0] = '\0';
+      whereField.stringValue = *(char* const*)whereValue;
+      if (whereField.stringValue == nullptr) {
+        return IMDB_ERROR_NO_RECORDS;
       }
       break;
-    case IMDB_TYPE_EPOCH:
-      result->epochValue = field->epochValue;
-      break;
-    case IMDB_TYPE_BOOL:
-      result->boolValue = field->boolValue;
-      break;
-    case IMDB_TYPE_FLOAT:
-      result->floatValue = field->floatValue;
+    default:
+      memcpy(&whereField.int32Value, whereValue, 4);
       break;
   }
-}
-
-// Select a single column value from first matching record
-IMDBResult ESP32IMDB::select(const char* column, const char* whereColumn,
-                            const void* whereValue, IMDBSelectResult* result) {
-  lock();
-  
-  if (!_tableExists) {
-    unlock();
-    return IMDB_ERROR_NO_TABLE;
+  uint32_t key = keyIndexKey(&whereField, keyType);
+  
+  // First entry with this key
+  uint32_t low = 0;
+  uint32_t high = lazy->recordCount;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (lazy->index[mid].key < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
   }
   
-  if (column == nullptr || whereColumn == nullptr || whereValue == nullptr || result == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+  // Entries with the same key are in file order; skip the ones already hydrated
+  uint32_t last = low;
+  while (last < lazy->recordCount && lazy->index[last].key == key) {
+    last++;
+  }
+  uint32_t first = low;
+  while (first < last && lazy->index[first].offset < lazy->reader.payloadRead) {
+    first++;
+  }
+  if (first == last) {
+    return IMDB_ERROR_NO_RECORDS;
   }
   
-  int colIdx = findColumnIndex(column);
-  int whereIdx = findColumnIndex(whereColumn);
+  uint32_t capacity = last - first;
+  if (capacity > (uint32_t)maxRows) {
+    capacity = (uint32_t)maxRows;
+  }
+  IMDBRecord* matches = (IMDBRecord*)malloc(sizeof(IMDBRecord) * capacity);
+  if (matches == nullptr) {
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
   
-  if (colIdx < 0 || whereIdx < 0) {
-    unlock();
-    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  // Equal keys are only candidates (hash collisions); compare the real values
+  int count = 0;
+  for (uint32_t i = first; i < last && count < maxRows; i++) {
+    IMDBRecord* record = &matches[count];
+    IMDBResult result = readLazyRecord(lazy->index[i].offset, record);
+    if (result != IMDB_OK) {
+      freeLazyMatches(matches, count);
+      return result;
+    }
+    if (record->isValid && !isRecordExpired(record->expiryMillis) &&
+        compareValues(&record->fields[keyIdx], whereValue, keyType)) {
+      count++;
+    } else {
+      freeRecord(record);
+    }
   }
   
-  result->hasValue = false;
+  if (count == 0) {
+    free(matches);
+    return IMDB_ERROR_NO_RECORDS;
+  }
   
-  for (int i = 0; i < _recordCount; i++) {
-    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
-      continue;
+  *rows = matches;
+  *rowCount = count;
+  return IMDB_OK;
+}
+
+// Free rows returned by readLazyMatches()
+void ESP32IMDB::freeLazyMatches(IMDBRecord* rows, int rowCount) {
+  for (int i = 0; i < rowCount; i++) {
+    freeRecord(&rows[i]);
+  }
+  free(rows);
+}
+
+// Background hydration task: one batch per lock hold, so other callers get in between
+void ESP32IMDB::loadTask(void* parameter) {
+  ESP32IMDB* db = (ESP32IMDB*)parameter;
+  bool loading = true;
+  
+  while (loading) {
+    db->lock();
+    if (db->_lazy != nullptr) {
+      db->hydrateLocked(IMDB_LAZY_LOAD_BATCH);
+    }
+    loading = (db->_lazy != nullptr);
+    if (!loading) {
+      // Cleared under the lock: a lazy load started after this point sees
+      // the flag down and starts its own task
+      db->_loadTaskRunning = false;
     }
+    db->unlock();
     
-    if (compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
-      getFieldValue(&_records[i].fields[colIdx], _columns[colIdx].type, result);
-      unlock();
-      return IMDB_OK;
+    if (loading) {
+      vTaskDelay(1);
     }
   }
   
+  vTaskDelete(NULL);
+}
+
+// True while a lazy load is still hydrating rows
+bool ESP32IMDB::isLoadInProgress() const {
+  lock();
+  bool inProgress = (_lazy != nullptr);
   unlock();
-  return IMDB_ERROR_NO_RECORDS;
+  return inProgress;
 }
 
-// Select all matching records (caller must free results)
-IMDBResult ESP32IMDB::selectAll(const char* whereColumn, const void* whereValue,
-                               IMDBSelectResult** results, int* resultCount) {
+// Percentage of rows hydrated by the current lazy load; 100 when none is running
+uint8_t ESP32IMDB::getLoadProgress() const {
   lock();
+  uint8_t progress = 100;
+  if (_lazy != nullptr) {
+    progress = (uint8_t)((uint64_t)_recordCount * 100 / _lazy->recordCount);
+  }
+  unlock();
+  return progress;
+}
+
+// Result of the most recent loadFromFileLazy(): IMDB_OK while rows are still
+// loading, then the outcome of the hydration
+IMDBResult ESP32IMDB::getLastLoadResult() const {
+  return _lastLoadResult;
+}
+
+#if IMDB_ENABLE_COMPRESSION
+// Compressed (v3) snapshots
+//
+// Same preamble and CRC-checked block framing as v2. The header adds
+// maxRawBytes (largest uncompressed group) and stringBytes (string arena
+// size for the loader). Records follow in row groups, each encoded column
+// by column and then compressed with an LZ4-compatible block codec:
+//   method u8 (0 stored, 1 LZ4) | rows u16 | rawLength u32 | storedLength u32 | data
+// Inside a group:
+//   expiry        zigzag varint delta from the previous row
+//   INT32/EPOCH   zigzag varint delta from the previous row
+//   FLOAT         4 bytes
+//   BOOL          bit-packed, 8 rows per byte
+//   MAC           OUI dictionary code (varint, 0 = literal 3 bytes follow) + 3 bytes
+//   STRING        dictionary code (varint, 0 = literal u8 length + bytes follow)
+// Dictionaries start empty in every group, so each group decodes on its own.
+
+#define IMDB_COLUMNAR_MAX_GROUP_ROWS 1024
+#define IMDB_COLUMNAR_DICT_SLOTS 2048      // String dictionary hash slots (power of two)
+#define IMDB_COLUMNAR_OUI_ENTRIES 64
+#define IMDB_LZ_HASH_BITS 12
+#define IMDB_LZ_MIN_MATCH 4
+#define IMDB_LZ_LAST_LITERALS 5            // LZ4 block rules: sequences end in literals
+#define IMDB_LZ_MATCH_LIMIT 12             // and no match starts this close to the end
+
+static inline uint8_t* putVarint(uint8_t* out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+static inline bool getVarint(const uint8_t** in, const uint8_t* end, uint32_t* value) {
+  uint32_t result = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*in >= end) {
+      return false;
+    }
+    uint8_t byte = *(*in)++;
+    result |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline uint32_t zigzag(uint32_t delta) {
+  return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t value) {
+  return (value >> 1) ^ (0U - (value & 1));
+}
+
+// Worst-case compressed size for an input of the given length
+static inline size_t lzBound(size_t length) {
+  return length + length / 255 + 16;
+}
+
+// Write an LZ4 length continuation (bytes of 255 plus a remainder)
+static inline uint8_t* putLzLength(uint8_t* out, size_t length) {
+  while (length >= 255) {
+    *out++ = 255;
+    length -= 255;
+  }
+  *out++ = (uint8_t)length;
+  return out;
+}
+
+// Greedy LZ4 block compressor. Returns the compressed length, or 0 if the
+// output would not fit in capacity. Input must be at most 64KB.
+static size_t lzCompress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity,
+                         uint16_t* table) {
+  memset(table, 0, sizeof(uint16_t) << IMDB_LZ_HASH_BITS);
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* end = src + length;
+  uint8_t* op = dst;
+  uint8_t* opEnd = dst + capacity;
+  
+  if (length > IMDB_LZ_MATCH_LIMIT) {
+    const uint8_t* matchLimit = end - IMDB_LZ_MATCH_LIMIT;
+    const uint8_t* literalLimit = end - IMDB_LZ_LAST_LITERALS;
+    while (ip < matchLimit) {
+      uint32_t sequence;
+      memcpy(&sequence, ip, 4);
+      uint32_t hash = (sequence * 2654435761U) >> (32 - IMDB_LZ_HASH_BITS);
+      const uint8_t* ref = src + table[hash];
+      table[hash] = (uint16_t)(ip - src);
+      
+      if (ref >= ip || memcmp(ref, ip, IMDB_LZ_MIN_MATCH) != 0) {
+        ip++;
+        continue;
+      }
+      
+      const uint8_t* matchEnd = ip + IMDB_LZ_MIN_MATCH;
+      ref += IMDB_LZ_MIN_MATCH;
+      while (matchEnd < literalLimit && *matchEnd == *ref) {
+        matchEnd++;
+        ref++;
+      }
+      
+      size_t literals = ip - anchor;
+      size_t matchLength = (matchEnd - ip) - IMDB_LZ_MIN_MATCH;
+      if (op + 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1 > opEnd) {
+        return 0;
+      }
+      uint16_t offset = (uint16_t)(matchEnd - ref);
+      uint8_t* token = op++;
+      *token = (uint8_t)(((literals >= 15) ? 15 : literals) << 4);
+      if (literals >= 15) {
+        op = putLzLength(op, literals - 15);
+      }
+      memcpy(op, anchor, literals);
+      op += literals;
+      memcpy(op, &offset, 2);
+      op += 2;
+      *token |= (uint8_t)((matchLength >= 15) ? 15 : matchLength);
+      if (matchLength >= 15) {
+        op = putLzLength(op, matchLength - 15);
+      }
+      
+      ip = matchEnd;
+      anchor = ip;
+    }
+  }
   
-  if (!_tableExists) {
-    unlock();
-    return IMDB_ERROR_NO_TABLE;
+  // Trailing literals
+  size_t literals = end - anchor;
+  if (op + 1 + literals / 255 + 1 + literals > opEnd) {
+    return 0;
+  }
+  *op++ = (uint8_t)(((literals >= 15) ? 15 : literals) << 4);
+  if (literals >= 15) {
+    op = putLzLength(op, literals - 15);
+  }
+  memcpy(op, anchor, literals);
+  op += literals;
+  return op - dst;
+}
+
+// Read an LZ4 length continuation
+static inline bool getLzLength(const uint8_t** in, const uint8_t* end, size_t* length) {
+  uint8_t byte;
+  do {
+    if (*in >= end) {
+      return false;
+    }
+    byte = *(*in)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// LZ4 block decompressor; succeeds only if exactly length bytes come out
+static bool lzDecompress(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t length) {
+  const uint8_t* ip = src;
+  const uint8_t* ipEnd = src + srcLength;
+  uint8_t* op = dst;
+  uint8_t* opEnd = dst + length;
+  
+  while (ip < ipEnd) {
+    uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !getLzLength(&ip, ipEnd, &literals)) {
+      return false;
+    }
+    if (literals > (size_t)(ipEnd - ip) || literals > (size_t)(opEnd - op)) {
+      return false;
+    }
+    memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+    
+    if (ip == ipEnd) {
+      break;  // Last sequence has no match
+    }
+    if (ipEnd - ip < 2) {
+      return false;
+    }
+    uint16_t offset;
+    memcpy(&offset, ip, 2);
+    ip += 2;
+    size_t matchLength = token & 0x0F;
+    if (matchLength == 15 && !getLzLength(&ip, ipEnd, &matchLength)) {
+      return false;
+    }
+    matchLength += IMDB_LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - dst) || matchLength > (size_t)(opEnd - op)) {
+      return false;
+    }
+    // Byte copy: matches may overlap their own output
+    const uint8_t* ref = op - offset;
+    for (size_t k = 0; k < matchLength; k++) {
+      op[k] = ref[k];
+    }
+    op += matchLength;
   }
   
-  if (whereColumn == nullptr || whereValue == nullptr || results == nullptr || resultCount == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+  return op == opEnd;
+}
+
+// Largest number of bytes one record can take inside a group
+size_t ESP32IMDB::columnarRowBound(const IMDBRecord* record) const {
+  size_t bound = 5;  // Expiry
+  for (int j = 0; j < _columnCount; j++) {
+    switch (_columns[j].type) {
+      case IMDB_TYPE_BOOL:
+        bound += 1;
+        break;
+      case IMDB_TYPE_MAC:
+        bound += 1 + 3 + 3;
+        break;
+      case IMDB_TYPE_STRING: {
+        size_t strLen = record->fields[j].stringValue ? strlen(record->fields[j].stringValue) : 0;
+        bound += 3 + 1 + ((strLen > IMDB_MAX_STRING_LENGTH) ? IMDB_MAX_STRING_LENGTH : strLen);
+        break;
+      }
+      case IMDB_TYPE_FLOAT:
+        bound += 4;
+        break;
+      default:
+        bound += 5;
+        break;
+    }
+  }
+  return bound;
+}
+
+// Encode rows [start, start + rows) column by column; returns the byte count
+size_t ESP32IMDB::encodeColumnarGroup(int start, int rows, uint8_t* out, int16_t* dictSlots,
+                                      const char** dictEntries, uint8_t* dictLengths) const {
+  uint8_t* op = out;
+  const IMDBRecord* records = &_records[start];
+  
+  uint32_t previous = 0;
+  for (int r = 0; r < rows; r++) {
+    op = putVarint(op, zigzag(records[r].expiryMillis - previous));
+    previous = records[r].expiryMillis;
   }
   
-  int whereIdx = findColumnIndex(whereColumn);
-  if (whereIdx < 0) {
-    unlock();
-    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  for (int j = 0; j < _columnCount; j++) {
+    switch (_columns[j].type) {
+      case IMDB_TYPE_INT32:
+      case IMDB_TYPE_EPOCH: {
+        // INT32 and EPOCH share the union's first 4 bytes
+        uint32_t last = 0;
+        for (int r = 0; r < rows; r++) {
+          uint32_t value = records[r].fields[j].epochValue;
+          op = putVarint(op, zigzag(value - last));
+          last = value;
+        }
+        break;
+      }
+      
+      case IMDB_TYPE_FLOAT:
+        for (int r = 0; r < rows; r++) {
+          memcpy(op, &records[r].fields[j].floatValue, 4);
+          op += 4;
+        }
+        break;
+        
+      case IMDB_TYPE_BOOL:
+        memset(op, 0, (rows + 7) / 8);
+        for (int r = 0; r < rows; r++) {
+          if (records[r].fields[j].boolValue) {
+            op[r / 8] |= (uint8_t)(1 << (r % 8));
+          }
+        }
+        op += (rows + 7) / 8;
+        break;
+        
+      case IMDB_TYPE_MAC: {
+        uint8_t ouis[IMDB_COLUMNAR_OUI_ENTRIES][3];
+        int ouiCount = 0;
+        for (int r = 0; r < rows; r++) {
+          const uint8_t* mac = records[r].fields[j].macAddress;
+          int code = 0;
+          for (int k = 0; k < ouiCount; k++) {
+            if (memcmp(ouis[k], mac, 3) == 0) {
+              code = k + 1;
+              break;
+            }
+          }
+          op = putVarint(op, (uint32_t)code);
+          if (code == 0) {
+            memcpy(op, mac, 3);
+            op += 3;
+            if (ouiCount < IMDB_COLUMNAR_OUI_ENTRIES) {
+              memcpy(ouis[ouiCount++], mac, 3);
+            }
+          }
+          memcpy(op, mac + 3, 3);
+          op += 3;
+        }
+        break;
+      }
+      
+      case IMDB_TYPE_STRING: {
+        memset(dictSlots, 0xFF, sizeof(int16_t) * IMDB_COLUMNAR_DICT_SLOTS);
+        int dictCount = 0;
+        for (int r = 0; r < rows; r++) {
+          const char* str = records[r].fields[j].stringValue;
+          size_t length = str ? strlen(str) : 0;
+          if (length > IMDB_MAX_STRING_LENGTH) {
+            length = IMDB_MAX_STRING_LENGTH;
+          }
+          if (length == 0) {
+            *op++ = 0;  // Literal
+            *op++ = 0;  // Empty
+            continue;
+          }
+          
+          uint32_t slot = hashString(str, length) & (IMDB_COLUMNAR_DICT_SLOTS - 1);
+          while (dictSlots[slot] >= 0) {
+            int entry = dictSlots[slot];
+            if (dictLengths[entry] == length && memcmp(dictEntries[entry], str, length) == 0) {
+              break;
+            }
+            slot = (slot + 1) & (IMDB_COLUMNAR_DICT_SLOTS - 1);
+          }
+          
+          if (dictSlots[slot] >= 0) {
+            op = putVarint(op, (uint32_t)dictSlots[slot] + 1);
+          } else {
+            *op++ = 0;
+            *op++ = (uint8_t)length;
+            memcpy(op, str, length);
+            op += length;
+            dictEntries[dictCount] = str;
+            dictLengths[dictCount] = (uint8_t)length;
+            dictSlots[slot] = (int16_t)dictCount++;
+          }
+        }
+        break;
+      }
+    }
   }
   
-  // Count matches first
-  int matches = 0;
+  return op - out;
+}
+
+// Write a compressed v3 snapshot (caller holds the lock and has purged)
+IMDBResult ESP32IMDB::saveColumnarLocked(const char* filename) {
+  // Size the group buffer for the widest row and the loader's string arena
+  size_t rawCapacity = IMDB_COMPRESS_GROUP_BYTES;
+  uint32_t stringBytes = 0;
   for (int i = 0; i < _recordCount; i++) {
-    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis) &&
-        compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
-      matches++;
+    size_t bound = columnarRowBound(&_records[i]);
+    if (bound > rawCapacity) {
+      rawCapacity = bound;
+    }
+    for (int j = 0; j < _columnCount; j++) {
+      const char* str = _records[i].fields[j].stringValue;
+      if (_columns[j].type == IMDB_TYPE_STRING && str != nullptr && str[0] != '\0') {
+        size_t length = strlen(str);
+        stringBytes += ((length > IMDB_MAX_STRING_LENGTH) ? IMDB_MAX_STRING_LENGTH : length) + 1;
+      }
     }
   }
   
-  if (matches == 0) {
-    *results = nullptr;
-    *resultCount = 0;
-    unlock();
-    return IMDB_ERROR_NO_RECORDS;
+  uint8_t* blockBuffer = (uint8_t*)malloc(IMDB_PERSIST_BLOCK_SIZE + IMDB_BLOCK_FRAMING);
+  uint8_t* raw = (uint8_t*)malloc(rawCapacity);
+  uint8_t* packed = (uint8_t*)malloc(lzBound(rawCapacity));
+  uint16_t* lzTable = (uint16_t*)malloc(sizeof(uint16_t) << IMDB_LZ_HASH_BITS);
+  int16_t* dictSlots = (int16_t*)malloc(sizeof(int16_t) * IMDB_COLUMNAR_DICT_SLOTS);
+  const char** dictEntries = (const char**)malloc(sizeof(const char*) * IMDB_COLUMNAR_MAX_GROUP_ROWS);
+  uint8_t* dictLengths = (uint8_t*)malloc(IMDB_COLUMNAR_MAX_GROUP_ROWS);
+  
+  IMDBResult result = IMDB_OK;
+  if (blockBuffer == nullptr || raw == nullptr || packed == nullptr || lzTable == nullptr ||
+      dictSlots == nullptr || dictEntries == nullptr || dictLengths == nullptr) {
+    result = IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  // Allocate result array with overflow check
-  // Check for potential integer overflow: matches * _columnCount
-  if (matches > 0 && _columnCount > 0 && matches > (INT_MAX / _columnCount / (int)sizeof(IMDBSelectResult))) {
-    unlock();
-    return IMDB_ERROR_OUT_OF_MEMORY;  // Would overflow
-  }
+  char tempFilename[256];
+  snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", filename);
   
-  *results = (IMDBSelectResult*)malloc(sizeof(IMDBSelectResult) * matches * _columnCount);
-  if (*results == nullptr) {
-    unlock();
-    return IMDB_ERROR_OUT_OF_MEMORY;
+  IMDBFile* file = nullptr;
+  if (result == IMDB_OK) {
+    file = _storage->open(tempFilename, "w");
+    if (file == nullptr) {
+      result = IMDB_ERROR_FILE_OPEN;
+    }
   }
   
-  // Fill results
-  int resultIdx = 0;
-  for (int i = 0; i < _recordCount; i++) {
-    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis) &&
-        compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
-      for (int col = 0; col < _columnCount; col++) {
-        getFieldValue(&_records[i].fields[col], _columns[col].type, 
-                     &(*results)[resultIdx * _columnCount + col]);
+  if (result == IMDB_OK) {
+    IMDBBlockWriter writer = {file, blockBuffer, 0, false};
+    
+    const uint8_t preamble[5] = {'I', 'M', 'D', 'B', IMDB_FILE_VERSION_V3};
+    writeRawBytes(&writer, preamble, 5);
+    
+    const uint8_t flags = (_ringCapacity > 0) ? IMDB_FILE_FLAG_RING : 0;
+    const uint16_t reserved = 0;
+    uint32_t recordCount = (uint32_t)_recordCount;
+    uint32_t saveMillis = millis();
+    uint32_t maxRawBytes = (uint32_t)rawCapacity;
+    
+    writeBlockBytes(&writer, &flags, 1);
+    writeBlockBytes(&writer, &_columnCount, 1);
+    writeBlockBytes(&writer, &reserved, 2);
+    writeBlockBytes(&writer, &recordCount, 4);
+    writeBlockBytes(&writer, &saveMillis, 4);
+    if (_ringCapacity > 0) {
+      writeBlockBytes(&writer, &_ringCapacity, 4);
+    }
+    writeBlockBytes(&writer, &maxRawBytes, 4);
+    writeBlockBytes(&writer, &stringBytes, 4);
+    
+    for (int i = 0; i < _columnCount; i++) {
+      uint8_t typeValue = (uint8_t)_columns[i].type;
+      writeBlockBytes(&writer, _columns[i].name, 32);
+      writeBlockBytes(&writer, &typeValue, 1);
+    }
+    
+    int start = 0;
+    while (start < _recordCount && !writer.failed) {
+      // Take rows while the group still fits the buffer
+      int rows = 0;
+      size_t groupBound = 0;
+      while (start + rows < _recordCount && rows < IMDB_COLUMNAR_MAX_GROUP_ROWS) {
+        size_t bound = columnarRowBound(&_records[start + rows]);
+        if (rows > 0 && groupBound + bound > rawCapacity) {
+          break;
+        }
+        groupBound += bound;
+        rows++;
+      }
+      
+      uint32_t rawLength = (uint32_t)encodeColumnarGroup(start, rows, raw, dictSlots, dictEntries,
+                                                         dictLengths);
+      // LZ4 offsets are 16 bits; oversized groups are stored as-is
+      uint32_t packedLength = 0;
+      if (rawLength <= 65535) {
+        packedLength = (uint32_t)lzCompress(raw, rawLength, packed, lzBound(rawLength), lzTable);
       }
-      resultIdx++;
+      uint8_t method = (packedLength > 0 && packedLength < rawLength) ? 1 : 0;
+      uint16_t groupRows = (uint16_t)rows;
+      uint32_t storedLength = method ? packedLength : rawLength;
+      
+      writeBlockBytes(&writer, &method, 1);
+      writeBlockBytes(&writer, &groupRows, 2);
+      writeBlockBytes(&writer, &rawLength, 4);
+      writeBlockBytes(&writer, &storedLength, 4);
+      writeBlockBytes(&writer, method ? packed : raw, storedLength);
+      
+      start += rows;
+    }
+    
+    bool writeOk = flushBlock(&writer);
+    writeOk = _storage->close(file) && writeOk;
+    
+    if (!writeOk) {
+      _storage->remove(tempFilename);
+      result = IMDB_ERROR_FILE_WRITE;
+    } else if (!replaceFile(_storage, tempFilename, filename)) {
+      result = IMDB_ERROR_FILE_WRITE;
     }
   }
   
-  *resultCount = matches;
-  unlock();
-  return IMDB_OK;
+  free(dictLengths);
+  free(dictEntries);
+  free(dictSlots);
+  free(lzTable);
+  free(packed);
+  free(raw);
+  free(blockBuffer);
+  return result;
 }
 
-// Count all valid records
-int32_t ESP32IMDB::count() {
+// Save a compressed snapshot; loadFromFile() reads it like any other
+IMDBResult ESP32IMDB::saveToFileCompressed(const char* filename) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SAVE);
   lock();
   
+  finishLazyLoad();
+  
   if (!_tableExists) {
     unlock();
-    return 0;
+    return IMDB_ERROR_NO_TABLE;
   }
   
-  int32_t cnt = 0;
-  for (int i = 0; i < _recordCount; i++) {
-    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis)) {
-      cnt++;
-    }
+  if (filename == nullptr) {
+    unlock();
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  // WAL checkpoints rewrite their snapshot in the v2 format
+  if ((_walEnabled && strcmp(filename, _walSnapshotFilename) == 0) || saveTargetBusy(filename)) {
+    unlock();
+    return IMDB_ERROR_INVALID_OPERATION;
   }
   
+  purgeForSnapshot();
+  IMDBResult result = saveColumnarLocked(filename);
+  
   unlock();
-  return cnt;
+  return result;
 }
 
-// Count records matching WHERE condition
-int32_t ESP32IMDB::countWhere(const char* whereColumn, const void* whereValue) {
-  lock();
-  
-  if (!_tableExists) {
-    unlock();
-    return 0;
+// Decode v3 row groups into the load arenas (caller holds the lock)
+IMDBResult ESP32IMDB::readColumnarRecords(IMDBBlockReader* reader, uint32_t recordCount,
+                                          uint32_t saveMillis, uint32_t maxRawBytes,
+                                          char* stringCursor, char* stringEnd) {
+  if (recordCount == 0) {
+    return IMDB_OK;
   }
-  
-  if (whereColumn == nullptr || whereValue == nullptr) {
-    unlock();
-    return 0;
+  if (maxRawBytes == 0) {
+    return IMDB_ERROR_CORRUPT_FILE;
   }
   
-  int whereIdx = findColumnIndex(whereColumn);
-  if (whereIdx < 0) {
-    unlock();
-    return 0;
+  uint8_t* raw = (uint8_t*)malloc(maxRawBytes);
+  uint8_t* packed = (uint8_t*)malloc(lzBound(maxRawBytes));
+  char** dict = (char**)malloc(sizeof(char*) * IMDB_COLUMNAR_MAX_GROUP_ROWS);
+  IMDBResult result = IMDB_OK;
+  if (raw == nullptr || packed == nullptr || dict == nullptr) {
+    result = IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  int32_t cnt = 0;
-  for (int i = 0; i < _recordCount; i++) {
-    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis) &&
-        compareValues(&_records[i].fields[whereIdx], whereValue, _columns[whereIdx].type)) {
-      cnt++;
+  uint32_t currentMillis = millis();
+  uint32_t done = 0;
+  
+  while (result == IMDB_OK && done < recordCount) {
+    uint8_t method = 0;
+    uint16_t rows = 0;
+    uint32_t rawLength = 0;
+    uint32_t storedLength = 0;
+    if (!readBlockBytes(reader, &method, 1) || !readBlockBytes(reader, &rows, 2) ||
+        !readBlockBytes(reader, &rawLength, 4) || !readBlockBytes(reader, &storedLength, 4)) {
+      result = reader->corrupt ? IMDB_ERROR_CORRUPT_FILE : IMDB_ERROR_FILE_READ;
+      break;
+    }
+    if (method > 1 || rows == 0 || rows > IMDB_COLUMNAR_MAX_GROUP_ROWS || rows > recordCount - done ||
+        rawLength > maxRawBytes || storedLength > lzBound(maxRawBytes) ||
+        (method == 0 && storedLength != rawLength)) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+      break;
+    }
+    
+    uint8_t* stored = method ? packed : raw;
+    if (!readBlockBytes(reader, stored, storedLength)) {
+      result = reader->corrupt ? IMDB_ERROR_CORRUPT_FILE : IMDB_ERROR_FILE_READ;
+      break;
+    }
+    if (method == 1 && !lzDecompress(packed, storedLength, raw, rawLength)) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+      break;
+    }
+    
+    // Decode column by column into the next rows of the arena
+    const uint8_t* in = raw;
+    const uint8_t* end = raw + rawLength;
+    IMDBRecord* records = &_records[done];
+    bool valid = true;
+    
+    uint32_t previous = 0;
+    for (int r = 0; r < rows && valid; r++) {
+      uint32_t value = 0;
+      valid = getVarint(&in, end, &value);
+      previous += unzigzag(value);
+      records[r].fields = &_fieldArena[(size_t)(done + r) * _columnCount];
+      records[r].expiryMillis = previous;
+    }
+    
+    for (int j = 0; j < _columnCount && valid; j++) {
+      switch (_columns[j].type) {
+        case IMDB_TYPE_INT32:
+        case IMDB_TYPE_EPOCH: {
+          uint32_t last = 0;
+          for (int r = 0; r < rows && valid; r++) {
+            uint32_t value = 0;
+            valid = getVarint(&in, end, &value);
+            last += unzigzag(value);
+            records[r].fields[j].epochValue = last;
+          }
+          break;
+        }
+        
+        case IMDB_TYPE_FLOAT:
+          valid = ((size_t)(end - in) >= (size_t)rows * 4);
+          for (int r = 0; r < rows && valid; r++) {
+            memcpy(&records[r].fields[j].floatValue, in, 4);
+            in += 4;
+          }
+          break;
+          
+        case IMDB_TYPE_BOOL:
+          valid = ((size_t)(end - in) >= (size_t)(rows + 7) / 8);
+          for (int r = 0; r < rows && valid; r++) {
+            records[r].fields[j].boolValue = (in[r / 8] >> (r % 8)) & 1;
+          }
+          in += valid ? (rows + 7) / 8 : 0;
+          break;
+          
+        case IMDB_TYPE_MAC: {
+          uint8_t ouis[IMDB_COLUMNAR_OUI_ENTRIES][3];
+          int ouiCount = 0;
+          for (int r = 0; r < rows && valid; r++) {
+            uint8_t* mac = records[r].fields[j].macAddress;
+            uint32_t code;
+            valid = getVarint(&in, end, &code) && code <= (uint32_t)ouiCount;
+            if (valid && code == 0) {
+              valid = (end - in >= 3);
+              if (valid) {
+                memcpy(mac, in, 3);
+                in += 3;
+                if (ouiCount < IMDB_COLUMNAR_OUI_ENTRIES) {
+                  memcpy(ouis[ouiCount++], mac, 3);
+                }
+              }
+            } else if (valid) {
+              memcpy(mac, ouis[code - 1], 3);
+            }
+            valid = valid && (end - in >= 3);
+            if (valid) {
+              memcpy(mac + 3, in, 3);
+              in += 3;
+            }
+          }
+          break;
+        }
+        
+        case IMDB_TYPE_STRING: {
+          int dictCount = 0;
+          for (int r = 0; r < rows && valid; r++) {
+            IMDBFieldValue* field = &records[r].fields[j];
+            field->stringValue = nullptr;
+            uint32_t code;
+            valid = getVarint(&in, end, &code) && code <= (uint32_t)dictCount;
+            if (!valid) {
+              break;
+            }
+            if (code > 0) {
+              // Repeated strings share one arena copy
+              field->stringValue = dict[code - 1];
+              _stringArenaLive++;
+              continue;
+            }
+            valid = (in < end);
+            size_t length = valid ? *in++ : 0;
+            if (length == 0) {
+              continue;
+            }
+            valid = length <= IMDB_MAX_STRING_LENGTH && (size_t)(end - in) >= length &&
+                    stringCursor + length + 1 <= stringEnd;
+            if (valid) {
+              memcpy(stringCursor, in, length);
+              stringCursor[length] = '\0';
+              in += length;
+              field->stringValue = stringCursor;
+              dict[dictCount++] = stringCursor;
+              stringCursor += length + 1;
+              _stringArenaLive++;
+              arenaStringLoaded(length + 1);
+            }
+          }
+          break;
+        }
+      }
+    }
+    
+    if (!valid || in != end) {
+      // Strings already counted are released with the arena
+      result = IMDB_ERROR_CORRUPT_FILE;
+      break;
+    }
+    
+    for (int r = 0; r < rows; r++) {
+      records[r].rowId = done + r + 1;
+      records[r].isValid = true;
+      records[r].isDirty = false;
+      records[r].expiryMillis = restoreExpiry(records[r].expiryMillis, saveMillis, currentMillis);
+      _fieldArenaLive++;
+      _recordCount++;
+      trackRecord(&records[r], true);
     }
+    done += rows;
+    markIndexesStale();
   }
   
-  unlock();
-  return cnt;
+  free(dict);
+  free(packed);
+  free(raw);
+  return result;
 }
+#endif // IMDB_ENABLE_COMPRESSION
 
-// Find minimum value in a column
-IMDBResult ESP32IMDB::min(const char* column, IMDBSelectResult* result) {
-  lock();
-  
-  if (!_tableExists) {
-    unlock();
-    return IMDB_ERROR_NO_TABLE;
+// Incremental saves
+//
+// saveIncremental() keeps a full base file (a v2 snapshot with row ids) and a
+// numbered series of delta files beside it, "<filename>.d1", ".d2", ... Each
+// delta holds only the rows inserted or changed, and the ids of rows removed,
+// since the previous incremental save:
+//   "IMDD" | version 2 (unframed), then CRC-checked v2 blocks:
+//   flags u8 | columnCount u8 | reserved u16 | baseId u32 | sequence u32 |
+//   saveMillis u32 | nextRowId u32 | schemaCrc u32 | deleteCount u32 | upsertCount u32
+//   deleteCount x rowId u32
+//   upsertCount x (rowId u32 + record)
+// A delta names the base it extends and its place in the series, so deltas
+// left over from an older base are never merged.
+
+#define IMDB_DELTA_VERSION 2
+
+// Remember a removed row for the next delta (caller holds the lock)
+void ESP32IMDB::noteDeletedRow(uint32_t rowId) {
+  if (_incNeedsBase) {
+    return;
   }
-  
-  if (column == nullptr || result == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+  if (_incDeletedCount == _incDeletedCapacity) {
+    size_t newCapacity = (_incDeletedCapacity > 0) ? _incDeletedCapacity * 2 : 16;
+    uint32_t* grown = (uint32_t*)realloc(_incDeleted, sizeof(uint32_t) * newCapacity);
+    if (grown == nullptr) {
+      // Can't track removals any more - the next save writes a full base instead
+      resetIncrementalTracking();
+      _incNeedsBase = true;
+      return;
+    }
+    _incDeleted = grown;
+    _incDeletedCapacity = newCapacity;
+  }
+  _incDeleted[_incDeletedCount++] = rowId;
+}
+
+// Free the removed-row list
+void ESP32IMDB::resetIncrementalTracking() {
+  free(_incDeleted);
+  _incDeleted = nullptr;
+  _incDeletedCount = 0;
+  _incDeletedCapacity = 0;
+}
+
+// Binary search by row id (records are kept in ascending row id order)
+int ESP32IMDB::findRowIndex(uint32_t rowId) const {
+  int low = 0;
+  int high = _recordCount - 1;
+  while (low <= high) {
+    int mid = low + (high - low) / 2;
+    if (_records[mid].rowId == rowId) {
+      return mid;
+    }
+    if (_records[mid].rowId < rowId) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  return -1;
+}
+
+// CRC32 of the schema as written to disk, so a delta can't be merged into a
+// table with different columns
+uint32_t ESP32IMDB::schemaCrc() const {
+  uint32_t crc = 0;
+  for (int i = 0; i < _columnCount; i++) {
+    uint8_t typeValue = (uint8_t)_columns[i].type;
+    crc = imdbCrc32(crc, (const uint8_t*)_columns[i].name, 32);
+    crc = imdbCrc32(crc, &typeValue, 1);
   }
+  return crc;
+}
+
+// Decode one record into individually allocated fields, like insert() makes
+bool ESP32IMDB::readRecordOwned(IMDBBlockReader* reader, IMDBRecord* record, char* scratch) {
+  uint8_t isValid = 0;
+  readBlockBytes(reader, &isValid, 1);
+  readBlockBytes(reader, &record->expiryMillis, 4);
+  record->isValid = (isValid != 0);
+  
+  record->fields = (IMDBFieldValue*)allocBulk(sizeof(IMDBFieldValue) * _columnCount);
+  if (record->fields == nullptr) {
+    return false;
+  }
+  memset(record->fields, 0, sizeof(IMDBFieldValue) * _columnCount);
   
-  int colIdx = findColumnIndex(column);
-  if (colIdx < 0) {
-    unlock();
-    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  bool ok = !reader->failed;
+  for (int j = 0; j < _columnCount && ok; j++) {
+    IMDBFieldValue* field = &record->fields[j];
+    
+    switch (_columns[j].type) {
+      case IMDB_TYPE_BOOL: {
+        uint8_t boolValue = 0;
+        ok = readBlockBytes(reader, &boolValue, 1);
+        field->boolValue = (boolValue != 0);
+        break;
+      }
+      
+      case IMDB_TYPE_MAC:
+        ok = readBlockBytes(reader, field->macAddress, 6);
+        break;
+        
+      case IMDB_TYPE_STRING: {
+        uint8_t length = 0;
+        ok = readBlockBytes(reader, &length, 1);
+#if IMDB_MAX_STRING_LENGTH < 255
+        if (ok && length > IMDB_MAX_STRING_LENGTH) {
+          reader->corrupt = true;
+          ok = false;
+        }
+#endif
+        if (ok && length > 0) {
+          ok = readBlockBytes(reader, scratch, length);
+          field->stringValue = ok ? (char*)allocBulk(length + 1) : nullptr;
+          if (field->stringValue != nullptr) {
+            memcpy(field->stringValue, scratch, length);
+            field->stringValue[length] = '\0';
+          } else {
+            ok = false;
+          }
+        }
+        break;
+      }
+      
+      default:
+        // INT32, FLOAT and EPOCH share the union's first 4 bytes
+        ok = readBlockBytes(reader, &field->int32Value, 4);
+        break;
+    }
   }
   
-  // Only numeric types supported
-  IMDBDataType type = _columns[colIdx].type;
-  if (type != IMDB_TYPE_INT32 && type != IMDB_TYPE_EPOCH && type != IMDB_TYPE_FLOAT) {
-    unlock();
-    return IMDB_ERROR_INVALID_TYPE;
+  if (!ok) {
+    freeRecord(record);
+  }
+  return ok;
+}
+
+// Write the rows changed since the last incremental save (caller holds the lock)
+IMDBResult ESP32IMDB::saveDeltaLocked(const char* deltaFilename) {
+  uint8_t* blockBuffer = (uint8_t*)malloc(IMDB_PERSIST_BLOCK_SIZE + IMDB_BLOCK_FRAMING);
+  if (blockBuffer == nullptr) {
+    return IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  result->hasValue = false;
-  int32_t minVal = INT32_MAX;  // Max int32
-  uint32_t minEpoch = UINT32_MAX;  // Max uint32 for EPOCH
-  float minFloat = 3.4028235e38f;  // Max float
+  char tempFilename[256];
+  snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", deltaFilename);
+  
+  IMDBFile* file = _storage->open(tempFilename, "w");
+  if (file == nullptr) {
+    free(blockBuffer);
+    return IMDB_ERROR_FILE_OPEN;
+  }
   
+  uint32_t upsertCount = 0;
   for (int i = 0; i < _recordCount; i++) {
-    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
-      continue;
+    if (_records[i].isDirty) {
+      upsertCount++;
     }
-    
-    if (type == IMDB_TYPE_FLOAT) {
-      float val = _records[i].fields[colIdx].floatValue;
-      if (!result->hasValue || val < minFloat) {
-        minFloat = val;
-        result->hasValue = true;
-      }
-    } else if (type == IMDB_TYPE_INT32) {
-      int32_t val = _records[i].fields[colIdx].int32Value;
-      if (!result->hasValue || val < minVal) {
-        minVal = val;
-        result->hasValue = true;
-      }
-    } else {  // IMDB_TYPE_EPOCH
-      uint32_t val = _records[i].fields[colIdx].epochValue;
-      if (!result->hasValue || val < minEpoch) {
-        minEpoch = val;
-        result->hasValue = true;
-      }
+  }
+  
+  IMDBBlockWriter writer = {file, blockBuffer, 0, false};
+  const uint8_t preamble[5] = {'I', 'M', 'D', 'D', IMDB_DELTA_VERSION};
+  writeRawBytes(&writer, preamble, 5);
+  
+  const uint8_t flags = 0;
+  const uint16_t reserved = 0;
+  uint32_t sequence = (uint32_t)_incDeltaCount + 1;
+  uint32_t saveMillis = millis();
+  uint32_t crc = schemaCrc();
+  uint32_t deleteCount = (uint32_t)_incDeletedCount;
+  
+  writeBlockBytes(&writer, &flags, 1);
+  writeBlockBytes(&writer, &_columnCount, 1);
+  writeBlockBytes(&writer, &reserved, 2);
+  writeBlockBytes(&writer, &_incBaseId, 4);
+  writeBlockBytes(&writer, &sequence, 4);
+  writeBlockBytes(&writer, &saveMillis, 4);
+  writeBlockBytes(&writer, &_nextRowId, 4);
+  writeBlockBytes(&writer, &crc, 4);
+  writeBlockBytes(&writer, &deleteCount, 4);
+  writeBlockBytes(&writer, &upsertCount, 4);
+  
+  if (deleteCount > 0) {
+    writeBlockBytes(&writer, _incDeleted, sizeof(uint32_t) * deleteCount);
+  }
+  for (int i = 0; i < _recordCount && !writer.failed; i++) {
+    if (_records[i].isDirty) {
+      writeBlockBytes(&writer, &_records[i].rowId, 4);
+      writeRecord(&writer, &_records[i]);
     }
   }
   
-  if (!result->hasValue) {
-    unlock();
-    return IMDB_ERROR_NO_RECORDS;
+  bool writeOk = flushBlock(&writer);
+  writeOk = _storage->close(file) && writeOk;
+  free(blockBuffer);
+  
+  if (!writeOk) {
+    _storage->remove(tempFilename);
+    return IMDB_ERROR_FILE_WRITE;
   }
   
-  result->type = type;
-  if (type == IMDB_TYPE_INT32) {
-    result->int32Value = minVal;
-  } else if (type == IMDB_TYPE_EPOCH) {
-    result->epochValue = minEpoch;
-  } else {
-    result->floatValue = minFloat;
+  if (!replaceFile(_storage, tempFilename, deltaFilename)) {
+    return IMDB_ERROR_FILE_WRITE;
   }
   
-  unlock();
   return IMDB_OK;
 }
 
-// Find maximum value in a column
-IMDBResult ESP32IMDB::max(const char* column, IMDBSelectResult* result) {
-  lock();
+// Merge one delta into the table (caller holds the lock). *applied stays
+// false for a delta that belongs to another base or sequence position.
+IMDBResult ESP32IMDB::applyDeltaLocked(const char* deltaFilename, uint32_t sequence, bool* applied) {
+  *applied = false;
+  markIndexesStale();
+  
+  IMDBFile* file = _storage->open(deltaFilename, "r");
+  if (file == nullptr) {
+    return IMDB_ERROR_FILE_OPEN;
+  }
   
-  if (!_tableExists) {
-    unlock();
-    return IMDB_ERROR_NO_TABLE;
+  uint8_t* blockBuffer = (uint8_t*)malloc(IMDB_PERSIST_BLOCK_SIZE);
+  char* scratch = (char*)malloc(IMDB_MAX_STRING_LENGTH + 1);
+  if (blockBuffer == nullptr || scratch == nullptr) {
+    free(blockBuffer);
+    free(scratch);
+    _storage->close(file);
+    return IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  if (column == nullptr || result == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+  IMDBBlockReader reader = {file, blockBuffer, 0, 0, false, false, false, 0, 0, 0};
+  IMDBResult result = IMDB_OK;
+  
+  char magic[4];
+  uint8_t version = 0;
+  uint8_t flags = 0;
+  uint8_t columnCount = 0;
+  uint16_t reserved = 0;
+  uint32_t baseId = 0;
+  uint32_t fileSequence = 0;
+  uint32_t saveMillis = 0;
+  uint32_t nextRowId = 0;
+  uint32_t crc = 0;
+  uint32_t deleteCount = 0;
+  uint32_t upsertCount = 0;
+  
+  if (!readRawBytes(&reader, magic, 4) || memcmp(magic, "IMDD", 4) != 0 ||
+      !readRawBytes(&reader, &version, 1) || version != IMDB_DELTA_VERSION) {
+    result = IMDB_ERROR_CORRUPT_FILE;
   }
   
-  int colIdx = findColumnIndex(column);
-  if (colIdx < 0) {
-    unlock();
-    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  if (result == IMDB_OK) {
+    reader.framed = true;
+    if (!readBlockBytes(&reader, &flags, 1) ||
+        !readBlockBytes(&reader, &columnCount, 1) ||
+        !readBlockBytes(&reader, &reserved, 2) ||
+        !readBlockBytes(&reader, &baseId, 4) ||
+        !readBlockBytes(&reader, &fileSequence, 4) ||
+        !readBlockBytes(&reader, &saveMillis, 4) ||
+        !readBlockBytes(&reader, &nextRowId, 4) ||
+        !readBlockBytes(&reader, &crc, 4) ||
+        !readBlockBytes(&reader, &deleteCount, 4) ||
+        !readBlockBytes(&reader, &upsertCount, 4) ||
+        flags != 0) {
+      result = IMDB_ERROR_CORRUPT_FILE;
+    }
   }
   
-  // Only numeric types supported
-  IMDBDataType type = _columns[colIdx].type;
-  if (type != IMDB_TYPE_INT32 && type != IMDB_TYPE_EPOCH && type != IMDB_TYPE_FLOAT) {
-    unlock();
-    return IMDB_ERROR_INVALID_TYPE;
+  // Leftover from an older base (or a gap in the series) - not ours to merge
+  if (result == IMDB_OK && (baseId != _incBaseId || fileSequence != sequence)) {
+    free(scratch);
+    free(blockBuffer);
+    _storage->close(file);
+    return IMDB_OK;
   }
   
-  result->hasValue = false;
-  int32_t maxVal = INT32_MIN;  // Minimum int32 value
-  uint32_t maxEpoch = 0;  // Min uint32 for EPOCH
-  float maxFloat = -3.4028235e38f;  // Min float (close to -FLT_MAX)
+  if (result == IMDB_OK && (columnCount != _columnCount || crc != schemaCrc())) {
+    result = IMDB_ERROR_CORRUPT_FILE;
+  }
   
-  for (int i = 0; i < _recordCount; i++) {
-    if (!_records[i].isValid || isRecordExpired(_records[i].expiryMillis)) {
-      continue;
+  // Removed rows
+  for (uint32_t k = 0; k < deleteCount && result == IMDB_OK; k++) {
+    uint32_t rowId = 0;
+    if (!readBlockBytes(&reader, &rowId, 4)) {
+      result = reader.corrupt ? IMDB_ERROR_CORRUPT_FILE : IMDB_ERROR_FILE_READ;
+      break;
+    }
+    int index = findRowIndex(rowId);
+    if (index >= 0 && _records[index].isValid) {
+      trackRecord(&_records[index], false);
+      freeRecord(&_records[index]);
+      _records[index].isValid = false;
+    }
+  }
+  
+  // Inserted or changed rows. New rows carry ids above every existing row,
+  // so appending them keeps the array sorted.
+  uint32_t currentMillis = millis();
+  for (uint32_t k = 0; k < upsertCount && result == IMDB_OK; k++) {
+    uint32_t rowId = 0;
+    IMDBRecord incoming;
+    if (!checkHeapLimit()) {
+      result = IMDB_ERROR_HEAP_LIMIT;
+      break;
+    }
+    if (!readBlockBytes(&reader, &rowId, 4) || !readRecordOwned(&reader, &incoming, scratch)) {
+      if (reader.corrupt) {
+        result = IMDB_ERROR_CORRUPT_FILE;
+      } else if (reader.failed) {
+        result = IMDB_ERROR_FILE_READ;
+      } else {
+        heapAllocationFailed();
+        result = IMDB_ERROR_OUT_OF_MEMORY;
+      }
+      break;
     }
+    incoming.rowId = rowId;
+    incoming.isDirty = false;
+    incoming.expiryMillis = restoreExpiry(incoming.expiryMillis, saveMillis, currentMillis);
     
-    if (type == IMDB_TYPE_FLOAT) {
-      float val = _records[i].fields[colIdx].floatValue;
-      if (!result->hasValue || val > maxFloat) {
-        maxFloat = val;
-        result->hasValue = true;
-      }
-    } else if (type == IMDB_TYPE_INT32) {
-      int32_t val = _records[i].fields[colIdx].int32Value;
-      if (!result->hasValue || val > maxVal) {
-        maxVal = val;
-        result->hasValue = true;
-      }
-    } else {  // IMDB_TYPE_EPOCH
-      uint32_t val = _records[i].fields[colIdx].epochValue;
-      if (!result->hasValue || val > maxEpoch) {
-        maxEpoch = val;
-        result->hasValue = true;
+    int index = findRowIndex(rowId);
+    if (index >= 0 && _ringCapacity > 0) {
+      copyIntoRing(&_records[index], &incoming);
+      freeRecord(&incoming);
+    } else if (index >= 0) {
+      trackRecord(&_records[index], false);
+      freeRecord(&_records[index]);
+      _records[index] = incoming;
+      trackRecord(&_records[index], true);
+    } else if (_ringCapacity > 0 &&
+               (_recordCount == 0 || rowId > _records[_recordCount - 1].rowId)) {
+      copyIntoRing(ringAppendSlot(), &incoming);
+      _recordCount++;
+      freeRecord(&incoming);
+    } else if (_recordCount == 0 || rowId > _records[_recordCount - 1].rowId) {
+      if (_recordCount >= _recordCapacity) {
+        result = growRecordArray();
+        if (result != IMDB_OK) {
+          freeRecord(&incoming);
+          break;
+        }
       }
+      _records[_recordCount++] = incoming;
+      trackRecord(&incoming, true);
+    } else {
+      freeRecord(&incoming);
+      result = IMDB_ERROR_CORRUPT_FILE;
     }
   }
   
-  if (!result->hasValue) {
-    unlock();
-    return IMDB_ERROR_NO_RECORDS;
+  if (result == IMDB_OK && !finishBlocks(&reader)) {
+    result = IMDB_ERROR_CORRUPT_FILE;
   }
   
-  result->type = type;
-  if (type == IMDB_TYPE_INT32) {
-    result->int32Value = maxVal;
-  } else if (type == IMDB_TYPE_EPOCH) {
-    result->epochValue = maxEpoch;
-  } else {
-    result->floatValue = maxFloat;
+  if (result == IMDB_OK) {
+    if (nextRowId > _nextRowId) {
+      _nextRowId = nextRowId;
+    }
+    *applied = true;
   }
   
-  unlock();
-  return IMDB_OK;
+  free(scratch);
+  free(blockBuffer);
+  _storage->close(file);
+  return result;
 }
 
-// Get top N records (caller must free results)
-IMDBResult ESP32IMDB::top(int n, IMDBSelectResult** results, int* resultCount) {
+// Save only what changed since the last incremental save. Writes a new base
+// instead when there is none yet, after maxDeltas deltas, or when most rows
+// changed (a delta would be as large as the base).
+IMDBResult ESP32IMDB::saveIncremental(const char* filename, uint8_t maxDeltas) {
+  IMDB_STAT_SCOPE(IMDB_STAT_SAVE);
   lock();
   
+  finishLazyLoad();
+  
   if (!_tableExists) {
     unlock();
     return IMDB_ERROR_NO_TABLE;
   }
   
-  if (results == nullptr || resultCount == nullptr) {
+  if (filename == nullptr) {
     unlock();
     return IMDB_ERROR_INVALID_VALUE;
   }
   
-  // Count valid records
-  int validCount = 0;
-  for (int i = 0; i < _recordCount; i++) {
-    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis)) {
-      validCount++;
-    }
+  // The WAL snapshot is rewritten by checkpoints; it can't also be a base
+  if (_walEnabled && strcmp(filename, _walSnapshotFilename) == 0) {
+    unlock();
+    return IMDB_ERROR_INVALID_OPERATION;
   }
   
-  if (validCount == 0) {
-    *results = nullptr;
-    *resultCount = 0;
-    unlock();
-    return IMDB_ERROR_NO_RECORDS;
+  // A new series starts with a base
+  if (_incFilename == nullptr || strcmp(_incFilename, filename) != 0) {
+    free(_incFilename);
+    _incFilename = strdup(filename);
+    if (_incFilename == nullptr) {
+      unlock();
+      return IMDB_ERROR_OUT_OF_MEMORY;
+    }
+    _incDeltaCount = 0;
+    _incDeletedCount = 0;
+    _incNeedsBase = true;
   }
   
-  int returnCount = (n < validCount) ? n : validCount;
+  // Expired rows are purged here so they are recorded as removals
+  purgeForSnapshot();
   
-  // Allocate result array with overflow check
-  // Check for potential integer overflow: returnCount * _columnCount
-  if (returnCount > 0 && _columnCount > 0 && returnCount > (INT_MAX / _columnCount / (int)sizeof(IMDBSelectResult))) {
-    unlock();
-    return IMDB_ERROR_OUT_OF_MEMORY;  // Would overflow
+  int dirtyRows = 0;
+  for (int i = 0; i < _recordCount; i++) {
+    if (_records[i].isDirty) {
+      dirtyRows++;
+    }
   }
   
-  *results = (IMDBSelectResult*)malloc(sizeof(IMDBSelectResult) * returnCount * _columnCount);
-  if (*results == nullptr) {
-    unlock();
-    return IMDB_ERROR_OUT_OF_MEMORY;
-  }
+  bool writeBase = _incNeedsBase || _incDeltaCount >= maxDeltas || dirtyRows * 2 > _recordCount;
+  char deltaFilename[256];
+  IMDBResult result;
   
-  // Fill results
-  int resultIdx = 0;
-  for (int i = 0; i < _recordCount && resultIdx < returnCount; i++) {
-    if (_records[i].isValid && !isRecordExpired(_records[i].expiryMillis)) {
-      for (int col = 0; col < _columnCount; col++) {
-        getFieldValue(&_records[i].fields[col], _columns[col].type,
-                     &(*results)[resultIdx * _columnCount + col]);
+  if (writeBase) {
+    uint32_t baseId = _incBaseId + 1;
+    if (baseId == 0) {
+      baseId = 1;  // 0 means "not a base"
+    }
+    result = saveSnapshotLocked(filename, 0, baseId);
+    if (result == IMDB_OK) {
+      _incBaseId = baseId;
+      _incDeltaCount = 0;
+      _incNeedsBase = false;
+      // Deltas of the previous base are obsolete (and would be skipped anyway)
+      for (int sequence = 1; sequence <= 255; sequence++) {
+        snprintf(deltaFilename, sizeof(deltaFilename), "%s.d%d", filename, sequence);
+        if (!_storage->exists(deltaFilename)) {
+          break;
+        }
+        _storage->remove(deltaFilename);
       }
-      resultIdx++;
+    }
+  } else {
+    snprintf(deltaFilename, sizeof(deltaFilename), "%s.d%d", filename, _incDeltaCount + 1);
+    result = saveDeltaLocked(deltaFilename);
+    if (result == IMDB_OK) {
+      _incDeltaCount++;
     }
   }
   
-  *resultCount = returnCount;
-  unlock();
-  return IMDB_OK;
-}
-
-// Get total number of records (including invalid)
-int ESP32IMDB::getRecordCount() const {
-  lock();
-  int count = _recordCount;
-  unlock();
-  return count;
-}
-
-// Estimate memory usage
-size_t ESP32IMDB::getMemoryUsage() const {
-  lock();
-  
-  size_t total = 0;
-  
-  // Column definitions
-  total += sizeof(IMDBColumn) * _columnCount;
-  
-  // Record array
-  total += sizeof(IMDBRecord) * _recordCapacity;
-  
-  // Fields in each record
-  if (_columns != nullptr && _records != nullptr) {
+  // Changes stay pending if the save failed
+  if (result == IMDB_OK) {
     for (int i = 0; i < _recordCount; i++) {
-      if (_records[i].fields != nullptr) {
-        total += sizeof(IMDBFieldValue) * _columnCount;
-        
-        // String allocations
-        for (int j = 0; j < _columnCount; j++) {
-          if (_columns[j].type == IMDB_TYPE_STRING && _records[i].fields[j].stringValue != nullptr) {
-            total += strlen(_records[i].fields[j].stringValue) + 1;
-          }
-        }
-      }
+      _records[i].isDirty = false;
     }
+    _incDeletedCount = 0;
   }
   
   unlock();
-  return total;
+  return result;
 }
 
-// Helper function to validate hexadecimal character
-static bool isHexChar(char c) {
-  return (c >= '0' && c <= '9') || 
-         (c >= 'a' && c <= 'f') || 
-         (c >= 'A' && c <= 'F');
-}
-
-// Parse MAC address from string (supports multiple formats)
-bool ESP32IMDB::parseMacAddress(const char* macStr, uint8_t* macBytes) {
-  if (macStr == nullptr || macBytes == nullptr) {
-    return false;
+// Load a base file and merge its delta series in order
+IMDBResult ESP32IMDB::loadIncremental(const char* filename) {
+  IMDB_STAT_SCOPE(IMDB_STAT_LOAD);
+  if (filename == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
   }
   
-  // Validate string length before operations to prevent buffer overruns
-  size_t len = strlen(macStr);
-  if (len != 12 && len != 17) {
-    return false;  // Invalid length for MAC address
+  // Base and deltas are applied under one lock, so no reader sees a
+  // partly merged table
+  lock();
+  
+  IMDBResult result = loadLocked(filename, false);
+  if (result != IMDB_OK) {
+    unlock();
+    return result;
   }
   
-  // Check for 12-character format (no delimiters): aabbccddeeff
-  if (len == 12) {
-    // Validate all characters are hex
-    for (int i = 0; i < 12; i++) {
-      if (!isHexChar(macStr[i])) {
-        return false;
-      }
+  // Deltas extend a base only; a plain snapshot starts a new series
+  int sequence = 1;
+  char deltaFilename[256];
+  while (result == IMDB_OK && _incBaseId != 0 && sequence <= 255) {
+    snprintf(deltaFilename, sizeof(deltaFilename), "%s.d%d", filename, sequence);
+    if (!_storage->exists(deltaFilename)) {
+      break;
     }
-    
-    // Parse hex pairs
-    for (int i = 0; i < 6; i++) {
-      char hex[3] = {macStr[i*2], macStr[i*2+1], '\0'};
-      macBytes[i] = (uint8_t)strtol(hex, nullptr, 16);
+    bool applied = false;
+    result = applyDeltaLocked(deltaFilename, sequence, &applied);
+    if (!applied) {
+      break;
     }
-    return true;
+    sequence++;
   }
   
-  // Check for 17-character format with delimiters: aa:bb:cc:dd:ee:ff or aa-bb-cc-dd-ee-ff
-  if (len == 17) {
-    char delimiter = macStr[2];
-    if (delimiter != ':' && delimiter != '-') {
-      return false;
+  if (result == IMDB_OK) {
+    compactRecords();
+    _incFilename = strdup(filename);
+    if (_incFilename == nullptr) {
+      result = IMDB_ERROR_OUT_OF_MEMORY;
     }
-    
-    for (int i = 0; i < 6; i++) {
-      int pos = i * 3;
+    _incDeltaCount = (uint8_t)(sequence - 1);
+    _incNeedsBase = (_incBaseId == 0);
+  }
+  
+  if (result != IMDB_OK) {
+    discardTable();
+  }
+  
+  unlock();
+  return result;
+}
+
+// Write-ahead log
+//
+// The log extends the snapshot written by the last checkpoint:
+//   "IWAL" | uint32_t checkpointId | uint32_t checkpointMillis
+//   entries: [uint32_t bodyLength][body][uint32_t CRC32(body)]
+// A body is an entry type byte and the millis() it was logged at, followed by
+// the operation's arguments, with values encoded as in the snapshot (strings
+// as uint8_t length + bytes). Inserts log the row's absolute expiry; replay
+// carries the time left at the last logged change over to the current clock.
+// Appends are never rewritten, so a crash can only leave a torn last entry;
+// replay stops at the first short or CRC-failing entry.
+
+// Bytes of framing around each WAL entry body (length prefix + CRC trailer)
+#define IMDB_WAL_ENTRY_FRAMING 8
+#define IMDB_WAL_HEADER_BYTES 12
+
+// Encode a value given in the insert()/update() pointer convention.
+// With out == nullptr only the encoded size is returned.
+static size_t encodeWalValue(uint8_t* out, IMDBDataType type, const void* value) {
+  switch (type) {
+    case IMDB_TYPE_INT32:
+    case IMDB_TYPE_FLOAT:
+    case IMDB_TYPE_EPOCH:
+      if (out) {
+        memcpy(out, value, 4);
+      }
+      return 4;
       
-      // Validate hex characters for this octet
-      if (!isHexChar(macStr[pos]) || !isHexChar(macStr[pos + 1])) {
-        return false;
+    case IMDB_TYPE_BOOL:
+      if (out) {
+        out[0] = *(const bool*)value ? 1 : 0;
       }
+      return 1;
       
-      char hex[3] = {macStr[pos], macStr[pos + 1], '\0'};
-      macBytes[i] = (uint8_t)strtol(hex, nullptr, 16);
+    case IMDB_TYPE_MAC:
+      if (out) {
+        memcpy(out, value, 6);
+      }
+      return 6;
       
-      // Check delimiters
-      if (i < 5 && macStr[pos + 2] != delimiter) {
-        return false;
+    case IMDB_TYPE_STRING: {
+      const char* str = *(const char**)value;
+      size_t length = (str != nullptr) ? strlen(str) : 0;
+      if (length > IMDB_MAX_STRING_LENGTH) {
+        length = IMDB_MAX_STRING_LENGTH;
       }
+      if (out) {
+        out[0] = (uint8_t)length;
+        memcpy(out + 1, str, length);
+      }
+      return 1 + length;
     }
-    return true;
   }
-  
-  return false;
+  return 0;
 }
 
-// Format MAC address as colon-separated string (output is 18 bytes)
-void ESP32IMDB::formatMacAddress(const uint8_t* macBytes, char* output) {
-  if (macBytes == nullptr || output == nullptr) {
-    if (output != nullptr) {
-      output[0] = '\0';
+// Decode one logged value into dest; strings are copied to *scratch and
+// NUL-terminated. Returns the bytes consumed, or 0 if the body is too short.
+static size_t decodeWalValue(const uint8_t* in, size_t available, IMDBDataType type,
+                             IMDBFieldValue* dest, char** scratch) {
+  switch (type) {
+    case IMDB_TYPE_INT32:
+    case IMDB_TYPE_FLOAT:
+    case IMDB_TYPE_EPOCH:
+      if (available < 4) {
+        return 0;
+      }
+      memcpy(&dest->int32Value, in, 4);
+      return 4;
+      
+    case IMDB_TYPE_BOOL:
+      if (available < 1) {
+        return 0;
+      }
+      dest->boolValue = (in[0] != 0);
+      return 1;
+      
+    case IMDB_TYPE_MAC:
+      if (available < 6) {
+        return 0;
+      }
+      memcpy(dest->macAddress, in, 6);
+      return 6;
+      
+    case IMDB_TYPE_STRING: {
+      if (available < 1 || available < 1 + (size_t)in[0]) {
+        return 0;
+      }
+      size_t length = in[0];
+      memcpy(*scratch, in + 1, length);
+      (*scratch)[length] = '\0';
+      dest->stringValue = *scratch;
+      *scratch += length + 1;
+      return 1 + length;
     }
-    return;
   }
-  
-  sprintf(output, "%02x:%02x:%02x:%02x:%02x:%02x",
-          macBytes[0], macBytes[1], macBytes[2],
-          macBytes[3], macBytes[4], macBytes[5]);
+  return 0;
 }
 
-// Check if the database is thread-safe (mutex was created successfully)
-bool ESP32IMDB::isThreadSafe() const {
-  return _mutex != nullptr;
+// Append raw bytes to the end of the log file
+static bool appendLogBytes(IMDBStorage* storage, const char* logFilename, const uint8_t* data,
+                           size_t length) {
+  IMDBFile* file = storage->open(logFilename, "a");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = (file->write(data, length) == length);
+  ok = storage->close(file) && ok;
+  return ok;
 }
 
-// Free memory allocated by selectAll() or top() functions
-void ESP32IMDB::freeSelectResults(IMDBSelectResult* results) {
-  if (results != nullptr) {
-    free(results);
-  }
+// Free WAL buffers and stop logging (caller holds the lock)
+void ESP32IMDB::releaseWAL() {
+  free(_walSnapshotFilename);
+  free(_walLogFilename);
+  free(_walBuffer);
+  free(_walOversize);
+  _walSnapshotFilename = nullptr;
+  _walLogFilename = nullptr;
+  _walBuffer = nullptr;
+  _walOversize = nullptr;
+  _walUsed = 0;
+  _walLogBytes = 0;
+  _walEnabled = false;
 }
 
-#if IMDB_ENABLE_PERSISTENCE
+// Group commit: append everything buffered in one write (caller holds the lock).
+// A failed append may leave a torn entry that would hide later ones from replay,
+// so it falls back to a checkpoint, which restarts the log from a snapshot.
+IMDBResult ESP32IMDB::walFlush() {
+  if (_walUsed > 0) {
+    if (!appendLogBytes(_storage, _walLogFilename, _walBuffer, _walUsed)) {
+      return checkpointLocked();
+    }
+    _walLogBytes += _walUsed;
+    _walUsed = 0;
+  }
+  _walLastCommit = millis();
+  return IMDB_OK;
+}
 
-// Save database to SPIFFS file
-IMDBResult ESP32IMDB::saveToFile(const char* filename) {
-  lock();
+// Snapshot the table and start an empty log for it (caller holds the lock).
+// Buffered entries are dropped: the snapshot already contains their changes.
+IMDBResult ESP32IMDB::checkpointLocked() {
+  uint32_t nextId = _walCheckpointId + 1;
+  if (nextId == 0) {
+    nextId = 1;  // 0 means "no checkpoint"
+  }
   
-  if (!_tableExists) {
-    unlock();
-    return IMDB_ERROR_NO_TABLE;
+  IMDBResult result = saveSnapshotLocked(_walSnapshotFilename, nextId);
+  if (result != IMDB_OK) {
+    return result;
+  }
+  _walCheckpointId = nextId;
+  _walUsed = 0;
+  _walLastCommit = millis();
+  
+  // The old log carries the previous id, so a crash before this point only
+  // leaves a log that recovery will skip
+  uint8_t header[IMDB_WAL_HEADER_BYTES] = {'I', 'W', 'A', 'L'};
+  uint32_t checkpointMillis = millis();
+  memcpy(header + 4, &nextId, 4);
+  memcpy(header + 8, &checkpointMillis, 4);
+  IMDBFile* file = _storage->open(_walLogFilename, "w");
+  if (file == nullptr) {
+    return IMDB_ERROR_FILE_OPEN;
   }
+  bool ok = (file->write(header, IMDB_WAL_HEADER_BYTES) == IMDB_WAL_HEADER_BYTES);
+  ok = _storage->close(file) && ok;
+  _walLogBytes = IMDB_WAL_HEADER_BYTES;
   
-  if (filename == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
+  return ok ? IMDB_OK : IMDB_ERROR_FILE_WRITE;
+}
+
+// Reserve room for an entry body. *body is nullptr when nothing needs to be
+// logged, either on error or because a fallback checkpoint already holds the change.
+IMDBResult ESP32IMDB::walBeginEntry(size_t bodySize, uint8_t** body) {
+  *body = nullptr;
+  size_t entrySize = bodySize + IMDB_WAL_ENTRY_FRAMING;
+  
+  if (_walUsed > 0 && _walUsed + entrySize > IMDB_WAL_BUFFER_SIZE) {
+    uint32_t checkpointId = _walCheckpointId;
+    IMDBResult result = walFlush();
+    if (result != IMDB_OK || _walCheckpointId != checkpointId) {
+      return result;
+    }
   }
   
-  // Purge expired records before saving (inline to avoid deadlock)
-  for (int i = 0; i < _recordCount; i++) {
-    if (_records[i].isValid && isRecordExpired(_records[i].expiryMillis)) {
-      freeRecord(&_records[i]);
-      _records[i].isValid = false;
+  if (entrySize > IMDB_WAL_BUFFER_SIZE) {
+    // Larger than the whole buffer - encode separately and append directly
+    _walOversize = (uint8_t*)malloc(entrySize);
+    if (_walOversize == nullptr) {
+      return IMDB_ERROR_OUT_OF_MEMORY;
+    }
+    *body = _walOversize + 4;
+  } else {
+    *body = _walBuffer + _walUsed + 4;
+  }
+  return IMDB_OK;
+}
+
+// Frame the entry encoded after walBeginEntry() and commit if due
+IMDBResult ESP32IMDB::walEndEntry(size_t bodySize) {
+  uint8_t* entry = (_walOversize != nullptr) ? _walOversize : _walBuffer + _walUsed;
+  size_t entrySize = bodySize + IMDB_WAL_ENTRY_FRAMING;
+  uint32_t length = (uint32_t)bodySize;
+  uint32_t crc = imdbCrc32(0, entry + 4, bodySize);
+  memcpy(entry, &length, 4);
+  memcpy(entry + 4 + bodySize, &crc, 4);
+  
+  IMDBResult result = IMDB_OK;
+  if (_walOversize != nullptr) {
+    bool ok = appendLogBytes(_storage, _walLogFilename, _walOversize, entrySize);
+    free(_walOversize);
+    _walOversize = nullptr;
+    if (ok) {
+      _walLogBytes += entrySize;
+      _walLastCommit = millis();
+    } else {
+      result = checkpointLocked();
     }
+  } else {
+    _walUsed += entrySize;
+    if (_walCommitInterval == 0 || millis() - _walLastCommit >= _walCommitInterval) {
+      result = walFlush();
+    }
+  }
+  
+  if (result == IMDB_OK && _walLogBytes >= IMDB_WAL_CHECKPOINT_BYTES) {
+    result = checkpointLocked();
+  }
+  return result;
+}
+
+// Log an insert (caller holds the lock and has applied it)
+IMDBResult ESP32IMDB::walLogInsert(const void** values, uint32_t expiryMillis) {
+  size_t bodySize = 1 + 4 + 4;
+  for (int i = 0; i < _columnCount; i++) {
+    bodySize += encodeWalValue(nullptr, _columns[i].type, values[i]);
+  }
+  
+  uint8_t* body;
+  IMDBResult result = walBeginEntry(bodySize, &body);
+  if (body == nullptr) {
+    return result;
+  }
+  
+  uint32_t loggedMillis = millis();
+  uint8_t* out = body;
+  *out++ = IMDB_WAL_ENTRY_INSERT;
+  memcpy(out, &loggedMillis, 4);
+  out += 4;
+  memcpy(out, &expiryMillis, 4);
+  out += 4;
+  for (int i = 0; i < _columnCount; i++) {
+    out += encodeWalValue(out, _columns[i].type, values[i]);
   }
-  compactRecords();
   
-  // Check record count limit for file format (uint16_t)
-  if (_recordCount > 65535) {
-    unlock();
-    return IMDB_ERROR_INVALID_OPERATION;  // Too many records for file format
+  return walEndEntry(bodySize);
+}
+
+// Log an update, math update or delete (caller holds the lock and has applied it)
+IMDBResult ESP32IMDB::walLogChange(uint8_t entryType, int whereIdx, const void* whereValue,
+                                   int setIdx, const void* setValue, IMDBMathOp operation,
+                                   int32_t operand) {
+  size_t bodySize = 2 + 4 + encodeWalValue(nullptr, _columns[whereIdx].type, whereValue);
+  if (entryType == IMDB_WAL_ENTRY_UPDATE) {
+    bodySize += 1 + encodeWalValue(nullptr, _columns[setIdx].type, setValue);
+  } else if (entryType == IMDB_WAL_ENTRY_MATH) {
+    bodySize += 1 + 1 + 4;
   }
   
-  // Create temporary filename for atomic write
-  char tempFilename[256];
-  snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", filename);
+  uint8_t* body;
+  IMDBResult result = walBeginEntry(bodySize, &body);
+  if (body == nullptr) {
+    return result;
+  }
   
-  // Open file for writing
-  File file = SPIFFS.open(tempFilename, "w");
-  if (!file) {
-    unlock();
-    return IMDB_ERROR_FILE_OPEN;
+  uint32_t loggedMillis = millis();
+  uint8_t* out = body;
+  *out++ = entryType;
+  memcpy(out, &loggedMillis, 4);
+  out += 4;
+  *out++ = (uint8_t)whereIdx;
+  out += encodeWalValue(out, _columns[whereIdx].type, whereValue);
+  if (entryType == IMDB_WAL_ENTRY_UPDATE) {
+    *out++ = (uint8_t)setIdx;
+    out += encodeWalValue(out, _columns[setIdx].type, setValue);
+  } else if (entryType == IMDB_WAL_ENTRY_MATH) {
+    *out++ = (uint8_t)setIdx;
+    *out++ = (uint8_t)operation;
+    memcpy(out, &operand, 4);
   }
   
-  // Write header
-  const char magic[4] = {'I', 'M', 'D', 'B'};
-  const uint8_t version = 1;
-  uint16_t recordCount = (uint16_t)_recordCount;
-  uint32_t saveMillis = millis();
+  return walEndEntry(bodySize);
+}
+
+// Start logging changes. A checkpoint is taken immediately so the log always
+// has a snapshot to extend.
+IMDBResult ESP32IMDB::enableWAL(const char* snapshotFilename, const char* logFilename,
+                                uint32_t commitIntervalMs) {
+  lock();
   
-  if (file.write((const uint8_t*)magic, 4) != 4) {
-    file.close();
-    SPIFFS.remove(tempFilename);
+  finishLazyLoad();
+  
+  if (!_tableExists) {
     unlock();
-    return IMDB_ERROR_FILE_WRITE;
+    return IMDB_ERROR_NO_TABLE;
   }
   
-  if (file.write(&version, 1) != 1) {
-    file.close();
-    SPIFFS.remove(tempFilename);
+  if (snapshotFilename == nullptr || logFilename == nullptr) {
     unlock();
-    return IMDB_ERROR_FILE_WRITE;
+    return IMDB_ERROR_INVALID_VALUE;
   }
   
-  if (file.write(&_columnCount, 1) != 1) {
-    file.close();
-    SPIFFS.remove(tempFilename);
+  if (_walEnabled || saveTargetBusy(snapshotFilename)) {
     unlock();
-    return IMDB_ERROR_FILE_WRITE;
+    return IMDB_ERROR_INVALID_OPERATION;
   }
   
-  if (file.write((const uint8_t*)&recordCount, 2) != 2) {
-    file.close();
-    SPIFFS.remove(tempFilename);
+  _walSnapshotFilename = strdup(snapshotFilename);
+  _walLogFilename = strdup(logFilename);
+  _walBuffer = (uint8_t*)malloc(IMDB_WAL_BUFFER_SIZE);
+  if (_walSnapshotFilename == nullptr || _walLogFilename == nullptr || _walBuffer == nullptr) {
+    releaseWAL();
     unlock();
-    return IMDB_ERROR_FILE_WRITE;
+    return IMDB_ERROR_OUT_OF_MEMORY;
   }
+  _walCommitInterval = commitIntervalMs;
+  _walEnabled = true;
   
-  if (file.write((const uint8_t*)&saveMillis, 4) != 4) {
-    file.close();
-    SPIFFS.remove(tempFilename);
-    unlock();
-    return IMDB_ERROR_FILE_WRITE;
+  IMDBResult result = checkpointLocked();
+  if (result != IMDB_OK) {
+    releaseWAL();
   }
   
-  // Write schema
-  for (int i = 0; i < _columnCount; i++) {
-    if (file.write((const uint8_t*)_columns[i].name, 32) != 32) {
-      file.close();
-      SPIFFS.remove(tempFilename);
-      unlock();
-      return IMDB_ERROR_FILE_WRITE;
-    }
-    
-    uint8_t typeValue = (uint8_t)_columns[i].type;
-    if (file.write(&typeValue, 1) != 1) {
-      file.close();
-      SPIFFS.remove(tempFilename);
-      unlock();
-      return IMDB_ERROR_FILE_WRITE;
+  // Commits a batch once no further writes arrive. A task still winding down
+  // from an earlier enableWAL() picks this log up; without a task, batches
+  // wait for the next write or flushWAL().
+  if (result == IMDB_OK && commitIntervalMs > 0 && !_walTaskRunning) {
+    _walTaskRunning = true;
+    if (xTaskCreate(walCommitTask, "IMDBWal", IMDB_SAVE_TASK_STACK, this,
+                    IMDB_SAVE_TASK_PRIORITY, NULL) != pdPASS) {
+      _walTaskRunning = false;
     }
   }
   
-  // Write records
-  for (int i = 0; i < _recordCount; i++) {
-    IMDBRecord* record = &_records[i];
-    
-    // Write isValid flag
-    uint8_t isValid = record->isValid ? 1 : 0;
-    if (file.write(&isValid, 1) != 1) {
-      file.close();
-      SPIFFS.remove(tempFilename);
-      unlock();
-      return IMDB_ERROR_FILE_WRITE;
-    }
-    
-    // Write expiryMillis
-    if (file.write((const uint8_t*)&record->expiryMillis, 4) != 4) {
-      file.close();
-      SPIFFS.remove(tempFilename);
-      unlock();
-      return IMDB_ERROR_FILE_WRITE;
+  unlock();
+  return result;
+}
+
+// Background commit task: flush a batch that has waited out the commit
+// interval, and exit once logging stops
+void ESP32IMDB::walCommitTask(void* parameter) {
+  ESP32IMDB* db = (ESP32IMDB*)parameter;
+  bool running = true;
+  
+  while (running) {
+    db->lock();
+    running = db->_walEnabled && db->_walCommitInterval > 0;
+    uint32_t waitMillis = 0;
+    if (running) {
+      uint32_t sinceCommit = millis() - db->_walLastCommit;
+      if (db->_walUsed > 0 && sinceCommit >= db->_walCommitInterval) {
+        db->walFlush();  // A failure surfaces on the next write or flushWAL()
+        sinceCommit = 0;
+      }
+      waitMillis = (sinceCommit < db->_walCommitInterval) ? db->_walCommitInterval - sinceCommit : 1;
+    } else {
+      // Cleared under the lock: an enableWAL() after this point sees the
+      // flag down and starts its own task
+      db->_walTaskRunning = false;
     }
+    db->unlock();
     
-    // Write fields
-    for (int j = 0; j < _columnCount; j++) {
-      IMDBFieldValue* field = &record->fields[j];
-      IMDBDataType type = _columns[j].type;
-      
-      switch (type) {
-        case IMDB_TYPE_INT32:
-          if (file.write((const uint8_t*)&field->int32Value, 4) != 4) {
-            file.close();
-            SPIFFS.remove(tempFilename);
-            unlock();
-            return IMDB_ERROR_FILE_WRITE;
-          }
-          break;
-          
-        case IMDB_TYPE_FLOAT:
-          if (file.write((const uint8_t*)&field->floatValue, 4) != 4) {
-            file.close();
-            SPIFFS.remove(tempFilename);
-            unlock();
-            return IMDB_ERROR_FILE_WRITE;
-          }
-          break;
-          
-        case IMDB_TYPE_BOOL: {
-          uint8_t boolValue = field->boolValue ? 1 : 0;
-          if (file.write(&boolValue, 1) != 1) {
-            file.close();
-            SPIFFS.remove(tempFilename);
-            unlock();
-            return IMDB_ERROR_FILE_WRITE;
-          }
-          break;
-        }
-        
-        case IMDB_TYPE_MAC:
-          if (file.write(field->macAddress, 6) != 6) {
-            file.close();
-            SPIFFS.remove(tempFilename);
-            unlock();
-            return IMDB_ERROR_FILE_WRITE;
-          }
-          break;
-          
-        case IMDB_TYPE_EPOCH:
-          if (file.write((const uint8_t*)&field->epochValue, 4) != 4) {
-            file.close();
-            SPIFFS.remove(tempFilename);
-            unlock();
-            return IMDB_ERROR_FILE_WRITE;
-          }
-          break;
-          
-        case IMDB_TYPE_STRING: {
-          uint8_t length = 0;
-          if (field->stringValue) {
-            size_t strLen = strlen(field->stringValue);
-            // Clamp to max string length for safety
-            length = (strLen > IMDB_MAX_STRING_LENGTH) ? IMDB_MAX_STRING_LENGTH : (uint8_t)strLen;
-          }
-          if (file.write(&length, 1) != 1) {
-            file.close();
-            SPIFFS.remove(tempFilename);
-            unlock();
-            return IMDB_ERROR_FILE_WRITE;
-          }
-          
-          if (length > 0) {
-            if (file.write((const uint8_t*)field->stringValue, length) != length) {
-              file.close();
-              SPIFFS.remove(tempFilename);
-              unlock();
-              return IMDB_ERROR_FILE_WRITE;
-            }
-          }
-          break;
-        }
-      }
+    if (running) {
+      // Wake at least every 100 ms so disableWAL() and the destructor don't
+      // wait out a long interval
+      TickType_t ticks = pdMS_TO_TICKS(waitMillis < 100 ? waitMillis : 100);
+      vTaskDelay(ticks > 0 ? ticks : 1);
     }
   }
   
-  file.close();
+  vTaskDelete(NULL);
+}
+
+// Commit buffered entries and stop logging
+IMDBResult ESP32IMDB::disableWAL() {
+  lock();
   
-  // Atomic rename - replace old file with new one
-  if (SPIFFS.exists(filename)) {
-    SPIFFS.remove(filename);
-  }
-  if (!SPIFFS.rename(tempFilename, filename)) {
-    SPIFFS.remove(tempFilename);
+  if (!_walEnabled) {
     unlock();
-    return IMDB_ERROR_FILE_WRITE;
+    return IMDB_ERROR_INVALID_OPERATION;
   }
   
+  IMDBResult result = walFlush();
+  releaseWAL();
+  
   unlock();
-  return IMDB_OK;
+  return result;
 }
 
-// Load database from SPIFFS file
-IMDBResult ESP32IMDB::loadFromFile(const char* filename) {
+// Commit buffered entries now, regardless of the commit interval
+IMDBResult ESP32IMDB::flushWAL() {
   lock();
   
-  if (filename == nullptr) {
-    unlock();
-    return IMDB_ERROR_INVALID_VALUE;
-  }
-  
-  // Check if table already exists - don't overwrite
-  if (_tableExists) {
-    unlock();
-    return IMDB_ERROR_TABLE_EXISTS;
-  }
-  
-  // Check if file exists first
-  if (!SPIFFS.exists(filename)) {
+  if (!_walEnabled) {
     unlock();
-    return IMDB_ERROR_FILE_OPEN;
+    return IMDB_ERROR_INVALID_OPERATION;
   }
   
-  // Open file for reading
-  File file = SPIFFS.open(filename, "r");
-  if (!file) {
-    unlock();
-    return IMDB_ERROR_FILE_OPEN;
+  IMDBResult result = walFlush();
+  if (result == IMDB_OK && _walLogBytes >= IMDB_WAL_CHECKPOINT_BYTES) {
+    result = checkpointLocked();
   }
   
-  // Read and validate header
-  char magic[4];
-  if (file.read((uint8_t*)magic, 4) != 4 || 
-      magic[0] != 'I' || magic[1] != 'M' || magic[2] != 'D' || magic[3] != 'B') {
-    file.close();
-    unlock();
-    return IMDB_ERROR_CORRUPT_FILE;
-  }
+  unlock();
+  return result;
+}
+
+// Fold the log into a fresh snapshot and truncate it
+IMDBResult ESP32IMDB::checkpoint() {
+  lock();
   
-  uint8_t version;
-  if (file.read(&version, 1) != 1 || version != 1) {
-    file.close();
-    unlock();
-    return IMDB_ERROR_CORRUPT_FILE;
-  }
+  finishLazyLoad();
   
-  uint8_t columnCount;
-  if (file.read(&columnCount, 1) != 1) {
-    file.close();
+  if (!_walEnabled) {
     unlock();
-    return IMDB_ERROR_CORRUPT_FILE;
+    return IMDB_ERROR_INVALID_OPERATION;
   }
   
-  uint16_t recordCount;
-  if (file.read((uint8_t*)&recordCount, 2) != 2) {
-    file.close();
-    unlock();
-    return IMDB_ERROR_CORRUPT_FILE;
-  }
+  IMDBResult result = checkpointLocked();
   
-  uint32_t saveMillis;
-  if (file.read((uint8_t*)&saveMillis, 4) != 4) {
-    file.close();
-    unlock();
-    return IMDB_ERROR_CORRUPT_FILE;
+  unlock();
+  return result;
+}
+
+// Re-apply logged changes on top of the snapshot just loaded. Runs with the WAL
+// disabled, so the public operations used here do not log again.
+IMDBResult ESP32IMDB::replayWAL(const char* logFilename) {
+  if (!_storage->exists(logFilename)) {
+    return IMDB_OK;  // Nothing logged since the snapshot
   }
   
-  // Read schema
-  if (!checkHeapLimit()) {
-    file.close();
-    unlock();
-    return IMDB_ERROR_HEAP_LIMIT;
+  IMDBFile* file = _storage->open(logFilename, "r");
+  if (file == nullptr) {
+    return IMDB_ERROR_FILE_OPEN;
   }
   
-  _columns = (IMDBColumn*)malloc(sizeof(IMDBColumn) * columnCount);
-  if (_columns == nullptr) {
-    file.close();
-    unlock();
+  uint8_t* blockBuffer = (uint8_t*)malloc(IMDB_PERSIST_BLOCK_SIZE);
+  if (blockBuffer == nullptr) {
+    _storage->close(file);
     return IMDB_ERROR_OUT_OF_MEMORY;
   }
+  IMDBBlockReader reader = {file, blockBuffer, 0, 0, false, false, false, 0, 0, 0};
   
-  for (int i = 0; i < columnCount; i++) {
-    if (file.read((uint8_t*)_columns[i].name, 32) != 32) {
-      free(_columns);
-      _columns = nullptr;
-      file.close();
-      unlock();
-      return IMDB_ERROR_FILE_READ;
-    }
-    // Ensure null-termination of column name for safety
-    _columns[i].name[31] = '\0';
-    
-    uint8_t typeValue;
-    if (file.read(&typeValue, 1) != 1) {
-      free(_columns);
-      _columns = nullptr;
-      file.close();
-      unlock();
-      return IMDB_ERROR_FILE_READ;
-    }
-    // Validate type value is within valid enum range
-    if (typeValue > IMDB_TYPE_FLOAT) {
-      free(_columns);
-      _columns = nullptr;
-      file.close();
-      unlock();
-      return IMDB_ERROR_CORRUPT_FILE;
-    }
-    _columns[i].type = (IMDBDataType)typeValue;
-  }
-  
-  _columnCount = columnCount;
-  _tableExists = true;
-  
-  // Allocate records array
-  if (!checkHeapLimit()) {
-    free(_columns);
-    _columns = nullptr;
-    _tableExists = false;
-    file.close();
-    unlock();
-    return IMDB_ERROR_HEAP_LIMIT;
+  // Only a log started by the snapshot's own checkpoint extends it
+  char magic[4];
+  uint32_t checkpointId = 0;
+  uint32_t checkpointMillis = 0;
+  if (!readRawBytes(&reader, magic, 4) || memcmp(magic, "IWAL", 4) != 0 ||
+      !readRawBytes(&reader, &checkpointId, 4) || !readRawBytes(&reader, &checkpointMillis, 4) ||
+      _walCheckpointId == 0 || checkpointId != _walCheckpointId) {
+    free(blockBuffer);
+    _storage->close(file);
+    return IMDB_OK;
   }
   
-  _recordCapacity = recordCount > 10 ? recordCount : 10;
-  _records = (IMDBRecord*)malloc(sizeof(IMDBRecord) * _recordCapacity);
-  if (_records == nullptr) {
-    free(_columns);
-    _columns = nullptr;
-    _tableExists = false;
-    file.close();
-    unlock();
-    return IMDB_ERROR_OUT_OF_MEMORY;
+  // Largest body any entry for this schema can have
+  size_t maxBody = 1 + 4 + 4 + (size_t)_columnCount * (1 + IMDB_MAX_STRING_LENGTH) + 8;
+  int decodedSlots = (_columnCount > 2) ? _columnCount : 2;
+  IMDBFieldValue* decoded = (IMDBFieldValue*)malloc(sizeof(IMDBFieldValue) * decodedSlots);
+  const void** values = (const void**)malloc(sizeof(const void*) * decodedSlots);
+  uint8_t* entryBuffer = nullptr;  // Body followed by scratch for decoded strings
+  size_t entryCapacity = 0;
+  uint32_t lastLoggedMillis = checkpointMillis;
+  IMDBResult result = IMDB_OK;
+  
+  if (decoded == nullptr || values == nullptr) {
+    result = IMDB_ERROR_OUT_OF_MEMORY;
   }
   
-  _recordCount = 0;
-  uint32_t currentMillis = millis();
-  
-  // Read records
-  for (int i = 0; i < recordCount; i++) {
-    IMDBRecord record;
-    
-    // Read isValid flag
-    uint8_t isValid;
-    if (file.read(&isValid, 1) != 1) {
-      // Cleanup on error
-      for (int j = 0; j < _recordCount; j++) {
-        freeRecord(&_records[j]);
-      }
-      free(_records);
-      free(_columns);
-      _records = nullptr;
-      _columns = nullptr;
-      _recordCount = 0;
-      _recordCapacity = 0;
-      _tableExists = false;
-      file.close();
-      unlock();
-      return IMDB_ERROR_FILE_READ;
-    }
-    record.isValid = (isValid != 0);
-    
-    // Read expiryMillis
-    uint32_t savedExpiryMillis;
-    if (file.read((uint8_t*)&savedExpiryMillis, 4) != 4) {
-      for (int j = 0; j < _recordCount; j++) {
-        freeRecord(&_records[j]);
-      }
-      free(_records);
-      free(_columns);
-      _records = nullptr;
-      _columns = nullptr;
-      _recordCount = 0;
-      _recordCapacity = 0;
-      _tableExists = false;
-      file.close();
-      unlock();
-      return IMDB_ERROR_FILE_READ;
+  while (result == IMDB_OK) {
+    uint32_t length = 0;
+    uint32_t storedCrc = 0;
+    if (!readRawBytes(&reader, &length, 4)) {
+      break;  // End of log
+    }
+    if (length == 0 || length > maxBody) {
+      break;  // Torn tail
     }
     
-    // Adjust TTL based on time difference
-    if (savedExpiryMillis == 0) {
-      record.expiryMillis = 0;  // No expiry
-    } else {
-      // Calculate remaining time, handling potential underflow
-      if (savedExpiryMillis > saveMillis) {
-        uint32_t remainingMillis = savedExpiryMillis - saveMillis;
-        // Check for overflow when adding to currentMillis
-        if (remainingMillis > (UINT32_MAX - currentMillis)) {
-          record.expiryMillis = UINT32_MAX;
-        } else {
-          record.expiryMillis = currentMillis + remainingMillis;
-        }
-      } else {
-        // Record was already expired when saved, mark as expired now
-        record.expiryMillis = currentMillis - 1;
+    size_t needed = (size_t)length * 2 + _columnCount;
+    if (needed > entryCapacity) {
+      uint8_t* grown = (uint8_t*)realloc(entryBuffer, needed);
+      if (grown == nullptr) {
+        result = IMDB_ERROR_OUT_OF_MEMORY;
+        break;
       }
+      entryBuffer = grown;
+      entryCapacity = needed;
     }
     
-    // Allocate fields array
-    if (!checkHeapLimit()) {
-      for (int j = 0; j < _recordCount; j++) {
-        freeRecord(&_records[j]);
-      }
-      free(_records);
-      free(_columns);
-      _records = nullptr;
-      _columns = nullptr;
-      _recordCount = 0;
-      _recordCapacity = 0;
-      _tableExists = false;
-      file.close();
-      unlock();
-      return IMDB_ERROR_HEAP_LIMIT;
+    if (!readRawBytes(&reader, entryBuffer, length) ||
+        !readRawBytes(&reader, &storedCrc, 4) ||
+        imdbCrc32(0, entryBuffer, length) != storedCrc) {
+      break;  // Torn tail
     }
     
-    record.fields = (IMDBFieldValue*)malloc(sizeof(IMDBFieldValue) * _columnCount);
-    if (record.fields == nullptr) {
-      for (int j = 0; j < _recordCount; j++) {
-        freeRecord(&_records[j]);
-      }
-      free(_records);
-      free(_columns);
-      _records = nullptr;
-      _columns = nullptr;
-      _recordCount = 0;
-      _recordCapacity = 0;
-      _tableExists = false;
-      file.close();
-      unlock();
-      return IMDB_ERROR_OUT_OF_MEMORY;
+    // Decode; a CRC-valid entry that does not parse is corrupt, not torn
+    const uint8_t* in = entryBuffer;
+    const uint8_t* end = entryBuffer + length;
+    char* scratch = (char*)entryBuffer + length;
+    uint8_t entryType = *in++;
+    IMDBResult applied = IMDB_ERROR_CORRUPT_FILE;
+    if (end - in < 4) {
+      entryType = 0;  // Not a valid entry
+    } else {
+      memcpy(&lastLoggedMillis, in, 4);
+      in += 4;
     }
     
-    // Initialize string pointers to nullptr
-    for (int j = 0; j < _columnCount; j++) {
-      if (_columns[j].type == IMDB_TYPE_STRING) {
-        record.fields[j].stringValue = nullptr;
+    if (entryType == IMDB_WAL_ENTRY_INSERT) {
+      uint32_t expiryMillis = 0;
+      bool valid = (end - in >= 4);
+      if (valid) {
+        memcpy(&expiryMillis, in, 4);
+        in += 4;
       }
-    }
-    
-    // Read fields
-    bool readError = false;
-    for (int j = 0; j < _columnCount; j++) {
-      IMDBFieldValue* field = &record.fields[j];
-      IMDBDataType type = _columns[j].type;
-      
-      switch (type) {
-        case IMDB_TYPE_INT32:
-          if (file.read((uint8_t*)&field->int32Value, 4) != 4) {
-            readError = true;
-          }
-          break;
-          
-        case IMDB_TYPE_FLOAT:
-          if (file.read((uint8_t*)&field->floatValue, 4) != 4) {
-            readError = true;
-          }
-          break;
-          
-        case IMDB_TYPE_BOOL: {
-          uint8_t boolValue;
-          if (file.read(&boolValue, 1) != 1) {
-            readError = true;
-          } else {
-            field->boolValue = (boolValue != 0);
-          }
-          break;
+      for (int i = 0; i < _columnCount && valid; i++) {
+        size_t used = decodeWalValue(in, end - in, _columns[i].type, &decoded[i], &scratch);
+        valid = (used > 0);
+        in += used;
+        values[i] = &decoded[i];
+      }
+      if (valid && in == end) {
+        // Time left at the checkpoint, like the snapshot's rows; the time
+        // logged after it is taken off every row once the log is replayed
+        uint32_t ttlMillis = 0;
+        if (expiryMillis != 0) {
+          ttlMillis = ((int32_t)(expiryMillis - checkpointMillis) > 0) ? expiryMillis - checkpointMillis : 1;
         }
-        
-        case IMDB_TYPE_MAC:
-          if (file.read(field->macAddress, 6) != 6) {
-            readError = true;
-          }
-          break;
-          
-        case IMDB_TYPE_EPOCH:
-          if (file.read((uint8_t*)&field->epochValue, 4) != 4) {
-            readError = true;
-          }
-          break;
-          
-        case IMDB_TYPE_STRING: {
-          uint8_t length;
-          if (file.read(&length, 1) != 1) {
-            readError = true;
-            break;
-          }
-          
-          // Validate string length
-          if (length > IMDB_MAX_STRING_LENGTH) {
-            readError = true;
-            break;
-          }
-          
-          if (length > 0) {
-            field->stringValue = (char*)malloc(length + 1);
-            if (field->stringValue == nullptr) {
-              readError = true;
-              break;
-            }
-            
-            if (file.read((uint8_t*)field->stringValue, length) != length) {
-              free(field->stringValue);
-              field->stringValue = nullptr;
-              readError = true;
-              break;
-            }
-            field->stringValue[length] = '\0';
-          } else {
-            field->stringValue = nullptr;
-          }
-          break;
+        applied = insert(values, ttlMillis);
+      }
+    } else if (entryType == IMDB_WAL_ENTRY_UPDATE || entryType == IMDB_WAL_ENTRY_MATH ||
+               entryType == IMDB_WAL_ENTRY_DELETE) {
+      int whereIdx = (in < end) ? *in++ : _columnCount;
+      int setIdx = -1;
+      uint8_t operation = 0;
+      int32_t operand = 0;
+      bool valid = (whereIdx < _columnCount);
+      if (valid) {
+        size_t used = decodeWalValue(in, end - in, _columns[whereIdx].type, &decoded[0], &scratch);
+        valid = (used > 0);
+        in += used;
+      }
+      if (valid && entryType != IMDB_WAL_ENTRY_DELETE) {
+        setIdx = (in < end) ? *in++ : _columnCount;
+        valid = (setIdx < _columnCount);
+      }
+      if (valid && entryType == IMDB_WAL_ENTRY_UPDATE) {
+        size_t used = decodeWalValue(in, end - in, _columns[setIdx].type, &decoded[1], &scratch);
+        valid = (used > 0);
+        in += used;
+      } else if (valid && entryType == IMDB_WAL_ENTRY_MATH) {
+        valid = (end - in >= 5 && in[0] <= IMDB_MATH_MODULO);
+        if (valid) {
+          operation = in[0];
+          memcpy(&operand, in + 1, 4);
+          in += 5;
         }
       }
       
-      if (readError) {
-        break;
+      if (valid && in == end) {
+        if (entryType == IMDB_WAL_ENTRY_UPDATE) {
+          applied = update(_columns[whereIdx].name, &decoded[0], _columns[setIdx].name, &decoded[1]);
+        } else if (entryType == IMDB_WAL_ENTRY_MATH) {
+          applied = updateWithMath(_columns[whereIdx].name, &decoded[0], _columns[setIdx].name,
+                                   (IMDBMathOp)operation, operand);
+        } else {
+          applied = deleteRecords(_columns[whereIdx].name, &decoded[0]);
+        }
+        // Rows an entry touched may have expired before the crash
+        if (applied == IMDB_ERROR_NO_RECORDS) {
+          applied = IMDB_OK;
+        }
       }
     }
     
-    if (readError) {
-      // Free this record's fields
-      for (int j = 0; j < _columnCount; j++) {
-        if (_columns[j].type == IMDB_TYPE_STRING && record.fields[j].stringValue != nullptr) {
-          free(record.fields[j].stringValue);
-        }
+    result = applied;
+  }
+  
+  // TTLs pause at the last logged change: the time that passed between the
+  // checkpoint and that change counts against every row
+  uint32_t elapsedMillis = lastLoggedMillis - checkpointMillis;
+  if (result == IMDB_OK && elapsedMillis > 0) {
+    lock();
+    uint32_t currentMillis = millis();
+    for (int i = 0; i < _recordCount; i++) {
+      IMDBRecord* record = &_records[i];
+      if (record->isValid && record->expiryMillis != 0) {
+        bool outlived = ((int32_t)(record->expiryMillis - currentMillis) > (int32_t)elapsedMillis);
+        record->expiryMillis = outlived ? record->expiryMillis - elapsedMillis : currentMillis - 1;
       }
-      free(record.fields);
-      
-      // Cleanup all previous records
-      for (int j = 0; j < _recordCount; j++) {
-        freeRecord(&_records[j]);
-      }
-      free(_records);
-      free(_columns);
-      _records = nullptr;
-      _columns = nullptr;
-      _recordCount = 0;
-      _recordCapacity = 0;
-      _tableExists = false;
-      file.close();
-      unlock();
-      return IMDB_ERROR_FILE_READ;
     }
-    
-    // Add record to array
-    _records[_recordCount] = record;
-    _recordCount++;
+    unlock();
   }
   
-  file.close();
-  unlock();
-  return IMDB_OK;
+  free(entryBuffer);
+  free(values);
+  free(decoded);
+  free(blockBuffer);
+  _storage->close(file);
+  return result;
+}
+
+// Load the last checkpoint, replay the log over it and resume logging.
+// Resuming takes a checkpoint, so a torn tail never sits before new entries.
+IMDBResult ESP32IMDB::recoverFromWAL(const char* snapshotFilename, const char* logFilename,
+                                     uint32_t commitIntervalMs) {
+  if (snapshotFilename == nullptr || logFilename == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  
+  IMDBResult result = loadFromFile(snapshotFilename);
+  if (result != IMDB_OK) {
+    return result;
+  }
+  
+  result = replayWAL(logFilename);
+  if (result != IMDB_OK) {
+    dropTable();
+    return result;
+  }
+  
+  // The recovered table stays loaded even if logging cannot resume
+  return enableWAL(snapshotFilename, logFilename, commitIntervalMs);
 }
 
 #endif // IMDB_ENABLE_PERSISTENCE
@@ -1868,6 +8485,8 @@ const char* ESP32IMDB::resultToString(IMDBResult result) {
     case IMDB_ERROR_INVALID_OPERATION: return "Invalid operation";
     case IMDB_ERROR_NO_RECORDS: return "No records found";
     case IMDB_ERROR_INVALID_MAC_FORMAT: return "Invalid MAC address format";
+    case IMDB_ERROR_STREAM_WRITE: return "Failed to write to stream";
+    case IMDB_ERROR_PARSE: return "Malformed CSV or JSON input";
 #if IMDB_ENABLE_PERSISTENCE
     case IMDB_ERROR_FILE_OPEN: return "Failed to open file";
     case IMDB_ERROR_FILE_WRITE: return "Failed to write to file";
@@ -27,11 +27,22 @@
 // Feature flags - set to 0 to disable, saves about 30kB of flash and 2kB of RAM
 // Override these defaults with a #define before #include in your Arduino sketch
 
-// Enable saveToFile/loadFromFile (requires SPIFFS)
+// Enable saveToFile/loadFromFile (SPIFFS by default, see setStorage())
 #ifndef IMDB_ENABLE_PERSISTENCE
 #define IMDB_ENABLE_PERSISTENCE 1
 #endif
 
+// Enable saveToFileCompressed() and loading of compressed files (requires persistence)
+#ifndef IMDB_ENABLE_COMPRESSION
+#define IMDB_ENABLE_COMPRESSION 1
+#endif
+
+// Per-operation counters and latency histograms, read with getStats(). Adds a timer read
+// per operation and about 1kB of RAM per database.
+#ifndef IMDB_ENABLE_STATS
+#define IMDB_ENABLE_STATS 0
+#endif
+
 // User-configurable limits.
 // Override these defaults with a #define before #include in your Arduino sketch
 
@@ -40,16 +51,114 @@
 #define IMDB_MIN_HEAP_BYTES 30000
 #endif
 
+// Memory budget for the table (bytes, 0 = none) - operations that grow the table fail once
+// getMemoryUsage() reaches it. Can be changed at runtime with setMemoryBudget().
+#ifndef IMDB_MEMORY_BUDGET
+#define IMDB_MEMORY_BUDGET 0
+#endif
+
+// Free heap sampling interval (ms) - between samples of ESP.getFreeHeap(), the heap limit
+// check estimates free heap from the last sample and the table's own allocations since
+#ifndef IMDB_HEAP_SAMPLE_INTERVAL_MS
+#define IMDB_HEAP_SAMPLE_INTERVAL_MS 100
+#endif
+
 // Maximum string length - strings longer than this will automatically truncate when inserted
 #ifndef IMDB_MAX_STRING_LENGTH
 #define IMDB_MAX_STRING_LENGTH 255
 #endif
 
+// Heap bytes added to every allocation (block header, poisoning canaries), used only to
+// estimate allocator slack in getMemoryBreakdown(). ESP-IDF adds 4 to 12 depending on
+// the heap poisoning setting.
+#ifndef IMDB_HEAP_BLOCK_OVERHEAD
+#define IMDB_HEAP_BLOCK_OVERHEAD 8
+#endif
+
+// Default placement of field arrays and strings - 1 puts them in PSRAM on boards that have
+// it, 0 keeps everything in internal RAM. Can be changed at runtime with setPlacement().
+#ifndef IMDB_PSRAM_PLACEMENT
+#define IMDB_PSRAM_PLACEMENT 1
+#endif
+
+// Zone map block size (records) - range scans, min() and max() on INT32, EPOCH and FLOAT
+// columns skip whole blocks whose smallest and largest values rule them out
+#ifndef IMDB_ZONE_MAP_BLOCK_ROWS
+#define IMDB_ZONE_MAP_BLOCK_ROWS 64
+#endif
+
+// Query planner - histogram buckets kept per column by the column statistics (at least 2),
+// and the most conditions one compound WHERE clause may hold
+#ifndef IMDB_COLUMN_HISTOGRAM_BUCKETS
+#define IMDB_COLUMN_HISTOGRAM_BUCKETS 8
+#endif
+#ifndef IMDB_MAX_PREDICATES
+#define IMDB_MAX_PREDICATES 4
+#endif
+
+// Persistence I/O block size (bytes) - saveToFile/loadFromFile encode into a buffer of this size
+// and hand whole blocks to the filesystem. Must be at least 512.
+#ifndef IMDB_PERSIST_BLOCK_SIZE
+#define IMDB_PERSIST_BLOCK_SIZE 4096
+#endif
+
+// Compressed saves - rows are encoded column by column in groups of about this many bytes,
+// and each group is compressed on its own. Larger groups compress better but need more RAM.
+#ifndef IMDB_COMPRESS_GROUP_BYTES
+#define IMDB_COMPRESS_GROUP_BYTES 8192
+#endif
+
+// Write-ahead log group commit buffer (bytes) - logged changes collect here and reach the
+// filesystem in one append per commit
+#ifndef IMDB_WAL_BUFFER_SIZE
+#define IMDB_WAL_BUFFER_SIZE 1024
+#endif
+
+// Default WAL commit interval (ms) - buffered changes are appended to the log once this much
+// time has passed since the last commit. 0 commits every change before the call returns.
+#ifndef IMDB_WAL_COMMIT_INTERVAL_MS
+#define IMDB_WAL_COMMIT_INTERVAL_MS 1000
+#endif
+
+// WAL size (bytes) that triggers an automatic checkpoint (snapshot + log truncation)
+#ifndef IMDB_WAL_CHECKPOINT_BYTES
+#define IMDB_WAL_CHECKPOINT_BYTES 65536
+#endif
+
+// Incremental saves - saveIncremental() writes a new full base file instead of another delta
+// once this many delta files exist
+#ifndef IMDB_INCREMENTAL_MAX_DELTAS
+#define IMDB_INCREMENTAL_MAX_DELTAS 8
+#endif
+
+// Background task (WAL commits, saveToFileAsync, loadFromFileLazy) stack size (bytes) and priority
+#ifndef IMDB_SAVE_TASK_STACK
+#define IMDB_SAVE_TASK_STACK 4096
+#endif
+
+#ifndef IMDB_SAVE_TASK_PRIORITY
+#define IMDB_SAVE_TASK_PRIORITY 1
+#endif
+
+// Lazy loads - rows loadFromFileLazy() hydrates per lock hold; callers wait at most this long
+#ifndef IMDB_LAZY_LOAD_BATCH
+#define IMDB_LAZY_LOAD_BATCH 64
+#endif
+
+// Streaming export/import - bytes buffered and rows handled per lock hold
+#ifndef IMDB_STREAM_BUFFER_SIZE
+#define IMDB_STREAM_BUFFER_SIZE 1024
+#endif
+#ifndef IMDB_STREAM_CHUNK_ROWS
+#define IMDB_STREAM_CHUNK_ROWS 64
+#endif
+
 // End user-configurable settings
 
 #include <Arduino.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include "IMDBWire.h"
 
 // Maximum record TTL (30 days)
 #define IMDB_MAX_TTL_MS (30UL * 24UL * 60UL * 60UL * 1000UL)
@@ -85,8 +194,11 @@ enum IMDBResult {
   IMDB_ERROR_FILE_OPEN,
   IMDB_ERROR_FILE_WRITE,
   IMDB_ERROR_FILE_READ,
-  IMDB_ERROR_CORRUPT_FILE
+  IMDB_ERROR_CORRUPT_FILE,
 #endif
+  // Later codes keep their values with or without persistence
+  IMDB_ERROR_STREAM_WRITE = 16,
+  IMDB_ERROR_PARSE
 };
 
 // Column definition
@@ -109,7 +221,11 @@ union IMDBFieldValue {
 struct IMDBRecord {
   IMDBFieldValue* fields;  // Array of field values
   uint32_t expiryMillis;   // Expiry time (0 = no expiry)
+  uint32_t rowId;          // Stable row identity, ascending in table order
   bool isValid;            // Flag for deleted records
+#if IMDB_ENABLE_PERSISTENCE
+  bool isDirty;            // Changed since the last incremental save
+#endif
 };
 
 // Comparison operators for WHERE clauses
@@ -143,13 +259,136 @@ struct IMDBSelectResult {
   bool hasValue;
 };
 
+// One condition of a compound WHERE clause; a record matches when all of them hold
+struct IMDBPredicate {
+  const char* column;
+  IMDBOperator op;
+  const void* value;
+};
+
+// Column statistics used by the query planner
+struct IMDBColumnStats {
+  uint32_t rows;           // Live records when collected
+  uint32_t distinct;       // Estimated number of distinct values
+  double min;              // INT32, EPOCH and FLOAT columns only
+  double max;
+  // Equal-width buckets from min to max; BOOL columns count false in [0], true in [1]
+  uint32_t histogram[IMDB_COLUMN_HISTOGRAM_BUCKETS];
+};
+
+// How a WHERE clause finds its candidate records
+enum IMDBAccessPath {
+  IMDB_PATH_FULL_SCAN,     // Every record slot
+  IMDB_PATH_ZONE_SCAN,     // Blocks the zone map can't rule out
+  IMDB_PATH_BOOL_INDEX     // Set bits of a BOOL column bitmap
+};
+
+// Plan chosen for a compound WHERE clause, filled in by explain()
+struct IMDBPlan {
+  IMDBAccessPath path;                 // Access path of the driving condition, order[0]
+  uint8_t order[IMDB_MAX_PREDICATES];  // Conditions in the order they are checked
+  uint8_t predicateCount;
+  uint32_t estimatedRows;              // Matches expected from the column statistics
+  uint32_t estimatedScanned;           // Records the access path was expected to visit
+  uint32_t actualRows;                 // Matches found
+  uint32_t actualScanned;              // Records the access path visited
+};
+
+// Memory held by the table, by category (bytes)
+struct IMDBMemoryUsage {
+  size_t directory;        // Column definitions and the record array, spare capacity included
+  size_t fieldArrays;      // Field values of stored records
+  size_t strings;          // String values, terminators included; loaded strings until their arena is freed
+  size_t indexes;          // Lookup structures (BOOL bitmaps, membership filter, lazy-load key index)
+  size_t allocatorSlack;   // Estimated heap block overhead and alignment padding
+  size_t fragmentation;    // Load arena space not used by any record or loaded string, freed with the arena
+  size_t total;
+  size_t psram;            // Part of the total placed in PSRAM
+};
+
+// Where field arrays and strings are allocated. The record array, the schema and
+// indexes always stay in internal RAM, where scans walk them fastest.
+enum IMDBPlacement {
+  IMDB_PLACE_INTERNAL,     // Internal RAM only
+  IMDB_PLACE_PSRAM         // PSRAM when present, internal RAM when it is missing or full
+};
+
+#if IMDB_ENABLE_STATS
+// Operation types counted by getStats()
+enum IMDBStatOp {
+  IMDB_STAT_INSERT,     // insert()
+  IMDB_STAT_SELECT,     // select(), selectAll()
+  IMDB_STAT_UPDATE,     // update(), updateWithMath()
+  IMDB_STAT_DELETE,     // deleteRecords()
+  IMDB_STAT_SCAN,       // count(), countWhere(), min(), max(), top(), exports, encodeRows()
+  IMDB_STAT_PURGE,      // purgeExpiredRecords()
+  IMDB_STAT_SAVE,       // saveToFile(), saveToFileCompressed(), saveToFileAsync(), saveIncremental()
+  IMDB_STAT_LOAD,       // loadFromFile(), loadFromFileLazy(), loadIncremental()
+  IMDB_STAT_OTHER,      // Lock use only: getRecordCount(), background load and save steps, etc.
+  IMDB_STAT_OP_COUNT
+};
+
+// Latency histogram: bucket 0 counts calls under 2us, bucket i calls from 2^i to
+// 2^(i+1) - 1 us, and the last bucket everything from 2^19 us (about 0.5s) up
+#define IMDB_STATS_BUCKETS 20
+
+struct IMDBOpStats {
+  uint32_t calls;
+  uint64_t totalMicros;
+  uint32_t maxMicros;
+  uint64_t rowsScanned;    // Records examined
+  uint64_t rowsMatched;    // Records that matched the WHERE column (or were purged)
+  uint32_t latency[IMDB_STATS_BUCKETS];
+  
+  // Table lock use. Operations that release the lock between chunks (exports,
+  // lazy loads) acquire it more than once per call.
+  uint32_t lockAcquisitions;
+  uint32_t lockContended;     // Acquisitions that had to wait for another task
+  uint64_t lockWaitMicros;
+  uint32_t lockWaitMaxMicros;
+  uint64_t lockHoldMicros;
+  uint32_t lockHoldMaxMicros;
+};
+
+struct IMDBStats {
+  IMDBOpStats ops[IMDB_STAT_OP_COUNT];
+  uint32_t elapsedMillis;     // Time covered, since the database was created or resetStats()
+  uint32_t maxHoldMicros;     // Longest single lock hold
+  IMDBStatOp maxHoldOp;       // Operation type that held it
+};
+
+struct IMDBStatScope;         // Times one operation (internal)
+struct IMDBLockSample;        // Lock use within one operation (internal)
+#endif
+
+struct IMDBFilter;            // Membership filter state (internal)
+struct IMDBZone;              // Zone map bounds of one column in one block (internal)
+struct IMDBScan;              // Access path of one WHERE clause (internal)
+struct IMDBQuery;             // Planned compound WHERE clause (internal)
+
+#if IMDB_ENABLE_PERSISTENCE
+#include "IMDBStorage.h"
+
+struct IMDBBlockWriter;  // Buffered block writer used by persistence (internal)
+struct IMDBBlockReader;  // Buffered block reader used by persistence (internal)
+struct IMDBSaveJob;      // Snapshot image handed to the background save task (internal)
+struct IMDBLazyLoad;     // State of a loadFromFileLazy() in progress (internal)
+struct IMDBKeyIndexEntry; // Key index entry saved for lazy loads (internal)
+
+// Completion callback for saveToFileAsync(); runs in the background save task
+typedef void (*IMDBSaveCallback)(IMDBResult result, void* userArg);
+#endif
+
 class ESP32IMDB {
 public:
   ESP32IMDB();
   ~ESP32IMDB();
 
-  // Table operations
-  IMDBResult createTable(const IMDBColumn* columns, uint8_t columnCount);
+  // Table operations. A ringCapacity above 0 creates a ring buffer table: all
+  // storage for that many rows is allocated up front and once it is full each
+  // insert overwrites the oldest row.
+  IMDBResult createTable(const IMDBColumn* columns, uint8_t columnCount,
+                         uint32_t ringCapacity = 0);
   IMDBResult dropTable();
   
   // Data operations
@@ -166,27 +405,113 @@ public:
                    const void* whereValue, IMDBSelectResult* result);
   IMDBResult selectAll(const char* whereColumn, const void* whereValue,
                       IMDBSelectResult** results, int* resultCount);
+  IMDBResult selectAll(const char* whereColumn, IMDBOperator op, const void* whereValue,
+                      IMDBSelectResult** results, int* resultCount);
   
   // Aggregate functions
   int32_t count();
   int32_t countWhere(const char* whereColumn, const void* whereValue);
+  int32_t countWhere(const char* whereColumn, IMDBOperator op, const void* whereValue);
   IMDBResult min(const char* column, IMDBSelectResult* result);
   IMDBResult max(const char* column, IMDBSelectResult* result);
   IMDBResult top(int n, IMDBSelectResult** results, int* resultCount);
   
+  // Membership filter: a cuckoo filter over one column's values, kept current by
+  // every change. exists() answers "no" from the filter without taking the table
+  // lock and only scans when the value may be present. nullptr removes the filter.
+  IMDBResult setMembershipFilter(const char* column);
+  bool exists(const char* column, const void* value);
+  
+  // Compound WHERE clauses (every condition must hold). The planner runs the
+  // condition with the cheapest access path and checks the rest most selective
+  // first, estimating from column statistics that are collected when first needed
+  // and again after a quarter of the rows changed. explain() runs the count and
+  // reports the plan with estimated and actual rows.
+  int32_t countWhere(const IMDBPredicate* where, uint8_t whereCount);
+  IMDBResult selectAll(const IMDBPredicate* where, uint8_t whereCount,
+                      IMDBSelectResult** results, int* resultCount);
+  IMDBResult explain(const IMDBPredicate* where, uint8_t whereCount, IMDBPlan* plan);
+  IMDBResult analyze();
+  IMDBResult getColumnStats(const char* column, IMDBColumnStats* stats);
+  static const char* accessPathName(IMDBAccessPath path);
+  
   // Utility functions
   void purgeExpiredRecords();
   int getRecordCount() const;
+  uint32_t getRingCapacity() const;
   size_t getMemoryUsage() const;
+  IMDBResult getMemoryBreakdown(IMDBMemoryUsage* usage) const;
+  void setMemoryBudget(size_t bytes);
+  size_t getMemoryBudget() const;
+  void setPlacement(IMDBPlacement placement);
+  IMDBPlacement getPlacement() const;
   bool isThreadSafe() const;
   
   // Memory management helper
   static void freeSelectResults(IMDBSelectResult* results);
   
+  // Streaming export/import. Rows are formatted or parsed one at a time through a
+  // fixed-size buffer, and the lock is released between chunks. columns picks and
+  // orders the exported columns (nullptr = all).
+  IMDBResult exportCSV(Print& out, const char* whereColumn = nullptr, const void* whereValue = nullptr,
+                       const char* const* columns = nullptr, uint8_t columnCount = 0);
+  IMDBResult exportJSON(Print& out, const char* whereColumn = nullptr, const void* whereValue = nullptr,
+                        const char* const* columns = nullptr, uint8_t columnCount = 0);
+  IMDBResult importCSV(Stream& in, uint32_t ttlMillis = 0, int* importedCount = nullptr);
+  IMDBResult importJSON(Stream& in, uint32_t ttlMillis = 0, int* importedCount = nullptr);
+  
+  // Binary wire encoding (see IMDBWire.h). Fills buffer with as many whole rows as
+  // fit and advances cursor; call again with the same cursor until cursor->finished.
+  IMDBResult encodeRows(IMDBWireCursor* cursor, uint8_t* buffer, size_t capacity, size_t* length);
+  
+#if IMDB_ENABLE_STATS
+  // Operation counters and latency histograms. Latency is measured from the call
+  // to its return, so it includes waiting for the lock.
+  IMDBResult getStats(IMDBStats* stats) const;
+  void resetStats();
+  static const char* statOpName(IMDBStatOp op);
+  // Latency (us) that fraction (0-1) of the calls stayed under, to within a factor of 2
+  static uint32_t latencyPercentile(const IMDBOpStats* op, float fraction);
+#endif
+  
 #if IMDB_ENABLE_PERSISTENCE
+  // Filesystem used by all persistence functions; nullptr selects SPIFFS.
+  // The storage object must outlive the database.
+  IMDBResult setStorage(IMDBStorage* storage);
+  
   // Persistence functions
   IMDBResult saveToFile(const char* filename);
   IMDBResult loadFromFile(const char* filename);
+#if IMDB_ENABLE_COMPRESSION
+  IMDBResult saveToFileCompressed(const char* filename);
+#endif
+  
+  // Background save: snapshot in RAM under the lock, file write in a separate task
+  IMDBResult saveToFileAsync(const char* filename, IMDBSaveCallback callback = nullptr,
+                             void* userArg = nullptr);
+  bool isSaveInProgress() const;
+  IMDBResult getLastSaveResult() const;
+  
+  // Lazy load: header, schema and key index are read up front and the rows load in a
+  // background task. Until then, lookups on the key column are read from the file.
+  IMDBResult setLazyLoadKey(const char* column);
+  IMDBResult loadFromFileLazy(const char* filename);
+  bool isLoadInProgress() const;
+  uint8_t getLoadProgress() const;
+  IMDBResult getLastLoadResult() const;
+  
+  // Incremental saves: a full base file plus delta files holding only changed rows
+  IMDBResult saveIncremental(const char* filename, uint8_t maxDeltas = IMDB_INCREMENTAL_MAX_DELTAS);
+  IMDBResult loadIncremental(const char* filename);
+  
+  // Write-ahead log: changes are appended to logFilename between snapshots
+  IMDBResult enableWAL(const char* snapshotFilename, const char* logFilename,
+                       uint32_t commitIntervalMs = IMDB_WAL_COMMIT_INTERVAL_MS);
+  IMDBResult disableWAL();
+  IMDBResult flushWAL();
+  IMDBResult checkpoint();
+  IMDBResult recoverFromWAL(const char* snapshotFilename, const char* logFilename,
+                            uint32_t commitIntervalMs = IMDB_WAL_COMMIT_INTERVAL_MS);
 #endif
   
   // Helper functions for value preparation
@@ -203,8 +528,139 @@ private:
   mutable SemaphoreHandle_t _mutex;  // Mutable for const method locking
   bool _tableExists;
   
+  // Bulk storage filled by loadFromFile(). Loaded records point into these
+  // arenas instead of owning individual allocations; each arena is freed once
+  // its last record or string has been released.
+  IMDBFieldValue* _fieldArena;
+  size_t _fieldArenaSlots;
+  int _fieldArenaLive;
+  char* _stringArena;
+  size_t _stringArenaSize;
+  int _stringArenaLive;
+  size_t _stringArenaUsed;   // Bytes loaded into _stringArena, counted as strings
+  
+  uint32_t _nextRowId;       // Assigned to the next inserted record
+  uint32_t _tableGeneration; // Changes whenever the table is discarded
+  
+  // Memory accounting, updated under the lock by every change and read
+  // without it by getMemoryUsage() and getMemoryBreakdown()
+  IMDBMemoryUsage _memory;
+  
+  // Memory governor. checkHeapLimit() compares the counters with _memoryBudget
+  // and estimates free heap from the last sample, taking a new one when the
+  // interval has passed, the estimate nears the floor or an allocation failed.
+  size_t _memoryBudget;
+  mutable uint32_t _heapSample;       // ESP.getFreeHeap() at the last sample
+  mutable size_t _heapSampleUsage;    // Table memory at the last sample
+  mutable uint32_t _heapSampleMillis;
+  mutable bool _heapSampleValid;
+  
+  IMDBPlacement _placement;  // Applies to allocations made from now on
+  
+  // BOOL column bitmap index, one bit per record slot: bitmap 0 marks valid
+  // records, bitmap 1 records with a TTL, then one bitmap per BOOL column.
+  // Built by the first BOOL lookup and kept current from then on; bulk loads
+  // set _boolIndexStale and the next lookup rebuilds it.
+  uint32_t* _boolIndex;
+  size_t _boolIndexWords;    // Words per bitmap
+  uint8_t _boolIndexMaps;
+  bool _boolIndexStale;
+  
+  // Membership filter, guarded by its own mutex so exists() never waits for the
+  // table lock. Changes to it are made under both locks.
+  IMDBFilter* _filter;
+  mutable SemaphoreHandle_t _filterMutex;
+  
+  // Zone map: lowest and highest value of each INT32, EPOCH and FLOAT column in
+  // each block of IMDB_ZONE_MAP_BLOCK_ROWS record slots, block by block. Built
+  // like the BOOL index; bounds only widen until compaction rebuilds them.
+  IMDBZone* _zones;
+  size_t _zoneBlocks;        // Blocks allocated
+  uint8_t _zoneColumns;
+  bool _zoneMapStale;
+  
+  // Column statistics for the query planner, one entry per column. Collected
+  // when a plan needs them and again once the changes pass a quarter of the rows.
+  IMDBColumnStats* _columnStats;
+  uint32_t _columnStatsChanges;  // Records inserted, updated or removed since collected
+  bool _columnStatsStale;        // Loads and delta merges bypass _columnStatsChanges
+  
+  // Ring buffer mode (_ringCapacity > 0). _records points into a directory of
+  // 2 * capacity entries and slides forward as the oldest row is evicted; the
+  // capacity entries from _records on own all field and string storage, live
+  // rows first. Strings are copied into fixed IMDB_MAX_STRING_LENGTH + 1 slots.
+  IMDBRecord* _ringBase;
+  IMDBFieldValue* _ringFields;
+  char* _ringStrings;
+  uint32_t _ringCapacity;
+  uint8_t _ringStringColumns;
+  
+#if IMDB_ENABLE_STATS
+  // Operation stats, guarded by their own mutex so recording never waits for
+  // the table lock. The _lock* members describe the current lock hold and are
+  // only touched by the task holding the table lock.
+  mutable IMDBStats _stats;
+  uint32_t _statsResetMillis;
+  mutable SemaphoreHandle_t _statsMutex;
+  mutable uint32_t _lockAcquiredMicros;
+  mutable uint32_t _lockWaitMicros;
+  mutable bool _lockContended;
+  friend struct IMDBStatScope;
+  void recordStat(IMDBStatOp op, uint32_t micros, uint32_t rowsScanned, uint32_t rowsMatched,
+                  const IMDBLockSample* lockSample);
+  void recordLockUse(uint32_t waitMicros, bool contended, uint32_t holdMicros) const;
+#endif
+  
+#if IMDB_ENABLE_PERSISTENCE
+  IMDBStorage* _storage;     // Never nullptr; SPIFFS unless setStorage() was called
+  
+  // Write-ahead log state. Changes are encoded into _walBuffer under the table
+  // lock and appended to the log on group commit. _walCheckpointId ties the log
+  // to the snapshot it extends so a stale log is never replayed.
+  bool _walEnabled;
+  char* _walSnapshotFilename;
+  char* _walLogFilename;
+  uint8_t* _walBuffer;
+  size_t _walUsed;
+  uint8_t* _walOversize;     // Entry too large for _walBuffer, written directly
+  size_t _walLogBytes;
+  uint32_t _walCommitInterval;
+  uint32_t _walLastCommit;
+  uint32_t _walCheckpointId;
+  volatile bool _walTaskRunning;
+  
+  // Background save state, written by the save task
+  volatile bool _saveInProgress;
+  volatile IMDBResult _lastSaveResult;
+  char* _saveFilename;       // Target of the running or last background save
+  
+  // Lazy load state. _lazyKey is the column indexed in v2 snapshots (-1 = none);
+  // _lazy is set while rows are still being hydrated from the file.
+  int _lazyKey;
+  IMDBLazyLoad* _lazy;
+  volatile bool _loadTaskRunning;
+  volatile IMDBResult _lastLoadResult;
+  
+  // Incremental save state. Once _incFilename is set, rows removed by
+  // compaction are remembered in _incDeleted until the next incremental save.
+  char* _incFilename;
+  uint32_t _incBaseId;       // Id of the base file the deltas extend
+  uint8_t _incDeltaCount;    // Delta files written against the current base
+  bool _incNeedsBase;        // Deleted-row tracking was lost; next save must be a base
+  uint32_t* _incDeleted;
+  size_t _incDeletedCount;
+  size_t _incDeletedCapacity;
+#endif
+  
   // Internal helper functions
-  bool checkHeapLimit() const;
+  bool checkHeapLimit(size_t reserveBytes = 0, size_t bulkBytes = 0) const;
+  void heapAllocationFailed() const;
+  void* allocBulk(size_t bytes) const;
+  void memoryAllocated(size_t* category, size_t bytes, const void* ptr);
+  void memoryFreed(size_t* category, size_t bytes, const void* ptr);
+  void trackRecord(const IMDBRecord* record, bool added);
+  void trackString(const char* str, bool added);
+  void arenaStringLoaded(size_t bytes);
   int findColumnIndex(const char* columnName) const;
   bool compareValues(const IMDBFieldValue* fieldValue, const void* compareValue, 
                     IMDBDataType type, IMDBOperator op = IMDB_OP_EQUAL) const;
@@ -212,10 +668,108 @@ private:
   IMDBResult growRecordArray();
   IMDBResult shrinkRecordArray();
   void freeRecord(IMDBRecord* record);
+  void releaseFields(IMDBFieldValue* fields);
+  void releaseString(char* str);
+  void discardTable();
   void compactRecords();
+  int indexPosition(int slot) const;
+  int indexSlot(int position) const;
+  int indexPositions() const;
+  bool reserveBoolIndex(int slots);
+  bool rebuildBoolIndex();
+  void releaseBoolIndex();
+  void indexBoolSlot(int slot);
+  const uint32_t* boolIndexFor(int colIdx);
+  int nextBoolMatch(const uint32_t* bits, const void* whereValue, int slot) const;
+  int32_t countBoolMatches(const uint32_t* bits, const void* whereValue) const;
+  bool reserveZoneMap(int slots);
+  bool rebuildZoneMap();
+  void releaseZoneMap();
+  void zoneMapSlot(int slot);
+  void refreshZoneBlock(int slot);
+  const IMDBZone* zoneOfSlot(const IMDBZone* zones, int slot) const;
+  int nextZoneBlock(int slot) const;
+  int zoneBlockRows(int block) const;
+  const IMDBZone* zoneMapFor(int colIdx);
+  void prepareScan(IMDBScan* scan, int colIdx, IMDBOperator op, const void* value);
+  int nextCandidate(const IMDBScan* scan, int slot) const;
+  IMDBResult collectColumnStats();
+  bool columnStatsOutdated() const;
+  float estimateSelectivity(int colIdx, IMDBOperator op, const void* value) const;
+  IMDBResult planQuery(IMDBQuery* query, const IMDBPredicate* where, uint8_t whereCount, IMDBPlan* plan);
+  bool queryMatches(const IMDBQuery* query, const IMDBRecord* record) const;
+  void markIndexesStale();
+  IMDBResult enterRingMode(uint32_t capacity);
+  IMDBRecord* ringAppendSlot();
+  bool ringOwns(const void* ptr) const;
+  char* ringStringSlot(const IMDBFieldValue* field) const;
+  void copyIntoRing(IMDBRecord* dest, const IMDBRecord* src);
+  IMDBResult rebuildFilter(uint32_t buckets);
+  void releaseFilter();
+  void filterRecord(const IMDBRecord* record, bool added);
+  void filterValue(uint32_t hash, bool added);
   IMDBResult copyFieldValue(IMDBFieldValue* dest, const void* src, IMDBDataType type);
   void getFieldValue(const IMDBFieldValue* field, IMDBDataType type, IMDBSelectResult* result) const;
-  
+  int firstRecordFrom(uint32_t rowId) const;
+  IMDBResult resolveColumns(const char* const* columns, uint8_t columnCount,
+                            uint8_t** projection, uint8_t* outputCount) const;
+  size_t wireRowSize(const IMDBRecord* record, const uint8_t* projection, uint8_t outputCount,
+                     size_t boolBytes) const;
+  IMDBResult exportRows(Print& out, bool json, const char* whereColumn, const void* whereValue,
+                        const char* const* columns, uint8_t columnCount);
+  IMDBResult importRows(Stream& in, bool json, uint32_t ttlMillis, int* importedCount);
+  IMDBResult insertBatchLocked(IMDBFieldValue** rows, int rowCount, uint32_t ttlMillis);
+#if IMDB_ENABLE_PERSISTENCE
+  bool writeRecord(IMDBBlockWriter* writer, const IMDBRecord* record) const;
+  bool readRecord(IMDBBlockReader* reader, IMDBRecord* record, char** stringCursor, char* stringEnd);
+  size_t recordEncodedSize(const IMDBRecord* record) const;
+  void purgeForSnapshot();
+  size_t snapshotPayloadSize(uint32_t checkpointId, uint32_t baseId) const;
+  size_t snapshotImageSize(uint32_t checkpointId, uint32_t baseId) const;
+  IMDBResult buildKeyIndex(uint32_t checkpointId, uint32_t baseId, IMDBKeyIndexEntry** index) const;
+  bool encodeSnapshot(IMDBBlockWriter* writer, uint32_t checkpointId, uint32_t baseId,
+                      const IMDBKeyIndexEntry* keyIndex) const;
+  IMDBResult saveSnapshotLocked(const char* filename, uint32_t checkpointId, uint32_t baseId = 0);
+  void noteDeletedRow(uint32_t rowId);
+  void resetIncrementalTracking();
+  int findRowIndex(uint32_t rowId) const;
+  uint32_t schemaCrc() const;
+  IMDBResult saveDeltaLocked(const char* deltaFilename);
+  IMDBResult applyDeltaLocked(const char* deltaFilename, uint32_t sequence, bool* applied);
+  bool readRecordOwned(IMDBBlockReader* reader, IMDBRecord* record, char* scratch);
+  static void saveTask(void* parameter);
+  bool saveTargetBusy(const char* filename) const;
+  IMDBResult loadLocked(const char* filename, bool lazy);
+  IMDBResult loadNextRecord(IMDBBlockReader* reader, bool hasRowIds, uint32_t saveMillis,
+                            uint32_t currentMillis, uint32_t* lastRowId, char** stringCursor,
+                            char* stringEnd);
+  void hydrateLocked(uint32_t rows);
+  void finishLazyLoad(const char* whereColumn = nullptr);
+  void releaseLazyLoad();
+  IMDBResult readLazyRecord(uint32_t offset, IMDBRecord* record);
+  IMDBResult readLazyMatches(const void* whereValue, int maxRows, IMDBRecord** rows, int* rowCount);
+  void freeLazyMatches(IMDBRecord* rows, int rowCount);
+  static void loadTask(void* parameter);
+#if IMDB_ENABLE_COMPRESSION
+  size_t columnarRowBound(const IMDBRecord* record) const;
+  size_t encodeColumnarGroup(int start, int rows, uint8_t* out, int16_t* dictSlots,
+                             const char** dictEntries, uint8_t* dictLengths) const;
+  IMDBResult saveColumnarLocked(const char* filename);
+  IMDBResult readColumnarRecords(IMDBBlockReader* reader, uint32_t recordCount, uint32_t saveMillis,
+                                 uint32_t maxRawBytes, char* stringCursor, char* stringEnd);
+#endif
+  IMDBResult checkpointLocked();
+  void releaseWAL();
+  IMDBResult walBeginEntry(size_t bodySize, uint8_t** body);
+  IMDBResult walEndEntry(size_t bodySize);
+  IMDBResult walFlush();
+  IMDBResult walLogInsert(const void** values, uint32_t expiryMillis);
+  IMDBResult walLogChange(uint8_t entryType, int whereIdx, const void* whereValue,
+                          int setIdx, const void* setValue, IMDBMathOp operation, int32_t operand);
+  IMDBResult replayWAL(const char* logFilename);
+  static void walCommitTask(void* parameter);
+#endif
+
   // Thread-safe lock/unlock wrappers
   void lock() const;
   void unlock() const;
@@ -0,0 +1,41 @@
+/*
+ * ESP32IMDB - CRC32 shared by the persistence formats
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Used by save files, the WAL, table images and the host image builder in
+ * tools/imdb_image, which all have to agree on the same checksum. Uses the
+ * ROM routine on ESP32 and a nibble table elsewhere. No Arduino dependencies.
+ */
+
+#ifndef IMDB_CRC32_H
+#define IMDB_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+#if defined(ARDUINO_ARCH_ESP32)
+#include <esp_rom_crc.h>
+#endif
+
+// CRC32 (IEEE 802.3, reflected). Chainable: pass the previous result as crc.
+static inline uint32_t imdbCrc32(uint32_t crc, const uint8_t* data, size_t length) {
+#if defined(ARDUINO_ARCH_ESP32)
+  return esp_rom_crc32_le(crc, data, length);
+#else
+  static const uint32_t nibbleTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ nibbleTable[crc & 0x0F];
+    crc = (crc >> 4) ^ nibbleTable[crc & 0x0F];
+  }
+  return ~crc;
+#endif
+}
+
+#endif // IMDB_CRC32_H
@@ -0,0 +1,599 @@
+/*
+ * ESP32IMDB - Read-only table images
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ */
+
+#include "IMDBImage.h"
+
+#if IMDB_ENABLE_PERSISTENCE
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#if defined(ARDUINO_ARCH_ESP32)
+#include <esp_partition.h>
+#include <esp_idf_version.h>
+#if ESP_IDF_VERSION_MAJOR < 5
+#include <esp_spi_flash.h>
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(IMDBImageHeader) == 44, "IMDBImageHeader layout");
+static_assert(sizeof(IMDBImageColumn) == 44, "IMDBImageColumn layout");
+
+// Field width in a row, by column type
+static uint32_t imageFieldWidth(uint8_t type) {
+  switch (type) {
+    case IMDB_IMAGE_TYPE_MAC: return 6;
+    case IMDB_IMAGE_TYPE_BOOL: return 1;
+    default: return 4;
+  }
+}
+
+IMDBImageTable::IMDBImageTable() {
+  _image = nullptr;
+  _imageSize = 0;
+  _header = nullptr;
+  _columns = nullptr;
+  _rows = nullptr;
+  _strings = nullptr;
+  _mapHandle = 0;
+  _partitionMapped = false;
+  _fileMapped = false;
+}
+
+IMDBImageTable::~IMDBImageTable() {
+  close();
+}
+
+// Validate the header and section bounds, then point at the sections.
+// Nothing per row is touched, so this costs the same for any table size.
+IMDBResult IMDBImageTable::attach(const uint8_t* image, size_t size) {
+  if (size < sizeof(IMDBImageHeader) || ((uintptr_t)image & 3) != 0) {
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+
+  const IMDBImageHeader* header = (const IMDBImageHeader*)image;
+  if (memcmp(header->magic, IMDB_IMAGE_MAGIC, 4) != 0 || header->version != IMDB_IMAGE_VERSION) {
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+  uint64_t imageSize = header->imageSize;
+  uint64_t columnsEnd = (uint64_t)header->columnsOffset + (uint64_t)header->columnCount * sizeof(IMDBImageColumn);
+  uint64_t rowsEnd = (uint64_t)header->rowsOffset + (uint64_t)header->rowCount * header->rowSize;
+  uint64_t stringsEnd = (uint64_t)header->stringsOffset + header->stringsSize;
+
+  if (imageSize > size || columnsEnd > imageSize) {
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+
+  // The header CRC also covers the column table
+  uint32_t crc = imdbCrc32(0, image, offsetof(IMDBImageHeader, headerCrc));
+  crc = imdbCrc32(crc, image + header->columnsOffset, header->columnCount * sizeof(IMDBImageColumn));
+  if (crc != header->headerCrc) {
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+
+  if (header->columnCount == 0 || header->rowSize == 0 ||
+      header->rowCount > INT_MAX || header->stringsSize == 0 ||
+      (header->columnsOffset & 3) != 0 || header->columnsOffset < sizeof(IMDBImageHeader) ||
+      columnsEnd > header->rowsOffset || rowsEnd > header->stringsOffset || stringsEnd > imageSize) {
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+
+  // A terminated pool keeps every in-range string offset terminated
+  const char* strings = (const char*)(image + header->stringsOffset);
+  if (strings[header->stringsSize - 1] != '\0') {
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+
+  const IMDBImageColumn* columns = (const IMDBImageColumn*)(image + header->columnsOffset);
+  for (int i = 0; i < header->columnCount; i++) {
+    const IMDBImageColumn* column = &columns[i];
+    if (column->type > IMDB_IMAGE_TYPE_FLOAT || column->name[31] != '\0' ||
+        (uint64_t)column->fieldOffset + imageFieldWidth(column->type) > header->rowSize) {
+      return IMDB_ERROR_CORRUPT_FILE;
+    }
+    if (column->indexOffset != 0) {
+      uint64_t indexEnd = (uint64_t)column->indexOffset + (uint64_t)header->rowCount * 4;
+      if ((column->indexOffset & 3) != 0 || column->indexOffset < rowsEnd ||
+          indexEnd > header->stringsOffset ||
+          column->type == IMDB_IMAGE_TYPE_FLOAT || column->type == IMDB_IMAGE_TYPE_BOOL) {
+        return IMDB_ERROR_CORRUPT_FILE;
+      }
+    }
+  }
+
+  _image = image;
+  _imageSize = (size_t)imageSize;
+  _header = header;
+  _columns = columns;
+  _rows = image + header->rowsOffset;
+  _strings = strings;
+  return IMDB_OK;
+}
+
+IMDBResult IMDBImageTable::openPartition(const char* partitionLabel) {
+#if defined(ARDUINO_ARCH_ESP32)
+  if (_image != nullptr) {
+    return IMDB_ERROR_TABLE_EXISTS;
+  }
+  if (partitionLabel == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                              ESP_PARTITION_SUBTYPE_ANY,
+                                                              partitionLabel);
+  if (partition == nullptr) {
+    return IMDB_ERROR_FILE_OPEN;
+  }
+
+  // Map only the image, not the whole partition
+  IMDBImageHeader header;
+  if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK) {
+    return IMDB_ERROR_FILE_READ;
+  }
+  if (memcmp(header.magic, IMDB_IMAGE_MAGIC, 4) != 0 || header.imageSize < sizeof(header) ||
+      header.imageSize > partition->size) {
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+
+  const void* mapped = nullptr;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_partition_mmap_handle_t handle;
+  esp_err_t err = esp_partition_mmap(partition, 0, header.imageSize, ESP_PARTITION_MMAP_DATA,
+                                     &mapped, &handle);
+#else
+  spi_flash_mmap_handle_t handle;
+  esp_err_t err = esp_partition_mmap(partition, 0, header.imageSize, SPI_FLASH_MMAP_DATA,
+                                     &mapped, &handle);
+#endif
+  if (err != ESP_OK) {
+    return IMDB_ERROR_FILE_OPEN;
+  }
+
+  IMDBResult result = attach((const uint8_t*)mapped, header.imageSize);
+  if (result != IMDB_OK) {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_munmap(handle);
+#else
+    spi_flash_munmap(handle);
+#endif
+    return result;
+  }
+
+  _mapHandle = (uint32_t)handle;
+  _partitionMapped = true;
+  return IMDB_OK;
+#else
+  (void)partitionLabel;
+  return IMDB_ERROR_INVALID_OPERATION;
+#endif
+}
+
+IMDBResult IMDBImageTable::openFile(const char* path) {
+#if defined(ARDUINO_ARCH_ESP32)
+  (void)path;
+  return IMDB_ERROR_INVALID_OPERATION;
+#else
+  if (_image != nullptr) {
+    return IMDB_ERROR_TABLE_EXISTS;
+  }
+  if (path == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return IMDB_ERROR_FILE_OPEN;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(IMDBImageHeader)) {
+    ::close(fd);
+    return IMDB_ERROR_CORRUPT_FILE;
+  }
+
+  size_t size = (size_t)info.st_size;
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    return IMDB_ERROR_FILE_READ;
+  }
+
+  IMDBResult result = attach((const uint8_t*)mapped, size);
+  if (result != IMDB_OK) {
+    munmap(mapped, size);
+    return result;
+  }
+
+  _imageSize = size;  // Unmap the whole file on close()
+  _fileMapped = true;
+  return IMDB_OK;
+#endif
+}
+
+IMDBResult IMDBImageTable::openMemory(const void* image, size_t size) {
+  if (_image != nullptr) {
+    return IMDB_ERROR_TABLE_EXISTS;
+  }
+  if (image == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+  return attach((const uint8_t*)image, size);
+}
+
+void IMDBImageTable::close() {
+  if (_image == nullptr) {
+    return;
+  }
+
+#if defined(ARDUINO_ARCH_ESP32)
+  if (_partitionMapped) {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_munmap((esp_partition_mmap_handle_t)_mapHandle);
+#else
+    spi_flash_munmap((spi_flash_mmap_handle_t)_mapHandle);
+#endif
+  }
+#else
+  if (_fileMapped) {
+    munmap((void*)_image, _imageSize);
+  }
+#endif
+
+  _image = nullptr;
+  _imageSize = 0;
+  _header = nullptr;
+  _columns = nullptr;
+  _rows = nullptr;
+  _strings = nullptr;
+  _mapHandle = 0;
+  _partitionMapped = false;
+  _fileMapped = false;
+}
+
+bool IMDBImageTable::isOpen() const {
+  return _image != nullptr;
+}
+
+IMDBResult IMDBImageTable::verify() const {
+  if (_image == nullptr) {
+    return IMDB_ERROR_NO_TABLE;
+  }
+
+  uint32_t crc = imdbCrc32(0, _image + sizeof(IMDBImageHeader),
+                            _header->imageSize - sizeof(IMDBImageHeader));
+  return (crc == _header->dataCrc) ? IMDB_OK : IMDB_ERROR_CORRUPT_FILE;
+}
+
+int IMDBImageTable::findColumnIndex(const char* columnName) const {
+  for (int i = 0; i < _header->columnCount; i++) {
+    if (strcmp(_columns[i].name, columnName) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Decode one field; strings point into the image
+void IMDBImageTable::getField(uint32_t row, int column, IMDBFieldValue* field) const {
+  const uint8_t* data = _rows + (size_t)row * _header->rowSize + _columns[column].fieldOffset;
+
+  switch (_columns[column].type) {
+    case IMDB_IMAGE_TYPE_MAC:
+      memcpy(field->macAddress, data, 6);
+      break;
+    case IMDB_IMAGE_TYPE_BOOL:
+      field->boolValue = (*data != 0);
+      break;
+    case IMDB_IMAGE_TYPE_STRING: {
+      uint32_t offset;
+      memcpy(&offset, data, 4);
+      field->stringValue = (char*)_strings + ((offset < _header->stringsSize) ? offset : 0);
+      break;
+    }
+    default:
+      memcpy(&field->int32Value, data, 4);
+      break;
+  }
+}
+
+// Three-way comparison of a field with a WHERE value, for index search
+static int compareKey(const IMDBFieldValue* field, const void* value, uint8_t type) {
+  switch (type) {
+    case IMDB_IMAGE_TYPE_INT32: {
+      int32_t b = *(const int32_t*)value;
+      return (field->int32Value < b) ? -1 : (field->int32Value > b);
+    }
+    case IMDB_IMAGE_TYPE_EPOCH: {
+      uint32_t b = *(const uint32_t*)value;
+      return (field->epochValue < b) ? -1 : (field->epochValue > b);
+    }
+    case IMDB_IMAGE_TYPE_MAC:
+      return memcmp(field->macAddress, value, 6);
+    case IMDB_IMAGE_TYPE_STRING:
+      return strcmp(field->stringValue, *(const char**)value);
+  }
+  return 0;
+}
+
+// Equality, as ESP32IMDB compares WHERE values
+bool IMDBImageTable::matches(uint32_t row, int column, const void* value) const {
+  IMDBFieldValue field;
+  getField(row, column, &field);
+
+  switch (_columns[column].type) {
+    case IMDB_IMAGE_TYPE_BOOL:
+      return field.boolValue == *(const bool*)value;
+    case IMDB_IMAGE_TYPE_FLOAT: {
+      float diff = field.floatValue - *(const float*)value;
+      return (diff > -IMDB_FLOAT_EPSILON && diff < IMDB_FLOAT_EPSILON);
+    }
+    default:
+      return compareKey(&field, value, _columns[column].type) == 0;
+  }
+}
+
+// Row number at a position of a column's index. Entries are not checked at
+// open; an out-of-range entry reads row 0 (verify() reports the damage).
+uint32_t IMDBImageTable::rowAt(int column, uint32_t position) const {
+  uint32_t row;
+  memcpy(&row, _image + _columns[column].indexOffset + (size_t)position * 4, 4);
+  return (row < _header->rowCount) ? row : 0;
+}
+
+// Index positions [first, last) whose value equals value
+bool IMDBImageTable::findRange(int column, const void* value, uint32_t* first, uint32_t* last) const {
+  uint8_t type = _columns[column].type;
+  IMDBFieldValue field;
+
+  // Lower bound
+  uint32_t low = 0;
+  uint32_t high = _header->rowCount;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    getField(rowAt(column, mid), column, &field);
+    if (compareKey(&field, value, type) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *first = low;
+
+  // Upper bound
+  high = _header->rowCount;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    getField(rowAt(column, mid), column, &field);
+    if (compareKey(&field, value, type) <= 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *last = low;
+
+  return *first < *last;
+}
+
+// Copy one field into a select result
+void IMDBImageTable::getValue(uint32_t row, int column, IMDBSelectResult* result) const {
+  IMDBFieldValue field;
+  getField(row, column, &field);
+
+  result->type = (IMDBDataType)_columns[column].type;
+  result->hasValue = true;
+  switch (_columns[column].type) {
+    case IMDB_IMAGE_TYPE_MAC:
+      memcpy(result->macAddress, field.macAddress, 6);
+      break;
+    case IMDB_IMAGE_TYPE_STRING:
+      strncpy(result->stringValue, field.stringValue, IMDB_MAX_STRING_LENGTH);
+      result->stringValue[IMDB_MAX_STRING_LENGTH] = '\0';
+      break;
+    case IMDB_IMAGE_TYPE_BOOL:
+      result->boolValue = field.boolValue;
+      break;
+    case IMDB_IMAGE_TYPE_FLOAT:
+      result->floatValue = field.floatValue;
+      break;
+    case IMDB_IMAGE_TYPE_EPOCH:
+      result->epochValue = field.epochValue;
+      break;
+    default:
+      result->int32Value = field.int32Value;
+      break;
+  }
+}
+
+// Copy every column of a row into results[0..columnCount)
+void IMDBImageTable::getRow(uint32_t row, IMDBSelectResult* results) const {
+  for (int col = 0; col < _header->columnCount; col++) {
+    getValue(row, col, &results[col]);
+  }
+}
+
+// Select a single column value from the first matching record
+IMDBResult IMDBImageTable::select(const char* column, const char* whereColumn,
+                                  const void* whereValue, IMDBSelectResult* result) const {
+  if (_image == nullptr) {
+    return IMDB_ERROR_NO_TABLE;
+  }
+
+  if (column == nullptr || whereColumn == nullptr || whereValue == nullptr || result == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+
+  int colIdx = findColumnIndex(column);
+  int whereIdx = findColumnIndex(whereColumn);
+  if (colIdx < 0 || whereIdx < 0) {
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+
+  result->hasValue = false;
+
+  if (_columns[whereIdx].type == IMDB_IMAGE_TYPE_STRING && *(const char* const*)whereValue == nullptr) {
+    return IMDB_ERROR_NO_RECORDS;
+  }
+
+  // Equal index entries are in row order, so the first is the first match
+  uint32_t row = _header->rowCount;
+  if (_columns[whereIdx].indexOffset != 0) {
+    uint32_t first, last;
+    if (findRange(whereIdx, whereValue, &first, &last)) {
+      row = rowAt(whereIdx, first);
+    }
+  } else {
+    for (uint32_t i = 0; i < _header->rowCount; i++) {
+      if (matches(i, whereIdx, whereValue)) {
+        row = i;
+        break;
+      }
+    }
+  }
+
+  if (row == _header->rowCount) {
+    return IMDB_ERROR_NO_RECORDS;
+  }
+
+  getValue(row, colIdx, result);
+  return IMDB_OK;
+}
+
+// Select all matching records (caller must free results)
+IMDBResult IMDBImageTable::selectAll(const char* whereColumn, const void* whereValue,
+                                     IMDBSelectResult** results, int* resultCount) const {
+  if (_image == nullptr) {
+    return IMDB_ERROR_NO_TABLE;
+  }
+
+  if (whereColumn == nullptr || whereValue == nullptr || results == nullptr || resultCount == nullptr) {
+    return IMDB_ERROR_INVALID_VALUE;
+  }
+
+  int whereIdx = findColumnIndex(whereColumn);
+  if (whereIdx < 0) {
+    return IMDB_ERROR_COLUMN_NOT_FOUND;
+  }
+
+  *results = nullptr;
+  *resultCount = 0;
+
+  if (_columns[whereIdx].type == IMDB_IMAGE_TYPE_STRING && *(const char* const*)whereValue == nullptr) {
+    return IMDB_ERROR_NO_RECORDS;
+  }
+
+  bool indexed = (_columns[whereIdx].indexOffset != 0);
+  uint32_t first = 0;
+  uint32_t last = 0;
+  int matchCount = 0;
+  if (indexed) {
+    findRange(whereIdx, whereValue, &first, &last);
+    matchCount = (int)(last - first);
+  } else {
+    for (uint32_t i = 0; i < _header->rowCount; i++) {
+      if (matches(i, whereIdx, whereValue)) {
+        matchCount++;
+      }
+    }
+  }
+
+  if (matchCount == 0) {
+    return IMDB_ERROR_NO_RECORDS;
+  }
+
+  int columnCount = _header->columnCount;
+  if (matchCount > (INT_MAX / columnCount / (int)sizeof(IMDBSelectResult))) {
+    return IMDB_ERROR_OUT_OF_MEMORY;  // Would overflow
+  }
+
+  *results = (IMDBSelectResult*)malloc(sizeof(IMDBSelectResult) * matchCount * columnCount);
+  if (*results == nullptr) {
+    return IMDB_ERROR_OUT_OF_MEMORY;
+  }
+
+  int resultIdx = 0;
+  if (indexed) {
+    for (uint32_t position = first; position < last; position++) {
+      getRow(rowAt(whereIdx, position), &(*results)[resultIdx * columnCount]);
+      resultIdx++;
+    }
+  } else {
+    for (uint32_t i = 0; i < _header->rowCount; i++) {
+      if (matches(i, whereIdx, whereValue)) {
+        getRow(i, &(*results)[resultIdx * columnCount]);
+        resultIdx++;
+      }
+    }
+  }
+
+  *resultCount = matchCount;
+  return IMDB_OK;
+}
+
+int32_t IMDBImageTable::count() const {
+  return (_image != nullptr) ? (int32_t)_header->rowCount : 0;
+}
+
+// Count records matching WHERE condition
+int32_t IMDBImageTable::countWhere(const char* whereColumn, const void* whereValue) const {
+  if (_image == nullptr || whereColumn == nullptr || whereValue == nullptr) {
+    return 0;
+  }
+
+  int whereIdx = findColumnIndex(whereColumn);
+  if (whereIdx < 0) {
+    return 0;
+  }
+
+  if (_columns[whereIdx].type == IMDB_IMAGE_TYPE_STRING && *(const char* const*)whereValue == nullptr) {
+    return 0;
+  }
+
+  if (_columns[whereIdx].indexOffset != 0) {
+    uint32_t first, last;
+    findRange(whereIdx, whereValue, &first, &last);
+    return (int32_t)(last - first);
+  }
+
+  int32_t cnt = 0;
+  for (uint32_t i = 0; i < _header->rowCount; i++) {
+    if (matches(i, whereIdx, whereValue)) {
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+int IMDBImageTable::getRecordCount() const {
+  return (_image != nullptr) ? (int)_header->rowCount : 0;
+}
+
+uint8_t IMDBImageTable::getColumnCount() const {
+  return (_image != nullptr) ? _header->columnCount : 0;
+}
+
+const char* IMDBImageTable::getColumnName(uint8_t column) const {
+  if (_image == nullptr || column >= _header->columnCount) {
+    return nullptr;
+  }
+  return _columns[column].name;
+}
+
+bool IMDBImageTable::isIndexed(const char* column) const {
+  if (_image == nullptr || column == nullptr) {
+    return false;
+  }
+  int idx = findColumnIndex(column);
+  return idx >= 0 && _columns[idx].indexOffset != 0;
+}
+#endif // IMDB_ENABLE_PERSISTENCE
@@ -0,0 +1,85 @@
+/*
+ * ESP32IMDB - Read-only table images
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * IMDBImageTable serves queries straight from a prebuilt table image that is
+ * memory-mapped from a flash partition (or from a file on a host build). Rows
+ * are never copied to the heap, so opening is instant regardless of table
+ * size. Images are built on a PC with tools/imdb_image; see IMDBImageFormat.h
+ * for the layout.
+ *
+ * The image is immutable, so queries need no lock and may run from any task.
+ */
+
+#ifndef IMDB_IMAGE_H
+#define IMDB_IMAGE_H
+
+#include "ESP32IMDB.h"
+
+#if IMDB_ENABLE_PERSISTENCE
+#include "IMDBImageFormat.h"
+
+class IMDBImageTable {
+public:
+  IMDBImageTable();
+  ~IMDBImageTable();
+
+  // Map the image in a data partition (ESP32 only), e.g. openPartition("imdb")
+  IMDBResult openPartition(const char* partitionLabel);
+
+  // Map an image file (host builds only; ESP32 filesystems can't be mapped)
+  IMDBResult openFile(const char* path);
+
+  // Use an image that is already addressable, e.g. a const array in flash.
+  // The memory must stay valid until close().
+  IMDBResult openMemory(const void* image, size_t size);
+
+  void close();
+  bool isOpen() const;
+
+  // Check the CRC of the whole image; open() only checks the header
+  IMDBResult verify() const;
+
+  // Queries - same semantics as the ESP32IMDB functions of the same name.
+  // Equality lookups on an indexed column are a binary search; other columns
+  // are scanned.
+  IMDBResult select(const char* column, const char* whereColumn,
+                    const void* whereValue, IMDBSelectResult* result) const;
+  IMDBResult selectAll(const char* whereColumn, const void* whereValue,
+                       IMDBSelectResult** results, int* resultCount) const;
+  int32_t count() const;
+  int32_t countWhere(const char* whereColumn, const void* whereValue) const;
+
+  int getRecordCount() const;
+  uint8_t getColumnCount() const;
+  const char* getColumnName(uint8_t column) const;
+  bool isIndexed(const char* column) const;
+
+private:
+  const uint8_t* _image;
+  size_t _imageSize;
+  const IMDBImageHeader* _header;
+  const IMDBImageColumn* _columns;
+  const uint8_t* _rows;
+  const char* _strings;
+
+  // Mapping to undo on close()
+  uint32_t _mapHandle;
+  bool _partitionMapped;
+  bool _fileMapped;
+
+  IMDBResult attach(const uint8_t* image, size_t size);
+  int findColumnIndex(const char* columnName) const;
+  void getField(uint32_t row, int column, IMDBFieldValue* field) const;
+  bool matches(uint32_t row, int column, const void* value) const;
+  bool findRange(int column, const void* value, uint32_t* first, uint32_t* last) const;
+  uint32_t rowAt(int column, uint32_t position) const;
+  void getValue(uint32_t row, int column, IMDBSelectResult* result) const;
+  void getRow(uint32_t row, IMDBSelectResult* results) const;
+};
+#endif
+
+#endif // IMDB_IMAGE_H
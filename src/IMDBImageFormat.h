@@ -0,0 +1,70 @@
+/*
+ * ESP32IMDB - Read-only table image layout
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Shared by IMDBImageTable (which queries an image in place) and the host
+ * builder in tools/imdb_image. No Arduino dependencies. Both CRCs use
+ * imdbCrc32 from IMDBCrc32.h.
+ *
+ * All integers are little-endian and every section starts 4-byte aligned:
+ *
+ *   header      IMDBImageHeader (44 bytes)
+ *   columns     IMDBImageColumn[columnCount] (44 bytes each)
+ *   rows        rowCount fixed-size rows of rowSize bytes
+ *   indexes     per indexed column: uint32_t row numbers sorted by that
+ *               column's value (ties in row order)
+ *   strings     string pool of null-terminated, deduplicated strings
+ *
+ * Row fields sit at their column's offset: INT32, EPOCH and FLOAT as 4 bytes,
+ * STRING as a 4-byte offset into the string pool, MAC as 6 bytes, BOOL as 1.
+ * dataCrc covers everything after the header. headerCrc covers the header
+ * bytes before it followed by the column table, so a reader can trust the
+ * layout without reading the rows.
+ */
+
+#ifndef IMDB_IMAGE_FORMAT_H
+#define IMDB_IMAGE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "IMDBCrc32.h"
+
+#define IMDB_IMAGE_MAGIC "IMDI"
+#define IMDB_IMAGE_VERSION 1
+
+// Column types, same values as IMDBDataType
+#define IMDB_IMAGE_TYPE_INT32 0
+#define IMDB_IMAGE_TYPE_MAC 1
+#define IMDB_IMAGE_TYPE_STRING 2
+#define IMDB_IMAGE_TYPE_EPOCH 3
+#define IMDB_IMAGE_TYPE_BOOL 4
+#define IMDB_IMAGE_TYPE_FLOAT 5
+
+struct IMDBImageHeader {
+  char magic[4];           // "IMDI"
+  uint8_t version;
+  uint8_t columnCount;
+  uint16_t reserved;
+  uint32_t rowCount;
+  uint32_t rowSize;
+  uint32_t columnsOffset;
+  uint32_t rowsOffset;
+  uint32_t stringsOffset;
+  uint32_t stringsSize;    // Includes the empty string at offset 0
+  uint32_t imageSize;
+  uint32_t dataCrc;
+  uint32_t headerCrc;
+};
+
+struct IMDBImageColumn {
+  char name[32];
+  uint8_t type;
+  uint8_t reserved[3];
+  uint32_t fieldOffset;    // Byte offset of the field within a row
+  uint32_t indexOffset;    // Sorted row numbers, 0 = column not indexed
+};
+
+#endif // IMDB_IMAGE_FORMAT_H
@@ -0,0 +1,200 @@
+/*
+ * ESP32IMDB - Storage backends for persistence
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ */
+
+#include "IMDBStorage.h"
+#include <new>
+#include <string.h>
+#include <sys/stat.h>
+
+// Arduino filesystem backend
+
+class IMDBFSFile : public IMDBFile {
+public:
+  explicit IMDBFSFile(fs::File file) : _file(file) {}
+
+  size_t read(uint8_t* buffer, size_t length) override {
+    return _file.read(buffer, length);
+  }
+
+  size_t write(const uint8_t* buffer, size_t length) override {
+    return _file.write(buffer, length);
+  }
+
+  size_t position() override {
+    return _file.position();
+  }
+
+  size_t size() override {
+    return _file.size();
+  }
+
+  bool seek(size_t position) override {
+    return _file.seek(position);
+  }
+
+  void close() {
+    _file.close();
+  }
+
+private:
+  fs::File _file;
+};
+
+IMDBFSStorage::IMDBFSStorage(fs::FS& fs) : _fs(fs) {
+}
+
+IMDBFile* IMDBFSStorage::open(const char* path, const char* mode) {
+  fs::File file = _fs.open(path, mode);
+  if (!file) {
+    return nullptr;
+  }
+
+  IMDBFSFile* result = new (std::nothrow) IMDBFSFile(file);
+  if (result == nullptr) {
+    file.close();
+  }
+  return result;
+}
+
+bool IMDBFSStorage::close(IMDBFile* file) {
+  if (file == nullptr) {
+    return true;
+  }
+
+  IMDBFSFile* fsFile = static_cast<IMDBFSFile*>(file);
+  fsFile->close();
+  delete fsFile;
+  return true;
+}
+
+bool IMDBFSStorage::exists(const char* path) {
+  return _fs.exists(path);
+}
+
+bool IMDBFSStorage::remove(const char* path) {
+  return _fs.remove(path);
+}
+
+bool IMDBFSStorage::rename(const char* from, const char* to) {
+  return _fs.rename(from, to);
+}
+
+// stdio backend
+
+class IMDBPosixFile : public IMDBFile {
+public:
+  explicit IMDBPosixFile(FILE* handle) : _handle(handle) {}
+
+  size_t read(uint8_t* buffer, size_t length) override {
+    return fread(buffer, 1, length, _handle);
+  }
+
+  size_t write(const uint8_t* buffer, size_t length) override {
+    return fwrite(buffer, 1, length, _handle);
+  }
+
+  size_t position() override {
+    long pos = ftell(_handle);
+    return (pos < 0) ? 0 : (size_t)pos;
+  }
+
+  size_t size() override {
+    fflush(_handle);
+    struct stat info;
+    if (fstat(fileno(_handle), &info) != 0) {
+      return 0;
+    }
+    return (size_t)info.st_size;
+  }
+
+  bool seek(size_t position) override {
+    return fseek(_handle, (long)position, SEEK_SET) == 0;
+  }
+
+  bool close() {
+    return fclose(_handle) == 0;
+  }
+
+private:
+  FILE* _handle;
+};
+
+IMDBPosixStorage::IMDBPosixStorage(const char* rootPath) {
+  _rootPath = strdup(rootPath ? rootPath : "");
+}
+
+IMDBPosixStorage::~IMDBPosixStorage() {
+  free(_rootPath);
+}
+
+// Join the root and an absolute path; false if it doesn't fit
+bool IMDBPosixStorage::fullPath(const char* path, char* out, size_t outSize) const {
+  if (path == nullptr || _rootPath == nullptr) {
+    return false;
+  }
+  int written = snprintf(out, outSize, "%s%s", _rootPath, path);
+  return written > 0 && (size_t)written < outSize;
+}
+
+IMDBFile* IMDBPosixStorage::open(const char* path, const char* mode) {
+  char full[256];
+  if (!fullPath(path, full, sizeof(full))) {
+    return nullptr;
+  }
+
+  const char* stdioMode;
+  if (strcmp(mode, "r") == 0) {
+    stdioMode = "rb";
+  } else if (strcmp(mode, "w") == 0) {
+    stdioMode = "wb";
+  } else if (strcmp(mode, "a") == 0) {
+    stdioMode = "ab";
+  } else {
+    return nullptr;
+  }
+
+  FILE* handle = fopen(full, stdioMode);
+  if (handle == nullptr) {
+    return nullptr;
+  }
+
+  IMDBPosixFile* result = new (std::nothrow) IMDBPosixFile(handle);
+  if (result == nullptr) {
+    fclose(handle);
+  }
+  return result;
+}
+
+bool IMDBPosixStorage::close(IMDBFile* file) {
+  if (file == nullptr) {
+    return true;
+  }
+
+  IMDBPosixFile* posixFile = static_cast<IMDBPosixFile*>(file);
+  bool ok = posixFile->close();
+  delete posixFile;
+  return ok;
+}
+
+bool IMDBPosixStorage::exists(const char* path) {
+  char full[256];
+  struct stat info;
+  return fullPath(path, full, sizeof(full)) && stat(full, &info) == 0;
+}
+
+bool IMDBPosixStorage::remove(const char* path) {
+  char full[256];
+  return fullPath(path, full, sizeof(full)) && ::remove(full) == 0;
+}
+
+bool IMDBPosixStorage::rename(const char* from, const char* to) {
+  char fullFrom[256];
+  char fullTo[256];
+  return fullPath(from, fullFrom, sizeof(fullFrom)) && fullPath(to, fullTo, sizeof(fullTo)) &&
+         ::rename(fullFrom, fullTo) == 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * ESP32IMDB - Storage backends for persistence
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Every file the persistence functions touch goes through an IMDBStorage:
+ * - IMDBFSStorage wraps any Arduino fs::FS (SPIFFS, LittleFS, FFat, SD, SD_MMC)
+ * - IMDBPosixStorage uses stdio directly, for Linux host builds or ESP-IDF
+ *   VFS paths such as "/littlefs/..."
+ *
+ * Custom backends implement IMDBStorage and IMDBFile. Saves rely on rename():
+ * data is written to "<name>.tmp" and renamed over the target once complete.
+ */
+
+#ifndef IMDB_STORAGE_H
+#define IMDB_STORAGE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <stdio.h>
+
+// An open file. Obtained from IMDBStorage::open(), released with IMDBStorage::close().
+class IMDBFile {
+public:
+  virtual ~IMDBFile() {}
+
+  virtual size_t read(uint8_t* buffer, size_t length) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t length) = 0;
+  virtual size_t position() = 0;
+  virtual size_t size() = 0;
+
+  // Move to an absolute position; used by loadFromFileLazy() lookups
+  virtual bool seek(size_t position) = 0;
+};
+
+// A filesystem. Paths are absolute ("/data.imdb").
+class IMDBStorage {
+public:
+  virtual ~IMDBStorage() {}
+
+  // mode is "r", "w" (create or truncate) or "a" (create or append).
+  // Returns nullptr if the file can't be opened.
+  virtual IMDBFile* open(const char* path, const char* mode) = 0;
+
+  // Close a file returned by open(); file may be nullptr. Returns false if
+  // buffered data could not be written.
+  virtual bool close(IMDBFile* file) = 0;
+
+  virtual bool exists(const char* path) = 0;
+  virtual bool remove(const char* path) = 0;
+
+  // Rename from over to. Backends that can't replace an existing file
+  // return false if to exists.
+  virtual bool rename(const char* from, const char* to) = 0;
+};
+
+// Arduino filesystem backend: IMDBFSStorage storage(LittleFS);
+// The filesystem must already be mounted (LittleFS.begin(), SD.begin(), ...).
+class IMDBFSStorage : public IMDBStorage {
+public:
+  explicit IMDBFSStorage(fs::FS& fs);
+
+  IMDBFile* open(const char* path, const char* mode) override;
+  bool close(IMDBFile* file) override;
+  bool exists(const char* path) override;
+  bool remove(const char* path) override;
+  bool rename(const char* from, const char* to) override;
+
+private:
+  fs::FS& _fs;
+};
+
+// stdio backend. Paths are appended to rootPath, so with rootPath "/tmp/imdb"
+// "/data.imdb" is stored as "/tmp/imdb/data.imdb". The directory must exist.
+class IMDBPosixStorage : public IMDBStorage {
+public:
+  explicit IMDBPosixStorage(const char* rootPath = "");
+  ~IMDBPosixStorage();
+
+  IMDBFile* open(const char* path, const char* mode) override;
+  bool close(IMDBFile* file) override;
+  bool exists(const char* path) override;
+  bool remove(const char* path) override;
+  bool rename(const char* from, const char* to) override;
+
+private:
+  bool fullPath(const char* path, char* out, size_t outSize) const;
+  char* _rootPath;
+};
+
+#endif // IMDB_STORAGE_H
@@ -0,0 +1,247 @@
+/*
+ * ESP32IMDB - Binary wire encoding of query results
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Decoder for chunks written by ESP32IMDB::encodeRows(). Portable C++ with
+ * no Arduino dependencies; see IMDBWire.h for the layout.
+ */
+
+#include "IMDBWire.h"
+#include <stdlib.h>
+#include <string.h>
+
+IMDBWireDecoder::IMDBWireDecoder() {
+  _names = nullptr;
+  _types = nullptr;
+  _columnCount = 0;
+  _boolCount = 0;
+  _schemaTag = 0;
+  _values = nullptr;
+  _cursor = nullptr;
+  _end = nullptr;
+  _rowCount = 0;
+  _rowsRead = 0;
+  _final = false;
+  _error = false;
+}
+
+IMDBWireDecoder::~IMDBWireDecoder() {
+  releaseSchema();
+}
+
+void IMDBWireDecoder::releaseSchema() {
+  free(_names);
+  free(_types);
+  free(_values);
+  _names = nullptr;
+  _types = nullptr;
+  _values = nullptr;
+  _columnCount = 0;
+  _boolCount = 0;
+  _schemaTag = 0;
+}
+
+// Read the schema section into freshly allocated arrays
+bool IMDBWireDecoder::readSchema(const uint8_t** in, const uint8_t* end) {
+  releaseSchema();
+
+  const uint8_t* p = *in;
+  if (p >= end || *p == 0) {
+    return false;
+  }
+  uint8_t columnCount = *p++;
+
+  _names = (char (*)[32])calloc(columnCount, 32);
+  _types = (uint8_t*)malloc(columnCount);
+  _values = (IMDBWireValue*)calloc(columnCount, sizeof(IMDBWireValue));
+  if (_names == nullptr || _types == nullptr || _values == nullptr) {
+    releaseSchema();
+    return false;
+  }
+
+  uint32_t hash = IMDB_WIRE_TAG_SEED;
+  for (int i = 0; i < columnCount; i++) {
+    if (end - p < 2) {
+      releaseSchema();
+      return false;
+    }
+    uint8_t type = *p++;
+    uint8_t nameLength = *p++;
+    if (type > IMDB_WIRE_TYPE_FLOAT || nameLength > 31 || end - p < nameLength) {
+      releaseSchema();
+      return false;
+    }
+    memcpy(_names[i], p, nameLength);
+    _names[i][nameLength] = '\0';
+    hash = imdbWireHashColumn(hash, type, (const char*)p, nameLength);
+    p += nameLength;
+
+    _types[i] = type;
+    _values[i].type = type;
+    if (type == IMDB_WIRE_TYPE_BOOL) {
+      _boolCount++;
+    }
+  }
+
+  _columnCount = columnCount;
+  _schemaTag = imdbWireSchemaTag(hash);
+  *in = p;
+  return true;
+}
+
+bool IMDBWireDecoder::begin(const uint8_t* chunk, size_t length) {
+  _cursor = nullptr;
+  _end = nullptr;
+  _rowCount = 0;
+  _rowsRead = 0;
+  _final = false;
+  _error = true;
+
+  if (chunk == nullptr || length < IMDB_WIRE_HEADER_SIZE ||
+      chunk[0] != IMDB_WIRE_MAGIC_0 || chunk[1] != IMDB_WIRE_MAGIC_1 ||
+      chunk[2] != IMDB_WIRE_VERSION) {
+    return false;
+  }
+
+  uint8_t flags = chunk[3];
+  uint16_t rowCount = (uint16_t)(chunk[4] | (chunk[5] << 8));
+  uint16_t schemaTag = (uint16_t)(chunk[6] | (chunk[7] << 8));
+  const uint8_t* p = chunk + IMDB_WIRE_HEADER_SIZE;
+  const uint8_t* end = chunk + length;
+
+  if ((flags & IMDB_WIRE_FLAG_SCHEMA) && !readSchema(&p, end)) {
+    return false;
+  }
+
+  // Without a schema section the chunk must match the one we have
+  if (_columnCount == 0 || schemaTag != _schemaTag) {
+    return false;
+  }
+
+  _cursor = p;
+  _end = end;
+  _rowCount = rowCount;
+  _final = (flags & IMDB_WIRE_FLAG_FINAL) != 0;
+  _error = false;
+  return true;
+}
+
+bool IMDBWireDecoder::next() {
+  if (_error || _cursor == nullptr || _rowsRead >= _rowCount) {
+    return false;
+  }
+
+  const uint8_t* p = _cursor;
+  const uint8_t* bools = p;
+  size_t boolBytes = (_boolCount + 7) / 8;
+  if ((size_t)(_end - p) < boolBytes) {
+    _error = true;
+    return false;
+  }
+  p += boolBytes;
+
+  int boolIndex = 0;
+  for (int i = 0; i < _columnCount; i++) {
+    IMDBWireValue* value = &_values[i];
+    uint32_t raw;
+
+    switch (_types[i]) {
+      case IMDB_WIRE_TYPE_BOOL:
+        value->boolValue = (bools[boolIndex / 8] >> (boolIndex % 8)) & 1;
+        boolIndex++;
+        break;
+
+      case IMDB_WIRE_TYPE_INT32:
+        p = imdbWireGetVarint(p, _end, &raw);
+        value->int32Value = imdbWireUnzigzag(raw);
+        break;
+
+      case IMDB_WIRE_TYPE_EPOCH:
+        p = imdbWireGetVarint(p, _end, &raw);
+        value->epochValue = raw;
+        break;
+
+      case IMDB_WIRE_TYPE_FLOAT:
+        if (_end - p < 4) {
+          p = nullptr;
+          break;
+        }
+        raw = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        memcpy(&value->floatValue, &raw, 4);
+        p += 4;
+        break;
+
+      case IMDB_WIRE_TYPE_MAC:
+        if (_end - p < 6) {
+          p = nullptr;
+          break;
+        }
+        memcpy(value->macAddress, p, 6);
+        p += 6;
+        break;
+
+      case IMDB_WIRE_TYPE_STRING:
+        p = imdbWireGetVarint(p, _end, &raw);
+        if (p == nullptr || (size_t)(_end - p) < raw) {
+          p = nullptr;
+          break;
+        }
+        value->stringValue = (const char*)p;
+        value->stringLength = raw;
+        p += raw;
+        break;
+    }
+
+    if (p == nullptr) {
+      _error = true;
+      return false;
+    }
+  }
+
+  _cursor = p;
+  _rowsRead++;
+  return true;
+}
+
+bool IMDBWireDecoder::hasError() const {
+  return _error;
+}
+
+bool IMDBWireDecoder::isFinal() const {
+  return _final;
+}
+
+uint16_t IMDBWireDecoder::getRowCount() const {
+  return _rowCount;
+}
+
+uint8_t IMDBWireDecoder::getColumnCount() const {
+  return _columnCount;
+}
+
+const char* IMDBWireDecoder::getColumnName(uint8_t column) const {
+  return (column < _columnCount) ? _names[column] : nullptr;
+}
+
+uint8_t IMDBWireDecoder::getColumnType(uint8_t column) const {
+  return (column < _columnCount) ? _types[column] : 0xFF;
+}
+
+int IMDBWireDecoder::findColumn(const char* name) const {
+  if (name == nullptr) {
+    return -1;
+  }
+  for (int i = 0; i < _columnCount; i++) {
+    if (strcmp(_names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const IMDBWireValue* IMDBWireDecoder::getValue(uint8_t column) const {
+  return (column < _columnCount && _rowsRead > 0) ? &_values[column] : nullptr;
+}
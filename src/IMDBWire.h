@@ -0,0 +1,195 @@
+/*
+ * ESP32IMDB - Binary wire encoding of query results
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * ESP32IMDB::encodeRows() writes rows straight from the table into a caller
+ * buffer as self-contained chunks, sized for a UART frame or an ESP-NOW
+ * packet. IMDBWireDecoder reads them back. This header has no Arduino
+ * dependencies, so IMDBWire.h/.cpp also build on a host (e.g. a gateway):
+ *
+ *   c++ -std=c++11 -Isrc gateway.cpp src/IMDBWire.cpp
+ *
+ * Chunk layout (integers little-endian):
+ *
+ *   header      "IW", version u8, flags u8, rowCount u16, schemaTag u16
+ *   schema      only with IMDB_WIRE_FLAG_SCHEMA: columnCount u8, then per
+ *               column type u8, nameLength u8, name (not null-terminated)
+ *   rows        rowCount rows. Each starts with the BOOL columns packed
+ *               into ceil(bools / 8) bytes (first BOOL column = bit 0),
+ *               followed by the other columns in order:
+ *                 INT32   zigzag varint
+ *                 EPOCH   varint
+ *                 FLOAT   4 bytes
+ *                 MAC     6 bytes
+ *                 STRING  varint length, then the bytes
+ *
+ * Varints are LEB128: 7 bits per byte, low bits first, high bit set on all
+ * but the last byte. schemaTag is a hash of the column types and names, so a
+ * chunk sent without the schema is only decoded against the schema it was
+ * encoded with. Rows never span chunks.
+ */
+
+#ifndef IMDB_WIRE_H
+#define IMDB_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMDB_WIRE_MAGIC_0 'I'
+#define IMDB_WIRE_MAGIC_1 'W'
+#define IMDB_WIRE_VERSION 1
+#define IMDB_WIRE_HEADER_SIZE 8
+
+// Header flags
+#define IMDB_WIRE_FLAG_SCHEMA 0x01  // Schema follows the header
+#define IMDB_WIRE_FLAG_FINAL 0x02   // Last chunk of the result
+
+// When encodeRows() includes the schema
+#define IMDB_WIRE_SCHEMA_NONE 0     // Never; the receiver already knows it
+#define IMDB_WIRE_SCHEMA_FIRST 1    // In the first chunk
+#define IMDB_WIRE_SCHEMA_EVERY 2    // In every chunk, so each decodes on its own
+
+// Column types, same values as IMDBDataType
+#define IMDB_WIRE_TYPE_INT32 0
+#define IMDB_WIRE_TYPE_MAC 1
+#define IMDB_WIRE_TYPE_STRING 2
+#define IMDB_WIRE_TYPE_EPOCH 3
+#define IMDB_WIRE_TYPE_BOOL 4
+#define IMDB_WIRE_TYPE_FLOAT 5
+
+// Progress of an encodeRows() series. Zero-initialize, set the options, then
+// call encodeRows() until finished is true.
+struct IMDBWireCursor {
+  // Options, set before the first call
+  const char* whereColumn;     // Row filter, nullptr = every row
+  const void* whereValue;
+  const char* const* columns;  // Columns to encode, in order; nullptr = all
+  uint8_t columnCount;
+  uint8_t schemaMode;          // IMDB_WIRE_SCHEMA_*
+
+  // Maintained by encodeRows()
+  uint32_t nextRowId;          // Row id to resume at
+  uint32_t rowsEncoded;
+  uint32_t chunks;
+  uint32_t tableGeneration;    // Table the series started on
+  bool finished;
+};
+
+// One decoded column value. Strings point into the chunk and are not
+// null-terminated; they stay valid as long as the chunk buffer does.
+struct IMDBWireValue {
+  uint8_t type;
+  int32_t int32Value;
+  uint32_t epochValue;
+  float floatValue;
+  bool boolValue;
+  uint8_t macAddress[6];
+  const char* stringValue;
+  size_t stringLength;
+};
+
+static inline size_t imdbWireVarintSize(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static inline uint8_t* imdbWirePutVarint(uint8_t* out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+// Returns the byte after the varint, or nullptr if it is truncated or too long
+static inline const uint8_t* imdbWireGetVarint(const uint8_t* in, const uint8_t* end, uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 35 && in < end; shift += 7) {
+    uint8_t byte = *in++;
+    *value |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return in;
+    }
+  }
+  return nullptr;
+}
+
+static inline uint32_t imdbWireZigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t imdbWireUnzigzag(uint32_t value) {
+  return (int32_t)((value >> 1) ^ (0U - (value & 1)));
+}
+
+// Schema tag: FNV-1a over each column's type and name, starting from
+// IMDB_WIRE_TAG_SEED, folded to 16 bits by imdbWireSchemaTag()
+#define IMDB_WIRE_TAG_SEED 2166136261u
+
+static inline uint32_t imdbWireHashColumn(uint32_t hash, uint8_t type, const char* name, size_t nameLength) {
+  hash = (hash ^ type) * 16777619u;
+  for (size_t i = 0; i < nameLength; i++) {
+    hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static inline uint16_t imdbWireSchemaTag(uint32_t hash) {
+  return (uint16_t)(hash ^ (hash >> 16));
+}
+
+class IMDBWireDecoder {
+public:
+  IMDBWireDecoder();
+  ~IMDBWireDecoder();
+
+  // Start decoding a chunk. The schema is read from the chunk or, if the
+  // chunk has none, kept from an earlier one. Returns false if the chunk is
+  // malformed or its schema is unknown.
+  bool begin(const uint8_t* chunk, size_t length);
+
+  // Decode the next row of the chunk; false at the end or on malformed data
+  bool next();
+
+  // True when next() stopped on malformed data
+  bool hasError() const;
+
+  bool isFinal() const;           // Chunk is the last of its result
+  uint16_t getRowCount() const;   // Rows in the current chunk
+
+  uint8_t getColumnCount() const;
+  const char* getColumnName(uint8_t column) const;
+  uint8_t getColumnType(uint8_t column) const;
+  int findColumn(const char* name) const;
+
+  // Value of a column in the current row, nullptr if out of range
+  const IMDBWireValue* getValue(uint8_t column) const;
+
+private:
+  char (*_names)[32];
+  uint8_t* _types;
+  uint8_t _columnCount;
+  uint8_t _boolCount;
+  uint16_t _schemaTag;
+  IMDBWireValue* _values;
+
+  const uint8_t* _cursor;
+  const uint8_t* _end;
+  uint16_t _rowCount;
+  uint16_t _rowsRead;
+  bool _final;
+  bool _error;
+
+  bool readSchema(const uint8_t** in, const uint8_t* end);
+  void releaseSchema();
+};
+
+#endif // IMDB_WIRE_H
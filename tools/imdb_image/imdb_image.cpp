@@ -0,0 +1,394 @@
+/*
+ * ESP32IMDB - Read-only table image builder
+ *
+ * Copyright (c) 2026 Xorlent
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ * https://github.com/Xorlent/ESP32IMDB
+ *
+ * Builds an image for IMDBImageTable from a CSV file. Runs on the PC:
+ *
+ *   c++ -std=c++17 -O2 -o imdb_image tools/imdb_image/imdb_image.cpp
+ *   ./imdb_image --index OUI vendors.csv vendors.img
+ *
+ * The first CSV line names the columns and their types:
+ *
+ *   OUI:MAC,Vendor:STRING,Updated:EPOCH
+ *   00:1A:2B:00:00:00,Example Corp,1700000000
+ *
+ * Types: INT32, FLOAT, STRING, MAC, EPOCH, BOOL (true/false/1/0). Fields may
+ * be quoted ("a, b" or "say ""hi"""). --index may be repeated; INT32, EPOCH,
+ * MAC and STRING columns can be indexed. Flash the image to a data partition,
+ * e.g. with: parttool.py write_partition --partition-name imdb --input vendors.img
+ */
+
+#include "../../src/IMDBImageFormat.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Same limits as the library defaults
+static const size_t kMaxStringLength = 255;
+static const size_t kMaxColumns = 255;
+
+struct Column {
+  std::string name;
+  uint8_t type;
+  uint32_t fieldOffset;
+  bool indexed;
+};
+
+static void fail(const char* message, size_t line = 0) {
+  if (line > 0) {
+    fprintf(stderr, "imdb_image: line %zu: %s\n", line, message);
+  } else {
+    fprintf(stderr, "imdb_image: %s\n", message);
+  }
+  exit(1);
+}
+
+// Split one CSV record; handles quoted fields with "" escapes
+static bool splitCsv(const std::string& line, std::vector<std::string>* fields) {
+  fields->clear();
+  std::string field;
+  bool quoted = false;
+  bool wasQuoted = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    char c = line[i];
+    if (quoted) {
+      if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+        field += '"';
+        i++;
+      } else if (c == '"') {
+        quoted = false;
+      } else {
+        field += c;
+      }
+    } else if (c == '"' && field.empty() && !wasQuoted) {
+      quoted = true;
+      wasQuoted = true;
+    } else if (c == ',') {
+      fields->push_back(field);
+      field.clear();
+      wasQuoted = false;
+    } else {
+      field += c;
+    }
+  }
+  fields->push_back(field);
+  return !quoted;
+}
+
+static bool parseType(const std::string& name, uint8_t* type) {
+  static const char* names[] = {"INT32", "MAC", "STRING", "EPOCH", "BOOL", "FLOAT"};
+  for (uint8_t i = 0; i < 6; i++) {
+    if (name == names[i]) {
+      *type = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool parseMac(const std::string& text, uint8_t* mac) {
+  unsigned int bytes[6];
+  char extra;
+  if (sscanf(text.c_str(), "%2x%*[:-]%2x%*[:-]%2x%*[:-]%2x%*[:-]%2x%*[:-]%2x%c",
+             &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5], &extra) != 6) {
+    return false;
+  }
+  for (int i = 0; i < 6; i++) {
+    mac[i] = (uint8_t)bytes[i];
+  }
+  return true;
+}
+
+static void put32(std::vector<uint8_t>* out, size_t offset, uint32_t value) {
+  memcpy(out->data() + offset, &value, 4);
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> indexNames;
+  const char* inputPath = nullptr;
+  const char* outputPath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+      indexNames.push_back(argv[++i]);
+    } else if (inputPath == nullptr) {
+      inputPath = argv[i];
+    } else if (outputPath == nullptr) {
+      outputPath = argv[i];
+    } else {
+      inputPath = nullptr;
+      break;
+    }
+  }
+  if (inputPath == nullptr || outputPath == nullptr) {
+    fprintf(stderr, "usage: imdb_image [--index COLUMN]... input.csv output.img\n");
+    return 2;
+  }
+
+  std::ifstream input(inputPath);
+  if (!input) {
+    fail("cannot open input file");
+  }
+
+  // Header line: Name:TYPE,...
+  std::string line;
+  std::vector<std::string> fields;
+  size_t lineNumber = 1;
+  if (!std::getline(input, line)) {
+    fail("input is empty");
+  }
+  if (!line.empty() && line.back() == '\r') {
+    line.pop_back();
+  }
+  splitCsv(line, &fields);
+  if (fields.size() > kMaxColumns) {
+    fail("too many columns", lineNumber);
+  }
+
+  std::vector<Column> columns;
+  for (const std::string& spec : fields) {
+    size_t colon = spec.rfind(':');
+    Column column;
+    if (colon == std::string::npos || colon == 0 || colon > 31 ||
+        !parseType(spec.substr(colon + 1), &column.type)) {
+      fail("column must be Name:TYPE with a name of at most 31 characters", lineNumber);
+    }
+    column.name = spec.substr(0, colon);
+    if (std::find_if(columns.begin(), columns.end(),
+                     [&](const Column& c) { return c.name == column.name; }) != columns.end()) {
+      fail("duplicate column name", lineNumber);
+    }
+    column.indexed = false;
+    columns.push_back(column);
+  }
+
+  for (const std::string& name : indexNames) {
+    auto it = std::find_if(columns.begin(), columns.end(),
+                           [&](const Column& c) { return c.name == name; });
+    if (it == columns.end()) {
+      fail("--index names an unknown column");
+    }
+    if (it->type == IMDB_IMAGE_TYPE_FLOAT || it->type == IMDB_IMAGE_TYPE_BOOL) {
+      fail("FLOAT and BOOL columns can't be indexed");
+    }
+    it->indexed = true;
+  }
+
+  // Row layout: 4-byte fields first so they stay aligned, then MACs, then BOOLs
+  uint32_t rowSize = 0;
+  for (int pass = 0; pass < 3; pass++) {
+    for (Column& column : columns) {
+      uint8_t group = (column.type == IMDB_IMAGE_TYPE_MAC) ? 1 : (column.type == IMDB_IMAGE_TYPE_BOOL) ? 2 : 0;
+      if (group == pass) {
+        column.fieldOffset = rowSize;
+        rowSize += (group == 0) ? 4 : (group == 1) ? 6 : 1;
+      }
+    }
+  }
+  rowSize = (rowSize + 3) & ~3u;
+
+  // Rows; strings are deduplicated into the pool (offset 0 is "")
+  std::vector<uint8_t> rows;
+  std::string strings(1, '\0');
+  std::unordered_map<std::string, uint32_t> stringOffsets;
+  stringOffsets[""] = 0;
+  uint32_t rowCount = 0;
+
+  while (std::getline(input, line)) {
+    lineNumber++;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty()) {
+      continue;
+    }
+    if (!splitCsv(line, &fields)) {
+      fail("unterminated quote", lineNumber);
+    }
+    if (fields.size() != columns.size()) {
+      fail("wrong number of fields", lineNumber);
+    }
+
+    size_t base = rows.size();
+    rows.resize(base + rowSize, 0);
+    uint8_t* row = rows.data() + base;
+
+    for (size_t i = 0; i < columns.size(); i++) {
+      const std::string& text = fields[i];
+      uint8_t* data = row + columns[i].fieldOffset;
+      char* end = nullptr;
+      switch (columns[i].type) {
+        case IMDB_IMAGE_TYPE_INT32: {
+          long value = strtol(text.c_str(), &end, 10);
+          if (text.empty() || *end != '\0' || value < INT32_MIN || value > INT32_MAX) {
+            fail("invalid INT32 value", lineNumber);
+          }
+          int32_t v = (int32_t)value;
+          memcpy(data, &v, 4);
+          break;
+        }
+        case IMDB_IMAGE_TYPE_EPOCH: {
+          unsigned long long value = strtoull(text.c_str(), &end, 10);
+          if (text.empty() || *end != '\0' || text[0] == '-' || value > UINT32_MAX) {
+            fail("invalid EPOCH value", lineNumber);
+          }
+          uint32_t v = (uint32_t)value;
+          memcpy(data, &v, 4);
+          break;
+        }
+        case IMDB_IMAGE_TYPE_FLOAT: {
+          float v = strtof(text.c_str(), &end);
+          if (text.empty() || *end != '\0') {
+            fail("invalid FLOAT value", lineNumber);
+          }
+          memcpy(data, &v, 4);
+          break;
+        }
+        case IMDB_IMAGE_TYPE_BOOL:
+          if (text == "1" || text == "true" || text == "TRUE") {
+            *data = 1;
+          } else if (!(text == "0" || text == "false" || text == "FALSE")) {
+            fail("invalid BOOL value", lineNumber);
+          }
+          break;
+        case IMDB_IMAGE_TYPE_MAC:
+          if (!parseMac(text, data)) {
+            fail("invalid MAC address", lineNumber);
+          }
+          break;
+        case IMDB_IMAGE_TYPE_STRING: {
+          if (text.size() > kMaxStringLength || text.find('\0') != std::string::npos) {
+            fail("string longer than 255 bytes", lineNumber);
+          }
+          auto it = stringOffsets.find(text);
+          uint32_t offset;
+          if (it != stringOffsets.end()) {
+            offset = it->second;
+          } else {
+            offset = (uint32_t)strings.size();
+            strings.append(text);
+            strings.push_back('\0');
+            stringOffsets[text] = offset;
+          }
+          memcpy(data, &offset, 4);
+          break;
+        }
+      }
+    }
+    rowCount++;
+  }
+
+  // Assemble the image
+  uint32_t columnsOffset = sizeof(IMDBImageHeader);
+  uint32_t rowsOffset = columnsOffset + (uint32_t)(columns.size() * sizeof(IMDBImageColumn));
+  uint64_t offset = (uint64_t)rowsOffset + rows.size();
+  std::vector<uint32_t> indexOffsets(columns.size(), 0);
+  for (size_t i = 0; i < columns.size(); i++) {
+    if (columns[i].indexed) {
+      indexOffsets[i] = (uint32_t)offset;
+      offset += (uint64_t)rowCount * 4;
+    }
+  }
+  uint64_t stringsOffset = offset;
+  uint64_t imageSize = (stringsOffset + strings.size() + 3) & ~3ull;
+  if (imageSize > UINT32_MAX) {
+    fail("image larger than 4GB");
+  }
+
+  std::vector<uint8_t> image((size_t)imageSize, 0);
+  memcpy(image.data() + rowsOffset, rows.data(), rows.size());
+  memcpy(image.data() + stringsOffset, strings.data(), strings.size());
+
+  for (size_t i = 0; i < columns.size(); i++) {
+    IMDBImageColumn column;
+    memset(&column, 0, sizeof(column));
+    strncpy(column.name, columns[i].name.c_str(), sizeof(column.name) - 1);
+    column.type = columns[i].type;
+    column.fieldOffset = columns[i].fieldOffset;
+    column.indexOffset = indexOffsets[i];
+    memcpy(image.data() + columnsOffset + i * sizeof(IMDBImageColumn), &column, sizeof(column));
+
+    if (!columns[i].indexed) {
+      continue;
+    }
+
+    // Sorted row numbers; stable so equal values stay in row order
+    const uint8_t* rowData = image.data() + rowsOffset;
+    uint32_t fieldOffset = columns[i].fieldOffset;
+    uint8_t type = columns[i].type;
+    std::vector<uint32_t> order(rowCount);
+    for (uint32_t r = 0; r < rowCount; r++) {
+      order[r] = r;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      const uint8_t* fa = rowData + (size_t)a * rowSize + fieldOffset;
+      const uint8_t* fb = rowData + (size_t)b * rowSize + fieldOffset;
+      switch (type) {
+        case IMDB_IMAGE_TYPE_INT32: {
+          int32_t va, vb;
+          memcpy(&va, fa, 4);
+          memcpy(&vb, fb, 4);
+          return va < vb;
+        }
+        case IMDB_IMAGE_TYPE_EPOCH: {
+          uint32_t va, vb;
+          memcpy(&va, fa, 4);
+          memcpy(&vb, fb, 4);
+          return va < vb;
+        }
+        case IMDB_IMAGE_TYPE_MAC:
+          return memcmp(fa, fb, 6) < 0;
+        default: {
+          uint32_t oa, ob;
+          memcpy(&oa, fa, 4);
+          memcpy(&ob, fb, 4);
+          return strcmp(strings.c_str() + oa, strings.c_str() + ob) < 0;
+        }
+      }
+    });
+    for (uint32_t r = 0; r < rowCount; r++) {
+      put32(&image, indexOffsets[i] + (size_t)r * 4, order[r]);
+    }
+  }
+
+  IMDBImageHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IMDB_IMAGE_MAGIC, 4);
+  header.version = IMDB_IMAGE_VERSION;
+  header.columnCount = (uint8_t)columns.size();
+  header.rowCount = rowCount;
+  header.rowSize = rowSize;
+  header.columnsOffset = columnsOffset;
+  header.rowsOffset = rowsOffset;
+  header.stringsOffset = (uint32_t)stringsOffset;
+  header.stringsSize = (uint32_t)strings.size();
+  header.imageSize = (uint32_t)imageSize;
+  header.dataCrc = imdbCrc32(0, image.data() + sizeof(header), image.size() - sizeof(header));
+  header.headerCrc = imdbCrc32(0, (const uint8_t*)&header, offsetof(IMDBImageHeader, headerCrc));
+  header.headerCrc = imdbCrc32(header.headerCrc, image.data() + columnsOffset,
+                                    columns.size() * sizeof(IMDBImageColumn));
+  memcpy(image.data(), &header, sizeof(header));
+
+  FILE* output = fopen(outputPath, "wb");
+  if (output == nullptr) {
+    fail("cannot create output file");
+  }
+  bool ok = fwrite(image.data(), 1, image.size(), output) == image.size();
+  ok = (fclose(output) == 0) && ok;
+  if (!ok) {
+    fail("write failed");
+  }
+
+  printf("%s: %u rows, %zu columns, %u bytes per row, %zu string bytes, %u bytes total\n",
+         outputPath, rowCount, columns.size(), rowSize, strings.size(), header.imageSize);
+  return 0;
+}